@@ -1,5 +1,5 @@
 /*
- * Arc4 random number generator for OpenBSD.
+ * ChaCha20 based random number generator for OpenBSD.
  * Copyright 1996 David Mazieres <dm@lcs.mit.edu>.
  *
  * Modification and redistribution in source and binary forms is
@@ -8,18 +8,15 @@
  */
 
 /*
- * This code is derived from section 17.1 of Applied Cryptography,
- * second edition, which describes a stream cipher allegedly
- * compatible with RSA Labs "RC4" cipher (the actual description of
- * which is a trade secret).  The same algorithm is used as a stream
- * cipher called "arcfour" in Tatu Ylonen's ssh package.
+ * The historic arc4 stream cipher was replaced with the ChaCha20
+ * keystream, following the OpenBSD implementation.  A whole buffer
+ * of keystream is generated at a time so that each draw is just a
+ * copy out of the buffer, which matters when thousands of interfaces
+ * pull transaction ids and timer fuzz at startup.
  *
- * Here the stream cipher has been modified always to include the time
- * when initializing the state.  That makes it impossible to
- * regenerate the same random sequence twice, so this can't be used
- * for encryption, but will generate good random numbers.
- *
- * RC4 is a registered trademark of RSA Laboratories.
+ * The generator rekeys itself from its own keystream after every
+ * buffer fill, so consumed output cannot be reconstructed, and it
+ * reseeds from the kernel on fork and after ARC4_RESEED_BYTES.
  */
 
 #include <sys/time.h>
@@ -27,75 +24,113 @@
 #include <fcntl.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "arc4random.h"
 
+#define ARC4_KEYSZ		32
+#define ARC4_IVSZ		8
+#define ARC4_BLOCKSZ		64
+#define ARC4_RSBUFSZ		(16 * ARC4_BLOCKSZ)
+#define ARC4_RESEED_BYTES	1600000
+
 struct arc4_stream {
-	uint8_t i;
-	uint8_t j;
-	uint8_t s[256];
-	size_t count;
+	uint32_t input[16];		/* ChaCha20 state */
+	uint8_t buf[ARC4_RSBUFSZ];	/* keystream blocks */
+	size_t have;			/* valid bytes at end of buf */
+	size_t count;			/* bytes until reseed */
 	pid_t stir_pid;
 	int fd;
 };
 
-#define S(n) (n)
-#define S4(n) S(n), S(n + 1), S(n + 2), S(n + 3)
-#define S16(n) S4(n), S4(n + 4), S4(n + 8), S4(n + 12)
-#define S64(n) S16(n), S16(n + 16), S16(n + 32), S16(n + 48)
-#define S256 S64(0), S64(64), S64(128), S64(192)
+static struct arc4_stream rs = { .stir_pid = 0, .fd = -1 };
 
-static struct arc4_stream rs = { .i = 0xff, .j = 0, .s = { S256 },
-                    .count = 0, .stir_pid = 0, .fd = -1 };
+static inline uint32_t
+arc4_rotl32(uint32_t x, int n)
+{
 
-#undef S
-#undef S4
-#undef S16
-#undef S64
-#undef S256
+	return x << n | x >> (32 - n);
+}
+
+#define ARC4_QR(a, b, c, d)						\
+	do {								\
+		a += b; d ^= a; d = arc4_rotl32(d, 16);			\
+		c += d; b ^= c; b = arc4_rotl32(b, 12);			\
+		a += b; d ^= a; d = arc4_rotl32(d, 8);			\
+		c += d; b ^= c; b = arc4_rotl32(b, 7);			\
+	} while (0 /* CONSTCOND */)
+
+static uint32_t
+arc4_le32dec(const uint8_t *p)
+{
+
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+	    (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
 
 static void
-arc4_addrandom(struct arc4_stream *as, unsigned char *dat, int datlen)
+arc4_keysetup(struct arc4_stream *as, const uint8_t *key)
 {
-	int n;
-	uint8_t si;
-
-	as->i--;
-	for (n = 0; n < 256; n++) {
-		as->i = (uint8_t)(as->i + 1);
-		si = as->s[as->i];
-		as->j = (uint8_t)(as->j + si + dat[n % datlen]);
-		as->s[as->i] = as->s[as->j];
-		as->s[as->j] = si;
-	}
-	as->j = as->i;
+	static const char sigma[16] = "expand 32-byte k";
+	int i;
+
+	for (i = 0; i < 4; i++)
+		as->input[i] = arc4_le32dec((const uint8_t *)sigma + i * 4);
+	for (i = 0; i < 8; i++)
+		as->input[4 + i] = arc4_le32dec(key + i * 4);
+	as->input[12] = 0;	/* 64 bit block counter */
+	as->input[13] = 0;
+	as->input[14] = arc4_le32dec(key + ARC4_KEYSZ);
+	as->input[15] = arc4_le32dec(key + ARC4_KEYSZ + 4);
 }
 
-static uint8_t
-arc4_getbyte(struct arc4_stream *as)
+static void
+arc4_block(struct arc4_stream *as, uint8_t *out)
 {
-	uint8_t si, sj;
-
-	as->i = (uint8_t)(as->i + 1);
-	si = as->s[as->i];
-	as->j = (uint8_t)(as->j + si);
-	sj = as->s[as->j];
-	as->s[as->i] = sj;
-	as->s[as->j] = si;
-	return (as->s[(si + sj) & 0xff]);
+	uint32_t x[16];
+	int i;
+
+	memcpy(x, as->input, sizeof(x));
+	for (i = 0; i < 10; i++) {
+		ARC4_QR(x[0], x[4], x[ 8], x[12]);
+		ARC4_QR(x[1], x[5], x[ 9], x[13]);
+		ARC4_QR(x[2], x[6], x[10], x[14]);
+		ARC4_QR(x[3], x[7], x[11], x[15]);
+		ARC4_QR(x[0], x[5], x[10], x[15]);
+		ARC4_QR(x[1], x[6], x[11], x[12]);
+		ARC4_QR(x[2], x[7], x[ 8], x[13]);
+		ARC4_QR(x[3], x[4], x[ 9], x[14]);
+	}
+	for (i = 0; i < 16; i++) {
+		uint32_t w = x[i] + as->input[i];
+
+		out[i * 4 + 0] = (uint8_t)w;
+		out[i * 4 + 1] = (uint8_t)(w >> 8);
+		out[i * 4 + 2] = (uint8_t)(w >> 16);
+		out[i * 4 + 3] = (uint8_t)(w >> 24);
+	}
+	if (++as->input[12] == 0)
+		as->input[13]++;
 }
 
-static uint32_t
-arc4_getword(struct arc4_stream *as)
+/* Refill the keystream buffer, mixing in any new seed material,
+ * then throw away the leading keystream as the next key so that
+ * already consumed output cannot be recovered from our state. */
+static void
+arc4_rekey(struct arc4_stream *as, const uint8_t *dat, size_t datlen)
 {
-	int val;
+	size_t n;
 
-	val = (int)((unsigned int)arc4_getbyte(as) << 24);
-	val |= arc4_getbyte(as) << 16;
-	val |= arc4_getbyte(as) << 8;
-	val |= arc4_getbyte(as);
-	return (uint32_t)val;
+	for (n = 0; n < sizeof(as->buf); n += ARC4_BLOCKSZ)
+		arc4_block(as, as->buf + n);
+	if (dat != NULL) {
+		for (n = 0; n < datlen && n < ARC4_KEYSZ + ARC4_IVSZ; n++)
+			as->buf[n] ^= dat[n];
+	}
+	arc4_keysetup(as, as->buf);
+	memset(as->buf, 0, ARC4_KEYSZ + ARC4_IVSZ);
+	as->have = sizeof(as->buf) - ARC4_KEYSZ - ARC4_IVSZ;
 }
 
 /* We don't care about any error on read, just use what we have
@@ -106,10 +141,8 @@ arc4_stir(struct arc4_stream *as)
 {
 	struct {
 		struct timeval tv;
-		unsigned int rnd[(128 - sizeof(struct timeval)) /
-			sizeof(unsigned int)];
-	}       rdat;
-	size_t n;
+		uint8_t rnd[ARC4_KEYSZ + ARC4_IVSZ];
+	}	rdat;
 
 	gettimeofday(&rdat.tv, NULL);
 	if (as->fd == -1) {
@@ -139,35 +172,51 @@ arc4_stir(struct arc4_stream *as)
 	/* fd < 0?  Ah, what the heck. We'll just take
 	 * whatever was on the stack... */
 	/* coverity[uninit_use_in_call] */
-	arc4_addrandom(as, (void *) &rdat, sizeof(rdat));
-
-	/*
-	 * Throw away the first N words of output, as suggested in the
-	 * paper "Weaknesses in the Key Scheduling Algorithm of RC4"
-	 * by Fluher, Mantin, and Shamir.  (N = 256 in our case.)
-	 */
-	for (n = 0; n < 256 * sizeof(uint32_t); n++)
-		arc4_getbyte(as);
-	as->count = 1600000;
+	arc4_rekey(as, (void *)&rdat, sizeof(rdat));
+	memset(&rdat, 0, sizeof(rdat));
+
+	/* Invalidate the buffered keystream from the old key. */
+	as->have = 0;
+	as->count = ARC4_RESEED_BYTES;
 }
 
 static void
-arc4_stir_if_needed(struct arc4_stream *as)
+arc4_stir_if_needed(struct arc4_stream *as, size_t len)
 {
 	pid_t pid;
 
 	pid = getpid();
-	if (as->count <= sizeof(uint32_t) || as->stir_pid != pid) {
+	if (as->count <= len || as->stir_pid != pid) {
 		as->stir_pid = pid;
 		arc4_stir(as);
 	} else
-		as->count -= sizeof(uint32_t);
+		as->count -= len;
+}
+
+void
+arc4random_buf(void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	size_t m;
+
+	arc4_stir_if_needed(&rs, len);
+	while (len != 0) {
+		if (rs.have == 0)
+			arc4_rekey(&rs, NULL, 0);
+		m = len < rs.have ? len : rs.have;
+		memcpy(p, rs.buf + sizeof(rs.buf) - rs.have, m);
+		memset(rs.buf + sizeof(rs.buf) - rs.have, 0, m);
+		rs.have -= m;
+		p += m;
+		len -= m;
+	}
 }
 
 uint32_t
-arc4random()
+arc4random(void)
 {
+	uint32_t val;
 
-	arc4_stir_if_needed(&rs);
-	return arc4_getword(&rs);
+	arc4random_buf(&val, sizeof(val));
+	return val;
 }
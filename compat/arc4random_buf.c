@@ -0,0 +1,34 @@
+/*
+ * Arc4 random number generator for OpenBSD.
+ * Copyright 1996 David Mazieres <dm@lcs.mit.edu>.
+ *
+ * Modification and redistribution in source and binary forms is
+ * permitted provided that due credit is given to the author and the
+ * OpenBSD project by leaving this copyright notice intact.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* We need to include config.h so we pickup either the system arc4random
+ * or our compat one. */
+#include "config.h"
+
+/* For platforms with a native arc4random(3) but no arc4random_buf(3).
+ * Our compat arc4random provides its own bulk fill. */
+void
+arc4random_buf(void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	uint32_t r;
+	size_t m;
+
+	while (len != 0) {
+		r = arc4random();
+		m = len < sizeof(r) ? len : sizeof(r);
+		memcpy(p, &r, m);
+		p += m;
+		len -= m;
+	}
+}
@@ -139,49 +139,88 @@ hmac_find(const char *name)
 	return NULL;
 }
 
-ssize_t
-hmac(const char *name,
-    const void *key, size_t klen,
-    const void *text, size_t tlen,
-    void *digest, size_t dlen)
-{
-	uint8_t ipad[HMAC_SIZE], opad[HMAC_SIZE], d[HMAC_SIZE];
-	const uint8_t *k = key;
+/* Digest states primed with the inner and outer key pads so keyed
+ * users pay the key hashing once rather than per message. */
+struct hmacctx {
 	const struct hmac *h;
-	uint64_t c[32];
-	void *p;
+	uint64_t ictx[32];
+	uint64_t octx[32];
+};
 
-	if ((h = hmac_find(name)) == NULL)
-		return -1;
+static void
+hmac_prime(struct hmacctx *hc, const struct hmac *h,
+    const void *key, size_t klen)
+{
+	uint8_t pad[HMAC_SIZE], d[HMAC_SIZE];
+	const uint8_t *k = key;
 
+	hc->h = h;
 
 	if (klen > h->blocksize) {
-		(*h->init)(c);
-		(*h->update)(c, k, (unsigned int)klen);
-		(*h->final)(d, c);
-		k = (void *)d;
+		(*h->init)(hc->ictx);
+		(*h->update)(hc->ictx, k, (unsigned int)klen);
+		(*h->final)(d, hc->ictx);
+		k = d;
 		klen = h->digsize;
 	}
 
-	/* Form input and output pads for the digests */
-	for (size_t i = 0; i < sizeof(ipad); i++) {
-		ipad[i] = (i < klen ? k[i] : 0) ^ HMAC_IPAD;
-		opad[i] = (i < klen ? k[i] : 0) ^ HMAC_OPAD;
-	}
+	/* Form input and output pads and absorb them */
+	for (size_t i = 0; i < sizeof(pad); i++)
+		pad[i] = (i < klen ? k[i] : 0) ^ HMAC_IPAD;
+	(*h->init)(hc->ictx);
+	(*h->update)(hc->ictx, pad, (unsigned int)h->blocksize);
+
+	for (size_t i = 0; i < sizeof(pad); i++)
+		pad[i] = (i < klen ? k[i] : 0) ^ HMAC_OPAD;
+	(*h->init)(hc->octx);
+	(*h->update)(hc->octx, pad, (unsigned int)h->blocksize);
+
+	memset(pad, 0, sizeof(pad));
+	memset(d, 0, sizeof(d));
+}
+
+struct hmacctx *
+hmac_new(const char *name, const void *key, size_t klen)
+{
+	const struct hmac *h;
+	struct hmacctx *hc;
+
+	if ((h = hmac_find(name)) == NULL)
+		return NULL;
+	if ((hc = malloc(sizeof(*hc))) == NULL)
+		return NULL;
+	hmac_prime(hc, h, key, klen);
+	return hc;
+}
+
+void
+hmac_free(struct hmacctx *hc)
+{
+
+	if (hc == NULL)
+		return;
+	memset(hc, 0, sizeof(*hc));
+	free(hc);
+}
+
+ssize_t
+hmac_digest(const struct hmacctx *hc,
+    const void *text, size_t tlen,
+    void *digest, size_t dlen)
+{
+	uint8_t d[HMAC_SIZE];
+	const struct hmac *h = hc->h;
+	uint64_t c[32];
+	void *p;
 
 	p = dlen >= h->digsize ? digest : d;
-	if (p != digest) {
-		memcpy(p, digest, dlen);
-		memset((char *)p + dlen, 0, h->digsize - dlen);
-	}
-	(*h->init)(c);
-	(*h->update)(c, ipad, (unsigned int)h->blocksize);
+
+	memcpy(c, hc->ictx, sizeof(c));
 	(*h->update)(c, text, (unsigned int)tlen);
 	(*h->final)(p, c);
 
-	(*h->init)(c);
-	(*h->update)(c, opad, (unsigned int)h->blocksize);
-	(*h->update)(c, digest, (unsigned int)h->digsize);
+	memcpy(c, hc->octx, sizeof(c));
+	(*h->update)(c, p, (unsigned int)h->digsize);
 	(*h->final)(p, c);
 
 	if (p != digest)
@@ -189,3 +228,22 @@ hmac(const char *name,
 
 	return (ssize_t)h->digsize;
 }
+
+ssize_t
+hmac(const char *name,
+    const void *key, size_t klen,
+    const void *text, size_t tlen,
+    void *digest, size_t dlen)
+{
+	const struct hmac *h;
+	struct hmacctx hc;
+	ssize_t r;
+
+	if ((h = hmac_find(name)) == NULL)
+		return -1;
+
+	hmac_prime(&hc, h, key, klen);
+	r = hmac_digest(&hc, text, tlen, digest, dlen);
+	memset(&hc, 0, sizeof(hc));
+	return r;
+}
@@ -37,4 +37,13 @@
 ssize_t	 hmac(const char *, const void *, size_t, const void *, size_t, void *,
    size_t);
 
+/* Reusable key schedule, not offered by libc implementations. */
+#define HAVE_HMAC_CTX
+struct hmacctx;
+
+struct hmacctx	*hmac_new(const char *, const void *, size_t);
+void		 hmac_free(struct hmacctx *);
+ssize_t		 hmac_digest(const struct hmacctx *, const void *, size_t,
+   void *, size_t);
+
 #endif
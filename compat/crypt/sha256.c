@@ -40,6 +40,34 @@
 #include "config.h"
 #include "sha256.h"
 
+/*
+ * Hardware accelerated transforms, selected at run time in
+ * SHA256_Init().  The scalar transform below is always compiled
+ * as the portable fallback.
+ */
+#if defined(__x86_64__) && \
+    ((defined(__clang_major__) && __clang_major__ >= 4) || \
+     (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 5))
+#define	SHA256_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__linux__) && \
+    ((defined(__clang_major__) && __clang_major__ >= 7) || \
+     (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 8))
+#define	SHA256_ARMCE
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#endif
+
+#if defined(SHA256_SHANI) || defined(SHA256_ARMCE)
+#define	SHA256_DISPATCH
+static void (*SHA256_TransformFn)(uint32_t *, const unsigned char[64]);
+#define	SHA256_TRANSFORM(state, block) SHA256_TransformFn(state, block)
+#else
+#define	SHA256_TRANSFORM(state, block) SHA256_Transform(state, block)
+#endif
+
 #if BYTE_ORDER == BIG_ENDIAN
 
 /* Copy a vector of big-endian uint32_t into a vector of bytes */
@@ -196,6 +224,394 @@ SHA256_Transform(uint32_t * state, const unsigned char block[64])
 		state[i] += S[i];
 }
 
+#ifdef SHA256_SHANI
+static int
+SHA256_HaveShani(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0)
+		return 0;
+	return (ebx & (1U << 29)) != 0;	/* CPUID.7.0:EBX.SHA */
+}
+
+__attribute__((target("sha,sse4.1")))
+static void
+SHA256_TransformShani(uint32_t *state, const unsigned char block[64])
+{
+	__m128i state0, state1, abef_save, cdgh_save;
+	__m128i msg, tmp, msg0, msg1, msg2, msg3;
+	const __m128i mask = _mm_set_epi64x(
+	    (long long)0x0c0d0e0f08090a0bULL, (long long)0x0405060700010203ULL);
+
+	/* Swizzle the state into the ABEF/CDGH order
+	 * the sha256rnds2 instruction works on. */
+	tmp = _mm_loadu_si128((const __m128i *)(const void *)&state[0]);
+	state1 = _mm_loadu_si128((const __m128i *)(const void *)&state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xB1);		/* CDAB */
+	state1 = _mm_shuffle_epi32(state1, 0x1B);	/* EFGH */
+	state0 = _mm_alignr_epi8(tmp, state1, 8);	/* ABEF */
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);	/* CDGH */
+
+	abef_save = state0;
+	cdgh_save = state1;
+
+	/* Rounds 0-3 */
+	msg = _mm_loadu_si128((const __m128i *)(const void *)(block + 0));
+	msg0 = _mm_shuffle_epi8(msg, mask);
+	msg = _mm_add_epi32(msg0, _mm_set_epi64x(
+	    (long long)0xE9B5DBA5B5C0FBCFULL, (long long)0x71374491428A2F98ULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+	/* Rounds 4-7 */
+	msg1 = _mm_loadu_si128((const __m128i *)(const void *)(block + 16));
+	msg1 = _mm_shuffle_epi8(msg1, mask);
+	msg = _mm_add_epi32(msg1, _mm_set_epi64x(
+	    (long long)0xAB1C5ED5923F82A4ULL, (long long)0x59F111F13956C25BULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+
+	/* Rounds 8-11 */
+	msg2 = _mm_loadu_si128((const __m128i *)(const void *)(block + 32));
+	msg2 = _mm_shuffle_epi8(msg2, mask);
+	msg = _mm_add_epi32(msg2, _mm_set_epi64x(
+	    (long long)0x550C7DC3243185BEULL, (long long)0x12835B01D807AA98ULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+
+	/* Rounds 12-15 */
+	msg3 = _mm_loadu_si128((const __m128i *)(const void *)(block + 48));
+	msg3 = _mm_shuffle_epi8(msg3, mask);
+	msg = _mm_add_epi32(msg3, _mm_set_epi64x(
+	    (long long)0xC19BF1749BDC06A7ULL, (long long)0x80DEB1FE72BE5D74ULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	tmp = _mm_alignr_epi8(msg3, msg2, 4);
+	msg0 = _mm_add_epi32(msg0, tmp);
+	msg0 = _mm_sha256msg2_epu32(msg0, msg3);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+
+	/* Rounds 16-19 */
+	msg = _mm_add_epi32(msg0, _mm_set_epi64x(
+	    (long long)0x240CA1CC0FC19DC6ULL, (long long)0xEFBE4786E49B69C1ULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	tmp = _mm_alignr_epi8(msg0, msg3, 4);
+	msg1 = _mm_add_epi32(msg1, tmp);
+	msg1 = _mm_sha256msg2_epu32(msg1, msg0);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+
+	/* Rounds 20-23 */
+	msg = _mm_add_epi32(msg1, _mm_set_epi64x(
+	    (long long)0x76F988DA5CB0A9DCULL, (long long)0x4A7484AA2DE92C6FULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	tmp = _mm_alignr_epi8(msg1, msg0, 4);
+	msg2 = _mm_add_epi32(msg2, tmp);
+	msg2 = _mm_sha256msg2_epu32(msg2, msg1);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+
+	/* Rounds 24-27 */
+	msg = _mm_add_epi32(msg2, _mm_set_epi64x(
+	    (long long)0xBF597FC7B00327C8ULL, (long long)0xA831C66D983E5152ULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	tmp = _mm_alignr_epi8(msg2, msg1, 4);
+	msg3 = _mm_add_epi32(msg3, tmp);
+	msg3 = _mm_sha256msg2_epu32(msg3, msg2);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+
+	/* Rounds 28-31 */
+	msg = _mm_add_epi32(msg3, _mm_set_epi64x(
+	    (long long)0x1429296706CA6351ULL, (long long)0xD5A79147C6E00BF3ULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	tmp = _mm_alignr_epi8(msg3, msg2, 4);
+	msg0 = _mm_add_epi32(msg0, tmp);
+	msg0 = _mm_sha256msg2_epu32(msg0, msg3);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+
+	/* Rounds 32-35 */
+	msg = _mm_add_epi32(msg0, _mm_set_epi64x(
+	    (long long)0x53380D134D2C6DFCULL, (long long)0x2E1B213827B70A85ULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	tmp = _mm_alignr_epi8(msg0, msg3, 4);
+	msg1 = _mm_add_epi32(msg1, tmp);
+	msg1 = _mm_sha256msg2_epu32(msg1, msg0);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+
+	/* Rounds 36-39 */
+	msg = _mm_add_epi32(msg1, _mm_set_epi64x(
+	    (long long)0x92722C8581C2C92EULL, (long long)0x766A0ABB650A7354ULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	tmp = _mm_alignr_epi8(msg1, msg0, 4);
+	msg2 = _mm_add_epi32(msg2, tmp);
+	msg2 = _mm_sha256msg2_epu32(msg2, msg1);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+
+	/* Rounds 40-43 */
+	msg = _mm_add_epi32(msg2, _mm_set_epi64x(
+	    (long long)0xC76C51A3C24B8B70ULL, (long long)0xA81A664BA2BFE8A1ULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	tmp = _mm_alignr_epi8(msg2, msg1, 4);
+	msg3 = _mm_add_epi32(msg3, tmp);
+	msg3 = _mm_sha256msg2_epu32(msg3, msg2);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+
+	/* Rounds 44-47 */
+	msg = _mm_add_epi32(msg3, _mm_set_epi64x(
+	    (long long)0x106AA070F40E3585ULL, (long long)0xD6990624D192E819ULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	tmp = _mm_alignr_epi8(msg3, msg2, 4);
+	msg0 = _mm_add_epi32(msg0, tmp);
+	msg0 = _mm_sha256msg2_epu32(msg0, msg3);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	msg2 = _mm_sha256msg1_epu32(msg2, msg3);
+
+	/* Rounds 48-51 */
+	msg = _mm_add_epi32(msg0, _mm_set_epi64x(
+	    (long long)0x34B0BCB52748774CULL, (long long)0x1E376C0819A4C116ULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	tmp = _mm_alignr_epi8(msg0, msg3, 4);
+	msg1 = _mm_add_epi32(msg1, tmp);
+	msg1 = _mm_sha256msg2_epu32(msg1, msg0);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+
+	/* Rounds 52-55 */
+	msg = _mm_add_epi32(msg1, _mm_set_epi64x(
+	    (long long)0x682E6FF35B9CCA4FULL, (long long)0x4ED8AA4A391C0CB3ULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	tmp = _mm_alignr_epi8(msg1, msg0, 4);
+	msg2 = _mm_add_epi32(msg2, tmp);
+	msg2 = _mm_sha256msg2_epu32(msg2, msg1);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+	/* Rounds 56-59 */
+	msg = _mm_add_epi32(msg2, _mm_set_epi64x(
+	    (long long)0x8CC7020884C87814ULL, (long long)0x78A5636F748F82EEULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	tmp = _mm_alignr_epi8(msg2, msg1, 4);
+	msg3 = _mm_add_epi32(msg3, tmp);
+	msg3 = _mm_sha256msg2_epu32(msg3, msg2);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+	/* Rounds 60-63 */
+	msg = _mm_add_epi32(msg3, _mm_set_epi64x(
+	    (long long)0xC67178F2BEF9A3F7ULL, (long long)0xA4506CEB90BEFFFAULL));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+	msg = _mm_shuffle_epi32(msg, 0x0E);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+	/* Mix in and swizzle back */
+	state0 = _mm_add_epi32(state0, abef_save);
+	state1 = _mm_add_epi32(state1, cdgh_save);
+	tmp = _mm_shuffle_epi32(state0, 0x1B);		/* FEBA */
+	state1 = _mm_shuffle_epi32(state1, 0xB1);	/* DCHG */
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);	/* DCBA */
+	state1 = _mm_alignr_epi8(state1, tmp, 8);	/* HGFE */
+	_mm_storeu_si128((__m128i *)(void *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)(void *)&state[4], state1);
+}
+#endif /* SHA256_SHANI */
+
+#ifdef SHA256_ARMCE
+static const uint32_t SHA256_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static int
+SHA256_HaveArmce(void)
+{
+
+#ifdef HWCAP_SHA2
+	return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#else
+	return 0;
+#endif
+}
+
+__attribute__((target("+crypto")))
+static void
+SHA256_TransformArmce(uint32_t *state, const unsigned char block[64])
+{
+	uint32x4_t state0, state1, abcd_save, efgh_save;
+	uint32x4_t msg0, msg1, msg2, msg3;
+	uint32x4_t tmp0, tmp1, tmp2;
+
+	state0 = vld1q_u32(&state[0]);
+	state1 = vld1q_u32(&state[4]);
+
+	abcd_save = state0;
+	efgh_save = state1;
+
+	msg0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 0)));
+	msg1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 16)));
+	msg2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 32)));
+	msg3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 48)));
+
+	tmp0 = vaddq_u32(msg0, vld1q_u32(&SHA256_K[0]));
+
+	/* Rounds 0-3 */
+	tmp1 = vaddq_u32(msg1, vld1q_u32(&SHA256_K[4]));
+	tmp2 = state0;
+	msg0 = vsha256su0q_u32(msg0, msg1);
+	state0 = vsha256hq_u32(state0, state1, tmp0);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp0);
+	msg0 = vsha256su1q_u32(msg0, msg2, msg3);
+
+	/* Rounds 4-7 */
+	tmp0 = vaddq_u32(msg2, vld1q_u32(&SHA256_K[8]));
+	tmp2 = state0;
+	msg1 = vsha256su0q_u32(msg1, msg2);
+	state0 = vsha256hq_u32(state0, state1, tmp1);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp1);
+	msg1 = vsha256su1q_u32(msg1, msg3, msg0);
+
+	/* Rounds 8-11 */
+	tmp1 = vaddq_u32(msg3, vld1q_u32(&SHA256_K[12]));
+	tmp2 = state0;
+	msg2 = vsha256su0q_u32(msg2, msg3);
+	state0 = vsha256hq_u32(state0, state1, tmp0);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp0);
+	msg2 = vsha256su1q_u32(msg2, msg0, msg1);
+
+	/* Rounds 12-15 */
+	tmp0 = vaddq_u32(msg0, vld1q_u32(&SHA256_K[16]));
+	tmp2 = state0;
+	msg3 = vsha256su0q_u32(msg3, msg0);
+	state0 = vsha256hq_u32(state0, state1, tmp1);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp1);
+	msg3 = vsha256su1q_u32(msg3, msg1, msg2);
+
+	/* Rounds 16-19 */
+	tmp1 = vaddq_u32(msg1, vld1q_u32(&SHA256_K[20]));
+	tmp2 = state0;
+	msg0 = vsha256su0q_u32(msg0, msg1);
+	state0 = vsha256hq_u32(state0, state1, tmp0);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp0);
+	msg0 = vsha256su1q_u32(msg0, msg2, msg3);
+
+	/* Rounds 20-23 */
+	tmp0 = vaddq_u32(msg2, vld1q_u32(&SHA256_K[24]));
+	tmp2 = state0;
+	msg1 = vsha256su0q_u32(msg1, msg2);
+	state0 = vsha256hq_u32(state0, state1, tmp1);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp1);
+	msg1 = vsha256su1q_u32(msg1, msg3, msg0);
+
+	/* Rounds 24-27 */
+	tmp1 = vaddq_u32(msg3, vld1q_u32(&SHA256_K[28]));
+	tmp2 = state0;
+	msg2 = vsha256su0q_u32(msg2, msg3);
+	state0 = vsha256hq_u32(state0, state1, tmp0);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp0);
+	msg2 = vsha256su1q_u32(msg2, msg0, msg1);
+
+	/* Rounds 28-31 */
+	tmp0 = vaddq_u32(msg0, vld1q_u32(&SHA256_K[32]));
+	tmp2 = state0;
+	msg3 = vsha256su0q_u32(msg3, msg0);
+	state0 = vsha256hq_u32(state0, state1, tmp1);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp1);
+	msg3 = vsha256su1q_u32(msg3, msg1, msg2);
+
+	/* Rounds 32-35 */
+	tmp1 = vaddq_u32(msg1, vld1q_u32(&SHA256_K[36]));
+	tmp2 = state0;
+	msg0 = vsha256su0q_u32(msg0, msg1);
+	state0 = vsha256hq_u32(state0, state1, tmp0);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp0);
+	msg0 = vsha256su1q_u32(msg0, msg2, msg3);
+
+	/* Rounds 36-39 */
+	tmp0 = vaddq_u32(msg2, vld1q_u32(&SHA256_K[40]));
+	tmp2 = state0;
+	msg1 = vsha256su0q_u32(msg1, msg2);
+	state0 = vsha256hq_u32(state0, state1, tmp1);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp1);
+	msg1 = vsha256su1q_u32(msg1, msg3, msg0);
+
+	/* Rounds 40-43 */
+	tmp1 = vaddq_u32(msg3, vld1q_u32(&SHA256_K[44]));
+	tmp2 = state0;
+	msg2 = vsha256su0q_u32(msg2, msg3);
+	state0 = vsha256hq_u32(state0, state1, tmp0);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp0);
+	msg2 = vsha256su1q_u32(msg2, msg0, msg1);
+
+	/* Rounds 44-47 */
+	tmp0 = vaddq_u32(msg0, vld1q_u32(&SHA256_K[48]));
+	tmp2 = state0;
+	msg3 = vsha256su0q_u32(msg3, msg0);
+	state0 = vsha256hq_u32(state0, state1, tmp1);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp1);
+	msg3 = vsha256su1q_u32(msg3, msg1, msg2);
+
+	/* Rounds 48-51 */
+	tmp1 = vaddq_u32(msg1, vld1q_u32(&SHA256_K[52]));
+	tmp2 = state0;
+	state0 = vsha256hq_u32(state0, state1, tmp0);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp0);
+
+	/* Rounds 52-55 */
+	tmp0 = vaddq_u32(msg2, vld1q_u32(&SHA256_K[56]));
+	tmp2 = state0;
+	state0 = vsha256hq_u32(state0, state1, tmp1);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp1);
+
+	/* Rounds 56-59 */
+	tmp1 = vaddq_u32(msg3, vld1q_u32(&SHA256_K[60]));
+	tmp2 = state0;
+	state0 = vsha256hq_u32(state0, state1, tmp0);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp0);
+
+	/* Rounds 60-63 */
+	tmp2 = state0;
+	state0 = vsha256hq_u32(state0, state1, tmp1);
+	state1 = vsha256h2q_u32(state1, tmp2, tmp1);
+
+	vst1q_u32(&state[0], vaddq_u32(state0, abcd_save));
+	vst1q_u32(&state[4], vaddq_u32(state1, efgh_save));
+}
+#endif /* SHA256_ARMCE */
+
 static unsigned char PAD[64] = {
 	0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -230,6 +646,23 @@ void
 SHA256_Init(SHA256_CTX * ctx)
 {
 
+#ifdef SHA256_DISPATCH
+	/* Pick the best transform the CPU offers */
+	if (SHA256_TransformFn == NULL) {
+#ifdef SHA256_SHANI
+		if (SHA256_HaveShani())
+			SHA256_TransformFn = SHA256_TransformShani;
+		else
+#endif
+#ifdef SHA256_ARMCE
+		if (SHA256_HaveArmce())
+			SHA256_TransformFn = SHA256_TransformArmce;
+		else
+#endif
+			SHA256_TransformFn = SHA256_Transform;
+	}
+#endif
+
 	/* Zero bits processed so far */
 	ctx->count = 0;
 
@@ -269,13 +702,13 @@ SHA256_Update(SHA256_CTX * ctx, const void *in, size_t len)
 
 	/* Finish the current block */
 	memcpy(&ctx->buf[r], src, 64 - r);
-	SHA256_Transform(ctx->state, ctx->buf);
+	SHA256_TRANSFORM(ctx->state, ctx->buf);
 	src += 64 - r;
 	len -= 64 - r;
 
 	/* Perform complete blocks */
 	while (len >= 64) {
-		SHA256_Transform(ctx->state, src);
+		SHA256_TRANSFORM(ctx->state, src);
 		src += 64;
 		len -= 64;
 	}
@@ -77,9 +77,11 @@ __weak_alias(rb_tree_depths, _rb_tree_depths)
 #include <sys/rbtree.h>
 #endif
 
+#ifndef RB_TREE_ARRAY
 static void rb_tree_insert_rebalance(struct rb_tree *, struct rb_node *);
 static void rb_tree_removal_rebalance(struct rb_tree *, struct rb_node *,
 	unsigned int);
+#endif
 #ifdef RBDEBUG
 static const struct rb_node *rb_tree_iterate_const(const struct rb_tree *,
 	const struct rb_node *, const unsigned int);
@@ -96,6 +98,247 @@ static bool rb_tree_check_node(const struct rb_tree *, const struct rb_node *,
 
 #define	RB_SENTINEL_NODE	NULL
 
+#ifdef RB_TREE_ARRAY
+/*
+ * Sorted pointer array backend.  See rbtree.h for the trade offs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define	RB_ARRAY_MINALLOC	16
+
+void
+rb_tree_init(struct rb_tree *rbt, const rb_tree_ops_t *ops)
+{
+
+	rbt->rbt_ops = ops;
+	rbt->rbt_elems = NULL;
+	rbt->rbt_count = 0;
+	rbt->rbt_alloc = 0;
+	rbt->rbt_hint = 0;
+}
+
+void
+rb_tree_fini(struct rb_tree *rbt)
+{
+
+	free(rbt->rbt_elems);
+	rbt->rbt_elems = NULL;
+	rbt->rbt_count = 0;
+	rbt->rbt_alloc = 0;
+	rbt->rbt_hint = 0;
+}
+
+/*
+ * Lowest index whose element compares >= the key, which is rbt_count
+ * if there is none.  *eq is set if the element at that index compares
+ * equal.
+ */
+static size_t
+rb_array_geq(struct rb_tree *rbt, const void *key, bool bykey, bool *eq)
+{
+	const rb_tree_ops_t *rbto = rbt->rbt_ops;
+	size_t lo = 0, hi = rbt->rbt_count;
+
+	*eq = false;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		const signed int diff = bykey ?
+		    (*rbto->rbto_compare_key)(rbto->rbto_context,
+		    rbt->rbt_elems[mid], key) :
+		    (*rbto->rbto_compare_nodes)(rbto->rbto_context,
+		    rbt->rbt_elems[mid], key);
+
+		if (diff < 0)
+			lo = mid + 1;
+		else {
+			if (diff == 0)
+				*eq = true;
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* Index of an element known to be in the array, hinted by the last
+ * touched index so that sequential walks cost O(1) per step. */
+static size_t
+rb_array_index(struct rb_tree *rbt, const void *object, bool *eq)
+{
+	size_t i = rbt->rbt_hint;
+
+	if (i < rbt->rbt_count && rbt->rbt_elems[i] == object) {
+		*eq = true;
+		return i;
+	}
+	if (i + 1 < rbt->rbt_count && rbt->rbt_elems[i + 1] == object) {
+		*eq = true;
+		rbt->rbt_hint = i + 1;
+		return i + 1;
+	}
+	return rb_array_geq(rbt, object, false, eq);
+}
+
+static bool
+rb_array_reserve(struct rb_tree *rbt, size_t count)
+{
+	void **elems;
+	size_t alloc = rbt->rbt_alloc;
+
+	if (count <= alloc)
+		return true;
+	if (alloc == 0)
+		alloc = RB_ARRAY_MINALLOC;
+	while (alloc < count)
+		alloc *= 2;
+	elems = realloc(rbt->rbt_elems, alloc * sizeof(*elems));
+	if (elems == NULL)
+		return false;
+	rbt->rbt_elems = elems;
+	rbt->rbt_alloc = alloc;
+	return true;
+}
+
+void *
+rb_tree_insert_node(struct rb_tree *rbt, void *object)
+{
+	bool eq;
+	size_t i;
+
+	i = rb_array_geq(rbt, object, false, &eq);
+	if (eq)
+		return rbt->rbt_elems[i];
+	if (!rb_array_reserve(rbt, rbt->rbt_count + 1))
+		return NULL;
+	memmove(rbt->rbt_elems + i + 1, rbt->rbt_elems + i,
+	    (rbt->rbt_count - i) * sizeof(*rbt->rbt_elems));
+	rbt->rbt_elems[i] = object;
+	rbt->rbt_count++;
+	rbt->rbt_hint = i;
+	return object;
+}
+
+void *
+rb_tree_find_node(struct rb_tree *rbt, const void *key)
+{
+	bool eq;
+	size_t i;
+
+	i = rb_array_geq(rbt, key, true, &eq);
+	if (!eq)
+		return NULL;
+	rbt->rbt_hint = i;
+	return rbt->rbt_elems[i];
+}
+
+void *
+rb_tree_find_node_geq(struct rb_tree *rbt, const void *key)
+{
+	bool eq;
+	size_t i;
+
+	i = rb_array_geq(rbt, key, true, &eq);
+	return i < rbt->rbt_count ? rbt->rbt_elems[i] : NULL;
+}
+
+void *
+rb_tree_find_node_leq(struct rb_tree *rbt, const void *key)
+{
+	bool eq;
+	size_t i;
+
+	i = rb_array_geq(rbt, key, true, &eq);
+	if (eq)
+		return rbt->rbt_elems[i];
+	return i > 0 ? rbt->rbt_elems[i - 1] : NULL;
+}
+
+void
+rb_tree_remove_node(struct rb_tree *rbt, void *object)
+{
+	bool eq;
+	size_t i;
+
+	i = rb_array_index(rbt, object, &eq);
+	KASSERT(eq);
+	if (!eq)
+		return;
+	rbt->rbt_count--;
+	memmove(rbt->rbt_elems + i, rbt->rbt_elems + i + 1,
+	    (rbt->rbt_count - i) * sizeof(*rbt->rbt_elems));
+	rbt->rbt_hint = i;	/* now our old successor */
+}
+
+void *
+rb_tree_iterate(struct rb_tree *rbt, void *object, const unsigned int direction)
+{
+	bool eq;
+	size_t i;
+
+	KASSERT(direction == RB_DIR_LEFT || direction == RB_DIR_RIGHT);
+
+	if (rbt->rbt_count == 0)
+		return NULL;
+	if (object == NULL) {
+		rbt->rbt_hint = direction == RB_DIR_LEFT ?
+		    0 : rbt->rbt_count - 1;
+		return rbt->rbt_elems[rbt->rbt_hint];
+	}
+	i = rb_array_index(rbt, object, &eq);
+	if (direction == RB_DIR_RIGHT) {
+		if (eq)
+			i++;
+		if (i >= rbt->rbt_count)
+			return NULL;
+	} else {
+		if (i == 0)
+			return NULL;
+		i--;
+	}
+	rbt->rbt_hint = i;
+	return rbt->rbt_elems[i];
+}
+
+void
+rb_tree_bulkload(struct rb_tree *rbt, void **objects, size_t count)
+{
+
+	KASSERT(rbt->rbt_count == 0);
+	if (!rb_array_reserve(rbt, count))
+		return;
+	memcpy(rbt->rbt_elems, objects, count * sizeof(*objects));
+	rbt->rbt_count = count;
+	rbt->rbt_hint = 0;
+}
+
+void
+rb_tree_merge(struct rb_tree *rbt, struct rb_tree *other)
+{
+	const rb_tree_ops_t *rbto = rbt->rbt_ops;
+	size_t i = rbt->rbt_count, j = other->rbt_count, k;
+
+	KASSERT(rbto == other->rbt_ops);
+
+	/* Merge in place from the highest element down. */
+	if (!rb_array_reserve(rbt, i + j))
+		return;
+	k = i + j;
+	rbt->rbt_count = k;
+	while (j != 0) {
+		if (i != 0 && (*rbto->rbto_compare_nodes)(rbto->rbto_context,
+		    rbt->rbt_elems[i - 1], other->rbt_elems[j - 1]) > 0)
+			rbt->rbt_elems[--k] = rbt->rbt_elems[--i];
+		else
+			rbt->rbt_elems[--k] = other->rbt_elems[--j];
+	}
+	rbt->rbt_hint = 0;
+	other->rbt_count = 0;
+	other->rbt_hint = 0;
+}
+
+#else /* !RB_TREE_ARRAY */
+
 void
 rb_tree_init(struct rb_tree *rbt, const rb_tree_ops_t *ops)
 {
@@ -118,6 +361,13 @@ rb_tree_init(struct rb_tree *rbt, const rb_tree_ops_t *ops)
 #endif
 }
 
+void
+rb_tree_fini(__rbt_unused struct rb_tree *rbt)
+{
+
+	/* The nodes are intrusive, there is nothing to release. */
+}
+
 void *
 rb_tree_find_node(struct rb_tree *rbt, const void *key)
 {
@@ -1008,6 +1258,198 @@ rb_tree_iterate(struct rb_tree *rbt, void *object, const unsigned int direction)
 	return RB_NODETOITEM(rbto, self);
 }
 
+/*
+ * Build a balanced subtree from count sorted nodes consumed in order
+ * from *listp, linked through rb_right.  Nodes at maxlevel are marked
+ * red, every other node black.  As the list is consumed by a binary
+ * search style split, sentinels only ever hang from the bottom two
+ * levels, so this colouring satisfies both red-black invariants.
+ */
+static struct rb_node *
+rb_tree_build_sorted(struct rb_tree *rbt, struct rb_node **listp,
+	size_t count, unsigned int level, unsigned int maxlevel)
+{
+	struct rb_node *self, *left, *right;
+
+	if (count == 0)
+		return RB_SENTINEL_NODE;
+
+	left = rb_tree_build_sorted(rbt, listp, count / 2,
+	    level + 1, maxlevel);
+	self = *listp;
+	*listp = self->rb_right;
+	RB_TAILQ_INSERT_TAIL(&rbt->rbt_nodes, self, rb_link);
+	right = rb_tree_build_sorted(rbt, listp, count - count / 2 - 1,
+	    level + 1, maxlevel);
+
+	self->rb_left = left;
+	self->rb_right = right;
+	self->rb_info = 0;
+	if (level == maxlevel)
+		RB_MARK_RED(self);
+	if (!RB_SENTINEL_P(left)) {
+		RB_SET_FATHER(left, self);
+		RB_SET_POSITION(left, RB_DIR_LEFT);
+	}
+	if (!RB_SENTINEL_P(right)) {
+		RB_SET_FATHER(right, self);
+		RB_SET_POSITION(right, RB_DIR_RIGHT);
+	}
+	return self;
+}
+
+static void
+rb_tree_load_sorted(struct rb_tree *rbt, struct rb_node *list, size_t count)
+{
+	struct rb_node *self;
+	unsigned int maxlevel;
+	size_t m;
+
+	RB_TAILQ_INIT(&rbt->rbt_nodes);
+	if (count == 0) {
+		rbt->rbt_root = RB_SENTINEL_NODE;
+#ifndef RBSMALL
+		rbt->rbt_minmax[RB_DIR_LEFT] = rbt->rbt_root;
+		rbt->rbt_minmax[RB_DIR_RIGHT] = rbt->rbt_root;
+#endif
+		return;
+	}
+
+	/* The deepest node sits at ceil(log2(count + 1)) - 1. */
+	m = count + 1;
+	maxlevel = 0;
+	while ((m >> (maxlevel + 1)) != 0)
+		maxlevel++;
+	if ((m & (m - 1)) == 0)
+		maxlevel--;
+
+	self = rb_tree_build_sorted(rbt, &list, count, 0, maxlevel);
+	KASSERT(list == NULL);
+	RB_SET_FATHER(self, (struct rb_node *)(void *)&rbt->rbt_root);
+	RB_SET_POSITION(self, RB_DIR_LEFT);
+	RB_MARK_BLACK(self);		/* root is always black */
+	rbt->rbt_root = self;
+
+#ifndef RBSMALL
+	while (!RB_SENTINEL_P(self->rb_left))
+		self = self->rb_left;
+	rbt->rbt_minmax[RB_DIR_LEFT] = self;
+	self = rbt->rbt_root;
+	while (!RB_SENTINEL_P(self->rb_right))
+		self = self->rb_right;
+	rbt->rbt_minmax[RB_DIR_RIGHT] = self;
+#endif
+#ifdef RBSTATS
+	rbt->rbt_count += (unsigned int)count;
+	rbt->rbt_insertions += (unsigned int)count;
+#endif
+}
+
+/*
+ * Build a tree from count objects sorted ascending by the tree's
+ * compare functions with no equal keys.  The tree must be empty.
+ * Unlike inserting the objects one by one this is O(count).
+ */
+void
+rb_tree_bulkload(struct rb_tree *rbt, void **objects, size_t count)
+{
+	const rb_tree_ops_t *rbto = rbt->rbt_ops;
+	struct rb_node *list, **tailp;
+	size_t i;
+
+	KASSERT(RB_SENTINEL_P(rbt->rbt_root));
+
+	list = RB_SENTINEL_NODE;
+	tailp = &list;
+	for (i = 0; i < count; i++) {
+		KASSERT(i == 0 || (*rbto->rbto_compare_nodes)(
+		    rbto->rbto_context, objects[i - 1], objects[i]) < 0);
+		*tailp = RB_ITEMTONODE(rbto, objects[i]);
+		tailp = &(*tailp)->rb_right;
+	}
+	*tailp = RB_SENTINEL_NODE;
+
+	rb_tree_load_sorted(rbt, list, count);
+}
+
+/*
+ * Flatten a tree into a list sorted ascending and linked through
+ * rb_right, counting the nodes into *countp.
+ * Iterating from the maximum only reads child pointers of nodes not
+ * yet listed, so relinking rb_right behind the iterator is safe.
+ */
+static struct rb_node *
+rb_tree_flatten(struct rb_tree *rbt, size_t *countp)
+{
+	const rb_tree_ops_t *rbto = rbt->rbt_ops;
+	struct rb_node *self, *head = RB_SENTINEL_NODE;
+	void *obj, *prev;
+	size_t count = 0;
+
+	for (obj = rb_tree_iterate(rbt, NULL, RB_DIR_RIGHT);
+	    obj != NULL; obj = prev)
+	{
+		prev = rb_tree_iterate(rbt, obj, RB_DIR_LEFT);
+		self = RB_ITEMTONODE(rbto, obj);
+		self->rb_right = head;
+		head = self;
+		count++;
+	}
+	*countp = count;
+	return head;
+}
+
+/*
+ * Move every node from other into rbt.  Both trees must share the
+ * same ops and no node in one may compare equal to a node in the
+ * other.  Unlike inserting the nodes one by one this is
+ * O(size of rbt + size of other).
+ */
+void
+rb_tree_merge(struct rb_tree *rbt, struct rb_tree *other)
+{
+	const rb_tree_ops_t *rbto = rbt->rbt_ops;
+	rbto_compare_nodes_fn compare_nodes = rbto->rbto_compare_nodes;
+	struct rb_node *list1, *list2, *list, **tailp;
+	size_t count1, count2;
+
+	KASSERT(rbto == other->rbt_ops);
+
+	list1 = rb_tree_flatten(rbt, &count1);
+	list2 = rb_tree_flatten(other, &count2);
+	other->rbt_root = RB_SENTINEL_NODE;
+	RB_TAILQ_INIT(&other->rbt_nodes);
+#ifndef RBSMALL
+	other->rbt_minmax[RB_DIR_LEFT] = other->rbt_root;
+	other->rbt_minmax[RB_DIR_RIGHT] = other->rbt_root;
+#endif
+#ifdef RBSTATS
+	other->rbt_count -= (unsigned int)count2;
+	other->rbt_removals += (unsigned int)count2;
+	rbt->rbt_count -= (unsigned int)count1;
+#endif
+
+	list = RB_SENTINEL_NODE;
+	tailp = &list;
+	while (list1 != NULL && list2 != NULL) {
+		const signed int diff = (*compare_nodes)(rbto->rbto_context,
+		    RB_NODETOITEM(rbto, list1), RB_NODETOITEM(rbto, list2));
+
+		KASSERT(diff != 0);
+		if (diff < 0) {
+			*tailp = list1;
+			list1 = list1->rb_right;
+		} else {
+			*tailp = list2;
+			list2 = list2->rb_right;
+		}
+		tailp = &(*tailp)->rb_right;
+	}
+	*tailp = list1 != NULL ? list1 : list2;
+
+	rb_tree_load_sorted(rbt, list, count1 + count2);
+}
+
 #ifdef RBDEBUG
 static const struct rb_node *
 rb_tree_iterate_const(const struct rb_tree *rbt, const struct rb_node *self,
@@ -1344,3 +1786,5 @@ rb_tree_depths(const struct rb_tree *rbt, size_t *depths)
 	rb_tree_mark_depth(rbt, rbt->rbt_root, depths, 1);
 }
 #endif /* RBSTATS */
+
+#endif /* !RB_TREE_ARRAY */
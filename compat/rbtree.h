@@ -134,12 +134,14 @@ TAILQ_HEAD(rb_node_qh, rb_node);
 #define	RB_TAILQ_REMOVE(a, b, c)		TAILQ_REMOVE(a, b, c)
 #define	RB_TAILQ_INIT(a)			TAILQ_INIT(a)
 #define	RB_TAILQ_INSERT_HEAD(a, b, c)		TAILQ_INSERT_HEAD(a, b, c)
+#define	RB_TAILQ_INSERT_TAIL(a, b, c)		TAILQ_INSERT_TAIL(a, b, c)
 #define	RB_TAILQ_INSERT_BEFORE(a, b, c)		TAILQ_INSERT_BEFORE(a, b, c)
 #define	RB_TAILQ_INSERT_AFTER(a, b, c, d)	TAILQ_INSERT_AFTER(a, b, c, d)
 #else
 #define	RB_TAILQ_REMOVE(a, b, c)		do { } while (/*CONSTCOND*/0)
 #define	RB_TAILQ_INIT(a)			do { } while (/*CONSTCOND*/0)
 #define	RB_TAILQ_INSERT_HEAD(a, b, c)		do { } while (/*CONSTCOND*/0)
+#define	RB_TAILQ_INSERT_TAIL(a, b, c)		do { } while (/*CONSTCOND*/0)
 #define	RB_TAILQ_INSERT_BEFORE(a, b, c)		do { } while (/*CONSTCOND*/0)
 #define	RB_TAILQ_INSERT_AFTER(a, b, c, d)	do { } while (/*CONSTCOND*/0)
 #endif /* RBDEBUG */
@@ -166,6 +168,26 @@ typedef struct {
 	void *rbto_context;
 } rb_tree_ops_t;
 
+#ifdef RB_TREE_ARRAY
+/*
+ * Optional sorted pointer array backend offering the same interface
+ * as the red-black tree below, selectable with -DRB_TREE_ARRAY.
+ * Lookups and ordered scans touch contiguous memory rather than
+ * chasing heap-scattered nodes, which wins on large trees; inserts
+ * and removals shuffle the array instead of rebalancing.
+ * The index is allocated off tree, so trees must be released with
+ * rb_tree_fini() and rb_tree_insert_node() can return NULL when
+ * growing the index fails.
+ * RBDEBUG and RBSTATS do not apply to this backend.
+ */
+typedef struct rb_tree {
+	const rb_tree_ops_t *rbt_ops;
+	void **rbt_elems;
+	size_t rbt_count;
+	size_t rbt_alloc;
+	size_t rbt_hint;	/* last touched index, makes walks O(1) */
+} rb_tree_t;
+#else
 typedef struct rb_tree {
 	struct rb_node *rbt_root;
 	const rb_tree_ops_t *rbt_ops;
@@ -183,6 +205,7 @@ typedef struct rb_tree {
 	unsigned int rbt_removal_rebalance_passes;
 #endif
 } rb_tree_t;
+#endif /* !RB_TREE_ARRAY */
 
 #ifdef RBSTATS
 #define	RBSTAT_INC(v)	((void)((v)++))
@@ -193,12 +216,15 @@ typedef struct rb_tree {
 #endif
 
 void	rb_tree_init(rb_tree_t *, const rb_tree_ops_t *);
+void	rb_tree_fini(rb_tree_t *);
 void *	rb_tree_insert_node(rb_tree_t *, void *);
 void *	rb_tree_find_node(rb_tree_t *, const void *);
 void *	rb_tree_find_node_geq(rb_tree_t *, const void *);
 void *	rb_tree_find_node_leq(rb_tree_t *, const void *);
 void	rb_tree_remove_node(rb_tree_t *, void *);
 void *	rb_tree_iterate(rb_tree_t *, void *, const unsigned int);
+void	rb_tree_bulkload(rb_tree_t *, void **, size_t);
+void	rb_tree_merge(rb_tree_t *, rb_tree_t *);
 #ifdef RBDEBUG
 void	rb_tree_check(const rb_tree_t *, bool);
 #endif
@@ -54,6 +54,7 @@
 #include "ipv4ll.h"
 #include "logerr.h"
 #include "privsep.h"
+#include "stats.h"
 
 #if defined(ARP)
 #define ARP_LEN								\
@@ -63,6 +64,10 @@
 /* ARP debugging can be quite noisy. Enable this for more noise! */
 //#define	ARP_DEBUG
 
+/* Probes for the same interface due within this window are sent in
+ * one burst from a single wakeup. */
+#define	ARP_PROBE_TICK_MSEC	10
+
 /* Assert the correct structure size for on wire */
 __CTASSERT(sizeof(struct arphdr) == 8);
 
@@ -108,11 +113,11 @@ arp_request(const struct arp_state *astate,
 
 #ifdef PRIVSEP
 	if (ifp->ctx->options & DHCPCD_PRIVSEP)
-		return ps_bpf_sendarp(ifp, tip, arp_buffer, len);
+		return ps_bpf_sendarp(ifp, arp_buffer, len);
 #endif
 	/* Note that well formed ethernet will add extra padding
 	 * to ensure that the packet is at least 60 bytes (64 including FCS). */
-	return bpf_send(astate->bpf, ETHERTYPE_ARP, arp_buffer, len);
+	return bpf_send(ARP_STATE(ifp)->bpf, ETHERTYPE_ARP, arp_buffer, len);
 
 eexit:
 	errno = ENOBUFS;
@@ -233,6 +238,8 @@ arp_packet(struct interface *ifp, uint8_t *data, size_t len,
 	struct arp_state *astate, *astaten;
 	uint8_t *hw_s, *hw_t;
 
+	STAT_INC(arp_rx);
+
 	/* Copy the frame header source and destination out */
 	memset(&arm, 0, sizeof(arm));
 	if (fl != 0) {
@@ -301,58 +308,113 @@ arp_packet(struct interface *ifp, uint8_t *data, size_t len,
 static void
 arp_read(void *arg)
 {
-	struct arp_state *astate = arg;
-	struct bpf *bpf = astate->bpf;
-	struct interface *ifp = astate->iface;
+	struct interface *ifp = arg;
+	struct iarp_state *state = ARP_STATE(ifp);
+	struct bpf *bpf = state->bpf;
 	uint8_t buf[ARP_LEN];
 	ssize_t bytes;
-	struct in_addr addr = astate->addr;
+	unsigned int budget = BPF_READ_BUDGET;
+
+	/* We may be resuming a drain that ran out of budget. */
+	eloop_timeout_delete(ifp->ctx->eloop, arp_read, ifp);
 
 	/* Some RAW mechanisms are generic file descriptors, not sockets.
 	 * This means we have no kernel call to just get one packet,
 	 * so we have to process the entire buffer. */
 	bpf->bpf_flags &= ~BPF_EOF;
 	while (!(bpf->bpf_flags & BPF_EOF)) {
+		if (budget-- == 0) {
+			/* Out of budget - give way to other events and
+			 * pick up the residue afterwards. */
+			eloop_timeout_add_sec(ifp->ctx->eloop, 0,
+			    arp_read, ifp);
+			break;
+		}
 		bytes = bpf_read(bpf, buf, sizeof(buf));
 		if (bytes == -1) {
 			logerr("%s: %s", __func__, ifp->name);
-			arp_free(astate);
+			arp_drop(ifp);
 			return;
 		}
 		arp_packet(ifp, buf, (size_t)bytes, bpf->bpf_flags);
-		/* Check we still have a state after processing. */
-		if ((astate = arp_find(ifp, &addr)) == NULL)
-			break;
-		if ((bpf = astate->bpf) == NULL)
+		/* Processing may have dropped the last state
+		 * and with it the socket we are draining. */
+		if ((state = ARP_STATE(ifp)) == NULL ||
+		    (bpf = state->bpf) == NULL)
 			break;
 	}
 }
 
 static void
-arp_probed(void *arg)
+arp_probed(struct arp_state *astate)
 {
-	struct arp_state *astate = arg;
 
 	timespecclear(&astate->defend);
+	stats_lat_record(astate->iface->name, STAT_LAT_ARP_PROBE,
+	    &astate->probed);
 	astate->not_found_cb(astate);
 }
 
+static void arp_probe_tick(void *);
+
+/* Arm the shared per-interface probe timer for the earliest deadline. */
 static void
-arp_probe1(void *arg)
+arp_probe_schedule(struct interface *ifp)
+{
+	struct iarp_state *state = ARP_STATE(ifp);
+	struct arp_state *astate;
+	const struct timespec *earliest = NULL;
+	struct timespec now;
+	unsigned long ms;
+
+	TAILQ_FOREACH(astate, &state->arp_states, next) {
+		if (!timespecisset(&astate->probe_due))
+			continue;
+		if (earliest == NULL ||
+		    timespeccmp(&astate->probe_due, earliest, <))
+			earliest = &astate->probe_due;
+	}
+	if (earliest == NULL) {
+		eloop_timeout_delete(ifp->ctx->eloop, arp_probe_tick, ifp);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (timespeccmp(earliest, &now, <=))
+		ms = 0;
+	else {
+		long msl;
+
+		msl = (long)(earliest->tv_sec - now.tv_sec) * MSEC_PER_SEC +
+		    (earliest->tv_nsec - now.tv_nsec) / NSEC_PER_MSEC;
+		ms = msl > 0 ? (unsigned long)msl : 0;
+	}
+	eloop_timeout_add_msec(ifp->ctx->eloop, ms, arp_probe_tick, ifp);
+}
+
+/* Send one probe and work out when the next action is due. */
+static void
+arp_probe_send(struct arp_state *astate, const struct timespec *now)
 {
-	struct arp_state *astate = arg;
 	struct interface *ifp = astate->iface;
 	unsigned int delay;
 
-	if (++astate->probes < PROBE_NUM) {
+	if (++astate->probes < PROBE_NUM)
 		delay = (PROBE_MIN * MSEC_PER_SEC) +
 		    (arc4random_uniform(
 		    (PROBE_MAX - PROBE_MIN) * MSEC_PER_SEC));
-		eloop_timeout_add_msec(ifp->ctx->eloop, delay, arp_probe1, astate);
-	} else {
+	else
 		delay = ANNOUNCE_WAIT *	MSEC_PER_SEC;
-		eloop_timeout_add_msec(ifp->ctx->eloop, delay, arp_probed, astate);
+
+	astate->probe_due = *now;
+	astate->probe_due.tv_sec += delay / MSEC_PER_SEC;
+	astate->probe_due.tv_nsec += (long)(delay % MSEC_PER_SEC) *
+	    NSEC_PER_MSEC;
+	if (astate->probe_due.tv_nsec >= NSEC_PER_SEC) {
+		astate->probe_due.tv_sec++;
+		astate->probe_due.tv_nsec -= NSEC_PER_SEC;
 	}
+
 	logdebugx("%s: ARP probing %s (%d of %d), next in %0.1f seconds",
 	    ifp->name, inet_ntoa(astate->addr),
 	    astate->probes ? astate->probes : PROBE_NUM, PROBE_NUM,
@@ -361,14 +423,56 @@ arp_probe1(void *arg)
 		logerr(__func__);
 }
 
+/* One wakeup serves every state on the interface due within the same
+ * tick, so a subnet-wide event starting probes on hundreds of
+ * addresses costs one timer and one write burst, not one each. */
+static void
+arp_probe_tick(void *arg)
+{
+	struct interface *ifp = arg;
+	struct iarp_state *state = ARP_STATE(ifp);
+	struct arp_state *astate;
+	struct timespec now, tick;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	tick = now;
+	tick.tv_nsec += ARP_PROBE_TICK_MSEC * NSEC_PER_MSEC;
+	if (tick.tv_nsec >= NSEC_PER_SEC) {
+		tick.tv_sec++;
+		tick.tv_nsec -= NSEC_PER_SEC;
+	}
+
+restart:
+	TAILQ_FOREACH(astate, &state->arp_states, next) {
+		if (!timespecisset(&astate->probe_due) ||
+		    timespeccmp(&astate->probe_due, &tick, >))
+			continue;
+		if (astate->probes >= PROBE_NUM) {
+			timespecclear(&astate->probe_due);
+			arp_probed(astate);
+			/* The callback can add and free states at will,
+			 * so walk the list afresh. */
+			if ((state = ARP_STATE(ifp)) == NULL)
+				return;
+			goto restart;
+		}
+		arp_probe_send(astate, &now);
+	}
+
+	arp_probe_schedule(ifp);
+}
+
 void
 arp_probe(struct arp_state *astate)
 {
 
 	astate->probes = 0;
+	clock_gettime(CLOCK_MONOTONIC, &astate->probed);
+	/* Due now - fires on the shared tick with any other probes. */
+	astate->probe_due = astate->probed;
 	logdebugx("%s: probing for %s",
 	    astate->iface->name, inet_ntoa(astate->addr));
-	arp_probe1(astate);
+	arp_probe_schedule(astate->iface);
 }
 #endif	/* ARP */
 
@@ -525,6 +629,32 @@ arp_announceaddr(struct dhcpcd_ctx *ctx, const struct in_addr *ia)
 	return arp_ifannounceaddr(iff, ia);
 }
 
+/* Patch the shared BPF filter to cover all active states.
+ * Past BPF_ARP_MAXADDRS the filter falls back to accepting all ARP
+ * and arp_packet(3) matches the states in userland. */
+static int
+arp_update_bpf(struct interface *ifp)
+{
+	struct iarp_state *state = ARP_STATE(ifp);
+	struct arp_state *astate;
+	struct in_addr addrs[BPF_ARP_MAXADDRS + 1];
+	size_t naddrs = 0;
+
+	TAILQ_FOREACH(astate, &state->arp_states, next) {
+		addrs[naddrs++] = astate->addr;
+		/* One over the maximum is enough to signal the
+		 * accept-all fallback. */
+		if (naddrs == __arraycount(addrs))
+			break;
+	}
+
+#ifdef PRIVSEP
+	if (IN_PRIVSEP(ifp->ctx))
+		return (int)ps_bpf_addrsarp(ifp, addrs, naddrs);
+#endif
+	return bpf_arp_addrs(state->bpf, addrs, naddrs);
+}
+
 struct arp_state *
 arp_new(struct interface *ifp, const struct in_addr *addr)
 {
@@ -538,7 +668,30 @@ arp_new(struct interface *ifp, const struct in_addr *addr)
 			logerr(__func__);
 			return NULL;
 		}
+		state->bpf = NULL;
 		TAILQ_INIT(&state->arp_states);
+
+		/* Open one BPF socket per interface and share it
+		 * between the states. */
+#ifdef PRIVSEP
+		if (IN_PRIVSEP(ifp->ctx)) {
+			if (ps_bpf_openarp(ifp) == -1) {
+				logerr(__func__);
+				goto errstate;
+			}
+		} else
+#endif
+		{
+			state->bpf = bpf_open(ifp, bpf_arp, NULL);
+			if (state->bpf == NULL) {
+				logerr(__func__);
+				goto errstate;
+			}
+			eloop_event_add(ifp->ctx->eloop,
+			    state->bpf->bpf_fd, arp_read, ifp);
+			eloop_event_priority(ifp->ctx->eloop,
+			    state->bpf->bpf_fd, ELOOP_PRIO_HIGH);
+		}
 	} else {
 		if ((astate = arp_find(ifp, addr)) != NULL)
 			return astate;
@@ -551,30 +704,15 @@ arp_new(struct interface *ifp, const struct in_addr *addr)
 	astate->iface = ifp;
 	astate->addr = *addr;
 
-#ifdef PRIVSEP
-	if (IN_PRIVSEP(ifp->ctx)) {
-		if (ps_bpf_openarp(ifp, addr) == -1) {
-			logerr(__func__);
-			free(astate);
-			return NULL;
-		}
-	} else
-#endif
-	{
-		astate->bpf = bpf_open(ifp, bpf_arp, addr);
-		if (astate->bpf == NULL) {
-			logerr(__func__);
-			free(astate);
-			return NULL;
-		}
-		eloop_event_add(ifp->ctx->eloop, astate->bpf->bpf_fd,
-		    arp_read, astate);
-	}
-
-
-	state = ARP_STATE(ifp);
 	TAILQ_INSERT_TAIL(&state->arp_states, astate, next);
+	if (arp_update_bpf(ifp) == -1)
+		logerr(__func__);
 	return astate;
+
+errstate:
+	free(state);
+	ifp->if_data[IF_DATA_ARP] = NULL;
+	return NULL;
 }
 
 void
@@ -595,21 +733,27 @@ arp_free(struct arp_state *astate)
 	TAILQ_REMOVE(&state->arp_states, astate, next);
 	if (astate->free_cb)
 		astate->free_cb(astate);
-
-#ifdef PRIVSEP
-	if (IN_PRIVSEP(ctx) && ps_bpf_closearp(ifp, &astate->addr) == -1)
-		logerr(__func__);
-#endif
-	if (astate->bpf != NULL) {
-		eloop_event_delete(ctx->eloop, astate->bpf->bpf_fd);
-		bpf_close(astate->bpf);
-	}
-
 	free(astate);
 
 	if (TAILQ_FIRST(&state->arp_states) == NULL) {
+		eloop_timeout_delete(ctx->eloop, arp_read, ifp);
+		eloop_timeout_delete(ctx->eloop, arp_probe_tick, ifp);
+#ifdef PRIVSEP
+		if (IN_PRIVSEP(ctx)) {
+			if (ps_bpf_closearp(ifp) == -1)
+				logerr(__func__);
+		} else
+#endif
+		if (state->bpf != NULL) {
+			eloop_event_delete(ctx->eloop, state->bpf->bpf_fd);
+			bpf_close(state->bpf);
+		}
 		free(state);
 		ifp->if_data[IF_DATA_ARP] = NULL;
+	} else {
+		if (arp_update_bpf(ifp) == -1)
+			logerr(__func__);
+		arp_probe_schedule(ifp);
 	}
 }
 
@@ -69,11 +69,14 @@ struct arp_state {
 	TAILQ_ENTRY(arp_state) next;
 	struct interface *iface;
 	struct in_addr addr;
-	struct bpf *bpf;
 
 	int probes;
 	int claims;
 	struct timespec defend;
+	struct timespec probed;
+	/* When the next probe (or the probed callback) is due.
+	 * Unset when no probe is in flight. */
+	struct timespec probe_due;
 
 	void (*found_cb)(struct arp_state *, const struct arp_msg *);
 	void (*not_found_cb)(struct arp_state *);
@@ -84,6 +87,9 @@ struct arp_state {
 TAILQ_HEAD(arp_statehead, arp_state);
 
 struct iarp_state {
+	/* One BPF socket per interface, shared by all states.
+	 * The filter is repatched as states come and go. */
+	struct bpf *bpf;
 	struct arp_statehead arp_states;
 };
 
@@ -50,6 +50,27 @@
 #include <hmac.h>
 #endif
 
+static int
+token_compare(__unused void *context, const void *node1, const void *node2)
+{
+	const struct token *t1 = node1, *t2 = node2;
+
+	if (t1->secretid != t2->secretid)
+		return t1->secretid < t2->secretid ? -1 : 1;
+	if (t1->realm_len != t2->realm_len)
+		return t1->realm_len < t2->realm_len ? -1 : 1;
+	if (t1->realm_len == 0)
+		return 0;
+	return memcmp(t1->realm, t2->realm, t1->realm_len);
+}
+
+const rb_tree_ops_t token_compare_ops = {
+	.rbto_compare_nodes = token_compare,
+	.rbto_compare_key = token_compare,
+	.rbto_node_offset = offsetof(struct token, node),
+	.rbto_context = NULL
+};
+
 #ifdef __sun
 #define htonll
 #define ntohll
@@ -83,12 +104,18 @@ dhcp_auth_reset(struct authstate *state)
 	if (state->token) {
 		free(state->token->key);
 		free(state->token->realm);
+#ifdef HAVE_HMAC_CTX
+		hmac_free(state->token->hmac_md5);
+#endif
 		free(state->token);
 		state->token = NULL;
 	}
 	if (state->reconf) {
 		free(state->reconf->key);
 		free(state->reconf->realm);
+#ifdef HAVE_HMAC_CTX
+		hmac_free(state->reconf->hmac_md5);
+#endif
 		free(state->reconf);
 		state->reconf = NULL;
 	}
@@ -112,6 +139,7 @@ dhcp_auth_validate(struct authstate *state, const struct auth *auth,
 	const uint8_t *d, *realm;
 	size_t realm_len;
 	const struct token *t;
+	struct token match;
 	time_t now;
 	uint8_t hmac_code[HMAC_LENGTH];
 
@@ -256,8 +284,14 @@ dhcp_auth_validate(struct authstate *state, const struct auth *auth,
 					state->reconf->realm = NULL;
 					state->reconf->realm_len = 0;
 					state->reconf->key_len = 16;
+					state->reconf->hmac_md5 = NULL;
 				}
 				memcpy(state->reconf->key, d, 16);
+#ifdef HAVE_HMAC_CTX
+				/* The key may have changed */
+				hmac_free(state->reconf->hmac_md5);
+				state->reconf->hmac_md5 = NULL;
+#endif
 			} else {
 				errno = EINVAL;
 				return NULL;
@@ -294,13 +328,10 @@ dhcp_auth_validate(struct authstate *state, const struct auth *auth,
 	}
 
 	/* Find a token for the realm and secret */
-	TAILQ_FOREACH(t, &auth->tokens, next) {
-		if (t->secretid == secretid &&
-		    t->realm_len == realm_len &&
-		    (t->realm_len == 0 ||
-		    memcmp(t->realm, realm, t->realm_len) == 0))
-			break;
-	}
+	match.secretid = secretid;
+	match.realm = UNCONST(realm);
+	match.realm_len = realm_len;
+	t = rb_tree_find_node(UNCONST(&auth->tokens), &match);
 	if (t == NULL) {
 		errno = ESRCH;
 		return NULL;
@@ -353,6 +384,17 @@ gottoken:
 	memset(hmac_code, 0, sizeof(hmac_code));
 	switch (algorithm) {
 	case AUTH_ALG_HMAC_MD5:
+#ifdef HAVE_HMAC_CTX
+		/* Lazily prime the key schedule - keys change rarely,
+		 * messages arrive constantly. */
+		if (t->hmac_md5 == NULL)
+			((struct token *)UNCONST(t))->hmac_md5 =
+			    hmac_new("md5", t->key, t->key_len);
+		if (t->hmac_md5 != NULL)
+			hmac_digest(t->hmac_md5, mm, mlen,
+			    hmac_code, sizeof(hmac_code));
+		else
+#endif
 		hmac("md5", t->key, t->key_len, mm, mlen,
 		     hmac_code, sizeof(hmac_code));
 		break;
@@ -377,6 +419,8 @@ finish:
 		state->token = malloc(sizeof(*state->token));
 		if (state->token) {
 			state->token->secretid = t->secretid;
+			state->token->expire = 0;
+			state->token->hmac_md5 = NULL;
 			state->token->key = malloc(t->key_len);
 			if (state->token->key) {
 				state->token->key_len = t->key_len;
@@ -533,11 +577,12 @@ dhcp_auth_encode(struct dhcpcd_ctx *ctx, struct auth *auth,
 	/* Ignore the token argument given to us - always send using the
 	 * configured token. */
 	if (auth->protocol == AUTH_PROTO_TOKEN) {
-		TAILQ_FOREACH(t, &auth->tokens, next) {
-			if (t->secretid == auth->token_snd_secretid)
-				break;
-		}
-		if (t == NULL) {
+		struct token match = { .secretid = auth->token_snd_secretid };
+
+		/* Tokens order on secretid first, so this finds the
+		 * first token for the id regardless of realm. */
+		t = rb_tree_find_node_geq(&auth->tokens, &match);
+		if (t == NULL || t->secretid != auth->token_snd_secretid) {
 			errno = EINVAL;
 			return -1;
 		}
@@ -719,6 +764,15 @@ dhcp_auth_encode(struct dhcpcd_ctx *ctx, struct auth *auth,
 	/* Create our hash and write it out */
 	switch(auth->algorithm) {
 	case AUTH_ALG_HMAC_MD5:
+#ifdef HAVE_HMAC_CTX
+		if (t->hmac_md5 == NULL)
+			((struct token *)UNCONST(t))->hmac_md5 =
+			    hmac_new("md5", t->key, t->key_len);
+		if (t->hmac_md5 != NULL)
+			hmac_digest(t->hmac_md5, m, mlen,
+			    hmac_code, sizeof(hmac_code));
+		else
+#endif
 		hmac("md5", t->key, t->key_len, m, mlen,
 		     hmac_code, sizeof(hmac_code));
 		memcpy(data, hmac_code, sizeof(hmac_code));
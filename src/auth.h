@@ -34,6 +34,9 @@
 #ifdef HAVE_SYS_QUEUE_H
 #include <sys/queue.h>
 #endif
+#ifdef HAVE_SYS_RBTREE_H
+#include <sys/rbtree.h>
+#endif
 
 #define DHCPCD_AUTH_SEND	(1 << 0)
 #define DHCPCD_AUTH_REQUIRE	(1 << 1)
@@ -51,17 +54,22 @@
 
 #define AUTH_RDM_MONOTONIC	0
 
+struct hmacctx;
+
+/* Tokens index on (secretid, realm) so validation does not walk
+ * the whole set per message. */
 struct token {
-	TAILQ_ENTRY(token) next;
+	rb_node_t node;
 	uint32_t secretid;
 	size_t realm_len;
 	unsigned char *realm;
 	size_t key_len;
 	unsigned char *key;
 	time_t expire;
+	struct hmacctx *hmac_md5;	/* cached key schedule */
 };
 
-TAILQ_HEAD(token_head, token);
+extern const rb_tree_ops_t token_compare_ops;
 
 struct auth {
 	int options;
@@ -71,7 +79,7 @@ struct auth {
 	uint8_t rdm;
 	uint64_t last_replay;
 	uint8_t last_replay_set;
-	struct token_head tokens;
+	rb_tree_t tokens;
 	uint32_t token_snd_secretid;
 	uint32_t token_rcv_secretid;
 #endif
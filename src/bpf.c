@@ -299,6 +299,13 @@ bpf_attach(int fd, void *filter, unsigned int filter_len)
 	return ioctl(fd, BIOCSETF, &pf);
 }
 
+int
+bpf_lock(int fd)
+{
+
+	return ioctl(fd, BIOCLOCK);
+}
+
 #ifdef BIOCSETWF
 static int
 bpf_wattach(int fd, void *filter, unsigned int filter_len)
@@ -340,6 +347,9 @@ bpf_send(const struct bpf *bpf, uint16_t protocol,
 }
 #endif
 
+#ifndef __linux__
+/* Linux may have a receive ring mapped, so closing is special too.
+ * See if-linux.c. */
 void
 bpf_close(struct bpf *bpf)
 {
@@ -348,6 +358,7 @@ bpf_close(struct bpf *bpf)
 	free(bpf->bpf_buffer);
 	free(bpf);
 }
+#endif
 
 #ifdef ARP
 #define BPF_CMP_HWADDR_LEN	((((HWADDR_LEN / 4) + 2) * 2) + 1)
@@ -479,19 +490,20 @@ static const struct bpf_insn bpf_arp_filter [] = {
 #define BPF_ARP_FILTER_LEN	__arraycount(bpf_arp_filter)
 
 /* One address is two checks of two statements. */
-#define BPF_NADDRS		1
-#define BPF_ARP_ADDRS_LEN	5 + ((BPF_NADDRS * 2) * 2)
+#define BPF_ARP_ADDRS_LEN	5 + ((BPF_ARP_MAXADDRS * 2) * 2)
 
 #define BPF_ARP_LEN		BPF_ARP_ETHER_LEN + BPF_ARP_FILTER_LEN + \
 				BPF_CMP_HWADDR_LEN + BPF_ARP_ADDRS_LEN
 
 static int
-bpf_arp_rw(const struct bpf *bpf, const struct in_addr *ia, bool recv)
+bpf_arp_rw(const struct bpf *bpf, const struct in_addr *addrs,
+    size_t naddrs, bool recv)
 {
 	const struct interface *ifp = bpf->bpf_ifp;
 	struct bpf_insn buf[BPF_ARP_LEN + 1];
 	struct bpf_insn *bp;
 	uint16_t arp_len;
+	size_t i;
 
 	bp = buf;
 	/* Check frame header. */
@@ -514,14 +526,25 @@ bpf_arp_rw(const struct bpf *bpf, const struct in_addr *ia, bool recv)
 	bp += bpf_cmp_hwaddr(bp, BPF_CMP_HWADDR_LEN, sizeof(struct arphdr),
 	                     !recv, ifp->hwaddr, ifp->hwlen);
 
+	/* Too many addresses to match in the program - accept all ARP
+	 * and leave the matching to the state walk in userland. */
+	if (naddrs > BPF_ARP_MAXADDRS) {
+		BPF_SET_STMT(bp, BPF_RET + BPF_K, arp_len);
+		bp++;
+		goto attach;
+	}
+
 	/* Match sender protocol address */
 	BPF_SET_STMT(bp, BPF_LD + BPF_W + BPF_IND,
 	    sizeof(struct arphdr) + ifp->hwlen);
 	bp++;
-	BPF_SET_JUMP(bp, BPF_JMP + BPF_JEQ + BPF_K, htonl(ia->s_addr), 0, 1);
-	bp++;
-	BPF_SET_STMT(bp, BPF_RET + BPF_K, arp_len);
-	bp++;
+	for (i = 0; i < naddrs; i++) {
+		BPF_SET_JUMP(bp, BPF_JMP + BPF_JEQ + BPF_K,
+		    htonl(addrs[i].s_addr), 0, 1);
+		bp++;
+		BPF_SET_STMT(bp, BPF_RET + BPF_K, arp_len);
+		bp++;
+	}
 
 	/* If we didn't match sender, then we're only interested in
 	 * ARP probes to us, so check the null host sender. */
@@ -534,15 +557,19 @@ bpf_arp_rw(const struct bpf *bpf, const struct in_addr *ia, bool recv)
 	BPF_SET_STMT(bp, BPF_LD + BPF_W + BPF_IND, (sizeof(struct arphdr) +
 	    (size_t)(ifp->hwlen * 2) + sizeof(in_addr_t)));
 	bp++;
-	BPF_SET_JUMP(bp, BPF_JMP + BPF_JEQ + BPF_K, htonl(ia->s_addr), 0, 1);
-	bp++;
-	BPF_SET_STMT(bp, BPF_RET + BPF_K, arp_len);
-	bp++;
+	for (i = 0; i < naddrs; i++) {
+		BPF_SET_JUMP(bp, BPF_JMP + BPF_JEQ + BPF_K,
+		    htonl(addrs[i].s_addr), 0, 1);
+		bp++;
+		BPF_SET_STMT(bp, BPF_RET + BPF_K, arp_len);
+		bp++;
+	}
 
 	/* No match, drop it */
 	BPF_SET_STMT(bp, BPF_RET + BPF_K, 0);
 	bp++;
 
+attach:
 #ifdef BIOCSETWF
 	if (!recv)
 		return bpf_wattach(bpf->bpf_fd, buf, (unsigned int)(bp - buf));
@@ -551,20 +578,29 @@ bpf_arp_rw(const struct bpf *bpf, const struct in_addr *ia, bool recv)
 	return bpf_attach(bpf->bpf_fd, buf, (unsigned int)(bp - buf));
 }
 
+/* The filter is repatched as addresses come and go, so unlike BOOTP
+ * the descriptor cannot be locked with BIOCLOCK. */
 int
-bpf_arp(const struct bpf *bpf, const struct in_addr *ia)
+bpf_arp_addrs(const struct bpf *bpf, const struct in_addr *addrs,
+    size_t naddrs)
 {
 
 #ifdef BIOCSETWF
-	if (bpf_arp_rw(bpf, ia, true) == -1 ||
-	    bpf_arp_rw(bpf, ia, false) == -1 ||
-	    ioctl(bpf->bpf_fd, BIOCLOCK) == -1)
+	if (bpf_arp_rw(bpf, addrs, naddrs, true) == -1 ||
+	    bpf_arp_rw(bpf, addrs, naddrs, false) == -1)
 		return -1;
 	return 0;
 #else
-	return bpf_arp_rw(bpf, ia, true);
+	return bpf_arp_rw(bpf, addrs, naddrs, true);
 #endif
 }
+
+int
+bpf_arp(const struct bpf *bpf, const struct in_addr *ia)
+{
+
+	return bpf_arp_addrs(bpf, ia, ia == NULL ? 0 : 1);
+}
 #endif
 
 #ifdef ARPHRD_NONE
@@ -630,21 +666,23 @@ static const struct bpf_insn bpf_bootp_write[] = {
 #endif
 
 #define BPF_BOOTP_CHADDR_LEN	((BOOTP_CHADDR_LEN / 4) * 3)
-#define	BPF_BOOTP_XID_LEN	4 /* BOUND check is 4 instructions */
+/* The op and hlen checks are 3 instructions each. */
+#define	BPF_BOOTP_REPLY_LEN	6
 
 #define BPF_BOOTP_LEN		BPF_BOOTP_ETHER_LEN + \
 				BPF_BOOTP_BASE_LEN + BPF_BOOTP_READ_LEN + \
-				BPF_BOOTP_XID_LEN + BPF_BOOTP_CHADDR_LEN + 4
+				BPF_BOOTP_REPLY_LEN + BPF_BOOTP_CHADDR_LEN + 4
 
 static int
 bpf_bootp_rw(const struct bpf *bpf, bool read)
 {
+	const struct interface *ifp = bpf->bpf_ifp;
 	struct bpf_insn buf[BPF_BOOTP_LEN + 1];
 	struct bpf_insn *bp;
 
 	bp = buf;
 	/* Check frame header. */
-	switch(bpf->bpf_ifp->hwtype) {
+	switch(ifp->hwtype) {
 #ifdef ARPHRD_NONE
 	case ARPHRD_NONE:
 		memcpy(bp, bpf_bootp_none, sizeof(bpf_bootp_none));
@@ -682,6 +720,69 @@ bpf_bootp_rw(const struct bpf *bpf, bool read)
 	memcpy(bp, bpf_bootp_read, sizeof(bpf_bootp_read));
 	bp += BPF_BOOTP_READ_LEN;
 
+	/* Make sure it's a BOOTP reply. */
+	BPF_SET_STMT(bp, BPF_LD + BPF_B + BPF_IND,
+	    sizeof(struct udphdr) + offsetof(struct bootp, op));
+	bp++;
+	BPF_SET_JUMP(bp, BPF_JMP + BPF_JEQ + BPF_K, BOOTREPLY, 1, 0);
+	bp++;
+	BPF_SET_STMT(bp, BPF_RET + BPF_K, 0);
+	bp++;
+
+	/* Make sure the reply is addressed to our hardware address so
+	 * that other hosts' leases on the segment don't wake us.
+	 * We can't match the xid here as well - the filter is locked
+	 * once attached and the xid changes over the lifetime of the
+	 * socket, so dhcp_handlebootp() keeps checking it. */
+	if (ifp->hwlen != 0 && ifp->hwlen <= BOOTP_CHADDR_LEN) {
+		const uint8_t *hwaddr = ifp->hwaddr;
+		size_t hwlen = ifp->hwlen, maclen;
+		size_t off = sizeof(struct udphdr) +
+		    offsetof(struct bootp, chaddr);
+		uint32_t mac32;
+		uint16_t mac16;
+
+		BPF_SET_STMT(bp, BPF_LD + BPF_B + BPF_IND,
+		    sizeof(struct udphdr) + offsetof(struct bootp, hlen));
+		bp++;
+		BPF_SET_JUMP(bp, BPF_JMP + BPF_JEQ + BPF_K, ifp->hwlen, 1, 0);
+		bp++;
+		BPF_SET_STMT(bp, BPF_RET + BPF_K, 0);
+		bp++;
+
+		for (; hwlen > 0;
+		    hwaddr += maclen, hwlen -= maclen, off += maclen)
+		{
+			if (hwlen >= 4) {
+				maclen = sizeof(mac32);
+				memcpy(&mac32, hwaddr, maclen);
+				BPF_SET_STMT(bp, BPF_LD + BPF_W + BPF_IND,
+				    off);
+				bp++;
+				BPF_SET_JUMP(bp, BPF_JMP + BPF_JEQ + BPF_K,
+				    htonl(mac32), 1, 0);
+			} else if (hwlen >= 2) {
+				maclen = sizeof(mac16);
+				memcpy(&mac16, hwaddr, maclen);
+				BPF_SET_STMT(bp, BPF_LD + BPF_H + BPF_IND,
+				    off);
+				bp++;
+				BPF_SET_JUMP(bp, BPF_JMP + BPF_JEQ + BPF_K,
+				    htons(mac16), 1, 0);
+			} else {
+				maclen = sizeof(*hwaddr);
+				BPF_SET_STMT(bp, BPF_LD + BPF_B + BPF_IND,
+				    off);
+				bp++;
+				BPF_SET_JUMP(bp, BPF_JMP + BPF_JEQ + BPF_K,
+				    *hwaddr, 1, 0);
+			}
+			bp++;
+			BPF_SET_STMT(bp, BPF_RET + BPF_K, 0);
+			bp++;
+		}
+	}
+
 	/* All passed, return the packet. */
 	BPF_SET_STMT(bp, BPF_RET + BPF_K, BPF_WHOLEPACKET);
 	bp++;
@@ -696,7 +797,7 @@ bpf_bootp(const struct bpf *bpf, __unused const struct in_addr *ia)
 #ifdef BIOCSETWF
 	if (bpf_bootp_rw(bpf, true) == -1 ||
 	    bpf_bootp_rw(bpf, false) == -1 ||
-	    ioctl(bpf->bpf_fd, BIOCLOCK) == -1)
+	    bpf_lock(bpf->bpf_fd) == -1)
 		return -1;
 	return 0;
 #else
@@ -708,6 +809,9 @@ bpf_bootp(const struct bpf *bpf, __unused const struct in_addr *ia)
 #warning A compromised PF_PACKET socket can be used as a raw socket
 #endif
 #endif
-	return bpf_bootp_rw(bpf, true);
+	if (bpf_bootp_rw(bpf, true) == -1)
+		return -1;
+	/* The BOOTP filter never changes, so lock it down. */
+	return bpf_lock(bpf->bpf_fd);
 #endif
 }
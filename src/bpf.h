@@ -33,6 +33,11 @@
 #define	BPF_PARTIALCSUM		0x02U
 #define	BPF_BCAST		0x04U
 
+/* Maximum packets to drain per wakeup so that a flood of matching
+ * frames cannot starve the rest of dhcpcd.
+ * Readers schedule a zero length timeout to consume any residue. */
+#define	BPF_READ_BUDGET		64
+
 /*
  * Even though we program the BPF filter should we trust it?
  * On Linux at least there is a window between opening the socket,
@@ -62,6 +67,14 @@ struct bpf {
 	size_t bpf_size;
 	size_t bpf_len;
 	size_t bpf_pos;
+#ifdef __linux__
+	/* PACKET_RX_RING support, see if-linux.c. */
+	void *bpf_ring;
+	size_t bpf_ring_size;
+	unsigned int bpf_ring_block;
+	unsigned int bpf_ring_npkts;
+	void *bpf_ring_pkt;
+#endif
 };
 
 extern const char *bpf_name;
@@ -74,8 +87,14 @@ struct bpf * bpf_open(const struct interface *,
     const struct in_addr *);
 void bpf_close(struct bpf *);
 int bpf_attach(int, void *, unsigned int);
+int bpf_lock(int);
 ssize_t bpf_send(const struct bpf *, uint16_t, const void *, size_t);
 ssize_t bpf_read(struct bpf *, void *, size_t);
+/* Past this many addresses the shared ARP filter accepts all ARP
+ * frames and userland matching takes over. */
+#define	BPF_ARP_MAXADDRS	64
+
 int bpf_arp(const struct bpf *, const struct in_addr *);
+int bpf_arp_addrs(const struct bpf *, const struct in_addr *, size_t);
 int bpf_bootp(const struct bpf *, const struct in_addr *);
 #endif
@@ -33,6 +33,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -64,6 +65,7 @@ control_queue_free(struct fd_list *fd)
 			free(fdp->data);
 		free(fdp);
 	}
+	fd->queue_len = fd->queue_sent = 0;
 
 #ifdef CTL_FREE_LIST
 	while ((fdp = TAILQ_FIRST(&fd->free_queue))) {
@@ -144,6 +146,78 @@ control_handle_data(void *arg)
 	control_recvdata(fd, buffer, (size_t)bytes);
 }
 
+static void
+control_recvframes(struct fd_list *fd, char *data, size_t len)
+{
+	struct control_frame cf;
+	char *argvp[255], **ap;
+	char *p, *e;
+	size_t plen;
+	int argc;
+
+	fd->flags |= FD_BINARY;
+	while (len != 0) {
+		if (len < sizeof(cf)) {
+			errno = EINVAL;
+			logerrx("%s: truncated frame", __func__);
+			return;
+		}
+		memcpy(&cf, data, sizeof(cf));
+		data += sizeof(cf);
+		len -= sizeof(cf);
+		if (cf.cf_magic != CONTROL_FRAME_MAGIC ||
+		    cf.cf_version != CONTROL_FRAME_VERSION)
+		{
+			errno = EINVAL;
+			logerrx("%s: bad frame header", __func__);
+			return;
+		}
+		if (cf.cf_len > len) {
+			errno = EINVAL;
+			logerrx("%s: truncated frame", __func__);
+			return;
+		}
+		p = data;
+		plen = cf.cf_len;
+		data += plen;
+		len -= plen;
+		/* Ignore unknown frame types so the
+		 * protocol can grow. */
+		if (cf.cf_type != CONTROL_FRAME_COMMAND)
+			continue;
+		if (plen == 0 || p[plen - 1] != '\0') {
+			errno = EINVAL;
+			logerrx("%s: no terminator", __func__);
+			return;
+		}
+		argc = 0;
+		ap = argvp;
+		while (plen != 0) {
+			if ((size_t)argc >=
+			    sizeof(argvp) / sizeof(argvp[0]))
+			{
+				errno = ENOBUFS;
+				logerrx("%s: no arg buffer", __func__);
+				return;
+			}
+			e = memchr(p, '\0', plen);
+			*ap++ = p;
+			argc++;
+			e++;
+			plen -= (size_t)(e - p);
+			p = e;
+		}
+		*ap = NULL;
+		if (dhcpcd_handleargs(fd->ctx, fd, argc, argvp) == -1) {
+			logerr(__func__);
+			if (errno != EINTR && errno != EAGAIN) {
+				control_delete(fd);
+				return;
+			}
+		}
+	}
+}
+
 void
 control_recvdata(struct fd_list *fd, char *data, size_t len)
 {
@@ -151,6 +225,16 @@ control_recvdata(struct fd_list *fd, char *data, size_t len)
 	char *argvp[255], **ap;
 	int argc;
 
+#ifdef PRIVSEP
+	if (!IN_PRIVSEP(fd->ctx))
+#endif
+	if (fd->flags & FD_BINARY ||
+	    (len != 0 && (uint8_t)data[0] == CONTROL_FRAME_MAGIC))
+	{
+		control_recvframes(fd, data, len);
+		return;
+	}
+
 	/* Each command is \n terminated
 	 * Each argument is NULL separated */
 	while (len != 0) {
@@ -211,6 +295,8 @@ control_new(struct dhcpcd_ctx *ctx, int fd, unsigned int flags)
 	l->ctx = ctx;
 	l->fd = fd;
 	l->flags = flags;
+	l->listen_if[0] = l->listen_reason[0] = '\0';
+	l->queue_len = l->queue_sent = 0;
 	TAILQ_INIT(&l->queue);
 #ifdef CTL_FREE_LIST
 	TAILQ_INIT(&l->free_queue);
@@ -219,6 +305,41 @@ control_new(struct dhcpcd_ctx *ctx, int fd, unsigned int flags)
 	return l;
 }
 
+static const char *
+control_getvar(const char *env, size_t len, const char *var)
+{
+	const char *e = env + len, *p, *n;
+	size_t vlen = strlen(var);
+
+	for (p = env; p < e; p = n + 1) {
+		n = memchr(p, '\0', (size_t)(e - p));
+		if (n == NULL)
+			break;
+		if ((size_t)(n - p) > vlen &&
+		    strncmp(p, var, vlen) == 0 && p[vlen] == '=')
+			return p + vlen + 1;
+	}
+	return NULL;
+}
+
+bool
+control_listen_match(const struct fd_list *fd, const char *env, size_t len)
+{
+	const char *val;
+
+	if (fd->listen_if[0] != '\0') {
+		val = control_getvar(env, len, "interface");
+		if (val == NULL || fnmatch(fd->listen_if, val, 0) != 0)
+			return false;
+	}
+	if (fd->listen_reason[0] != '\0') {
+		val = control_getvar(env, len, "reason");
+		if (val == NULL || fnmatch(fd->listen_reason, val, 0) != 0)
+			return false;
+	}
+	return true;
+}
+
 static void
 control_handle1(struct dhcpcd_ctx *ctx, int lfd, unsigned int fd_flags)
 {
@@ -489,43 +610,101 @@ control_send(struct dhcpcd_ctx *ctx, int argc, char * const *argv)
 	return write(ctx->control_fd, buffer, len);
 }
 
+/* The header written before each message, if any. */
+static size_t
+control_headerlen(const struct fd_data *data)
+{
+
+	if (data->data_flags & FD_BINARY)
+		return sizeof(struct control_frame);
+	if (data->data_flags & FD_SENDLEN)
+		return sizeof(size_t);
+	return 0;
+}
+
 static void
-control_writeone(void *arg)
+control_write(void *arg)
 {
 	struct fd_list *fd;
-	struct iovec iov[2];
+	struct iovec iov[CONTROL_WRITEV_MSGS * 2], *v;
+	struct control_frame cf[CONTROL_WRITEV_MSGS];
+	struct fd_data *data, *datan;
+	size_t msgs, skip, total;
+	ssize_t wrote;
 	int iov_len;
-	struct fd_data *data;
 
 	fd = arg;
-	data = TAILQ_FIRST(&fd->queue);
-
-	if (data->data_flags & FD_SENDLEN) {
-		iov[0].iov_base = &data->data_len;
-		iov[0].iov_len = sizeof(size_t);
-		iov[1].iov_base = data->data;
-		iov[1].iov_len = data->data_len;
-		iov_len = 2;
-	} else {
-		iov[0].iov_base = data->data;
-		iov[0].iov_len = data->data_len;
-		iov_len = 1;
+
+	/* Batch as much of the queue as we can into one writev(2). */
+	v = iov;
+	msgs = 0;
+	TAILQ_FOREACH(data, &fd->queue, next) {
+		if (msgs == CONTROL_WRITEV_MSGS)
+			break;
+		if (data->data_flags & FD_BINARY) {
+			struct control_frame *cfp = &cf[msgs];
+
+			cfp->cf_magic = CONTROL_FRAME_MAGIC;
+			cfp->cf_version = CONTROL_FRAME_VERSION;
+			cfp->cf_type = data->data_flags & FD_LISTEN ?
+			    CONTROL_FRAME_EVENT : CONTROL_FRAME_REPLY;
+			cfp->cf_len = (uint32_t)data->data_len;
+			v->iov_base = cfp;
+			v->iov_len = sizeof(*cfp);
+			v++;
+		} else if (data->data_flags & FD_SENDLEN) {
+			v->iov_base = &data->data_len;
+			v->iov_len = sizeof(size_t);
+			v++;
+		}
+		v->iov_base = data->data;
+		v->iov_len = data->data_len;
+		v++;
+		msgs++;
+	}
+	iov_len = (int)(v - iov);
+
+	/* Skip over any partially written head message. */
+	skip = fd->queue_sent;
+	v = iov;
+	while (skip != 0) {
+		if (skip >= v->iov_len) {
+			skip -= v->iov_len;
+			v->iov_len = 0;
+		} else {
+			v->iov_base = (char *)v->iov_base + skip;
+			v->iov_len -= skip;
+			skip = 0;
+		}
+		v++;
 	}
 
-	if (writev(fd->fd, iov, iov_len) == -1) {
+	wrote = writev(fd->fd, iov, iov_len);
+	if (wrote == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return;
 		logerr("%s: write", __func__);
 		control_delete(fd);
 		return;
 	}
 
-	TAILQ_REMOVE(&fd->queue, data, next);
+	/* Release the messages written in full. */
+	fd->queue_sent += (size_t)wrote;
+	TAILQ_FOREACH_SAFE(data, &fd->queue, next, datan) {
+		total = control_headerlen(data) + data->data_len;
+		if (fd->queue_sent < total)
+			break;
+		fd->queue_sent -= total;
+		fd->queue_len--;
+		TAILQ_REMOVE(&fd->queue, data, next);
 #ifdef CTL_FREE_LIST
-	TAILQ_INSERT_TAIL(&fd->free_queue, data, next);
+		TAILQ_INSERT_TAIL(&fd->free_queue, data, next);
 #else
-	if (data->data_size != 0)
-		free(data->data);
-	free(data);
+		if (data->data_size != 0)
+			free(data->data);
+		free(data);
 #endif
+	}
 
 	if (TAILQ_FIRST(&fd->queue) != NULL)
 		return;
@@ -551,6 +730,14 @@ control_queue(struct fd_list *fd, void *data, size_t data_len)
 		return -1;
 	}
 
+	/* Cap the queue for listeners - event flow is endless so a stuck
+	 * client would balloon it.  Replies are finite and reads are
+	 * driven by the client, so they are not capped. */
+	if (fd->flags & FD_LISTEN && fd->queue_len >= CONTROL_QUEUE_MAX) {
+		errno = ENOBUFS;
+		return -1;
+	}
+
 #ifdef CTL_FREE_LIST
 	struct fd_data *df;
 
@@ -586,9 +773,10 @@ control_queue(struct fd_list *fd, void *data, size_t data_len)
 	}
 	memcpy(d->data, data, data_len);
 	d->data_len = data_len;
-	d->data_flags = fd->flags & FD_SENDLEN;
+	d->data_flags = fd->flags & (FD_SENDLEN | FD_BINARY | FD_LISTEN);
 
 	TAILQ_INSERT_TAIL(&fd->queue, d, next);
-	eloop_event_add_w(fd->ctx->eloop, fd->fd, control_writeone, fd);
+	fd->queue_len++;
+	eloop_event_add_w(fd->ctx->eloop, fd->fd, control_write, fd);
 	return 0;
 }
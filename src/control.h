@@ -30,6 +30,7 @@
 #define CONTROL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "dhcpcd.h"
 
@@ -39,9 +40,14 @@
 #undef	CTL_FREE_LIST
 #endif
 
-/* Limit queue size per fd */
+/* Limit queue size per fd.
+ * A client which cannot drain this many messages is disconnected
+ * rather than letting its queue grow without bound. */
 #define CONTROL_QUEUE_MAX	100
 
+/* Maximum messages batched into one writev(2) call. */
+#define CONTROL_WRITEV_MSGS	16
+
 struct fd_data {
 	TAILQ_ENTRY(fd_data) next;
 	void *data;
@@ -56,6 +62,12 @@ struct fd_list {
 	struct dhcpcd_ctx *ctx;
 	int fd;
 	unsigned int flags;
+	/* fnmatch(3) patterns limiting events sent to a listener,
+	 * empty patterns match everything. */
+	char listen_if[IF_NAMESIZE];
+	char listen_reason[32];
+	size_t queue_len;	/* messages queued */
+	size_t queue_sent;	/* bytes of the head message written */
 	struct fd_data_head queue;
 #ifdef CTL_FREE_LIST
 	struct fd_data_head free_queue;
@@ -66,6 +78,33 @@ TAILQ_HEAD(fd_list_head, fd_list);
 #define	FD_LISTEN	0x01U
 #define	FD_UNPRIV	0x02U
 #define	FD_SENDLEN	0x04U
+#define	FD_BINARY	0x08U
+
+/*
+ * Optional binary framing for the control socket.
+ * A client whose first byte is CONTROL_FRAME_MAGIC switches the
+ * connection to framed mode: each command and each reply is a frame
+ * header followed by cf_len bytes of payload, so clients can pipeline
+ * commands and parse replies without any ambiguity.
+ * Command payloads are NUL separated arguments, reply and event
+ * payloads are the same as the text protocol.
+ * Frames are in host byte order as the socket is local.
+ * Not available with privilege separation, where replies already
+ * carry a length prefix.
+ */
+#define	CONTROL_FRAME_MAGIC	0xD1
+#define	CONTROL_FRAME_VERSION	1
+
+#define	CONTROL_FRAME_COMMAND	1
+#define	CONTROL_FRAME_REPLY	2
+#define	CONTROL_FRAME_EVENT	3
+
+struct control_frame {
+	uint8_t cf_magic;
+	uint8_t cf_version;
+	uint16_t cf_type;
+	uint32_t cf_len;	/* payload length */
+};
 
 int control_start(struct dhcpcd_ctx *, const char *, sa_family_t);
 int control_stop(struct dhcpcd_ctx *);
@@ -75,5 +114,6 @@ struct fd_list *control_new(struct dhcpcd_ctx *, int, unsigned int);
 void control_free(struct fd_list *);
 void control_delete(struct fd_list *);
 int control_queue(struct fd_list *, void *, size_t);
+bool control_listen_match(const struct fd_list *, const char *, size_t);
 void control_recvdata(struct fd_list *fd, char *, size_t);
 #endif
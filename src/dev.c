@@ -68,10 +68,20 @@ dev_listening(struct dhcpcd_ctx *ctx)
 	return ctx->dev->listening();
 }
 
+/* Plugin startup is deferred to the eloop so a slow device manager
+ * cannot hold up lease acquisition on interfaces the kernel already
+ * knows about.  Until the plugin is up, dev_initialised() passes all
+ * interfaces and dev_listening() leaves announcements to the kernel;
+ * the plugin's own events reconcile its view once it arrives. */
+static int (*dev_handler)(void *, int, const char *);
+
+static void dev_start_cb(void *);
+
 static void
 dev_stop1(struct dhcpcd_ctx *ctx, int stop)
 {
 
+	eloop_timeout_delete(ctx->eloop, dev_start_cb, ctx);
 	if (ctx->dev) {
 		if (stop)
 			logdebugx("dev: unloaded %s", ctx->dev->name);
@@ -177,18 +187,14 @@ dev_handle_data(void *arg)
 	}
 }
 
-int
-dev_start(struct dhcpcd_ctx *ctx, int (*handler)(void *, int, const char *))
+static void
+dev_start_cb(void *arg)
 {
+	struct dhcpcd_ctx *ctx = arg;
 	struct dev_dhcpcd dev_dhcpcd = {
-		.handle_interface = handler,
+		.handle_interface = dev_handler,
 	};
 
-	if (ctx->dev_fd != -1) {
-		logerrx("%s: already started on fd %d", __func__, ctx->dev_fd);
-		return ctx->dev_fd;
-	}
-
 	ctx->dev_fd = dev_start1(ctx, &dev_dhcpcd);
 	if (ctx->dev_fd != -1) {
 		if (eloop_event_add(ctx->eloop, ctx->dev_fd,
@@ -196,9 +202,24 @@ dev_start(struct dhcpcd_ctx *ctx, int (*handler)(void *, int, const char *))
 		{
 			logerr(__func__);
 			dev_stop1(ctx, 1);
-			return -1;
 		}
 	}
+}
+
+int
+dev_start(struct dhcpcd_ctx *ctx, int (*handler)(void *, int, const char *))
+{
+
+	if (ctx->dev_fd != -1) {
+		logerrx("%s: already started on fd %d", __func__, ctx->dev_fd);
+		return ctx->dev_fd;
+	}
+
+	dev_handler = handler;
+	if (eloop_timeout_add_sec(ctx->eloop, 0, dev_start_cb, ctx) == -1) {
+		logerr(__func__);
+		return -1;
+	}
 
-	return ctx->dev_fd;
+	return 0;
 }
@@ -35,6 +35,7 @@
 #endif
 
 #include <libudev.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "../common.h"
@@ -48,6 +49,17 @@ static struct udev_monitor *monitor;
 
 static struct dev_dhcpcd dhcpcd;
 
+/* Boot time coldplug replays every device serially and each event
+ * used to wake dhcpcd separately.  Instead we drain the monitor,
+ * dedupe by interface name and deliver one batch per wakeup. */
+struct udev_batched {
+	char ifname[IF_NAMESIZE];
+	int action;		/* last action seen, 1 add, -1 remove */
+	int first_action;	/* action which created this entry */
+};
+static struct udev_batched *udev_batch;
+static size_t udev_batch_size;
+
 static int
 udev_listening(void)
 {
@@ -74,11 +86,37 @@ udev_initialised(const char *ifname)
 	return r;
 }
 
+static int
+udev_batch_device(const char *ifname, int action)
+{
+	struct udev_batched *b;
+	size_t i;
+
+	for (i = 0; i < udev_batch_size; i++) {
+		b = &udev_batch[i];
+		if (strcmp(b->ifname, ifname) == 0) {
+			b->action = action;
+			return 0;
+		}
+	}
+
+	b = reallocarray(udev_batch, udev_batch_size + 1, sizeof(*b));
+	if (b == NULL)
+		return -1;
+	udev_batch = b;
+	b = &udev_batch[udev_batch_size++];
+	strlcpy(b->ifname, ifname, sizeof(b->ifname));
+	b->action = b->first_action = action;
+	return 0;
+}
+
 static int
 udev_handle_device(void *ctx)
 {
 	struct udev_device *device;
 	const char *subsystem, *ifname, *action;
+	struct udev_batched *b;
+	size_t i;
 
 	device = udev_monitor_receive_device(monitor);
 	if (device == NULL) {
@@ -86,20 +124,44 @@ udev_handle_device(void *ctx)
 		return -1;
 	}
 
-	subsystem = udev_device_get_subsystem(device);
-	ifname = udev_device_get_sysname(device);
-	action = udev_device_get_action(device);
-
-	/* udev filter documentation says "usually" so double check */
-	if (strcmp(subsystem, "net") == 0) {
-		logdebugx("%s: libudev: %s", ifname, action);
-		if (strcmp(action, "add") == 0 || strcmp(action, "move") == 0)
-			dhcpcd.handle_interface(ctx, 1, ifname);
-		else if (strcmp(action, "remove") == 0)
-			dhcpcd.handle_interface(ctx, -1, ifname);
+	/* Drain the monitor so a coldplug replay becomes one batch. */
+	udev_batch_size = 0;
+	do {
+		subsystem = udev_device_get_subsystem(device);
+		ifname = udev_device_get_sysname(device);
+		action = udev_device_get_action(device);
+
+		/* udev filter documentation says "usually" so double check */
+		if (strcmp(subsystem, "net") == 0) {
+			logdebugx("%s: libudev: %s", ifname, action);
+			if (strcmp(action, "add") == 0 ||
+			    strcmp(action, "move") == 0)
+			{
+				if (udev_batch_device(ifname, 1) == -1)
+					dhcpcd.handle_interface(ctx, 1, ifname);
+			} else if (strcmp(action, "remove") == 0) {
+				if (udev_batch_device(ifname, -1) == -1)
+					dhcpcd.handle_interface(ctx, -1,
+					    ifname);
+			}
+		}
+
+		udev_device_unref(device);
+	} while ((device = udev_monitor_receive_device(monitor)) != NULL);
+
+	for (i = 0; i < udev_batch_size; i++) {
+		b = &udev_batch[i];
+		/* A device which appeared and vanished within one batch
+		 * never existed as far as dhcpcd is concerned. */
+		if (b->first_action == 1 && b->action == -1) {
+			logdebugx("%s: libudev: add/remove debounced",
+			    b->ifname);
+			continue;
+		}
+		dhcpcd.handle_interface(ctx, b->action, b->ifname);
 	}
+	udev_batch_size = 0;
 
-	udev_device_unref(device);
 	return 1;
 }
 
@@ -112,6 +174,10 @@ udev_stop(void)
 		monitor = NULL;
 	}
 
+	free(udev_batch);
+	udev_batch = NULL;
+	udev_batch_size = 0;
+
 	if (udev) {
 		udev_unref(udev);
 		udev = NULL;
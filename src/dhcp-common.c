@@ -32,8 +32,10 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "config.h"
@@ -41,8 +43,10 @@
 #include "common.h"
 #include "dhcp-common.h"
 #include "dhcp.h"
+#include "eloop.h"
 #include "if.h"
 #include "ipv6.h"
+#include "leasedb.h"
 #include "logerr.h"
 #include "script.h"
 
@@ -149,12 +153,34 @@ vivso_find(uint32_t iana_en, const void *arg)
 	    i++, opt++)
 		if (opt->option == iana_en)
 			return opt;
-	for (i = 0, opt = ifp->ctx->vivso;
-	    i < ifp->ctx->vivso_len;
-	    i++, opt++)
-		if (opt->option == iana_en)
-			return opt;
-	return NULL;
+	/* The embedded definitions are sorted at load. */
+	return dhcp_findoption(ifp->ctx->vivso, ifp->ctx->vivso_len, iana_en);
+}
+
+static int
+dhcp_opt_cmp(const void *a, const void *b)
+{
+	const struct dhcp_opt *oa = a, *ob = b;
+
+	return oa->option < ob->option ? -1 :
+	    (oa->option > ob->option ? 1 : 0);
+}
+
+/* The embedded option definitions are sorted by code once at startup
+ * so that per-packet definition lookups can binary search them. */
+void
+dhcp_sortoptions(struct dhcp_opt *opts, size_t opts_len)
+{
+
+	qsort(opts, opts_len, sizeof(*opts), dhcp_opt_cmp);
+}
+
+struct dhcp_opt *
+dhcp_findoption(const struct dhcp_opt *opts, size_t opts_len, uint32_t code)
+{
+	struct dhcp_opt key = { .option = code };
+
+	return bsearch(&key, opts, opts_len, sizeof(*opts), dhcp_opt_cmp);
 }
 
 ssize_t
@@ -204,34 +230,30 @@ make_option_mask(const struct dhcp_opt *dopts, size_t dopts_len,
 			token += 6;
 		if (strncmp(token, "nd_", 3) == 0)
 			token += 3;
+		/* Parse any numeric code once rather than per definition. */
+		n = (unsigned int)strtou(token, NULL, 0, 0, UINT_MAX, &e);
 		match = 0;
 		for (i = 0, opt = odopts; i < odopts_len; i++, opt++) {
 			if (opt->var == NULL || opt->option == 0)
 				continue; /* buggy dhcpcd-definitions.conf */
-			if (strcmp(opt->var, token) == 0)
+			if (strcmp(opt->var, token) == 0 ||
+			    (e == 0 && opt->option == n))
+			{
 				match = 1;
-			else {
-				n = (unsigned int)strtou(token, NULL, 0,
-				    0, UINT_MAX, &e);
-				if (e == 0 && opt->option == n)
-					match = 1;
-			}
-			if (match)
 				break;
+			}
 		}
 		if (match == 0) {
 			for (i = 0, opt = dopts; i < dopts_len; i++, opt++) {
-				if (strcmp(opt->var, token) == 0)
-				        match = 1;
-				else {
-					n = (unsigned int)strtou(token, NULL, 0,
-					    0, UINT_MAX, &e);
-					if (e == 0 && opt->option == n)
-						match = 1;
-				}
-				if (match)
+				if (strcmp(opt->var, token) == 0) {
+					match = 1;
 					break;
+				}
 			}
+			/* The definitions are sorted by code. */
+			if (match == 0 && e == 0 &&
+			    (opt = dhcp_findoption(dopts, dopts_len, n)))
+				match = 1;
 		}
 		if (!match || !opt->option) {
 			free(o);
@@ -621,6 +643,53 @@ dhcp_optlen(const struct dhcp_opt *opt, size_t dl)
 	return (ssize_t)sz;
 }
 
+/* Manual formatters for the hot conversions.
+ * The script env for a full lease emits hundreds of values into the
+ * memory stream and the stdio format machinery dominates that cost. */
+static size_t
+print_uint(char *buf, uint32_t n)
+{
+	char tmp[10];
+	size_t i = 0, l = 0;
+
+	do {
+		tmp[i++] = (char)('0' + n % 10);
+		n /= 10;
+	} while (n != 0);
+	while (i != 0)
+		buf[l++] = tmp[--i];
+	return l;
+}
+
+static size_t
+print_int(char *buf, int32_t n)
+{
+	size_t l = 0;
+	uint32_t u;
+
+	if (n < 0) {
+		buf[l++] = '-';
+		u = 0U - (uint32_t)n;
+	} else
+		u = (uint32_t)n;
+	return l + print_uint(buf + l, u);
+}
+
+static size_t
+print_addripv4(char *buf, const uint8_t *data)
+{
+	size_t l;
+
+	l = print_uint(buf, data[0]);
+	buf[l++] = '.';
+	l += print_uint(buf + l, data[1]);
+	buf[l++] = '.';
+	l += print_uint(buf + l, data[2]);
+	buf[l++] = '.';
+	l += print_uint(buf + l, data[3]);
+	return l;
+}
+
 static ssize_t
 print_option(FILE *fp, const char *prefix, const struct dhcp_opt *opt,
     int vname,
@@ -632,7 +701,6 @@ print_option(FILE *fp, const char *prefix, const struct dhcp_opt *opt,
 	int16_t s16;
 	uint32_t u32;
 	int32_t s32;
-	struct in_addr addr;
 	ssize_t sl;
 	size_t l;
 
@@ -643,13 +711,13 @@ print_option(FILE *fp, const char *prefix, const struct dhcp_opt *opt,
 
 	if (fgetpos(fp, &fp_pos) == -1)
 		return -1;
-	if (fprintf(fp, "%s", prefix) == -1)
+	if (fputs(prefix, fp) == EOF)
 		goto err;
 
 	/* We printed something, so always goto err from now-on
 	 * to terminate the string. */
 	if (vname) {
-		if (fprintf(fp, "_%s", opt->var) == -1)
+		if (fputc('_', fp) == EOF || fputs(opt->var, fp) == EOF)
 			goto err;
 	}
 	if (fputc('=', fp) == EOF)
@@ -711,63 +779,59 @@ print_option(FILE *fp, const char *prefix, const struct dhcp_opt *opt,
 	t = data;
 	e = data + dl;
 	while (data < e) {
+		char buf[INET6_ADDRSTRLEN];
+		size_t bl;
+
 		if (data != t) {
 			if (fputc(' ', fp) == EOF)
 				goto err;
 		}
 		if (opt->type & OT_UINT8) {
-			if (fprintf(fp, "%u", *data) == -1)
-				goto err;
+			bl = print_uint(buf, *data);
 			data++;
 		} else if (opt->type & OT_INT8) {
-			if (fprintf(fp, "%d", *data) == -1)
-				goto err;
+			bl = print_int(buf, *data);
 			data++;
 		} else if (opt->type & OT_UINT16) {
 			memcpy(&u16, data, sizeof(u16));
-			u16 = ntohs(u16);
-			if (fprintf(fp, "%u", u16) == -1)
-				goto err;
+			bl = print_uint(buf, ntohs(u16));
 			data += sizeof(u16);
 		} else if (opt->type & OT_INT16) {
 			memcpy(&u16, data, sizeof(u16));
 			s16 = (int16_t)ntohs(u16);
-			if (fprintf(fp, "%d", s16) == -1)
-				goto err;
+			bl = print_int(buf, s16);
 			data += sizeof(u16);
 		} else if (opt->type & OT_UINT32) {
 			memcpy(&u32, data, sizeof(u32));
-			u32 = ntohl(u32);
-			if (fprintf(fp, "%u", u32) == -1)
-				goto err;
+			bl = print_uint(buf, ntohl(u32));
 			data += sizeof(u32);
 		} else if (opt->type & OT_INT32) {
 			memcpy(&u32, data, sizeof(u32));
 			s32 = (int32_t)ntohl(u32);
-			if (fprintf(fp, "%d", s32) == -1)
-				goto err;
+			bl = print_int(buf, s32);
 			data += sizeof(u32);
 		} else if (opt->type & OT_ADDRIPV4) {
-			memcpy(&addr.s_addr, data, sizeof(addr.s_addr));
-			if (fprintf(fp, "%s", inet_ntoa(addr)) == -1)
-				goto err;
-			data += sizeof(addr.s_addr);
+			bl = print_addripv4(buf, data);
+			data += sizeof(uint32_t);
 		} else if (opt->type & OT_ADDRIPV6) {
-			char buf[INET6_ADDRSTRLEN];
-
 			if (inet_ntop(AF_INET6, data, buf, sizeof(buf)) == NULL)
 				goto err;
-			if (fprintf(fp, "%s", buf) == -1)
+			bl = strlen(buf);
+			if (fwrite(buf, 1, bl, fp) != bl)
 				goto err;
 			if (data[0] == 0xfe && (data[1] & 0xc0) == 0x80) {
-				if (fprintf(fp,"%%%s", ifname) == -1)
+				if (fputc('%', fp) == EOF ||
+				    fputs(ifname, fp) == EOF)
 					goto err;
 			}
 			data += 16;
+			continue;
 		} else {
 			errno = EINVAL;
 			goto err;
 		}
+		if (fwrite(buf, 1, bl, fp) != bl)
+			goto err;
 	}
 
 done:
@@ -824,9 +888,9 @@ dhcp_envoption(struct dhcpcd_ctx *ctx, FILE *fp, const char *prefix,
 	ssize_t eo;
 	unsigned int eoc;
 	const uint8_t *eod;
-	int ov;
+	int ov, pfxl;
 	struct dhcp_opt *eopt, *oopt;
-	char *pfx;
+	char pfxbuf[256], *pfx;
 
 	/* If no embedded or encapsulated options, it's easy */
 	if (opt->embopts_len == 0 && opt->encopts_len == 0) {
@@ -837,10 +901,24 @@ dhcp_envoption(struct dhcpcd_ctx *ctx, FILE *fp, const char *prefix,
 		return;
 	}
 
-	/* Create a new prefix based on the option */
-	if (opt->type & OT_INDEX) {
+	/* Create a new prefix based on the option.
+	 * Prefixes nearly always fit on the stack - only fall back to
+	 * the heap for pathological nesting. */
+	if (opt->type & OT_INDEX)
+		pfxl = snprintf(pfxbuf, sizeof(pfxbuf), "%s_%s%d",
+		    prefix, opt->var, ++opt->index);
+	else
+		pfxl = snprintf(pfxbuf, sizeof(pfxbuf), "%s_%s",
+		    prefix, opt->var);
+	if (pfxl < 0) {
+		logerr(__func__);
+		return;
+	}
+	if ((size_t)pfxl < sizeof(pfxbuf))
+		pfx = pfxbuf;
+	else if (opt->type & OT_INDEX) {
 		if (asprintf(&pfx, "%s_%s%d",
-		    prefix, opt->var, ++opt->index) == -1)
+		    prefix, opt->var, opt->index) == -1)
 			pfx = NULL;
 	} else {
 		if (asprintf(&pfx, "%s_%s", prefix, opt->var) == -1)
@@ -929,7 +1007,8 @@ dhcp_envoption(struct dhcpcd_ctx *ctx, FILE *fp, const char *prefix,
 	}
 
 out:
-	free(pfx);
+	if (pfx != pfxbuf)
+		free(pfx);
 }
 
 void
@@ -976,6 +1055,462 @@ dhcp_writefile(struct dhcpcd_ctx *ctx, const char *file, mode_t mode,
 	return writefile(file, mode, data, len);
 }
 
+/* RFC 1071 checksum, the same algorithm IP uses. */
+static uint16_t
+dhcp_lease_cksum(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint32_t sum = 0;
+
+	while (len > 1) {
+		sum += (uint32_t)((p[0] << 8) | p[1]);
+		p += 2;
+		len -= 2;
+	}
+	if (len == 1)
+		sum += (uint32_t)(p[0] << 8);
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return (uint16_t)~sum;
+}
+
+/* Validate and strip the lease header in place.
+ * Returns the message length or -1 on a corrupt lease.
+ * acquired is set to the stored acquisition time,
+ * or -1 for a legacy lease without a header. */
+ssize_t
+dhcp_leaseextract(void *data, size_t len, time_t *acquired)
+{
+	struct dhcp_lease_hdr hdr;
+
+	if (acquired != NULL)
+		*acquired = (time_t)-1;
+
+	if (len < sizeof(hdr))
+		return (ssize_t)len;
+	memcpy(&hdr, data, sizeof(hdr));
+	if (hdr.magic != DHCP_LEASE_MAGIC)
+		/* Legacy lease - a raw message dump. */
+		return (ssize_t)len;
+
+	if (hdr.version != DHCP_LEASE_VERSION ||
+	    hdr.len != len - sizeof(hdr) ||
+	    hdr.cksum != dhcp_lease_cksum((char *)data + sizeof(hdr), hdr.len))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (acquired != NULL)
+		*acquired = (time_t)hdr.acquired;
+	memmove(data, (char *)data + sizeof(hdr), hdr.len);
+	return (ssize_t)hdr.len;
+}
+
+static struct dhcp_lease_write *
+dhcp_findleasewrite(struct dhcpcd_ctx *ctx, const char *file)
+{
+	struct dhcp_lease_write *lw;
+
+	TAILQ_FOREACH(lw, &ctx->lease_writes, next) {
+		if (strcmp(lw->file, file) == 0)
+			return lw;
+	}
+	return NULL;
+}
+
+static void
+dhcp_freeleasewrite(struct dhcpcd_ctx *ctx, struct dhcp_lease_write *lw)
+{
+
+	TAILQ_REMOVE(&ctx->lease_writes, lw, next);
+	free(lw->file);
+	free(lw->data);
+	free(lw);
+}
+
+static struct dhcp_lease_fd *
+dhcp_findleasefd(struct dhcpcd_ctx *ctx, const char *file)
+{
+	struct dhcp_lease_fd *lf;
+
+	TAILQ_FOREACH(lf, &ctx->lease_fds, next) {
+		if (strcmp(lf->file, file) == 0)
+			return lf;
+	}
+	return NULL;
+}
+
+static void
+dhcp_dropleasefd(struct dhcpcd_ctx *ctx, const char *file)
+{
+	struct dhcp_lease_fd *lf;
+
+	lf = dhcp_findleasefd(ctx, file);
+	if (lf == NULL)
+		return;
+	TAILQ_REMOVE(&ctx->lease_fds, lf, next);
+	close(lf->fd);
+	free(lf->file);
+	free(lf);
+}
+
+void
+dhcp_closeleasefds(struct dhcpcd_ctx *ctx)
+{
+	struct dhcp_lease_fd *lf;
+
+	while ((lf = TAILQ_FIRST(&ctx->lease_fds)) != NULL) {
+		TAILQ_REMOVE(&ctx->lease_fds, lf, next);
+		close(lf->fd);
+		free(lf->file);
+		free(lf);
+	}
+}
+
+#ifdef PRIVSEP
+static int
+dhcp_leasefd(struct dhcpcd_ctx *ctx, const char *file, mode_t mode)
+{
+	struct dhcp_lease_fd *lf;
+	int fd;
+
+	lf = dhcp_findleasefd(ctx, file);
+	if (lf != NULL)
+		return lf->fd;
+
+	fd = ps_root_openfile(ctx, file, mode);
+	if (fd == -1)
+		return -1;
+	/* O_CLOEXEC is not preserved over descriptor passing. */
+	if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+		goto err;
+	lf = malloc(sizeof(*lf));
+	if (lf == NULL)
+		goto err;
+	lf->file = strdup(file);
+	if (lf->file == NULL) {
+		free(lf);
+		goto err;
+	}
+	lf->fd = fd;
+	TAILQ_INSERT_TAIL(&ctx->lease_fds, lf, next);
+	return fd;
+
+err:
+	close(fd);
+	return -1;
+}
+#endif
+
+static ssize_t
+dhcp_writeleasefile(struct dhcpcd_ctx *ctx, const char *file, mode_t mode,
+    const void *data, size_t len)
+{
+
+#ifdef PRIVSEP
+	/* Write through a descriptor the privileged proxy opened for us
+	 * so the lease payload is not copied over the socket on every
+	 * commit.  Only the first commit pays for the round trip. */
+	if (ctx->options & DHCPCD_PRIVSEP &&
+	    !(ctx->options & DHCPCD_PRIVSEPROOT))
+	{
+		ssize_t bytes;
+		int fd;
+
+		fd = dhcp_leasefd(ctx, file, mode);
+		if (fd != -1) {
+			if (lseek(fd, 0, SEEK_SET) != -1 &&
+			    (bytes = write(fd, data, len)) != -1 &&
+			    ftruncate(fd, (off_t)len) != -1)
+				return bytes;
+			/* Drop the descriptor and fall back
+			 * to the proxied write. */
+			dhcp_dropleasefd(ctx, file);
+		}
+	}
+#endif
+
+	return dhcp_writefile(ctx, file, mode, data, len);
+}
+
+static void
+dhcp_writeleases(void *arg)
+{
+	struct dhcpcd_ctx *ctx = arg;
+	struct dhcp_lease_write *lw;
+	ssize_t bytes;
+
+	while ((lw = TAILQ_FIRST(&ctx->lease_writes)) != NULL) {
+		if (ctx->leasedb != NULL)
+			bytes = dhcp_leasedb_write(ctx, lw->file,
+			    lw->data, lw->len);
+		else
+			bytes = dhcp_writeleasefile(ctx, lw->file, lw->mode,
+			    lw->data, lw->len);
+		if (bytes == -1)
+			logerr("%s: %s", __func__, lw->file);
+		dhcp_freeleasewrite(ctx, lw);
+	}
+}
+
+void
+dhcp_flushleases(struct dhcpcd_ctx *ctx)
+{
+
+	if (ctx->eloop != NULL)
+		eloop_timeout_delete(ctx->eloop, dhcp_writeleases, ctx);
+	dhcp_writeleases(ctx);
+}
+
+static struct dhcp_lease_read *
+dhcp_findleaseread(struct dhcpcd_ctx *ctx, const char *file)
+{
+	struct dhcp_lease_read *lr;
+
+	TAILQ_FOREACH(lr, &ctx->lease_reads, next) {
+		if (strcmp(lr->file, file) == 0)
+			return lr;
+	}
+	return NULL;
+}
+
+static void
+dhcp_dropleaseread(struct dhcpcd_ctx *ctx, struct dhcp_lease_read *lr)
+{
+
+	TAILQ_REMOVE(&ctx->lease_reads, lr, next);
+	free(lr->file);
+	free(lr->data);
+	free(lr);
+}
+
+void
+dhcp_freeleasereads(struct dhcpcd_ctx *ctx)
+{
+	struct dhcp_lease_read *lr;
+
+	while ((lr = TAILQ_FIRST(&ctx->lease_reads)) != NULL)
+		dhcp_dropleaseread(ctx, lr);
+}
+
+static void
+dhcp_preloadlease(struct dhcpcd_ctx *ctx, const char *file,
+    void *buf, size_t buflen)
+{
+	struct dhcp_lease_read *lr;
+	ssize_t bytes;
+
+	if (dhcp_findleaseread(ctx, file) != NULL)
+		return;
+	/* Most interfaces will simply have no lease yet. */
+	bytes = dhcp_readfile(ctx, file, buf, buflen);
+	if (bytes == -1)
+		return;
+
+	/* The cache is only advisory, so on any failure the lease
+	 * is just read again from the file. */
+	lr = malloc(sizeof(*lr));
+	if (lr == NULL)
+		return;
+	lr->file = strdup(file);
+	lr->data = malloc((size_t)bytes);
+	if (lr->file == NULL || lr->data == NULL) {
+		free(lr->file);
+		free(lr->data);
+		free(lr);
+		return;
+	}
+	memcpy(lr->data, buf, (size_t)bytes);
+	lr->len = (size_t)bytes;
+	TAILQ_INSERT_TAIL(&ctx->lease_reads, lr, next);
+}
+
+#ifdef POSIX_FADV_WILLNEED
+static void
+dhcp_leasewillneed(const char *file)
+{
+	int fd;
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return;
+	(void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	close(fd);
+}
+#endif
+
+void
+dhcp_preloadleases(struct dhcpcd_ctx *ctx)
+{
+	struct interface *ifp;
+	char file[PATH_MAX];
+	uint8_t *buf;
+
+	/* The consolidated database is already one sequential read. */
+	if (ctx->leasedb != NULL)
+		return;
+
+#ifdef POSIX_FADV_WILLNEED
+	/* Ask the kernel to start fetching every lease before the
+	 * first one is parsed, so a cold cache fills with one batch
+	 * of I/O instead of demand paging file by file.
+	 * When sandboxed the privileged process owns the files and
+	 * already reads them back to back on our behalf. */
+	if (!(ctx->options & DHCPCD_PRIVSEP)) {
+		TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+			if (!ifp->active)
+				continue;
+#ifdef INET
+			if (ifp->options->options & DHCPCD_DHCP &&
+			    dhcp_set_leasefile(file, sizeof(file),
+			    AF_INET, ifp) > 0)
+				dhcp_leasewillneed(file);
+#endif
+#ifdef DHCP6
+			if (ifp->options->options & DHCPCD_DHCP6 &&
+			    dhcp_set_leasefile(file, sizeof(file),
+			    AF_INET6, ifp) > 0)
+				dhcp_leasewillneed(file);
+#endif
+		}
+	}
+#endif
+
+	buf = malloc(UDPLEN_MAX);
+	if (buf == NULL) {
+		logerr(__func__);
+		return;
+	}
+	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+		if (!ifp->active)
+			continue;
+#ifdef INET
+		if (ifp->options->options & DHCPCD_DHCP &&
+		    dhcp_set_leasefile(file, sizeof(file), AF_INET, ifp) > 0)
+			dhcp_preloadlease(ctx, file, buf, UDPLEN_MAX);
+#endif
+#ifdef DHCP6
+		if (ifp->options->options & DHCPCD_DHCP6 &&
+		    dhcp_set_leasefile(file, sizeof(file), AF_INET6, ifp) > 0)
+			dhcp_preloadlease(ctx, file, buf, UDPLEN_MAX);
+#endif
+	}
+	free(buf);
+}
+
+ssize_t
+dhcp_readlease(struct dhcpcd_ctx *ctx, const char *file,
+    void *data, size_t len, time_t *acquired)
+{
+	struct dhcp_lease_write *lw;
+	struct dhcp_lease_read *lr;
+	ssize_t bytes;
+
+	/* A commit may still be queued for writing. */
+	lw = dhcp_findleasewrite(ctx, file);
+	if (lw != NULL) {
+		if (lw->len > len) {
+			errno = ENOBUFS;
+			return -1;
+		}
+		memcpy(data, lw->data, lw->len);
+		return dhcp_leaseextract(data, lw->len, acquired);
+	}
+
+	/* The lease may have been preloaded at startup. */
+	lr = dhcp_findleaseread(ctx, file);
+	if (lr != NULL) {
+		if (lr->len > len) {
+			dhcp_dropleaseread(ctx, lr);
+			errno = ENOBUFS;
+			return -1;
+		}
+		memcpy(data, lr->data, lr->len);
+		bytes = (ssize_t)lr->len;
+		dhcp_dropleaseread(ctx, lr);
+		return dhcp_leaseextract(data, (size_t)bytes, acquired);
+	}
+
+	if (ctx->leasedb != NULL) {
+		bytes = dhcp_leasedb_read(ctx, file, data, len);
+		if (bytes != -1)
+			return dhcp_leaseextract(data, (size_t)bytes,
+			    acquired);
+		/* Fall through to the flat file to migrate old leases. */
+	}
+
+	bytes = dhcp_readfile(ctx, file, data, len);
+	if (bytes == -1) {
+		if (acquired != NULL)
+			*acquired = (time_t)-1;
+		return -1;
+	}
+	return dhcp_leaseextract(data, (size_t)bytes, acquired);
+}
+
+ssize_t
+dhcp_writelease(struct dhcpcd_ctx *ctx, const char *file, mode_t mode,
+    const void *data, size_t len)
+{
+	struct dhcp_lease_hdr hdr = {
+	    .magic = DHCP_LEASE_MAGIC,
+	    .version = DHCP_LEASE_VERSION,
+	    .len = (uint32_t)len,
+	    .cksum = dhcp_lease_cksum(data, len),
+	    .acquired = (int64_t)time(NULL),
+	};
+	struct dhcp_lease_write *lw;
+	uint8_t *buf;
+	bool was_empty;
+
+	if (len > UINT32_MAX - sizeof(hdr)) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	buf = malloc(sizeof(hdr) + len);
+	if (buf == NULL)
+		return -1;
+	memcpy(buf, &hdr, sizeof(hdr));
+	memcpy(buf + sizeof(hdr), data, len);
+
+	/* Commit in memory and write behind from the eloop so a slow
+	 * or contended filesystem cannot stall the state machine.
+	 * A queued commit for the same lease is simply superseded. */
+	lw = dhcp_findleasewrite(ctx, file);
+	if (lw == NULL) {
+		lw = malloc(sizeof(*lw));
+		if (lw == NULL)
+			goto err;
+		lw->file = strdup(file);
+		if (lw->file == NULL) {
+			free(lw);
+			goto err;
+		}
+		was_empty = TAILQ_FIRST(&ctx->lease_writes) == NULL;
+		TAILQ_INSERT_TAIL(&ctx->lease_writes, lw, next);
+	} else {
+		free(lw->data);
+		was_empty = false;
+	}
+	lw->mode = mode;
+	lw->data = buf;
+	lw->len = sizeof(hdr) + len;
+
+	if (was_empty &&
+	    eloop_timeout_add_sec(ctx->eloop, LEASE_FLUSH_SEC,
+	    dhcp_writeleases, ctx) == -1)
+	{
+		/* No timeout, write it out now. */
+		dhcp_writeleases(ctx);
+	}
+	return (ssize_t)len;
+
+err:
+	free(buf);
+	return -1;
+}
+
 int
 dhcp_filemtime(struct dhcpcd_ctx *ctx, const char *file, time_t *time)
 {
@@ -994,16 +1529,34 @@ dhcp_filemtime(struct dhcpcd_ctx *ctx, const char *file, time_t *time)
 int
 dhcp_unlink(struct dhcpcd_ctx *ctx, const char *file)
 {
+	struct dhcp_lease_write *lw;
+	struct dhcp_lease_read *lr;
+	int dbe = -1, r;
+
+	/* Drop any queued commit so the flush
+	 * cannot resurrect the lease. */
+	lw = dhcp_findleasewrite(ctx, file);
+	if (lw != NULL)
+		dhcp_freeleasewrite(ctx, lw);
+	lr = dhcp_findleaseread(ctx, file);
+	if (lr != NULL)
+		dhcp_dropleaseread(ctx, lr);
+	dhcp_dropleasefd(ctx, file);
+
+	if (ctx->leasedb != NULL)
+		dbe = dhcp_leasedb_unlink(ctx, file);
+	/* Also remove any flat file so a stale lease
+	 * cannot be migrated back in. */
 
 #ifdef PRIVSEP
 	if (ctx->options & DHCPCD_PRIVSEP &&
 	    !(ctx->options & DHCPCD_PRIVSEPROOT))
-		return (int)ps_root_unlink(ctx, file);
-#else
-	UNUSED(ctx);
+		r = (int)ps_root_unlink(ctx, file);
+	else
 #endif
+		r = unlink(file);
 
-	return unlink(file);
+	return dbe == 0 ? 0 : r;
 }
 
 size_t
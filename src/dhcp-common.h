@@ -110,6 +110,8 @@ struct dhcp_opt {
 
 const char *dhcp_get_hostname(char *, size_t, const struct if_options *);
 struct dhcp_opt *vivso_find(uint32_t, const void *);
+void dhcp_sortoptions(struct dhcp_opt *, size_t);
+struct dhcp_opt *dhcp_findoption(const struct dhcp_opt *, size_t, uint32_t);
 
 ssize_t dhcp_vendor(char *, size_t);
 
@@ -140,6 +142,64 @@ void dhcp_zero_index(struct dhcp_opt *);
 ssize_t dhcp_readfile(struct dhcpcd_ctx *, const char *, void *, size_t);
 ssize_t dhcp_writefile(struct dhcpcd_ctx *, const char *, mode_t,
     const void *, size_t);
+
+/* Lease files are stored as the raw message prefixed with this header
+ * so that a truncated or corrupt lease is detected at startup without
+ * parsing any options.
+ * Files without the magic are read as legacy raw message dumps. */
+#define	DHCP_LEASE_MAGIC	0x6463646cU
+#define	DHCP_LEASE_VERSION	1U
+
+struct dhcp_lease_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t len;		/* message length, header excluded */
+	uint32_t cksum;		/* RFC 1071 checksum of the message */
+	int64_t acquired;	/* wall clock time the lease was written */
+};
+
+ssize_t dhcp_leaseextract(void *, size_t, time_t *);
+ssize_t dhcp_readlease(struct dhcpcd_ctx *, const char *, void *, size_t,
+    time_t *);
+ssize_t dhcp_writelease(struct dhcpcd_ctx *, const char *, mode_t,
+    const void *, size_t);
+void dhcp_flushleases(struct dhcpcd_ctx *);
+
+/* Lease commits are written behind from the eloop so a slow filesystem
+ * cannot stall the lease state machines.  Batched writes are flushed
+ * this many seconds after the first commit. */
+#define	LEASE_FLUSH_SEC		1
+
+struct dhcp_lease_write {
+	TAILQ_ENTRY(dhcp_lease_write) next;
+	char *file;
+	mode_t mode;
+	void *data;
+	size_t len;
+};
+
+/* Under privsep, lease files are written through descriptors the
+ * privileged proxy opened for us and passed over the socket, so only
+ * the first commit to a file pays for a proxy round trip. */
+struct dhcp_lease_fd {
+	TAILQ_ENTRY(dhcp_lease_fd) next;
+	char *file;
+	int fd;
+};
+void dhcp_closeleasefds(struct dhcpcd_ctx *);
+
+/* At startup every lease is read into this cache in one sequential
+ * pass before any interface state machine arms, so lease I/O is not
+ * interleaved with solicitation and configuration work.
+ * Entries are consumed by the first read of their file. */
+struct dhcp_lease_read {
+	TAILQ_ENTRY(dhcp_lease_read) next;
+	char *file;
+	void *data;
+	size_t len;
+};
+void dhcp_preloadleases(struct dhcpcd_ctx *);
+void dhcp_freeleasereads(struct dhcpcd_ctx *);
 int dhcp_filemtime(struct dhcpcd_ctx *, const char *, time_t *);
 int dhcp_unlink(struct dhcpcd_ctx *, const char *);
 size_t dhcp_read_hwaddr_aton(struct dhcpcd_ctx *, uint8_t **, const char *);
@@ -74,6 +74,8 @@
 #include "privsep.h"
 #include "sa.h"
 #include "script.h"
+#include "stats.h"
+#include "probes.h"
 
 #define DAD		"Duplicate address detected"
 #define DHCP_MIN_LEASE	20
@@ -132,6 +134,8 @@ static const char * const dhcp_params[] = {
 
 static int dhcp_openbpf(struct interface *);
 static void dhcp_start1(void *);
+static void dhcp_rebind(void *);
+static void dhcp_expire(void *);
 #if defined(ARP) && (!defined(KERNEL_RFC5227) || defined(ARPING))
 static void dhcp_arp_found(struct arp_state *, const struct arp_msg *);
 #endif
@@ -139,6 +143,7 @@ static void dhcp_handledhcp(struct interface *, struct bootp *, size_t,
     const struct in_addr *);
 static void dhcp_handleifudp(void *);
 static int dhcp_initstate(struct interface *);
+static void dhcp_readbpf(void *);
 
 void
 dhcp_printoptions(const struct dhcpcd_ctx *ctx,
@@ -167,6 +172,150 @@ dhcp_printoptions(const struct dhcpcd_ctx *ctx,
 	}
 }
 
+/* Per message index of the options region, built once when a message
+ * is processed so that each get_option() lookup is O(1) rather than
+ * rescanning the whole region. RFC3396 concatenation and RFC2132
+ * option overloading are resolved at build time, with concatenated
+ * data staged in the aggregate option buffer. */
+struct dhcp_optidx {
+	struct {
+		uint32_t off;
+		uint32_t len;
+		uint8_t where;
+#define	DHCP_OPTIDX_NONE	0	/* option not present */
+#define	DHCP_OPTIDX_MSG		1	/* off is into the message */
+#define	DHCP_OPTIDX_BUF		2	/* off is into ctx->opt_buffer */
+	} idx[256];
+};
+
+static int
+dhcp_optidx_reserve(struct dhcpcd_ctx *ctx, size_t len)
+{
+	uint8_t *nb;
+
+	if (len <= ctx->opt_buffer_len)
+		return 0;
+	nb = realloc(ctx->opt_buffer, len);
+	if (nb == NULL)
+		return -1;
+	ctx->opt_buffer = nb;
+	ctx->opt_buffer_len = len;
+	return 0;
+}
+
+static void
+dhcp_message_index(struct dhcpcd_ctx *ctx,
+    const struct bootp *bootp, size_t bootp_len)
+{
+	const uint8_t *p, *e, *msg = (const uint8_t *)bootp;
+	uint8_t l, o, overl;
+	size_t used;
+	struct dhcp_optidx *di;
+
+	ctx->opt_idx_msg = NULL;
+
+	if (bootp == NULL || bootp_len < DHCP_MIN_LEN || !IS_DHCP(bootp))
+		return;
+
+	if (ctx->opt_idx == NULL) {
+		ctx->opt_idx = malloc(sizeof(*ctx->opt_idx));
+		if (ctx->opt_idx == NULL)
+			return; /* get_option() scans as before */
+	}
+	di = ctx->opt_idx;
+	memset(di, 0, sizeof(*di));
+
+	overl = 0;
+	used = 0;
+	p = bootp->vend + 4; /* options after the 4 byte cookie */
+	e = msg + bootp_len;
+	while (p < e) {
+		o = *p++;
+		switch (o) {
+		case DHO_PAD:
+			/* No length to read */
+			continue;
+		case DHO_END:
+			if (overl & 1) {
+				/* bit 1 set means parse boot file */
+				overl = (uint8_t)(overl & ~1);
+				p = bootp->file;
+				e = p + sizeof(bootp->file);
+			} else if (overl & 2) {
+				/* bit 2 set means parse server name */
+				overl = (uint8_t)(overl & ~2);
+				p = bootp->sname;
+				e = p + sizeof(bootp->sname);
+			} else
+				goto exit;
+			/* No length to read */
+			continue;
+		}
+
+		/* A malformed message is left unindexed so that
+		 * get_option() reports the error as before. */
+		if (p == e)
+			return;
+		l = *p++;
+		if (p + l > e)
+			return;
+
+		if (o == DHO_OPTSOVERLOADED) {
+			/* Ensure we only get this option once by setting
+			 * the last bit as well as the value. */
+			if (l == 1 && !overl)
+				overl = 0x80 | p[0];
+		}
+
+		if (di->idx[o].where == DHCP_OPTIDX_NONE) {
+			di->idx[o].off = (uint32_t)(p - msg);
+			di->idx[o].len = l;
+			di->idx[o].where = DHCP_OPTIDX_MSG;
+		} else if (l != 0) {
+			/* We must concatonate the options. */
+			uint32_t noff;
+
+			if (di->idx[o].where == DHCP_OPTIDX_BUF &&
+			    di->idx[o].off + di->idx[o].len == used)
+				noff = di->idx[o].off; /* at the tail */
+			else
+				noff = (uint32_t)used;
+			if (dhcp_optidx_reserve(ctx,
+			    noff + di->idx[o].len + l) == -1)
+				return;
+			if (noff == used) {
+				/* Move the data gathered so far in. */
+				if (di->idx[o].where == DHCP_OPTIDX_BUF)
+					memmove(ctx->opt_buffer + used,
+					    ctx->opt_buffer + di->idx[o].off,
+					    di->idx[o].len);
+				else
+					memcpy(ctx->opt_buffer + used,
+					    msg + di->idx[o].off,
+					    di->idx[o].len);
+				used += di->idx[o].len;
+			}
+			memcpy(ctx->opt_buffer + used, p, l);
+			used += l;
+			di->idx[o].off = noff;
+			di->idx[o].len += l;
+			di->idx[o].where = DHCP_OPTIDX_BUF;
+		}
+		p += l;
+	}
+
+exit:
+	ctx->opt_idx_msg = bootp;
+	ctx->opt_idx_msg_len = bootp_len;
+}
+
+static void
+dhcp_message_index_clear(struct dhcpcd_ctx *ctx)
+{
+
+	ctx->opt_idx_msg = NULL;
+}
+
 static const uint8_t *
 get_option(struct dhcpcd_ctx *ctx,
     const struct bootp *bootp, size_t bootp_len,
@@ -188,6 +337,25 @@ get_option(struct dhcpcd_ctx *ctx,
 		return NULL;
 	}
 
+	/* Use the index built by dhcp_message_index() if it covers
+	 * this message. */
+	if (ctx->opt_idx_msg == (const void *)bootp &&
+	    ctx->opt_idx_msg_len == bootp_len && opt < 256)
+	{
+		const struct dhcp_optidx *di = ctx->opt_idx;
+
+		if (di->idx[opt].where == DHCP_OPTIDX_NONE) {
+			errno = ENOENT;
+			return NULL;
+		}
+		if (opt_len)
+			*opt_len = di->idx[opt].len;
+		if (di->idx[opt].where == DHCP_OPTIDX_BUF)
+			return (const uint8_t *)ctx->opt_buffer +
+			    di->idx[opt].off;
+		return (const uint8_t *)bootp + di->idx[opt].off;
+	}
+
 	p = bootp->vend + 4; /* options after the 4 byte cookie */
 	e = (const uint8_t *)bootp + bootp_len;
 	ol = o = overl = 0;
@@ -733,8 +901,40 @@ dhcp_message_add_addr(struct bootp *bootp,
 	return 0;
 }
 
+/* Almost everything in an outgoing message is invariant from one send
+ * to the next, so keep the last built DISCOVER/REQUEST per interface
+ * and just patch the header fields that do change.
+ * The inputs recorded here are cheap to compare and any drift throws
+ * the template away. */
+struct dhcp_message_template {
+	struct bootp *bootp;
+	size_t len;
+	uint8_t type;
+	int mtu;
+	const struct if_options *ifo;
+	unsigned long long ifo_opts;
+	uint32_t lease_addr;
+	uint32_t lease_server;
+	uint32_t lease_cookie;
+	const struct ipv4_addr *addr;
+	uint8_t added;
+	uint8_t clientid[UINT8_MAX + 2];
+	char hostname[HOSTNAME_MAX_LEN + 1];
+};
+
+static void
+dhcp_template_free(struct dhcp_state *state)
+{
+
+	if (state->msg_template == NULL)
+		return;
+	free(state->msg_template->bootp);
+	free(state->msg_template);
+	state->msg_template = NULL;
+}
+
 static ssize_t
-make_message(struct bootp **bootpm, const struct interface *ifp, uint8_t type)
+make_message1(struct bootp **bootpm, const struct interface *ifp, uint8_t type)
 {
 	struct bootp *bootp;
 	uint8_t *lp, *p, *e;
@@ -1141,8 +1341,121 @@ toobig:
 	return -1;
 }
 
+static ssize_t
+make_message(struct bootp **bootpm, const struct interface *ifp, uint8_t type)
+{
+	struct dhcp_state *state = D_STATE(ifp);
+	const struct dhcp_lease *lease = &state->lease;
+	const struct if_options *ifo = ifp->options;
+	struct dhcp_message_template *t = state->msg_template;
+	struct bootp *bootp;
+	char hbuf[HOSTNAME_MAX_LEN + 1];
+	const char *hostname;
+	ssize_t r;
+	int mtu;
+
+	/* Only the workhorse messages are worth caching.
+	 * BOOTP messages are trivial to build and authentication
+	 * covers the fields we would patch. */
+	if ((type != DHCP_DISCOVER && type != DHCP_REQUEST) ||
+	    ifo->options & DHCPCD_BOOTP
+#ifdef AUTH
+	    || ifo->auth.options & DHCPCD_AUTH_SEND
+#endif
+	    )
+		return make_message1(bootpm, ifp, type);
+
+	hostname = dhcp_get_hostname(hbuf, sizeof(hbuf), ifo);
+	if (hostname == NULL)
+		hostname = "";
+	mtu = if_getmtu(ifp);
+
+	if (t != NULL &&
+	    t->type == type &&
+	    t->mtu == mtu &&
+	    t->ifo == ifo &&
+	    t->ifo_opts == ifo->options &&
+	    t->lease_addr == lease->addr.s_addr &&
+	    t->lease_server == lease->server.s_addr &&
+	    t->lease_cookie == lease->cookie &&
+	    t->addr == state->addr &&
+	    t->added == state->added &&
+	    (state->clientid == NULL ? t->clientid[0] == 0 :
+	    memcmp(t->clientid, state->clientid,
+	    (size_t)state->clientid[0] + 1) == 0) &&
+	    strcmp(t->hostname, hostname) == 0)
+	{
+		struct timespec tv;
+		unsigned long long secs;
+
+		bootp = malloc(t->len);
+		if (bootp == NULL)
+			return -1;
+		memcpy(bootp, t->bootp, t->len);
+		*bootpm = bootp;
+
+		/* Patch the fields that vary between sends. */
+		if (state->addr != NULL &&
+		    type == DHCP_REQUEST &&
+		    state->addr->mask.s_addr == lease->mask.s_addr &&
+		    (state->new == NULL || IS_DHCP(state->new)) &&
+		    !(state->added & (STATE_FAKE | STATE_EXPIRED)))
+			bootp->ciaddr = state->addr->addr.s_addr;
+		else
+			bootp->ciaddr = 0;
+
+		if (ifo->options & DHCPCD_BROADCAST && bootp->ciaddr == 0)
+			bootp->flags = htons(BROADCAST_FLAG);
+		else
+			bootp->flags = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &tv);
+		secs = eloop_timespec_diff(&tv, &state->started, NULL);
+		if (secs > UINT16_MAX)
+			bootp->secs = htons((uint16_t)UINT16_MAX);
+		else
+			bootp->secs = htons((uint16_t)secs);
+
+		bootp->xid = htonl(state->xid);
+
+		return (ssize_t)t->len;
+	}
+
+	dhcp_template_free(state);
+	r = make_message1(bootpm, ifp, type);
+	if (r == -1)
+		return -1;
+
+	/* Running uncached is fine if we're out of memory. */
+	t = calloc(1, sizeof(*t));
+	if (t == NULL)
+		return r;
+	t->bootp = malloc((size_t)r);
+	if (t->bootp == NULL) {
+		free(t);
+		return r;
+	}
+	memcpy(t->bootp, *bootpm, (size_t)r);
+	t->len = (size_t)r;
+	t->type = type;
+	t->mtu = mtu;
+	t->ifo = ifo;
+	t->ifo_opts = ifo->options;
+	t->lease_addr = lease->addr.s_addr;
+	t->lease_server = lease->server.s_addr;
+	t->lease_cookie = lease->cookie;
+	t->addr = state->addr;
+	t->added = state->added;
+	if (state->clientid != NULL)
+		memcpy(t->clientid, state->clientid,
+		    (size_t)state->clientid[0] + 1);
+	strlcpy(t->hostname, hostname, sizeof(t->hostname));
+	state->msg_template = t;
+	return r;
+}
+
 static size_t
-read_lease(struct interface *ifp, struct bootp **bootp)
+read_lease(struct interface *ifp, struct bootp **bootp, time_t *acquired)
 {
 	union {
 		struct bootp bootp;
@@ -1163,11 +1476,14 @@ read_lease(struct interface *ifp, struct bootp **bootp)
 	if (state->leasefile[0] == '\0') {
 		logdebugx("reading standard input");
 		sbytes = read(fileno(stdin), buf.buf, sizeof(buf.buf));
+		if (sbytes != -1)
+			sbytes = dhcp_leaseextract(buf.buf, (size_t)sbytes,
+			    acquired);
 	} else {
 		logdebugx("%s: reading lease: %s",
 		    ifp->name, state->leasefile);
-		sbytes = dhcp_readfile(ifp->ctx, state->leasefile,
-		    buf.buf, sizeof(buf.buf));
+		sbytes = dhcp_readlease(ifp->ctx, state->leasefile,
+		    buf.buf, sizeof(buf.buf), acquired);
 	}
 	if (sbytes == -1) {
 		if (errno != ENOENT)
@@ -1249,8 +1565,6 @@ dhcp_getoption(struct dhcpcd_ctx *ctx,
     size_t *os, unsigned int *code, size_t *len,
     const uint8_t *od, size_t ol, struct dhcp_opt **oopt)
 {
-	size_t i;
-	struct dhcp_opt *opt;
 
 	if (od) {
 		if (ol < 2) {
@@ -1266,19 +1580,13 @@ dhcp_getoption(struct dhcpcd_ctx *ctx,
 		}
 	}
 
-	*oopt = NULL;
-	for (i = 0, opt = ctx->dhcp_opts; i < ctx->dhcp_opts_len; i++, opt++) {
-		if (opt->option == *code) {
-			*oopt = opt;
-			break;
-		}
-	}
+	*oopt = dhcp_findoption(ctx->dhcp_opts, ctx->dhcp_opts_len, *code);
 
 	return od;
 }
 
-ssize_t
-dhcp_env(FILE *fenv, const char *prefix, const struct interface *ifp,
+static ssize_t
+dhcp_env1(FILE *fenv, const char *prefix, const struct interface *ifp,
     const struct bootp *bootp, size_t bootp_len)
 {
 	const struct if_options *ifo;
@@ -1399,6 +1707,20 @@ dhcp_env(FILE *fenv, const char *prefix, const struct interface *ifp,
 	return 1;
 }
 
+ssize_t
+dhcp_env(FILE *fenv, const char *prefix, const struct interface *ifp,
+    const struct bootp *bootp, size_t bootp_len)
+{
+	ssize_t r;
+
+	/* Index the message so the option lookup for every known
+	 * option need not rescan the options region. */
+	dhcp_message_index(ifp->ctx, bootp, bootp_len);
+	r = dhcp_env1(fenv, prefix, ifp, bootp, bootp_len);
+	dhcp_message_index_clear(ifp->ctx);
+	return r;
+}
+
 static void
 get_lease(struct interface *ifp,
     struct dhcp_lease *lease, const struct bootp *bootp, size_t len)
@@ -1533,6 +1855,7 @@ dhcp_closebpf(struct interface *ifp)
 
 	if (state->bpf != NULL) {
 		eloop_event_delete(ctx->eloop, state->bpf->bpf_fd);
+		eloop_timeout_delete(ctx->eloop, dhcp_readbpf, ifp);
 		bpf_close(state->bpf);
 		state->bpf = NULL;
 	}
@@ -1615,22 +1938,52 @@ errexit:
 static uint16_t
 in_cksum(const void *data, size_t len, uint32_t *isum)
 {
-	const uint16_t *word = data;
-	uint32_t sum = isum != NULL ? *isum : 0;
+	const uint8_t *buf = data;
+	uint64_t sum = isum != NULL ? *isum : 0;
+	uint32_t sum32;
+
+	/* The one's complement sum is byte order independent and carries
+	 * wrap, so we can fold eight bytes per iteration rather than two
+	 * and still arrive at the same 16-bit result. */
+	while (len >= sizeof(uint64_t)) {
+		uint64_t word;
+
+		memcpy(&word, buf, sizeof(word));
+		sum += word;
+		if (sum < word)
+			sum++;
+		buf += sizeof(word);
+		len -= sizeof(word);
+	}
+
+	/* Fold to 32 bits before the tail additions so a near
+	 * saturated accumulator cannot overflow and drop a carry. */
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 32) + (sum & 0xffffffff);
+
+	while (len > 1) {
+		uint16_t word16;
 
-	for (; len > 1; len -= sizeof(*word))
-		sum += *word++;
+		memcpy(&word16, buf, sizeof(word16));
+		sum += word16;
+		buf += sizeof(word16);
+		len -= sizeof(word16);
+	}
 
 	if (len == 1)
-		sum += htons((uint16_t)(*(const uint8_t *)word << 8));
+		sum += htons((uint16_t)(*buf << 8));
+
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum32 = (uint32_t)sum;
 
 	if (isum != NULL)
-		*isum = sum;
+		*isum = sum32;
 
-	sum = (sum >> 16) + (sum & 0xffff);
-	sum += (sum >> 16);
+	sum32 = (sum32 >> 16) + (sum32 & 0xffff);
+	sum32 += sum32 >> 16;
 
-	return (uint16_t)~sum;
+	return (uint16_t)~sum32;
 }
 
 static struct bootp_pkt *
@@ -1965,6 +2318,21 @@ dhcp_startrenew(void *arg)
 	eloop_timeout_delete(ifp->ctx->eloop, dhcp_startrenew, ifp);
 
 	lease = &state->lease;
+
+	/* The rebind deadline is next. */
+	if (lease->leasetime != DHCP_INFINITE_LIFETIME) {
+		struct timespec now;
+		uint32_t elapsed;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = (uint32_t)eloop_timespec_diff(&now,
+		    &state->bound, NULL);
+		eloop_timeout_add_sec(ifp->ctx->eloop,
+		    lease->rebindtime > elapsed ?
+		    lease->rebindtime - elapsed : 0,
+		    dhcp_rebind, ifp);
+	}
+
 	logdebugx("%s: renewing lease of %s", ifp->name,
 	    inet_ntoa(lease->addr));
 	state->state = DHS_RENEW;
@@ -1986,11 +2354,20 @@ dhcp_rebind(void *arg)
 	struct interface *ifp = arg;
 	struct dhcp_state *state = D_STATE(ifp);
 	struct dhcp_lease *lease = &state->lease;
+	struct timespec now;
+	uint32_t elapsed;
 
 	logwarnx("%s: failed to renew DHCP, rebinding", ifp->name);
 	logdebugx("%s: expire in %"PRIu32" seconds",
 	    ifp->name, lease->leasetime - lease->rebindtime);
 	state->state = DHS_REBIND;
+
+	/* The expiry deadline is next. */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (uint32_t)eloop_timespec_diff(&now, &state->bound, NULL);
+	eloop_timeout_add_sec(ifp->ctx->eloop,
+	    lease->leasetime > elapsed ? lease->leasetime - elapsed : 0,
+	    dhcp_expire, ifp);
 	eloop_timeout_delete(ifp->ctx->eloop, send_renew, ifp);
 	state->lease.server.s_addr = INADDR_ANY;
 	state->interval = 0;
@@ -2220,6 +2597,20 @@ dhcp_arp_found(struct arp_state *astate, const struct arp_msg *amsg)
 
 #endif /* ARP */
 
+/* A renewing ACK is normally byte identical to the lease we hold bar
+ * the exchange id.  Compare everything from yiaddr on, which covers
+ * the options and any overloaded sname and file fields. */
+static bool
+dhcp_samelease(const struct bootp *a, size_t alen,
+    const struct bootp *b, size_t blen)
+{
+
+	if (alen != blen || alen < offsetof(struct bootp, yiaddr))
+		return false;
+	return memcmp(&a->yiaddr, &b->yiaddr,
+	    alen - offsetof(struct bootp, yiaddr)) == 0;
+}
+
 void
 dhcp_bind(struct interface *ifp)
 {
@@ -2229,7 +2620,46 @@ dhcp_bind(struct interface *ifp)
 	struct dhcp_lease *lease = &state->lease;
 	uint8_t old_state;
 
+	DHCPCD_PROBE2(dhcp_bind, ifp->name, state->xid);
+	stats_lat_record(ifp->name, STAT_LAT_DHCP_BIND, &state->started);
 	state->reason = NULL;
+
+	/* The vast majority of renewals hand back a lease identical to
+	 * the one we are already bound to, so just reset the timers
+	 * rather than reconfiguring the address, rebuilding routes and
+	 * running the script hooks all over again. */
+	if (state->state == DHS_RENEW &&
+	    state->offer != NULL && state->new != NULL &&
+	    state->added & STATE_ADDED &&
+	    !(state->added & (STATE_FAKE | STATE_EXPIRED)) &&
+	    !(ctx->options & DHCPCD_TEST) &&
+	    !(ifo->options & (DHCPCD_STATIC | DHCPCD_INFORM)) &&
+	    lease->leasetime != DHCP_INFINITE_LIFETIME &&
+	    dhcp_samelease(state->offer, state->offer_len,
+	    state->new, state->new_len))
+	{
+		free(state->offer);
+		state->offer = NULL;
+		state->offer_len = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &state->bound);
+		eloop_timeout_add_sec(ctx->eloop,
+		    lease->renewaltime -
+		    dhcpcd_renewjitter(ifp, lease->renewaltime),
+		    dhcp_startrenew, ifp);
+		logdebugx("%s: renewed lease of %s unchanged, "
+		    "renew in %"PRIu32" seconds",
+		    ifp->name, inet_ntoa(lease->addr), lease->renewaltime);
+		state->state = DHS_BOUND;
+		/* Still commit the lease so the stored acquisition
+		 * time stays honest over a restart. */
+		if (!state->lease.frominfo &&
+		    dhcp_writelease(ctx, state->leasefile, 0640,
+		    state->new, state->new_len) == -1)
+			logerr("dhcp_writelease: %s", state->leasefile);
+		return;
+	}
+
 	/* If we don't have an offer, we are re-binding a lease on preference,
 	 * normally when two interfaces have a lease matching IP addresses. */
 	if (state->offer) {
@@ -2324,12 +2754,14 @@ dhcp_bind(struct interface *ifp)
 	if (lease->leasetime == DHCP_INFINITE_LIFETIME)
 		lease->renewaltime = lease->rebindtime = lease->leasetime;
 	else {
+		/* Only the next deadline is armed - renewing arms the
+		 * rebind and rebinding arms the expiry, so a bound
+		 * lease keeps one pending timeout rather than three. */
+		clock_gettime(CLOCK_MONOTONIC, &state->bound);
 		eloop_timeout_add_sec(ctx->eloop,
-		    lease->renewaltime, dhcp_startrenew, ifp);
-		eloop_timeout_add_sec(ctx->eloop,
-		    lease->rebindtime, dhcp_rebind, ifp);
-		eloop_timeout_add_sec(ctx->eloop,
-		    lease->leasetime, dhcp_expire, ifp);
+		    lease->renewaltime -
+		    dhcpcd_renewjitter(ifp, lease->renewaltime),
+		    dhcp_startrenew, ifp);
 		logdebugx("%s: renew in %"PRIu32" seconds, rebind in %"PRIu32
 		    " seconds",
 		    ifp->name, lease->renewaltime, lease->rebindtime);
@@ -2339,9 +2771,9 @@ dhcp_bind(struct interface *ifp)
 	    !(ifo->options & (DHCPCD_INFORM | DHCPCD_STATIC))) {
 		logdebugx("%s: writing lease: %s",
 		    ifp->name, state->leasefile);
-		if (dhcp_writefile(ifp->ctx, state->leasefile, 0640,
+		if (dhcp_writelease(ifp->ctx, state->leasefile, 0640,
 		    state->new, state->new_len) == -1)
-			logerr("dhcp_writefile: %s", state->leasefile);
+			logerr("dhcp_writelease: %s", state->leasefile);
 	}
 
 	old_state = state->added;
@@ -2408,6 +2840,7 @@ openudp:
 		return;
 	}
 	eloop_event_add(ctx->eloop, state->udp_rfd, dhcp_handleifudp, ifp);
+	eloop_event_priority(ctx->eloop, state->udp_rfd, ELOOP_PRIO_HIGH);
 }
 
 static size_t
@@ -2972,7 +3405,7 @@ dhcp_redirect_dhcp(struct interface *ifp, struct bootp *bootp, size_t bootp_len,
 }
 
 static void
-dhcp_handledhcp(struct interface *ifp, struct bootp *bootp, size_t bootp_len,
+dhcp_handledhcp1(struct interface *ifp, struct bootp *bootp, size_t bootp_len,
     const struct in_addr *from)
 {
 	struct dhcp_state *state = D_STATE(ifp);
@@ -3414,6 +3847,20 @@ rapidcommit:
 #endif
 }
 
+static void
+dhcp_handledhcp(struct interface *ifp, struct bootp *bootp, size_t bootp_len,
+    const struct in_addr *from)
+{
+
+	DHCPCD_PROBE2(handle_dhcp, ifp->name, bootp->xid);
+
+	/* Index the message on arrival - validating and accepting it
+	 * makes dozens of option lookups. */
+	dhcp_message_index(ifp->ctx, bootp, bootp_len);
+	dhcp_handledhcp1(ifp, bootp, bootp_len, from);
+	dhcp_message_index_clear(ifp->ctx);
+}
+
 static void *
 get_udp_data(void *packet, size_t *len)
 {
@@ -3522,15 +3969,74 @@ checksums_valid(void *packet,
 	return csum == udp.uh_sum;
 }
 
+/* A legitimate exchange is a handful of frames while a looping relay
+ * or rogue NAKing server is hundreds a second, so allow a generous
+ * burst and refill well above any real server rate. */
+#define DHCP_RX_BURST	64
+#define DHCP_RX_RATE	16	/* tokens per second */
+
+static bool
+dhcp_ratelimited(struct interface *ifp, const struct in_addr *from)
+{
+	struct dhcp_state *state = D_STATE(ifp);
+	struct timespec now;
+	unsigned int elapsed;
+
+	if (state == NULL)
+		return false;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!timespecisset(&state->rx_refill)) {
+		state->rx_tokens = DHCP_RX_BURST;
+		state->rx_refill = now;
+	}
+
+	elapsed = (unsigned int)eloop_timespec_diff(&now,
+	    &state->rx_refill, NULL);
+	if (elapsed != 0) {
+		if (elapsed >= DHCP_RX_BURST / DHCP_RX_RATE ||
+		    elapsed * DHCP_RX_RATE >= DHCP_RX_BURST - state->rx_tokens)
+			state->rx_tokens = DHCP_RX_BURST;
+		else
+			state->rx_tokens += elapsed * DHCP_RX_RATE;
+		state->rx_refill = now;
+		if (state->rx_tokens != 0 && state->rx_limited) {
+			logwarnx("%s: BOOTP storm over, resuming",
+			    ifp->name);
+			state->rx_limited = false;
+		}
+	}
+
+	if (state->rx_tokens == 0) {
+		/* Log the offender once per storm, not per frame. */
+		if (!state->rx_limited) {
+			logwarnx("%s: BOOTP storm from %s, rate limiting",
+			    ifp->name, inet_ntoa(*from));
+			state->rx_limited = true;
+		}
+		STAT_INC(bootp_ratelimited);
+		return true;
+	}
+
+	state->rx_tokens--;
+	return false;
+}
+
 static void
 dhcp_handlebootp(struct interface *ifp, struct bootp *bootp, size_t len,
     struct in_addr *from)
 {
 	size_t v;
 
+	STAT_INC(bootp_rx);
+
+	/* Drop storm frames before validation, parsing and logging. */
+	if (dhcp_ratelimited(ifp, from))
+		return;
 	if (len < offsetof(struct bootp, vend)) {
 		logerrx("%s: truncated packet (%zu) from %s",
 		    ifp->name, len, inet_ntoa(*from));
+		STAT_INC(bootp_discarded);
 		return;
 	}
 
@@ -3608,6 +4114,7 @@ dhcp_packet(struct interface *ifp, uint8_t *data, size_t len,
 	if (!checksums_valid(data, &from, bpf_flags)) {
 		logerrx("%s: checksum failure from %s",
 		    ifp->name, inet_ntoa(from));
+		STAT_INC(bootp_discarded);
 		return;
 	}
 
@@ -3628,11 +4135,22 @@ dhcp_readbpf(void *arg)
 	struct interface *ifp = arg;
 	uint8_t buf[FRAMELEN_MAX];
 	ssize_t bytes;
+	unsigned int budget = BPF_READ_BUDGET;
 	struct dhcp_state *state = D_STATE(ifp);
 	struct bpf *bpf = state->bpf;
 
+	/* We may be resuming a drain that ran out of budget. */
+	eloop_timeout_delete(ifp->ctx->eloop, dhcp_readbpf, ifp);
+
 	bpf->bpf_flags &= ~BPF_EOF;
 	while (!(bpf->bpf_flags & BPF_EOF)) {
+		if (budget-- == 0) {
+			/* Out of budget - give way to other events and
+			 * pick up the residue afterwards. */
+			eloop_timeout_add_sec(ifp->ctx->eloop, 0,
+			    dhcp_readbpf, ifp);
+			break;
+		}
 		bytes = bpf_read(bpf, buf, sizeof(buf));
 		if (bytes == -1) {
 			if (state->state != DHS_NONE) {
@@ -3788,6 +4306,8 @@ dhcp_openbpf(struct interface *ifp)
 
 	eloop_event_add(ifp->ctx->eloop,
 	    state->bpf->bpf_fd, dhcp_readbpf, ifp);
+	eloop_event_priority(ifp->ctx->eloop, state->bpf->bpf_fd,
+	    ELOOP_PRIO_HIGH);
 	return 0;
 }
 
@@ -3803,11 +4323,13 @@ dhcp_free(struct interface *ifp)
 #endif
 	if (state) {
 		state->state = DHS_NONE;
+		dhcp_template_free(state);
 		free(state->old);
 		free(state->new);
 		free(state->offer);
 		free(state->clientid);
 		free(state);
+		ifp->if_data[IF_DATA_DHCP] = NULL;
 	}
 
 	ctx = ifp->ctx;
@@ -3833,6 +4355,9 @@ dhcp_free(struct interface *ifp)
 
 		free(ctx->opt_buffer);
 		ctx->opt_buffer = NULL;
+		free(ctx->opt_idx);
+		ctx->opt_idx = NULL;
+		ctx->opt_idx_msg = NULL;
 	}
 }
 
@@ -3947,6 +4472,7 @@ dhcp_start1(void *arg)
 	struct dhcp_state *state;
 	uint32_t l;
 	int nolease;
+	time_t acquired = (time_t)-1;
 
 	if (!(ifo->options & DHCPCD_IPV4))
 		return;
@@ -3964,6 +4490,7 @@ dhcp_start1(void *arg)
 			return;
 		}
 		eloop_event_add(ctx->eloop, ctx->udp_rfd, dhcp_handleudp, ctx);
+		eloop_event_priority(ctx->eloop, ctx->udp_rfd, ELOOP_PRIO_HIGH);
 	}
 	if (!IN_PRIVSEP(ctx) && ctx->udp_wfd == -1) {
 		ctx->udp_wfd = xsocket(PF_INET, SOCK_RAW|SOCK_CXNB,IPPROTO_UDP);
@@ -4005,7 +4532,7 @@ dhcp_start1(void *arg)
 	/* We don't want to read the old lease if we NAK an old test */
 	nolease = state->offer && ifp->ctx->options & DHCPCD_TEST;
 	if (!nolease && ifo->options & DHCPCD_DHCP) {
-		state->offer_len = read_lease(ifp, &state->offer);
+		state->offer_len = read_lease(ifp, &state->offer, &acquired);
 		/* Check the saved lease matches the type we want */
 		if (state->offer) {
 #ifdef IN_IFF_DUPLICATED
@@ -4032,7 +4559,6 @@ dhcp_start1(void *arg)
 	}
 	if (state->offer) {
 		struct ipv4_addr *ia;
-		time_t mtime;
 
 		get_lease(ifp, &state->lease, state->offer, state->offer_len);
 		state->lease.frominfo = 1;
@@ -4050,7 +4576,7 @@ dhcp_start1(void *arg)
 				state->new_len = state->offer_len;
 				state->addr = ia;
 				state->added |= STATE_ADDED | STATE_FAKE;
-				rt_build(ifp->ctx, AF_INET);
+				rt_build_if(ifp, AF_INET);
 			} else
 				logerr(__func__);
 		}
@@ -4060,14 +4586,15 @@ dhcp_start1(void *arg)
 			state->offer_len = 0;
 		} else if (!(ifo->options & DHCPCD_LASTLEASE_EXTEND) &&
 		    state->lease.leasetime != DHCP_INFINITE_LIFETIME &&
-		    dhcp_filemtime(ifp->ctx, state->leasefile, &mtime) == 0)
+		    (acquired != (time_t)-1 ||
+		    dhcp_filemtime(ifp->ctx, state->leasefile, &acquired) == 0))
 		{
 			time_t now;
 
 			/* Offset lease times and check expiry */
 			now = time(NULL);
 			if (now == -1 ||
-			    (time_t)state->lease.leasetime < now - mtime)
+			    (time_t)state->lease.leasetime < now - acquired)
 			{
 				logdebugx("%s: discarding expired lease",
 				    ifp->name);
@@ -4092,7 +4619,7 @@ dhcp_start1(void *arg)
 					dhcp_drop(ifp, "EXPIRE");
 #endif
 			} else {
-				l = (uint32_t)(now - mtime);
+				l = (uint32_t)(now - acquired);
 				state->lease.leasetime -= l;
 				state->lease.renewaltime -= l;
 				state->lease.rebindtime -= l;
@@ -4243,18 +4770,33 @@ dhcp_handleifa(int cmd, struct ipv4_addr *ia, pid_t pid)
 
 	ifo = ifp->options;
 
-#ifdef PRIVSEP
-	if (IN_PRIVSEP_SE(ifp->ctx) &&
-	    !(ifp->ctx->options & (DHCPCD_MANAGER | DHCPCD_CONFIGURE)) &&
+	/* When not configuring addresses ourselves, binding left the
+	 * BPF capture open until the lease address appears.  Now it
+	 * has, switch to the UDP socket and drop the capture tap. */
+	if (!(ifp->ctx->options & DHCPCD_CONFIGURE) &&
 	    IN_ARE_ADDR_EQUAL(&state->lease.addr, &ia->addr))
 	{
 		state->addr = ia;
 		state->added = STATE_ADDED;
 		dhcp_closebpf(ifp);
-		if (ps_inet_openbootp(ia) == -1)
-		    logerr(__func__);
-	}
+		if (!(ifp->ctx->options & DHCPCD_MANAGER)) {
+#ifdef PRIVSEP
+			if (IN_PRIVSEP_SE(ifp->ctx)) {
+				if (ps_inet_openbootp(ia) == -1)
+					logerr(__func__);
+			} else
 #endif
+			if (state->udp_rfd == -1 &&
+			    (state->udp_rfd =
+			    dhcp_openudp(&ia->addr)) != -1)
+			{
+				eloop_event_add(ifp->ctx->eloop,
+				    state->udp_rfd, dhcp_handleifudp, ifp);
+				eloop_event_priority(ifp->ctx->eloop,
+				    state->udp_rfd, ELOOP_PRIO_HIGH);
+			}
+		}
+	}
 
 	/* If we have requested a specific address, return now.
 	 * The below code is only for when inform or static has been
@@ -4286,7 +4828,7 @@ dhcp_handleifa(int cmd, struct ipv4_addr *ia, pid_t pid)
 	}
 
 	state->reason = "STATIC";
-	rt_build(ifp->ctx, AF_INET);
+	rt_build_if(ifp, AF_INET);
 	script_runreason(ifp, state->reason);
 
 	return ia;
@@ -4303,7 +4845,15 @@ dhcp_dump(struct interface *ifp)
 		logerr(__func__);
 		return -1;
 	}
-	state->new_len = read_lease(ifp, &state->new);
+	/* With no interface name the lease is piped in on stdin. */
+	if (ifp->name[0] != '\0' &&
+	    dhcp_set_leasefile(state->leasefile, sizeof(state->leasefile),
+	    AF_INET, ifp) == -1)
+	{
+		logerr(__func__);
+		return -1;
+	}
+	state->new_len = read_lease(ifp, &state->new, NULL);
 	if (state->new == NULL) {
 		logerr("read_lease");
 		return -1;
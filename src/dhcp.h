@@ -208,6 +208,8 @@ enum DHS {
 	DHS_RELEASE
 };
 
+struct dhcp_message_template;
+
 struct dhcp_state {
 	enum DHS state;
 	struct bootp *sent;
@@ -230,10 +232,21 @@ struct dhcp_state {
 	struct ipv4_addr *addr;
 	uint8_t added;
 
+	/* Token bucket for discarding BOOTP storms before the
+	 * expensive validation and logging paths. */
+	uint32_t rx_tokens;
+	struct timespec rx_refill;
+	bool rx_limited;
+
 	char leasefile[sizeof(LEASEFILE) + IF_NAMESIZE + (IF_SSIDLEN * 4)];
 	struct timespec started;
+	/* When the lease timers were armed.  Renew, rebind and expire
+	 * are chained from one pending timeout, each phase arming the
+	 * next from the deadline remaining against this. */
+	struct timespec bound;
 	unsigned char *clientid;
 	struct authstate auth;
+	struct dhcp_message_template *msg_template;
 #ifdef ARPING
 	ssize_t arping_index;
 #endif
@@ -58,6 +58,7 @@
 #include "logerr.h"
 #include "privsep.h"
 #include "script.h"
+#include "stats.h"
 
 #ifdef HAVE_SYS_BITOPS_H
 #include <sys/bitops.h>
@@ -172,6 +173,8 @@ static const char * const dhcp6_statuses[] = {
 };
 
 static void dhcp6_bind(struct interface *, const char *, const char *);
+static void dhcp6_startrebind(void *);
+static void dhcp6_startexpire(void *);
 static void dhcp6_failinform(void *);
 static void dhcp6_recvaddr(void *);
 static void dhcp6_startdecline(struct interface *);
@@ -321,6 +324,75 @@ dhcp6_makevendor(void *data, const struct interface *ifp)
 	return sizeof(o) + len;
 }
 
+/* Per message index of top level options, built once when a message
+ * is received so that repeated lookups need not rescan it.
+ * DHCPv6 option codes are 16 bits so rather than a table keyed by
+ * code this is the option list flattened into an array, preserving
+ * order so that the first occurrence of a code is found just as the
+ * linear scan would. */
+struct dhcp6_optidx {
+	uint16_t code;	/* host order */
+	uint16_t len;
+	uint32_t off;	/* from the start of the message */
+};
+
+static void
+dhcp6_message_index(struct dhcpcd_ctx *ctx, const void *data, size_t data_len)
+{
+	const uint8_t *d = data;
+	size_t dl = data_len;
+	struct dhcp6_option o;
+	struct dhcp6_optidx *e;
+
+	ctx->d6_opt_idx_msg = NULL;
+	ctx->d6_opt_idx_len = 0;
+
+	if (dl < sizeof(struct dhcp6_message))
+		return;
+	d += sizeof(struct dhcp6_message);
+	dl -= sizeof(struct dhcp6_message);
+
+	while (dl != 0) {
+		/* A malformed message is left unindexed so that
+		 * dhcp6_findoption() reports the error as before. */
+		if (dl < sizeof(o))
+			return;
+		memcpy(&o, d, sizeof(o));
+		d += sizeof(o);
+		dl -= sizeof(o);
+		o.len = ntohs(o.len);
+		if (dl < o.len)
+			return;
+		if (ctx->d6_opt_idx_len == ctx->d6_opt_idx_size) {
+			size_t n;
+
+			n = ctx->d6_opt_idx_size == 0 ?
+			    16 : ctx->d6_opt_idx_size * 2;
+			e = realloc(ctx->d6_opt_idx, n * sizeof(*e));
+			if (e == NULL)
+				return;
+			ctx->d6_opt_idx = e;
+			ctx->d6_opt_idx_size = n;
+		}
+		e = &ctx->d6_opt_idx[ctx->d6_opt_idx_len++];
+		e->code = ntohs(o.code);
+		e->len = o.len;
+		e->off = (uint32_t)(d - (const uint8_t *)data);
+		d += o.len;
+		dl -= o.len;
+	}
+
+	ctx->d6_opt_idx_msg = data;
+	ctx->d6_opt_idx_msg_len = data_len;
+}
+
+static void
+dhcp6_message_index_clear(struct dhcpcd_ctx *ctx)
+{
+
+	ctx->d6_opt_idx_msg = NULL;
+}
+
 static void *
 dhcp6_findoption(void *data, size_t data_len, uint16_t code, uint16_t *len)
 {
@@ -353,11 +425,30 @@ dhcp6_findoption(void *data, size_t data_len, uint16_t code, uint16_t *len)
 }
 
 static void *
-dhcp6_findmoption(void *data, size_t data_len, uint16_t code,
-    uint16_t *len)
+dhcp6_findmoption(struct dhcpcd_ctx *ctx, void *data, size_t data_len,
+    uint16_t code, uint16_t *len)
 {
 	uint8_t *d;
 
+	/* Use the index built by dhcp6_message_index() if it covers
+	 * this message. */
+	if (ctx->d6_opt_idx_msg == data &&
+	    ctx->d6_opt_idx_msg_len == data_len)
+	{
+		const struct dhcp6_optidx *e = ctx->d6_opt_idx;
+		size_t i;
+
+		for (i = 0; i < ctx->d6_opt_idx_len; i++, e++) {
+			if (e->code != code)
+				continue;
+			if (len != NULL)
+				*len = e->len;
+			return (uint8_t *)data + e->off;
+		}
+		errno = ENOENT;
+		return NULL;
+	}
+
 	if (data_len < sizeof(struct dhcp6_message)) {
 		errno = EINVAL;
 		return false;
@@ -374,8 +465,6 @@ dhcp6_getoption(struct dhcpcd_ctx *ctx,
     const uint8_t *od, size_t ol, struct dhcp_opt **oopt)
 {
 	struct dhcp6_option o;
-	size_t i;
-	struct dhcp_opt *opt;
 
 	if (od != NULL) {
 		*os = sizeof(o);
@@ -392,15 +481,7 @@ dhcp6_getoption(struct dhcpcd_ctx *ctx,
 		*code = ntohs(o.code);
 	}
 
-	*oopt = NULL;
-	for (i = 0, opt = ctx->dhcp6_opts;
-	    i < ctx->dhcp6_opts_len; i++, opt++)
-	{
-		if (opt->option == *code) {
-			*oopt = opt;
-			break;
-		}
-	}
+	*oopt = dhcp_findoption(ctx->dhcp6_opts, ctx->dhcp6_opts_len, *code);
 
 	if (od != NULL)
 		return od + sizeof(o);
@@ -417,7 +498,7 @@ dhcp6_updateelapsed(struct interface *ifp, struct dhcp6_message *m, size_t len)
 	unsigned long long hsec;
 	uint16_t sec;
 
-	opt = dhcp6_findmoption(m, len, D6_OPTION_ELAPSED, &opt_len);
+	opt = dhcp6_findmoption(ifp->ctx, m, len, D6_OPTION_ELAPSED, &opt_len);
 	if (opt == NULL)
 		return false;
 	if (opt_len != sizeof(sec)) {
@@ -626,6 +707,16 @@ dhcp6_delegateaddr(struct in6_addr *addr, struct interface *ifp,
 }
 #endif
 
+static void
+dhcp6_freesend(struct dhcp6_state *state)
+{
+
+	free(state->send);
+	state->send = NULL;
+	state->send_len = 0;
+	state->send_alloc = 0;
+}
+
 static int
 dhcp6_makemessage(struct interface *ifp)
 {
@@ -653,10 +744,6 @@ dhcp6_makemessage(struct interface *ifp)
 	size_t duid_len = 0;
 
 	state = D6_STATE(ifp);
-	if (state->send) {
-		free(state->send);
-		state->send = NULL;
-	}
 
 	switch(state->state) {
 	case DH6S_INIT: /* FALLTHROUGH */
@@ -685,6 +772,7 @@ dhcp6_makemessage(struct interface *ifp)
 		type = DHCP6_DECLINE;
 		break;
 	default:
+		dhcp6_freesend(state);
 		errno = EINVAL;
 		return -1;
 	}
@@ -806,9 +894,11 @@ dhcp6_makemessage(struct interface *ifp)
 			m = state->new;
 			ml = state->new_len;
 		}
-		si = dhcp6_findmoption(m, ml, D6_OPTION_SERVERID, &si_len);
-		if (si == NULL)
+		si = dhcp6_findmoption(ifp->ctx, m, ml, D6_OPTION_SERVERID, &si_len);
+		if (si == NULL) {
+			dhcp6_freesend(state);
 			return -1;
+		}
 		len += sizeof(o) + si_len;
 		/* FALLTHROUGH */
 	case DH6S_REBIND:
@@ -872,7 +962,7 @@ dhcp6_makemessage(struct interface *ifp)
 			unicast = NULL;
 			break;
 		}
-		unicast = dhcp6_findmoption(m, ml, D6_OPTION_UNICAST, &uni_len);
+		unicast = dhcp6_findmoption(ifp->ctx, m, ml, D6_OPTION_UNICAST, &uni_len);
 		break;
 	default:
 		unicast = NULL;
@@ -906,9 +996,19 @@ dhcp6_makemessage(struct interface *ifp)
 	}
 #endif
 
-	state->send = malloc(len);
-	if (state->send == NULL)
-		return -1;
+	/* Reuse the old buffer - retransmissions are byte identical
+	 * bar the elapsed time and auth options, and even a new
+	 * exchange rarely needs a larger message. */
+	if (len > state->send_alloc) {
+		free(state->send);
+		state->send = malloc(len);
+		if (state->send == NULL) {
+			state->send_alloc = 0;
+			state->send_len = 0;
+			return -1;
+		}
+		state->send_alloc = len;
+	}
 
 	state->send_len = len;
 	state->send->type = type;
@@ -1201,7 +1301,7 @@ dhcp6_update_auth(struct interface *ifp, struct dhcp6_message *m, size_t len)
 	uint8_t *opt;
 	uint16_t opt_len;
 
-	opt = dhcp6_findmoption(m, len, D6_OPTION_AUTH, &opt_len);
+	opt = dhcp6_findmoption(ifp->ctx, m, len, D6_OPTION_AUTH, &opt_len);
 	if (opt == NULL)
 		return -1;
 
@@ -1461,6 +1561,8 @@ dhcp6_startrenew(void *arg)
 {
 	struct interface *ifp;
 	struct dhcp6_state *state;
+	struct timespec now;
+	uint32_t elapsed;
 
 	ifp = arg;
 	if ((state = D6_STATE(ifp)) == NULL)
@@ -1474,6 +1576,18 @@ dhcp6_startrenew(void *arg)
 	/* Remove the timeout as the renew may have been forced. */
 	eloop_timeout_delete(ifp->ctx->eloop, dhcp6_startrenew, ifp);
 
+	/* The rebind deadline is next. */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (uint32_t)eloop_timespec_diff(&now, &state->bound, NULL);
+	if (state->rebind && state->rebind != ND6_INFINITE_LIFETIME)
+		eloop_timeout_add_sec(ifp->ctx->eloop,
+		    state->rebind > elapsed ? state->rebind - elapsed : 0,
+		    dhcp6_startrebind, ifp);
+	else if (state->expire != ND6_INFINITE_LIFETIME)
+		eloop_timeout_add_sec(ifp->ctx->eloop,
+		    state->expire > elapsed ? state->expire - elapsed : 0,
+		    dhcp6_startexpire, ifp);
+
 	state->state = DH6S_RENEW;
 	state->RTC = 0;
 	state->IMD = REN_MAX_DELAY;
@@ -1833,6 +1947,19 @@ dhcp6_startrebind(void *arg)
 	else
 		loginfox("%s: rebinding prior DHCPv6 lease", ifp->name);
 	state->state = DH6S_REBIND;
+
+	/* The expiry deadline is next. */
+	if (state->expire != ND6_INFINITE_LIFETIME) {
+		struct timespec now;
+		uint32_t elapsed;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = (uint32_t)eloop_timespec_diff(&now,
+		    &state->bound, NULL);
+		eloop_timeout_add_sec(ifp->ctx->eloop,
+		    state->expire > elapsed ? state->expire - elapsed : 0,
+		    dhcp6_startexpire, ifp);
+	}
 	state->RTC = 0;
 	state->MRC = 0;
 
@@ -2016,18 +2143,18 @@ dhcp6_checkstatusok(const struct interface *ifp,
 	uint8_t *opt;
 	uint16_t opt_len, code;
 	size_t mlen;
-	void * (*f)(void *, size_t, uint16_t, uint16_t *), *farg;
 	char buf[32], *sbuf;
 	const char *status;
 	int loglevel;
 
 	state = D6_STATE(ifp);
-	f = p ? dhcp6_findoption : dhcp6_findmoption;
 	if (p)
-		farg = p;
+		opt = dhcp6_findoption(p, len,
+		    D6_OPTION_STATUS_CODE, &opt_len);
 	else
-		farg = m;
-	if ((opt = f(farg, len, D6_OPTION_STATUS_CODE, &opt_len)) == NULL) {
+		opt = dhcp6_findmoption(ifp->ctx, m, len,
+		    D6_OPTION_STATUS_CODE, &opt_len);
+	if (opt == NULL) {
 		//logdebugx("%s: no status", ifp->name);
 		state->lerror = 0;
 		errno = ESRCH;
@@ -2593,7 +2720,7 @@ dhcp6_readlease(struct interface *ifp, int validate)
 	struct dhcp6_state *state;
 	ssize_t bytes;
 	int fd;
-	time_t mtime, now;
+	time_t acquired, mtime, now;
 #ifdef AUTH
 	uint8_t *o;
 	uint16_t ol;
@@ -2603,11 +2730,14 @@ dhcp6_readlease(struct interface *ifp, int validate)
 	if (state->leasefile[0] == '\0') {
 		logdebugx("reading standard input");
 		bytes = read(fileno(stdin), buf.buf, sizeof(buf.buf));
+		if (bytes != -1)
+			bytes = dhcp_leaseextract(buf.buf, (size_t)bytes,
+			    &acquired);
 	} else {
 		logdebugx("%s: reading lease: %s",
 		    ifp->name, state->leasefile);
-		bytes = dhcp_readfile(ifp->ctx, state->leasefile,
-		    buf.buf, sizeof(buf.buf));
+		bytes = dhcp_readlease(ifp->ctx, state->leasefile,
+		    buf.buf, sizeof(buf.buf), &acquired);
 	}
 	if (bytes == -1)
 		goto ex;
@@ -2623,12 +2753,17 @@ dhcp6_readlease(struct interface *ifp, int validate)
 	if (!validate)
 		goto auth;
 
-	if (dhcp_filemtime(ifp->ctx, state->leasefile, &mtime) == -1)
+	if (acquired != (time_t)-1)
+		mtime = acquired;
+	else if (dhcp_filemtime(ifp->ctx, state->leasefile, &mtime) == -1)
 		goto ex;
 	clock_gettime(CLOCK_MONOTONIC, &state->acquired);
 	if ((now = time(NULL)) == -1)
 		goto ex;
 	state->acquired.tv_sec -= now - mtime;
+	/* The lease timers read below are relative to the backdated
+	 * acquisition, so chain any phase deadlines from it too. */
+	state->bound = state->acquired;
 
 	/* Check to see if the lease is still valid */
 	fd = dhcp6_validatelease(ifp, &buf.dhcp6, (size_t)bytes, NULL,
@@ -2648,7 +2783,8 @@ dhcp6_readlease(struct interface *ifp, int validate)
 auth:
 #ifdef AUTH
 	/* Authenticate the message */
-	o = dhcp6_findmoption(&buf.dhcp6, (size_t)bytes, D6_OPTION_AUTH, &ol);
+	o = dhcp6_findmoption(ifp->ctx, &buf.dhcp6, (size_t)bytes,
+	    D6_OPTION_AUTH, &ol);
 	if (o) {
 		if (dhcp_auth_validate(&state->auth, &ifp->options->auth,
 		    buf.buf, (size_t)bytes, 6, buf.dhcp6.type, o, ol) == NULL)
@@ -2967,7 +3103,7 @@ dhcp6_delegate_prefix(struct interface *ifp)
 	}
 
 	/* Now all addresses have been added, rebuild the routing table. */
-	rt_build(ifp->ctx, AF_INET6);
+	rt_build_if(ifp, AF_INET6);
 }
 
 static void
@@ -3035,7 +3171,7 @@ dhcp6_find_delegates(struct interface *ifp)
 		state = D6_STATE(ifp);
 		state->state = DH6S_DELEGATED;
 		ipv6_addaddrs(&state->addrs);
-		rt_build(ifp->ctx, AF_INET6);
+		rt_build_if(ifp, AF_INET6);
 		dhcp6_script_try_run(ifp, 1);
 	}
 	return k;
@@ -3064,6 +3200,7 @@ dhcp6_bind(struct interface *ifp, const char *op, const char *sfrom)
 	else
 		loglevel = LOG_INFO;
 	state->new_start = false;
+	stats_lat_record(ifp->name, STAT_LAT_DHCP6_BIND, &state->started);
 
 	if (!timedout) {
 		logmessage(loglevel, "%s: %s received from %s",
@@ -3090,7 +3227,7 @@ dhcp6_bind(struct interface *ifp, const char *op, const char *sfrom)
 
 		if (state->reason == NULL)
 			state->reason = "INFORM6";
-		o = dhcp6_findmoption(state->new, state->new_len,
+		o = dhcp6_findmoption(ifp->ctx, state->new, state->new_len,
 		                      D6_OPTION_INFO_REFRESH_TIME, &ol);
 		if (o == NULL || ol != sizeof(uint32_t))
 			state->renew = IRT_DEFAULT;
@@ -3212,15 +3349,21 @@ dhcp6_bind(struct interface *ifp, const char *op, const char *sfrom)
 			state->state = DH6S_BOUND;
 		state->failed = false;
 
+		/* Only the next deadline is armed - renewing arms the
+		 * rebind and rebinding arms the expiry, so a bound
+		 * lease keeps one pending timeout rather than three. */
+		state->bound = now;
 		if (state->renew && state->renew != ND6_INFINITE_LIFETIME)
 			eloop_timeout_add_sec(ifp->ctx->eloop,
-			    state->renew,
+			    state->renew -
+			    dhcpcd_renewjitter(ifp, state->renew),
 			    state->state == DH6S_INFORMED ?
 			    dhcp6_startinform : dhcp6_startrenew, ifp);
-		if (state->rebind && state->rebind != ND6_INFINITE_LIFETIME)
+		else if (state->rebind &&
+		    state->rebind != ND6_INFINITE_LIFETIME)
 			eloop_timeout_add_sec(ifp->ctx->eloop,
 			    state->rebind, dhcp6_startrebind, ifp);
-		if (state->expire != ND6_INFINITE_LIFETIME)
+		else if (state->expire != ND6_INFINITE_LIFETIME)
 			eloop_timeout_add_sec(ifp->ctx->eloop,
 			    state->expire, dhcp6_startexpire, ifp);
 
@@ -3247,13 +3390,13 @@ dhcp6_bind(struct interface *ifp, const char *op, const char *sfrom)
 		else
 			logmessage(loglevel, "%s: expire in %"PRIu32" seconds",
 			    ifp->name, state->expire);
-		rt_build(ifp->ctx, AF_INET6);
+		rt_build_if(ifp, AF_INET6);
 		if (!confirmed && !timedout) {
 			logdebugx("%s: writing lease: %s",
 			    ifp->name, state->leasefile);
-			if (dhcp_writefile(ifp->ctx, state->leasefile, 0640,
+			if (dhcp_writelease(ifp->ctx, state->leasefile, 0640,
 			    state->new, state->new_len) == -1)
-				logerr("dhcp_writefile: %s",state->leasefile);
+				logerr("dhcp_writelease: %s",state->leasefile);
 		}
 #ifndef SMALL
 		dhcp6_delegate_prefix(ifp);
@@ -3305,7 +3448,7 @@ dhcp6_recvif(struct interface *ifp, const char *sfrom,
 		return;
 	}
 
-	if (dhcp6_findmoption(r, len, D6_OPTION_SERVERID, NULL) == NULL) {
+	if (dhcp6_findmoption(ctx, r, len, D6_OPTION_SERVERID, NULL) == NULL) {
 		logdebugx("%s: no DHCPv6 server ID from %s", ifp->name, sfrom);
 		return;
 	}
@@ -3316,14 +3459,14 @@ dhcp6_recvif(struct interface *ifp, const char *sfrom,
 	    i++, opt++)
 	{
 		if (has_option_mask(ifo->requiremask6, opt->option) &&
-		    !dhcp6_findmoption(r, len, (uint16_t)opt->option, NULL))
+		    !dhcp6_findmoption(ctx, r, len, (uint16_t)opt->option, NULL))
 		{
 			logwarnx("%s: reject DHCPv6 (no option %s) from %s",
 			    ifp->name, opt->var, sfrom);
 			return;
 		}
 		if (has_option_mask(ifo->rejectmask6, opt->option) &&
-		    dhcp6_findmoption(r, len, (uint16_t)opt->option, NULL))
+		    dhcp6_findmoption(ctx, r, len, (uint16_t)opt->option, NULL))
 		{
 			logwarnx("%s: reject DHCPv6 (option %s) from %s",
 			    ifp->name, opt->var, sfrom);
@@ -3333,7 +3476,7 @@ dhcp6_recvif(struct interface *ifp, const char *sfrom,
 
 #ifdef AUTH
 	/* Authenticate the message */
-	auth = dhcp6_findmoption(r, len, D6_OPTION_AUTH, &auth_len);
+	auth = dhcp6_findmoption(ctx, r, len, D6_OPTION_AUTH, &auth_len);
 	if (auth != NULL) {
 		if (dhcp_auth_validate(&state->auth, &ifo->auth,
 		    (uint8_t *)r, len, 6, r->type, auth, auth_len) == NULL)
@@ -3378,7 +3521,7 @@ dhcp6_recvif(struct interface *ifp, const char *sfrom,
 			 * Normally we get an ADVERTISE for a DISCOVER. */
 			if (!has_option_mask(ifo->requestmask6,
 			    D6_OPTION_RAPID_COMMIT) ||
-			    !dhcp6_findmoption(r, len, D6_OPTION_RAPID_COMMIT,
+			    !dhcp6_findmoption(ctx, r, len, D6_OPTION_RAPID_COMMIT,
 					      NULL))
 			{
 				valid_op = false;
@@ -3440,7 +3583,7 @@ dhcp6_recvif(struct interface *ifp, const char *sfrom,
 			break;
 		}
 		/* RFC7083 */
-		o = dhcp6_findmoption(r, len, D6_OPTION_SOL_MAX_RT, &ol);
+		o = dhcp6_findmoption(ctx, r, len, D6_OPTION_SOL_MAX_RT, &ol);
 		if (o && ol == sizeof(uint32_t)) {
 			uint32_t max_rt;
 
@@ -3456,7 +3599,7 @@ dhcp6_recvif(struct interface *ifp, const char *sfrom,
 				logerr("%s: invalid SOL_MAX_RT %u",
 				    ifp->name, max_rt);
 		}
-		o = dhcp6_findmoption(r, len, D6_OPTION_INF_MAX_RT, &ol);
+		o = dhcp6_findmoption(ctx, r, len, D6_OPTION_INF_MAX_RT, &ol);
 		if (o && ol == sizeof(uint32_t)) {
 			uint32_t max_rt;
 
@@ -3486,7 +3629,7 @@ dhcp6_recvif(struct interface *ifp, const char *sfrom,
 #ifdef AUTH
 		}
 		loginfox("%s: %s from %s", ifp->name, op, sfrom);
-		o = dhcp6_findmoption(r, len, D6_OPTION_RECONF_MSG, &ol);
+		o = dhcp6_findmoption(ctx, r, len, D6_OPTION_RECONF_MSG, &ol);
 		if (o == NULL) {
 			logerrx("%s: missing Reconfigure Message option",
 			    ifp->name);
@@ -3584,6 +3727,7 @@ dhcp6_recvmsg(struct dhcpcd_ctx *ctx, struct msghdr *msg, struct ipv6_addr *ia)
 	uint8_t *o;
 	uint16_t ol;
 
+	STAT_INC(dhcp6_rx);
 	inet_ntop(AF_INET6, &from->sin6_addr, sfrom, sizeof(sfrom));
 	if (len < sizeof(struct dhcp6_message)) {
 		logerrx("DHCPv6 packet too short from %s", sfrom);
@@ -3604,7 +3748,7 @@ dhcp6_recvmsg(struct dhcpcd_ctx *ctx, struct msghdr *msg, struct ipv6_addr *ia)
 
 	uint8_t duid[DUID_LEN], *dp;
 	size_t duid_len;
-	o = dhcp6_findmoption(r, len, D6_OPTION_CLIENTID, &ol);
+	o = dhcp6_findmoption(ctx, r, len, D6_OPTION_CLIENTID, &ol);
 	if (ifp->options->options & DHCPCD_ANONYMOUS) {
 		duid_len = duid_make(duid, ifp, DUID_LL);
 		dp = duid;
@@ -3618,7 +3762,7 @@ dhcp6_recvmsg(struct dhcpcd_ctx *ctx, struct msghdr *msg, struct ipv6_addr *ia)
 		return;
 	}
 
-	if (dhcp6_findmoption(r, len, D6_OPTION_SERVERID, NULL) == NULL) {
+	if (dhcp6_findmoption(ctx, r, len, D6_OPTION_SERVERID, NULL) == NULL) {
 		logdebugx("%s: no DHCPv6 server ID from %s",
 		    ifp->name, sfrom);
 		return;
@@ -3697,8 +3841,8 @@ dhcp6_recvmsg(struct dhcpcd_ctx *ctx, struct msghdr *msg, struct ipv6_addr *ia)
 	close(fd);
 
 	/* Copy across ServerID so we can work with our own server. */
-	si1 = dhcp6_findmoption(r, len, D6_OPTION_SERVERID, &si_len1);
-	si2 = dhcp6_findmoption(tbuf, (size_t)tlen,
+	si1 = dhcp6_findmoption(ctx, r, len, D6_OPTION_SERVERID, &si_len1);
+	si2 = dhcp6_findmoption(ctx, tbuf, (size_t)tlen,
 	    D6_OPTION_SERVERID, &si_len2);
 	if (si1 != NULL && si2 != NULL && si_len1 == si_len2)
 		memcpy(si2, si1, si_len2);
@@ -3707,7 +3851,11 @@ dhcp6_recvmsg(struct dhcpcd_ctx *ctx, struct msghdr *msg, struct ipv6_addr *ia)
 #endif
 
 recvif:
+	/* Index the message on arrival - accepting a reply makes many
+	 * option lookups across IA_NA, IA_PD and status codes. */
+	dhcp6_message_index(ctx, r, len);
 	dhcp6_recvif(ifp, sfrom, r, len);
+	dhcp6_message_index_clear(ctx);
 }
 
 static void
@@ -3879,6 +4027,8 @@ dhcp6_start1(void *arg)
 			return;
 		}
 		eloop_event_add(ctx->eloop, ctx->dhcp6_rfd, dhcp6_recvctx, ctx);
+		eloop_event_priority(ctx->eloop, ctx->dhcp6_rfd,
+		    ELOOP_PRIO_HIGH);
 	}
 
 	if (!IN_PRIVSEP(ctx) && ctx->dhcp6_wfd == -1) {
@@ -4197,9 +4347,12 @@ dhcp6_handleifa(int cmd, struct ipv6_addr *ia, pid_t pid)
 			if (ia->dhcp6_fd == -1)
 				ia->dhcp6_fd = dhcp6_openudp(ia->iface->index,
 				    &ia->addr);
-			if (ia->dhcp6_fd != -1)
+			if (ia->dhcp6_fd != -1) {
 				eloop_event_add(ia->iface->ctx->eloop,
 				ia->dhcp6_fd, dhcp6_recvaddr, ia);
+				eloop_event_priority(ia->iface->ctx->eloop,
+				    ia->dhcp6_fd, ELOOP_PRIO_HIGH);
+			}
 		}
 	}
 
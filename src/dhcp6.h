@@ -193,6 +193,7 @@ struct dhcp6_state {
 
 	struct dhcp6_message *send;
 	size_t send_len;
+	size_t send_alloc;	/* capacity of send, kept across exchanges */
 	struct dhcp6_message *recv;
 	size_t recv_len;
 	struct dhcp6_message *new;
@@ -201,6 +202,10 @@ struct dhcp6_state {
 	size_t old_len;
 
 	struct timespec acquired;
+	/* When renew, rebind and expire were established.  They are
+	 * chained from one pending timeout, each phase arming the next
+	 * from the deadline remaining against this. */
+	struct timespec bound;
 	uint32_t renew;
 	uint32_t rebind;
 	uint32_t expire;
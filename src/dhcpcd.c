@@ -35,6 +35,7 @@ static const char dhcpcd_copyright[] = "Copyright (c) 2006-2021 Roy Marples";
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/uio.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 
 #include <ctype.h>
@@ -44,6 +45,7 @@ static const char dhcpcd_copyright[] = "Copyright (c) 2006-2021 Roy Marples";
 #include <limits.h>
 #include <paths.h>
 #include <signal.h>
+#include <stddef.h>	/* For offsetof, readiness notification */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -68,13 +70,18 @@ static const char dhcpcd_copyright[] = "Copyright (c) 2006-2021 Roy Marples";
 #include "ipv4ll.h"
 #include "ipv6.h"
 #include "ipv6nd.h"
+#include "leasedb.h"
 #include "logerr.h"
 #include "privsep.h"
 #include "script.h"
+#include "stats.h"
 
 #ifdef HAVE_CAPSICUM
 #include <sys/capsicum.h>
 #endif
+#if defined(__linux__) && !defined(SMALL)
+#include <sys/inotify.h>
+#endif
 #ifdef HAVE_UTIL_H
 #include <util.h>
 #endif
@@ -130,6 +137,8 @@ free_globals(struct dhcpcd_ctx *ctx)
 {
 	struct dhcp_opt *opt;
 
+	free(ctx->leasedb_file);
+	ctx->leasedb_file = NULL;
 	if (ctx->ifac) {
 		for (; ctx->ifac > 0; ctx->ifac--)
 			free(ctx->ifav[ctx->ifac - 1]);
@@ -148,6 +157,7 @@ free_globals(struct dhcpcd_ctx *ctx)
 		free(ctx->ifcv);
 		ctx->ifcv = NULL;
 	}
+	config_cache_free(ctx);
 
 #ifdef INET
 	if (ctx->dhcp_opts) {
@@ -177,6 +187,10 @@ free_globals(struct dhcpcd_ctx *ctx)
 		free(ctx->dhcp6_opts);
 		ctx->dhcp6_opts = NULL;
 	}
+	free(ctx->d6_opt_idx);
+	ctx->d6_opt_idx = NULL;
+	ctx->d6_opt_idx_size = ctx->d6_opt_idx_len = 0;
+	ctx->d6_opt_idx_msg = NULL;
 #endif
 #endif
 	if (ctx->vivso) {
@@ -226,6 +240,36 @@ dhcpcd_af(int af)
 	}
 }
 
+/* Deterministic per-interface renewal jitter.
+ * Interfaces that bound together would otherwise all renew together,
+ * so when renew_jitter is set the renewal is brought forward by a
+ * hash of the interface name and DUID spread over that percentage of
+ * the renewal time.  Hashing rather than random keeps each interface
+ * at a stable point in the window across runs. */
+uint32_t
+dhcpcd_renewjitter(const struct interface *ifp, uint32_t renewaltime)
+{
+	const struct dhcpcd_ctx *ctx = ifp->ctx;
+	uint32_t window, hash = 2166136261U;
+	const char *n;
+	size_t i;
+
+	if (ifp->options->renew_jitter == 0)
+		return 0;
+	window = (uint32_t)((uint64_t)renewaltime *
+	    ifp->options->renew_jitter / 100);
+	if (window == 0)
+		return 0;
+
+	/* FNV-1a */
+	for (n = ifp->name; *n != '\0'; n++)
+		hash = (hash ^ (uint8_t)*n) * 16777619U;
+	for (i = 0; i < ctx->duid_len; i++)
+		hash = (hash ^ ctx->duid[i]) * 16777619U;
+
+	return hash % (window + 1);
+}
+
 int
 dhcpcd_ifafwaiting(const struct interface *ifp)
 {
@@ -303,18 +347,53 @@ dhcpcd_afwaiting(const struct dhcpcd_ctx *ctx)
 	return af;
 }
 
+/* An interface is ready when its waiting conditions are satisfied
+ * and it has gained at least one address. */
+static bool
+dhcpcd_ifready(const struct interface *ifp)
+{
+
+	if (ifp->active != IF_ACTIVE_USER ||
+	    dhcpcd_ifafwaiting(ifp) != AF_MAX)
+		return false;
+	return false
+#ifdef INET
+	    || ipv4_hasaddr(ifp)
+#endif
+#ifdef INET6
+	    || ipv6_hasaddr(ifp)
+#endif
+	    ; /* CONSTCOND */
+}
+
 static int
 dhcpcd_ipwaited(struct dhcpcd_ctx *ctx)
 {
 	struct interface *ifp;
 	int af;
+	size_t ready = 0;
 
 	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
 		if ((af = dhcpcd_ifafwaiting(ifp)) != AF_MAX) {
+			/* With waitifaces a slow interface cannot hold
+			 * everything back, keep counting the others. */
+			if (ctx->waitifaces != 0)
+				continue;
 			logdebugx("%s: waiting for an %s address",
 			    ifp->name, dhcpcd_af(af));
 			return 0;
 		}
+		if (dhcpcd_ifready(ifp))
+			ready++;
+	}
+
+	if (ctx->waitifaces != 0) {
+		if (ready < ctx->waitifaces) {
+			logdebugx("waiting for %zu of %zu interfaces",
+			    ctx->waitifaces - ready, ctx->waitifaces);
+			return 0;
+		}
+		return 1;
 	}
 
 	if ((af = dhcpcd_afwaiting(ctx)) != AF_MAX) {
@@ -326,6 +405,49 @@ dhcpcd_ipwaited(struct dhcpcd_ctx *ctx)
 	return 1;
 }
 
+/* Connect a datagram socket to a supervisor in the systemd
+ * NOTIFY_SOCKET style.  This must be done before the manager process
+ * is sandboxed as creating sockets is forbidden afterwards. */
+static void
+dhcpcd_notify_init(struct dhcpcd_ctx *ctx)
+{
+	struct sockaddr_un sun = { .sun_family = AF_UNIX };
+	const char *path;
+	size_t plen;
+
+	path = getenv("NOTIFY_SOCKET");
+	if (path == NULL)
+		return;
+	plen = strlen(path);
+	if (plen == 0 || plen >= sizeof(sun.sun_path))
+		return;
+	memcpy(sun.sun_path, path, plen);
+	if (sun.sun_path[0] == '@')	/* Linux abstract namespace */
+		sun.sun_path[0] = '\0';
+
+	ctx->notify_fd = xsocket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (ctx->notify_fd == -1)
+		return;
+	if (connect(ctx->notify_fd, (struct sockaddr *)&sun,
+	    (socklen_t)(offsetof(struct sockaddr_un, sun_path) + plen)) == -1)
+	{
+		logwarn(__func__);
+		close(ctx->notify_fd);
+		ctx->notify_fd = -1;
+	}
+}
+
+/* Report readiness to the supervisor.
+ * This is harmless where no supervisor is listening. */
+static void
+dhcpcd_notify(struct dhcpcd_ctx *ctx, const char *msg)
+{
+
+	if (ctx->notify_fd == -1)
+		return;
+	(void)send(ctx->notify_fd, msg, strlen(msg), 0);
+}
+
 /* Returns the pid of the child, otherwise 0. */
 void
 dhcpcd_daemonise(struct dhcpcd_ctx *ctx)
@@ -337,6 +459,26 @@ dhcpcd_daemonise(struct dhcpcd_ctx *ctx)
 #else
 	int i;
 	unsigned int logopts = loggetopts();
+	static bool ready_notified;
+
+	/* We are called whenever an interface binds, so tell any
+	 * supervisor how far along we are. */
+	if (ctx->notify_fd != -1) {
+		const struct interface *ifp;
+		size_t nactive = 0, nready = 0;
+		char status[64];
+
+		TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+			if (ifp->active != IF_ACTIVE_USER)
+				continue;
+			nactive++;
+			if (dhcpcd_ifready(ifp))
+				nready++;
+		}
+		snprintf(status, sizeof(status),
+		    "STATUS=%zu of %zu interfaces bound", nready, nactive);
+		dhcpcd_notify(ctx, status);
+	}
 
 	if (ctx->options & DHCPCD_DAEMONISE &&
 	    !(ctx->options & (DHCPCD_DAEMONISED | DHCPCD_NOWAITIP)))
@@ -345,6 +487,11 @@ dhcpcd_daemonise(struct dhcpcd_ctx *ctx)
 			return;
 	}
 
+	if (!ready_notified) {
+		dhcpcd_notify(ctx, "READY=1");
+		ready_notified = true;
+	}
+
 	if (ctx->options & DHCPCD_ONESHOT) {
 		loginfox("exiting due to oneshot");
 		eloop_exit(ctx->eloop, EXIT_SUCCESS);
@@ -403,6 +550,18 @@ dhcpcd_drop(struct interface *ifp, int stop)
 #ifdef ARP
 	arp_drop(ifp);
 #endif
+
+	/* DHCPv6 releases its state entirely in dhcp6_drop.
+	 * Do the same for DHCP and IPv6ND rather than hold their
+	 * state until the interface departs - they will allocate
+	 * it again on restart.  With many interfaces down or
+	 * disabled for a protocol this is a real memory saving. */
+#ifdef INET6
+	ipv6nd_free(ifp);
+#endif
+#ifdef INET
+	dhcp_free(ifp);
+#endif
 #if !defined(DHCP6) && !defined(DHCP)
 	UNUSED(stop);
 #endif
@@ -606,6 +765,8 @@ dhcpcd_selectprofile(struct interface *ifp, const char *profile)
 
 	free_options(ifp->ctx, ifp->options);
 	ifp->options = ifo;
+	/* The new options may serialize the same lease differently. */
+	script_free(ifp);
 	if (profile) {
 		add_options(ifp->ctx, ifp->name, ifp->options,
 		    ifp->ctx->argc, ifp->ctx->argv);
@@ -715,8 +876,8 @@ dhcpcd_nocarrier_roaming(struct interface *ifp)
 	script_runreason(ifp, "NOCARRIER_ROAMING");
 }
 
-void
-dhcpcd_handlecarrier(struct interface *ifp, int carrier, unsigned int flags)
+static void
+dhcpcd_handlecarrier1(struct interface *ifp, int carrier, unsigned int flags)
 {
 	bool was_link_up = if_is_link_up(ifp);
 	bool was_roaming = if_roaming(ifp);
@@ -787,7 +948,10 @@ dhcpcd_handlecarrier(struct interface *ifp, int carrier, unsigned int flags)
 
 		olen = ifp->ssid_len;
 		memcpy(ossid, ifp->ssid, ifp->ssid_len);
-		if_getssid(ifp);
+		/* Only query the driver if a wireless event
+		 * invalidated the cached SSID. */
+		if (!ifp->ssid_fresh || ifp->ssid_len == 0)
+			if_getssid(ifp);
 
 		/* If we changed SSID network, drop leases */
 		if ((ifp->ssid_len != olen ||
@@ -820,6 +984,52 @@ dhcpcd_handlecarrier(struct interface *ifp, int carrier, unsigned int flags)
 	dhcpcd_startinterface(ifp);
 }
 
+static void
+dhcpcd_debouncecarrier(void *arg)
+{
+	struct interface *ifp = arg;
+
+	ifp->carrier_debouncing = false;
+	dhcpcd_handlecarrier1(ifp, ifp->carrier_pending, ifp->flags_pending);
+}
+
+/* A flapping link gives us many transitions per second, each tearing
+ * down and re-arming address, route and DHCP state and running hooks.
+ * If a debounce window is configured, a changed link state must hold
+ * for the window before it is acted on.
+ * Flag changes which don't alter the link state are applied directly. */
+void
+dhcpcd_handlecarrier(struct interface *ifp, int carrier, unsigned int flags)
+{
+	struct if_options *ifo = ifp->options;
+
+	if (ifo == NULL || ifo->carrier_debounce == 0) {
+		dhcpcd_handlecarrier1(ifp, carrier, flags);
+		return;
+	}
+
+	if (if_is_link_state_up(ifp, carrier, flags) == if_is_link_up(ifp)) {
+		/* No transition, or a flap returned to the steady
+		 * state - cancel any pending transition. */
+		if (ifp->carrier_debouncing) {
+			eloop_timeout_delete(ifp->ctx->eloop,
+			    dhcpcd_debouncecarrier, ifp);
+			ifp->carrier_debouncing = false;
+		}
+		dhcpcd_handlecarrier1(ifp, carrier, flags);
+		return;
+	}
+
+	if (ifp->carrier_debouncing &&
+	    ifp->carrier_pending == carrier && ifp->flags_pending == flags)
+		return;
+	ifp->carrier_pending = carrier;
+	ifp->flags_pending = flags;
+	ifp->carrier_debouncing = true;
+	eloop_timeout_add_msec(ifp->ctx->eloop, ifo->carrier_debounce,
+	    dhcpcd_debouncecarrier, ifp);
+}
+
 static void
 warn_iaid_conflict(struct interface *ifp, uint16_t ia_type, uint8_t *iaid)
 {
@@ -1050,6 +1260,7 @@ dhcpcd_handleinterface(void *arg, int action, const char *ifname)
 			stop_interface(ifp, "DEPARTED");
 		}
 		TAILQ_REMOVE(ctx->ifaces, ifp, next);
+		if_dirtyindexmap(ctx);
 		if_free(ifp);
 		return 0;
 	}
@@ -1084,6 +1295,10 @@ dhcpcd_handleinterface(void *arg, int action, const char *ifname)
 	} else {
 		TAILQ_REMOVE(ifs, ifp, next);
 		TAILQ_INSERT_TAIL(ctx->ifaces, ifp, next);
+		if_dirtyindexmap(ctx);
+		/* The kernel may hold routes for the interface from
+		 * before we knew of it. */
+		rt_kroutes_invalidate(ctx);
 		if (ifp->active) {
 			logdebugx("%s: interface added", ifp->name);
 			dhcpcd_initstate(ifp, 0);
@@ -1105,7 +1320,7 @@ out:
 		if_free(ifp);
 	}
 	free(ifs);
-	if_freeifaddrs(&ifaddrs);
+	if_freeifaddrs(ctx, &ifaddrs);
 
 	return e;
 }
@@ -1203,6 +1418,18 @@ dhcpcd_linkoverflow(struct dhcpcd_ctx *ctx)
 	if (rcnt % 1000 != 0)
 		logwarnx("drained %zu messages", rcnt);
 
+	/* An unknown number of route messages were dropped with the
+	 * overflow, so our shadow of the kernel route table is stale. */
+	rt_kroutes_invalidate(ctx);
+
+#ifdef __linux__
+	/* Re-dump state for just the interfaces we manage rather than
+	 * discovering every system interface. */
+	if (if_resync(ctx) == 0)
+		return;
+	logerr("%s: if_resync", __func__);
+#endif
+
 	/* Work out the current interfaces. */
 	ifaces = if_discover(ctx, &ifaddrs, ctx->ifc, ctx->ifv);
 	if (ifaces == NULL) {
@@ -1230,6 +1457,7 @@ dhcpcd_linkoverflow(struct dhcpcd_ctx *ctx)
 			continue;
 		}
 		TAILQ_INSERT_TAIL(ctx->ifaces, ifp, next);
+		if_dirtyindexmap(ctx);
 		if (ifp->active) {
 			dhcpcd_initstate(ifp, 0);
 			eloop_timeout_add_sec(ctx->eloop, 0,
@@ -1242,7 +1470,7 @@ dhcpcd_linkoverflow(struct dhcpcd_ctx *ctx)
 	if_markaddrsstale(ctx->ifaces);
 	if_learnaddrs(ctx, ctx->ifaces, &ifaddrs);
 	if_deletestaleaddrs(ctx->ifaces);
-	if_freeifaddrs(&ifaddrs);
+	if_freeifaddrs(ctx, &ifaddrs);
 }
 
 void
@@ -1282,16 +1510,129 @@ dhcpcd_handlehwaddr(struct interface *ifp,
 		memcpy(ifp->hwaddr, hwaddr, hwlen);
 }
 
+#if defined(__linux__) && !defined(SMALL)
+/*
+ * Watch the config file for changes so the compiled configuration
+ * cache is refreshed ahead of any reload - SIGHUP then applies an
+ * already parsed configuration instead of parsing under time
+ * pressure.
+ * The directory is watched rather than the file as editors and
+ * config pushes commonly replace the file by rename, which would
+ * leave an inode watch stale.
+ */
+static void
+dhcpcd_preparse(void *arg)
+{
+	struct dhcpcd_ctx *ctx = arg;
+
+	logdebugx("%s changed, re-compiling", ctx->cffile);
+	config_preparse(ctx);
+}
+
+static void
+dhcpcd_watchcb(void *arg)
+{
+	struct dhcpcd_ctx *ctx = arg;
+	union {
+		struct inotify_event ev;
+		char buf[sizeof(struct inotify_event) + NAME_MAX + 1];
+	} ibuf;
+	const struct inotify_event *evp;
+	const char *base, *p;
+	ssize_t len;
+	bool changed = false;
+
+	len = read(ctx->inotify_fd, ibuf.buf, sizeof(ibuf.buf));
+	if (len == -1) {
+		logerr(__func__);
+		return;
+	}
+
+	base = strrchr(ctx->cffile, '/');
+	base = base == NULL ? ctx->cffile : base + 1;
+	for (p = ibuf.buf; p < ibuf.buf + len;
+	    p += sizeof(*evp) + evp->len)
+	{
+		evp = (const struct inotify_event *)(const void *)p;
+		if (evp->len != 0 && strcmp(evp->name, base) == 0)
+			changed = true;
+	}
+	if (!changed)
+		return;
+
+	/* Editors fire several events per save, so debounce. */
+	eloop_timeout_add_sec(ctx->eloop, 1, dhcpcd_preparse, ctx);
+}
+
+/* Called before the manager sandboxes itself - the watch keeps
+ * delivering events after the filesystem view is gone and the
+ * re-compile reads the file via the privileged process. */
+static void
+dhcpcd_watchconfig(struct dhcpcd_ctx *ctx)
+{
+	char dir[PATH_MAX], *p;
+
+	ctx->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (ctx->inotify_fd == -1) {
+		logwarn("%s: inotify_init1", __func__);
+		return;
+	}
+
+	strlcpy(dir, ctx->cffile, sizeof(dir));
+	if ((p = strrchr(dir, '/')) == NULL)
+		strlcpy(dir, ".", sizeof(dir));
+	else if (p == dir)
+		p[1] = '\0';
+	else
+		*p = '\0';
+
+	if (inotify_add_watch(ctx->inotify_fd, dir,
+	    IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) == -1 ||
+	    eloop_event_add(ctx->eloop, ctx->inotify_fd,
+	    dhcpcd_watchcb, ctx) == -1)
+	{
+		logwarn("%s: %s", __func__, dir);
+		close(ctx->inotify_fd);
+		ctx->inotify_fd = -1;
+	}
+}
+#endif
+
 static void
 if_reboot(struct interface *ifp, int argc, char **argv)
 {
+	struct if_options *oldifo = ifp->options;
 #ifdef INET
 	unsigned long long oldopts;
 
-	oldopts = ifp->options->options;
+	oldopts = oldifo->options;
 #endif
-	script_runreason(ifp, "RECONFIGURE");
+
+	/* Keep the old options aside so the new parse can be diffed
+	 * against them - an interface whose effective configuration
+	 * has not changed is left alone. */
+	ifp->options = NULL;
 	dhcpcd_initstate1(ifp, argc, argv, 0);
+	if (ifp->options == NULL) {
+		free_options(ifp->ctx, oldifo);
+		return;
+	}
+	if (if_options_equal(ifp->options, oldifo)) {
+		logdebugx("%s: configuration unchanged", ifp->name);
+		free_options(ifp->ctx, oldifo);
+		return;
+	}
+
+	/* configure_interface() could not see the old mtime, so expire
+	 * the lease here, now we know this interface really changed. */
+	if (oldifo->mtime != 0 && ifp->options->mtime != oldifo->mtime) {
+		logwarnx("%s: config file changed, expiring leases",
+		    ifp->name);
+		dhcpcd_drop(ifp, 0);
+	}
+	free_options(ifp->ctx, oldifo);
+
+	script_runreason(ifp, "RECONFIGURE");
 #ifdef INET
 	dhcp_reboot_newopts(ifp, oldopts);
 #endif
@@ -1306,6 +1647,10 @@ reload_config(struct dhcpcd_ctx *ctx)
 {
 	struct if_options *ifo;
 
+#ifdef __linux__
+	/* The new configuration may deny a different set of interfaces. */
+	if_ignorefilter_reset(ctx);
+#endif
 	free_globals(ctx);
 	if ((ifo = read_config(ctx, NULL, NULL, NULL)) == NULL)
 		return;
@@ -1467,9 +1812,14 @@ dhcpcd_signal_cb(int sig, void *arg)
 			logerr("logopen");
 		return;
 	case SIGCHLD:
-		while (waitpid(-1, NULL, WNOHANG) > 0)
-			;
+	{
+		int status;
+		pid_t pid;
+
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+			script_reap(ctx, pid, status);
 		return;
+	}
 	default:
 		logerrx("received signal %d but don't know what to do with it",
 		    sig);
@@ -1482,34 +1832,235 @@ dhcpcd_signal_cb(int sig, void *arg)
 }
 #endif
 
+/* Dump the requested interfaces (all active ones if none are named)
+ * to the control socket client.  Named interfaces are resolved
+ * through the sorted name map in if_find() so the cost does not grow
+ * with the interface count. */
+static int
+dhcpcd_sendinterfaces(struct dhcpcd_ctx *ctx, struct fd_list *fd,
+    int argc, char **argv, int af)
+{
+	struct interface *ifp;
+	size_t nifaces;
+	int n, oi, oj;
+
+	nifaces = 0;
+	if (argc == 0) {
+		TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+			if (!ifp->active)
+				continue;
+			n = send_interface(NULL, ifp, af);
+			if (n == -1)
+				return -1;
+			nifaces += (size_t)n;
+		}
+	} else {
+		for (oi = 0; oi < argc; oi++) {
+			/* Skip duplicate names, the interface walk
+			 * this replaces only sent each one once. */
+			for (oj = 0; oj < oi; oj++) {
+				if (strcmp(argv[oj], argv[oi]) == 0)
+					break;
+			}
+			if (oj != oi)
+				continue;
+			ifp = if_find(ctx->ifaces, argv[oi]);
+			if (ifp == NULL || !ifp->active)
+				continue;
+			n = send_interface(NULL, ifp, af);
+			if (n == -1)
+				return -1;
+			nifaces += (size_t)n;
+		}
+	}
+
+	if (write(fd->fd, &nifaces, sizeof(nifaces)) != sizeof(nifaces))
+		return -1;
+
+	if (argc == 0) {
+		TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+			if (!ifp->active)
+				continue;
+			if (send_interface(fd, ifp, af) == -1)
+				return -1;
+		}
+	} else {
+		for (oi = 0; oi < argc; oi++) {
+			for (oj = 0; oj < oi; oj++) {
+				if (strcmp(argv[oj], argv[oi]) == 0)
+					break;
+			}
+			if (oj != oi)
+				continue;
+			ifp = if_find(ctx->ifaces, argv[oi]);
+			if (ifp == NULL || !ifp->active)
+				continue;
+			if (send_interface(fd, ifp, af) == -1)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/* Control socket commands which reply directly.
+ * The other end should be blocking until it gets the expected reply
+ * so we can safely just change the write callback on the fd.
+ * Orchestration tooling can issue hundreds of control requests a
+ * second, so they dispatch from a sorted table rather than a strcmp
+ * chain.  Make any change here in privsep-control.c as well. */
+
+static int
+dhcpcd_command_getconfigfile(struct dhcpcd_ctx *ctx, struct fd_list *fd,
+    int argc, char **argv)
+{
+
+	UNUSED(ctx);
+	UNUSED(argc);
+	UNUSED(argv);
+	return control_queue(fd, UNCONST(fd->ctx->cffile),
+	    strlen(fd->ctx->cffile) + 1);
+}
+
+static int
+dhcpcd_command_getinterfaces(struct dhcpcd_ctx *ctx, struct fd_list *fd,
+    int argc, char **argv)
+{
+
+	UNUSED(argc);
+	UNUSED(argv);
+	return dhcpcd_sendinterfaces(ctx, fd, 0, NULL, AF_UNSPEC);
+}
+
+#ifdef STATS
+static int
+dhcpcd_command_getlatency(struct dhcpcd_ctx *ctx, struct fd_list *fd,
+    int argc, char **argv)
+{
+	char latbuf[4096];
+	ssize_t llen;
+
+	UNUSED(ctx);
+	UNUSED(argc);
+	UNUSED(argv);
+	llen = stats_lat_dump(latbuf, sizeof(latbuf));
+	if (llen == -1)
+		return -1;
+	return control_queue(fd, latbuf, (size_t)llen);
+}
+
+static int
+dhcpcd_command_getmemory(struct dhcpcd_ctx *ctx, struct fd_list *fd,
+    int argc, char **argv)
+{
+	char membuf[1024];
+	ssize_t mlen;
+
+	UNUSED(argc);
+	UNUSED(argv);
+	mlen = stats_mem_dump(ctx, membuf, sizeof(membuf));
+	if (mlen == -1)
+		return -1;
+	return control_queue(fd, membuf, (size_t)mlen);
+}
+
+static int
+dhcpcd_command_getstats(struct dhcpcd_ctx *ctx, struct fd_list *fd,
+    int argc, char **argv)
+{
+	char statbuf[1024];
+	ssize_t slen;
+
+	UNUSED(argc);
+	UNUSED(argv);
+	slen = stats_dump(ctx, statbuf, sizeof(statbuf));
+	if (slen == -1)
+		return -1;
+	return control_queue(fd, statbuf, (size_t)slen);
+}
+#endif
+
+static int
+dhcpcd_command_listen(struct dhcpcd_ctx *ctx, struct fd_list *fd,
+    int argc, char **argv)
+{
+
+	UNUSED(ctx);
+	UNUSED(argc);
+	UNUSED(argv);
+	fd->flags |= FD_LISTEN;
+	return 0;
+}
+
+static int
+dhcpcd_command_subscribe(struct dhcpcd_ctx *ctx, struct fd_list *fd,
+    int argc, char **argv)
+{
+
+	UNUSED(ctx);
+	fd->flags |= FD_LISTEN;
+	fd->listen_if[0] = fd->listen_reason[0] = '\0';
+	if (argc > 1)
+		strlcpy(fd->listen_if, argv[1], sizeof(fd->listen_if));
+	if (argc > 2)
+		strlcpy(fd->listen_reason, argv[2], sizeof(fd->listen_reason));
+	return 0;
+}
+
+static int
+dhcpcd_command_version(struct dhcpcd_ctx *ctx, struct fd_list *fd,
+    int argc, char **argv)
+{
+
+	UNUSED(ctx);
+	UNUSED(argc);
+	UNUSED(argv);
+	return control_queue(fd, UNCONST(VERSION), strlen(VERSION) + 1);
+}
+
+struct dhcpcd_command {
+	const char *name;
+	int (*exec)(struct dhcpcd_ctx *, struct fd_list *, int, char **);
+};
+
+/* Sorted by name for bsearch(3). */
+static const struct dhcpcd_command dhcpcd_commands[] = {
+	{ "--getconfigfile",	dhcpcd_command_getconfigfile },
+	{ "--getinterfaces",	dhcpcd_command_getinterfaces },
+#ifdef STATS
+	{ "--getlatency",	dhcpcd_command_getlatency },
+	{ "--getmemory",	dhcpcd_command_getmemory },
+	{ "--getstats",		dhcpcd_command_getstats },
+#endif
+	{ "--listen",		dhcpcd_command_listen },
+	{ "--subscribe",	dhcpcd_command_subscribe },
+	{ "--version",		dhcpcd_command_version },
+};
+
+static int
+dhcpcd_command_cmp(const void *vkey, const void *ventry)
+{
+	const struct dhcpcd_command *cmd = ventry;
+
+	return strcmp(vkey, cmd->name);
+}
+
 int
 dhcpcd_handleargs(struct dhcpcd_ctx *ctx, struct fd_list *fd,
     int argc, char **argv)
 {
+	const struct dhcpcd_command *cmd;
 	struct interface *ifp;
 	unsigned long long opts;
 	int opt, oi, do_reboot, do_renew, af = AF_UNSPEC;
-	size_t len, l, nifaces;
+	size_t len, l;
 	char *tmp, *p;
 
-	/* Special commands for our control socket
-	 * as the other end should be blocking until it gets the
-	 * expected reply we should be safely able just to change the
-	 * write callback on the fd */
-	/* Make any change here in privsep-control.c as well. */
-	if (strcmp(*argv, "--version") == 0) {
-		return control_queue(fd, UNCONST(VERSION),
-		    strlen(VERSION) + 1);
-	} else if (strcmp(*argv, "--getconfigfile") == 0) {
-		return control_queue(fd, UNCONST(fd->ctx->cffile),
-		    strlen(fd->ctx->cffile) + 1);
-	} else if (strcmp(*argv, "--getinterfaces") == 0) {
-		optind = argc = 0;
-		goto dumplease;
-	} else if (strcmp(*argv, "--listen") == 0) {
-		fd->flags |= FD_LISTEN;
-		return 0;
-	}
+	cmd = bsearch(*argv, dhcpcd_commands, __arraycount(dhcpcd_commands),
+	    sizeof(dhcpcd_commands[0]), dhcpcd_command_cmp);
+	if (cmd != NULL)
+		return cmd->exec(ctx, fd, argc, argv);
+
+	STAT_INC(control_commands);
 
 	/* Log the command */
 	len = 1;
@@ -1568,42 +2119,13 @@ dhcpcd_handleargs(struct dhcpcd_ctx *ctx, struct fd_list *fd,
 	}
 
 	if (opts & DHCPCD_DUMPLEASE) {
+		int r;
+
 		ctx->options |= DHCPCD_DUMPLEASE;
-dumplease:
-		nifaces = 0;
-		TAILQ_FOREACH(ifp, ctx->ifaces, next) {
-			if (!ifp->active)
-				continue;
-			for (oi = optind; oi < argc; oi++) {
-				if (strcmp(ifp->name, argv[oi]) == 0)
-					break;
-			}
-			if (optind == argc || oi < argc) {
-				opt = send_interface(NULL, ifp, af);
-				if (opt == -1)
-					goto dumperr;
-				nifaces += (size_t)opt;
-			}
-		}
-		if (write(fd->fd, &nifaces, sizeof(nifaces)) != sizeof(nifaces))
-			goto dumperr;
-		TAILQ_FOREACH(ifp, ctx->ifaces, next) {
-			if (!ifp->active)
-				continue;
-			for (oi = optind; oi < argc; oi++) {
-				if (strcmp(ifp->name, argv[oi]) == 0)
-					break;
-			}
-			if (optind == argc || oi < argc) {
-				if (send_interface(fd, ifp, af) == -1)
-					goto dumperr;
-			}
-		}
+		r = dhcpcd_sendinterfaces(ctx, fd, argc - optind,
+		    argv + optind, af);
 		ctx->options &= ~DHCPCD_DUMPLEASE;
-		return 0;
-dumperr:
-		ctx->options &= ~DHCPCD_DUMPLEASE;
-		return -1;
+		return r;
 	}
 
 	/* Only privileged users can control dhcpcd via the socket. */
@@ -1805,6 +2327,44 @@ dhcpcd_stderr_cb(void *arg)
 	fprintf(stderr, "%s", log);
 }
 
+#if defined(INET) && !defined(SMALL)
+/* Monitoring tools invoke -U often, commonly on hosts where the
+ * daemon is not the query path.  Serve such queries straight from
+ * the lease file without the config parse and control socket dance
+ * of the normal startup.
+ * Returns -1 to fall back to the normal path, else an exit code. */
+static int
+dhcpcd_dumpleasefast(struct dhcpcd_ctx *ctx, const char *ifname)
+{
+	struct interface *ifp;
+	int fd;
+
+	/* A running daemon knows more than the lease file, so hand
+	 * those queries back to the normal path. */
+	if ((fd = control_open(ifname, AF_INET, true)) != -1 ||
+	    (fd = control_open(ifname, AF_UNSPEC, true)) != -1 ||
+	    (fd = control_open(NULL, AF_UNSPEC, true)) != -1)
+	{
+		close(fd);
+		return -1;
+	}
+
+	if ((ifp = calloc(1, sizeof(*ifp))) == NULL) {
+		logerr(__func__);
+		return EXIT_FAILURE;
+	}
+	ifp->ctx = ctx;
+	strlcpy(ifp->name, ifname, sizeof(ifp->name));
+	if ((ifp->options = default_config(ctx)) == NULL) {
+		logerr(__func__);
+		return EXIT_FAILURE;
+	}
+	if (dhcp_dump(ifp) == -1)
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+#endif
+
 int
 main(int argc, char **argv, char **envp)
 {
@@ -1874,13 +2434,22 @@ main(int argc, char **argv, char **envp)
 	ifo = NULL;
 	ctx.cffile = CONFIG;
 	ctx.script = UNCONST(dhcpcd_default_script);
+	ctx.script_jobs = 1;
+	TAILQ_INIT(&ctx.script_jobs_queue);
 	ctx.control_fd = ctx.control_unpriv_fd = ctx.link_fd = -1;
+	ctx.notify_fd = -1;
 	ctx.pf_inet_fd = -1;
 #ifdef PF_LINK
 	ctx.pf_link_fd = -1;
 #endif
+#if defined(__linux__) && !defined(SMALL)
+	ctx.inotify_fd = -1;
+#endif
 
 	TAILQ_INIT(&ctx.control_fds);
+	TAILQ_INIT(&ctx.lease_writes);
+	TAILQ_INIT(&ctx.lease_fds);
+	TAILQ_INIT(&ctx.lease_reads);
 #ifdef USE_SIGNALS
 	ctx.fork_fd = -1;
 #endif
@@ -1900,8 +2469,10 @@ main(int argc, char **argv, char **envp)
 #endif
 #ifdef PRIVSEP
 	ctx.ps_root_fd = ctx.ps_log_fd = ctx.ps_data_fd = -1;
+	ctx.ps_script_fd = -1;
 	ctx.ps_inet_fd = ctx.ps_control_fd = -1;
 	TAILQ_INIT(&ctx.ps_processes);
+	TAILQ_INIT(&ctx.ps_async_ops);
 #endif
 
 	/* Check our streams for validity */
@@ -2002,6 +2573,25 @@ main(int argc, char **argv, char **envp)
 
 	rt_init(&ctx);
 
+#if defined(INET) && !defined(SMALL)
+	/* Take the short dumplease path for a single IPv4 interface
+	 * when nothing is piped in and no daemon is answering. */
+	if (i == 3 && family == AF_INET && optind == argc - 1 &&
+	    strlen(argv[optind]) < IF_NAMESIZE &&
+	    (!ctx.stdin_valid ||
+	    ioctl(STDIN_FILENO, FIONREAD, &opt, sizeof(opt)) == -1 ||
+	    opt == 0))
+	{
+		ctx.options |= DHCPCD_DUMPLEASE | DHCPCD_PERSISTENT;
+		opt = dhcpcd_dumpleasefast(&ctx, argv[optind]);
+		if (opt == EXIT_SUCCESS)
+			goto exit_success;
+		if (opt == EXIT_FAILURE)
+			goto exit_failure;
+		ctx.options &= ~(DHCPCD_DUMPLEASE | DHCPCD_PERSISTENT);
+	}
+#endif
+
 	ifo = read_config(&ctx, NULL, NULL, NULL);
 	if (ifo == NULL) {
 		if (ctx.options & DHCPCD_PRINT_PIDFILE)
@@ -2114,6 +2704,15 @@ printpidfile:
 		goto exit_failure;
 	}
 
+#ifdef ELOOP_COALESCE_MSEC
+	/* Let lease renewal timers fire a little late so that many
+	 * expiring together are batched into single wakeups. */
+	eloop_q_timeout_coalesce(ctx.eloop, ELOOP_DHCP, ELOOP_COALESCE_MSEC);
+#ifdef DHCP6
+	eloop_q_timeout_coalesce(ctx.eloop, ELOOP_DHCP6, ELOOP_COALESCE_MSEC);
+#endif
+#endif
+
 #ifdef USE_SIGNALS
 	for (si = 0; si < dhcpcd_signals_ignore_len; si++)
 		signal(dhcpcd_signals_ignore[si], SIG_IGN);
@@ -2161,6 +2760,9 @@ printpidfile:
 	}
 #endif
 
+	/* Must be done before sandboxing as it creates a socket. */
+	dhcpcd_notify_init(&ctx);
+
 #ifdef PRIVSEP
 	ps_init(&ctx);
 #endif
@@ -2308,6 +2910,10 @@ printpidfile:
 			goto exit_failure;
 		}
 #endif
+		if (eloop_forked(ctx.eloop) == -1) {
+			logerr("%s: eloop_forked", __func__);
+			goto exit_failure;
+		}
 		eloop_event_add(ctx.eloop, ctx.fork_fd, dhcpcd_fork_cb, &ctx);
 
 		/*
@@ -2337,6 +2943,10 @@ printpidfile:
 			logerr("fork");
 			goto exit_failure;
 		case 0:
+			if (eloop_forked(ctx.eloop) == -1) {
+				logerr("%s: eloop_forked", __func__);
+				goto exit_failure;
+			}
 			break;
 		default:
 			ctx.options |= DHCPCD_FORKED; /* A lie */
@@ -2355,6 +2965,10 @@ printpidfile:
 			goto exit_failure;
 		}
 #endif
+		if (eloop_forked(ctx.eloop) == -1) {
+			logerr("%s: eloop_forked", __func__);
+			goto exit_failure;
+		}
 		eloop_event_add(ctx.eloop, ctx.fork_fd, dhcpcd_fork_cb, &ctx);
 
 		if (ctx.stderr_valid) {
@@ -2408,6 +3022,12 @@ start_manager:
 		goto run_loop;
 #endif
 
+	/* Load the lease database before we sandbox so we keep the
+	 * descriptor for appending lease commits. */
+	if (ctx.leasedb_file != NULL && dhcp_leasedb_open(&ctx) == -1)
+		logerr("%s: dhcp_leasedb_open: %s",
+		    __func__, ctx.leasedb_file);
+
 	if (!(ctx.options & DHCPCD_TEST)) {
 		if (control_start(&ctx,
 		    ctx.options & DHCPCD_MANAGER ?
@@ -2450,6 +3070,12 @@ start_manager:
 	/* Start handling kernel messages for interfaces, addresses and
 	 * routes. */
 	eloop_event_add(ctx.eloop, ctx.link_fd, dhcpcd_handlelink, &ctx);
+	eloop_event_priority(ctx.eloop, ctx.link_fd, ELOOP_PRIO_HIGH);
+
+#if defined(__linux__) && !defined(SMALL)
+	if (!(ctx.options & DHCPCD_TEST))
+		dhcpcd_watchconfig(&ctx);
+#endif
 
 #ifdef PRIVSEP
 	if (IN_PRIVSEP(&ctx) && ps_managersandbox(&ctx, "stdio route") == -1)
@@ -2494,12 +3120,19 @@ start_manager:
 		}
 	}
 
+	opt = 0;
 	TAILQ_FOREACH(ifp, ctx.ifaces, next) {
 		if (ifp->active)
 			dhcpcd_initstate1(ifp, argc, argv, 0);
+		opt++;
 	}
+	/* Pre-warm the event loop pools from the interface count -
+	 * each interface carries a handful of timers but few fds. */
+	if (eloop_pool_reserve(ctx.eloop,
+	    (size_t)opt + 8, (size_t)opt * 4 + 8) == -1)
+		logwarn("%s: eloop_pool_reserve", __func__);
 	if_learnaddrs(&ctx, ctx.ifaces, &ifaddrs);
-	if_freeifaddrs(&ifaddrs);
+	if_freeifaddrs(&ctx, &ifaddrs);
 	ifaddrs = NULL;
 
 	if (ctx.options & DHCPCD_BACKGROUND)
@@ -2547,6 +3180,12 @@ start_manager:
 	free_options(&ctx, ifo);
 	ifo = NULL;
 
+	/* Phase the startup: read every lease in one sequential pass
+	 * before any interface state machine arms, so with many
+	 * interfaces the lease I/O is not interleaved with
+	 * solicitation and configuration work. */
+	dhcp_preloadleases(&ctx);
+
 	TAILQ_FOREACH(ifp, ctx.ifaces, next) {
 		if (ifp->active)
 			eloop_timeout_add_sec(ctx.eloop, 0,
@@ -2579,6 +3218,11 @@ exit1:
 #endif
 			freeifaddrs(ifaddrs);
 	}
+	/* Write out any pending leases while the privsep root
+	 * process can still proxy for us. */
+	dhcp_flushleases(&ctx);
+	dhcp_closeleasefds(&ctx);
+	dhcp_freeleasereads(&ctx);
 	/* ps_stop will clear DHCPCD_PRIVSEP but we need to
 	 * remember it to avoid attemping to remove the pidfile */
 	oi = ctx.options & DHCPCD_PRIVSEP ? 1 : 0;
@@ -2594,7 +3238,12 @@ exit1:
 		free(ctx.ifaces);
 		ctx.ifaces = NULL;
 	}
+	free(ctx.if_idxmap);
+	ctx.if_idxmap = NULL;
+	free(ctx.if_namemap);
+	ctx.if_namemap = NULL;
 	free_options(&ctx, ifo);
+	script_queue_drain(&ctx);
 #ifdef HAVE_OPEN_MEMSTREAM
 	if (ctx.script_fp)
 		fclose(ctx.script_fp);
@@ -2608,6 +3257,7 @@ exit1:
 		close(ctx.link_fd);
 	}
 	if_closesockets(&ctx);
+	dhcp_leasedb_close(&ctx);
 	free_globals(&ctx);
 #ifdef INET6
 	ipv6_ctxfree(&ctx);
@@ -2618,7 +3268,18 @@ exit1:
 #ifdef PRIVSEP
 	eloop_free(ctx.ps_eloop);
 #endif
+	if (ctx.eloop != NULL) {
+		struct eloop_pool_stats eps;
+
+		eloop_pool_stats(ctx.eloop, &eps);
+		logdebugx("eloop: pooled %zu events (%zu free), "
+		    "%zu timeouts (%zu free)",
+		    eps.events_pooled, eps.events_free,
+		    eps.timeouts_pooled, eps.timeouts_free);
+	}
 	eloop_free(ctx.eloop);
+	if (ctx.notify_fd != -1)
+		close(ctx.notify_fd);
 	if (ctx.script != dhcpcd_default_script)
 		free(ctx.script);
 	if (ctx.options & DHCPCD_STARTED && !(ctx.options & DHCPCD_FORKED))
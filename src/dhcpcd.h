@@ -63,7 +63,9 @@
 #define IF_DATA_IPV6	4
 #define IF_DATA_IPV6ND	5
 #define IF_DATA_DHCP6	6
-#define IF_DATA_MAX	7
+#define IF_DATA_SCRIPT	7
+#define IF_DATA_BUILTIN	8
+#define IF_DATA_MAX	9
 
 #ifdef __QNX__
 /* QNX carries defines for, but does not actually support PF_LINK */
@@ -83,15 +85,25 @@ struct interface {
 	unsigned short vlanid;
 	unsigned int metric;
 	int carrier;
+	/* Carrier state waiting out the debounce window. */
+	int carrier_pending;
+	unsigned int flags_pending;
+	bool carrier_debouncing;
 	bool wireless;
 	uint8_t ssid[IF_SSIDLEN];
 	unsigned int ssid_len;
+	bool ssid_fresh;	/* cached SSID valid, cleared by
+				 * wireless link events */
 
 	char profile[PROFILE_LEN];
 	struct if_options *options;
 	void *if_data[IF_DATA_MAX];
 };
 TAILQ_HEAD(if_head, interface);
+struct script_job;
+TAILQ_HEAD(dhcp_lease_writes, dhcp_lease_write);
+TAILQ_HEAD(dhcp_lease_fds, dhcp_lease_fd);
+TAILQ_HEAD(dhcp_lease_reads, dhcp_lease_read);
 
 #include "privsep.h"
 
@@ -112,6 +124,10 @@ TAILQ_HEAD(if_head, interface);
 #endif
 
 struct passwd;
+struct dhcp_optidx;
+struct dhcp6_optidx;
+struct if_idxentry;
+struct if_nameentry;
 
 struct dhcpcd_ctx {
 	char pidfile[sizeof(PIDFILE) + IF_NAMESIZE + 1];
@@ -122,6 +138,8 @@ struct dhcpcd_ctx {
 	int stderr_fd;	/* FD for logging to stderr */
 	int fork_fd;	/* FD for the fork init signal pipe */
 	const char *cffile;
+	void *cf_config;	/* compiled configuration, see if-options.c */
+	struct if_options *cf_ifo;	/* cached block-less evaluation */
 	unsigned long long options;
 	char *logfile;
 	int argc;
@@ -134,11 +152,28 @@ struct dhcpcd_ctx {
 	char **ifv;	/* listed interfaces */
 	int ifcc;	/* configured interfaces */
 	char **ifcv;	/* configured interfaces */
+	size_t waitifaces;	/* daemonise once this many are ready */
 	uint8_t duid_type;
 	unsigned char *duid;
 	size_t duid_len;
 	struct if_head *ifaces;
 
+	/* Sorted interface maps so the shared sockets can demultiplex
+	 * received packets and control requests can find their
+	 * interface without walking the interface list.
+	 * See if_findindex() and if_find() in if.c. */
+	struct if_idxentry *if_idxmap;
+	size_t if_idxmap_len;
+	struct if_nameentry *if_namemap;
+	size_t if_namemap_len;
+	bool if_idxmap_dirty;
+
+	char *leasedb_file;
+	struct leasedb *leasedb;	/* see leasedb.h */
+	struct dhcp_lease_writes lease_writes;	/* see dhcp-common.h */
+	struct dhcp_lease_fds lease_fds;	/* see dhcp-common.h */
+	struct dhcp_lease_reads lease_reads;	/* see dhcp-common.h */
+
 	char *ctl_buf;
 	size_t ctl_buflen;
 	size_t ctl_bufpos;
@@ -147,7 +182,12 @@ struct dhcpcd_ctx {
 	rb_tree_t routes;	/* our routes */
 #ifdef RT_FREE_ROUTE_TABLE
 	rb_tree_t froutes;	/* free routes for re-use */
+	void *rt_slabs;		/* pooled route allocations */
+	size_t rt_nuse;		/* pool entries in use */
+	size_t rt_maxuse;	/* most pool entries ever in use */
 #endif
+	rb_tree_t kroutes;	/* shadow of the kernel route table */
+	bool kroutes_valid;	/* shadow is current, no dump needed */
 	size_t rt_order;	/* route order storage */
 
 	int pf_inet_fd;
@@ -156,8 +196,15 @@ struct dhcpcd_ctx {
 #endif
 	void *priv;
 	int link_fd;
+	int notify_fd;	/* supervisor readiness (NOTIFY_SOCKET) */
 #ifndef SMALL
 	int link_rcvbuf;
+#endif
+#ifdef __linux__
+	int nl80211_fam;	/* cached generic netlink family id */
+#endif
+#if defined(__linux__) && !defined(SMALL)
+	int inotify_fd;	/* config file change watch */
 #endif
 	int seq;	/* route message sequence no */
 	int sseq;	/* successful seq no sent */
@@ -175,6 +222,9 @@ struct dhcpcd_ctx {
 	size_t script_buflen;
 	char **script_env;
 	size_t script_envlen;
+	size_t script_jobs;	/* max concurrent hook scripts */
+	size_t script_jobs_running;
+	TAILQ_HEAD(script_job_head, script_job) script_jobs_queue;
 
 	int control_fd;
 	int control_unpriv_fd;
@@ -202,7 +252,17 @@ struct dhcpcd_ctx {
 	int ps_root_fd;		/* Privileged Proxy commands */
 	int ps_log_fd;		/* chroot logging */
 	int ps_data_fd;		/* Data from root spawned processes */
+	pid_t ps_script_pid;
+	int ps_script_fd;	/* Pre-forked script runner */
+	/* Shared map for hook environments, created before the privsep
+	 * forks so every process sees the same pages and only the
+	 * length needs to cross the sockets. */
+	char *ps_script_map;
+	size_t ps_script_maplen;
 	struct eloop *ps_eloop;	/* eloop for polling root data */
+	/* Pipelined root requests awaiting completion, in request order */
+	TAILQ_HEAD(ps_async_head, ps_async_op) ps_async_ops;
+	size_t ps_async_len;
 	struct ps_process_head ps_processes;	/* List of spawned processes */
 	pid_t ps_inet_pid;
 	int ps_inet_fd;		/* Network Proxy commands and data */
@@ -225,6 +285,13 @@ struct dhcpcd_ctx {
 	 * practically never. See RFC3396 for details. */
 	uint8_t *opt_buffer;
 	size_t opt_buffer_len;
+
+	/* Index of the message being processed so that the many option
+	 * lookups involved need not rescan the options region.
+	 * See dhcp_message_index() in dhcp.c. */
+	struct dhcp_optidx *opt_idx;
+	const void *opt_idx_msg;
+	size_t opt_idx_msg_len;
 #endif
 #ifdef INET6
 	uint8_t *secret;
@@ -234,6 +301,7 @@ struct dhcpcd_ctx {
 	int nd_fd;
 #endif
 	struct ra_head *ra_routers;
+	struct ra_head *ra_hash;	/* RA_HASHSZ source address buckets */
 
 	struct dhcp_opt *nd_opts;
 	size_t nd_opts_len;
@@ -242,6 +310,15 @@ struct dhcpcd_ctx {
 	int dhcp6_wfd;
 	struct dhcp_opt *dhcp6_opts;
 	size_t dhcp6_opts_len;
+
+	/* Index of the message being processed so that the many option
+	 * lookups involved need not rescan it.
+	 * See dhcp6_message_index() in dhcp6.c. */
+	struct dhcp6_optidx *d6_opt_idx;
+	size_t d6_opt_idx_len;
+	size_t d6_opt_idx_size;
+	const void *d6_opt_idx_msg;
+	size_t d6_opt_idx_msg_len;
 #endif
 
 #ifndef __linux__
@@ -266,6 +343,7 @@ extern const size_t dhcpcd_signals_ignore_len;
 
 extern const char *dhcpcd_default_script;
 
+uint32_t dhcpcd_renewjitter(const struct interface *, uint32_t);
 int dhcpcd_ifafwaiting(const struct interface *);
 int dhcpcd_afwaiting(const struct dhcpcd_ctx *);
 void dhcpcd_daemonise(struct dhcpcd_ctx *);
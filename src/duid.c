@@ -41,6 +41,7 @@
 #include <net/if.h>
 #include <net/if_arp.h>
 
+#include <ctype.h>
 #include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -54,6 +55,41 @@
 #include "duid.h"
 #include "logerr.h"
 
+#ifdef __linux__
+/* Read /etc/machine-id straight into the callers UUID buffer,
+ * inserting the dashes as we go so it looks like the DMI UUID.
+ * Not all machines expose a DMI product UUID (VMs, containers, ARM)
+ * but nearly all Linux systems have a machine-id. */
+static size_t
+duid_machineid(char *uuid, size_t uuid_len)
+{
+	FILE *fp;
+	size_t i, n;
+	int c;
+
+	if (uuid_len < UUID_LEN + 1)
+		return 0;
+
+	fp = fopen("/etc/machine-id", "r");
+	if (fp == NULL)
+		return 0;
+
+	for (i = n = 0; n < 32; n++) {
+		c = fgetc(fp);
+		if (!isxdigit(c)) {
+			fclose(fp);
+			return 0;
+		}
+		if (n == 8 || n == 12 || n == 16 || n == 20)
+			uuid[i++] = '-';
+		uuid[i++] = (char)c;
+	}
+	fclose(fp);
+	uuid[i++] = '\0';
+	return i;
+}
+#endif
+
 static size_t
 duid_machineuuid(char *uuid, size_t uuid_len)
 {
@@ -75,14 +111,16 @@ duid_machineuuid(char *uuid, size_t uuid_len)
 
 	fp = fopen("/sys/class/dmi/id/product_uuid", "r");
 	if (fp == NULL)
-		return 0;
+		return duid_machineid(uuid, uuid_len);
 	if (fgets(uuid, (int)uuid_len, fp) == NULL) {
 		fclose(fp);
-		return 0;
+		return duid_machineid(uuid, uuid_len);
 	}
 	len = strlen(uuid) + 1;
 	fclose(fp);
-	r = len == 1 ? -1 : 0;
+	if (len == 1)
+		return duid_machineid(uuid, uuid_len);
+	r = 0;
 #else
 	UNUSED(uuid);
 	r = -1;
@@ -31,7 +31,6 @@
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
-#include <poll.h>
 #include <stdbool.h>
 #include <signal.h>
 #include <stdint.h>
@@ -39,11 +38,25 @@
 #include <string.h>
 #include <unistd.h>
 
-/* config.h should define HAVE_PPOLL, etc. */
+/* config.h should define HAVE_KQUEUE, HAVE_EPOLL, HAVE_PPOLL, etc. */
 #if defined(HAVE_CONFIG_H) && !defined(NO_CONFIG_H)
 #include "config.h"
 #endif
 
+#if defined(HAVE_KQUEUE)
+#include <sys/event.h>
+#include <fcntl.h>
+#ifdef __NetBSD__
+/* udata is void * except on NetBSD. */
+#define	UPTR(x)	((intptr_t)(x))
+#else
+#define	UPTR(x)	(x)
+#endif
+#elif defined(HAVE_EPOLL)
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#else
+#include <poll.h>
 #if defined(HAVE_PPOLL)
 #elif defined(HAVE_POLLTS)
 #define ppoll pollts
@@ -52,8 +65,10 @@
 #define HAVE_PSELECT
 #define ppoll eloop_ppoll
 #endif
+#endif
 
 #include "eloop.h"
+#include "probes.h"
 
 #ifndef UNUSED
 #define UNUSED(a) (void)((a))
@@ -114,6 +129,26 @@
 #define	UTIME_MAX	(TIME_MAX * 2) + 1
 #endif
 
+/* Timeouts are not worth more precision than the scheduler offers,
+ * so allow opting in to the cheaper coarse clock where it exists. */
+#if defined(ELOOP_COARSE_CLOCK) && defined(CLOCK_MONOTONIC_COARSE)
+#define	ELOOP_CLOCK	CLOCK_MONOTONIC_COARSE
+#else
+#define	ELOOP_CLOCK	CLOCK_MONOTONIC
+#endif
+
+/* Upper bound on eloop queue numbers for the per-queue coalescing
+ * windows. Queues are small application assigned integers. */
+#define	ELOOP_NQUEUES	16
+
+/* Number of backend slots an event can consume.
+ * kqueue uses separate kevents for the read and write filters. */
+#if defined(HAVE_KQUEUE)
+#define	NFD	2
+#else
+#define	NFD	1
+#endif
+
 struct eloop_event {
 	TAILQ_ENTRY(eloop_event) next;
 	int fd;
@@ -121,13 +156,33 @@ struct eloop_event {
 	void *read_cb_arg;
 	void (*write_cb)(void *);
 	void *write_cb_arg;
+	/* Events with a higher priority dispatch before the rest
+	 * within a loop iteration. */
+	int priority;
+#if !defined(HAVE_KQUEUE) && !defined(HAVE_EPOLL)
 	struct pollfd *pollfd;
+#endif
+};
+
+/* Initial size of the timeout heap - grows by doubling. */
+#define	ELOOP_TIMEOUTS_MIN	16
+
+/* Events and timeouts are carved out of slabs this many at a time.
+ * Slabs are only returned to the system with the loop itself, which
+ * avoids heap fragmentation from long lived daemons churning timers. */
+#define	ELOOP_POOL_CHUNK	64
+
+struct eloop_slab {
+	struct eloop_slab *next;
+	/* items follow */
 };
 
 struct eloop_timeout {
-	TAILQ_ENTRY(eloop_timeout) next;
+	TAILQ_ENTRY(eloop_timeout) next;	/* free list linkage */
 	unsigned int seconds;
 	unsigned int nseconds;
+	uint64_t seq;
+	size_t heap_idx;
 	void (*callback)(void *);
 	void *arg;
 	int queue;
@@ -138,17 +193,49 @@ struct eloop {
 	size_t nevents;
 	struct event_head free_events;
 	bool events_need_setup;
+	bool events_need_sweep;
 
 	struct timespec now;
-	TAILQ_HEAD (timeout_head, eloop_timeout) timeouts;
-	struct timeout_head free_timeouts;
+	/* true while eloop->now is known to be current, so timeout
+	 * arithmetic within a loop iteration can skip clock_gettime(2). */
+	bool now_fresh;
+	/* Binary min-heap of timeouts, soonest at the root. */
+	struct eloop_timeout **timeouts;
+	size_t ntimeouts;
+	size_t timeouts_len;
+	uint64_t timeout_seq;
+	TAILQ_HEAD (timeout_head, eloop_timeout) free_timeouts;
+	/* Coalescing window per queue in nanoseconds, zero for exact. */
+	unsigned long long coalesce_ns[ELOOP_NQUEUES];
+
+	struct eloop_slab *event_slabs;
+	struct eloop_slab *timeout_slabs;
+	size_t nevents_pooled;
+	size_t ntimeouts_pooled;
+
+	unsigned long long timeouts_fired;
+	unsigned long long events_fired;
 
 	const int *signals;
 	size_t signals_len;
 	void (*signal_cb)(int, void *);
 	void *signal_cb_ctx;
 
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+	int poll_fd;
+#endif
+#if defined(HAVE_EPOLL)
+	int signal_fd;
+#endif
+#if defined(HAVE_KQUEUE)
+	struct kevent *fds;
+#elif defined(HAVE_EPOLL)
+	struct epoll_event *fds;
+#else
 	struct pollfd *fds;
+	/* Owner of each pollfd slot, for compacting on delete. */
+	struct eloop_event **fdevs;
+#endif
 	size_t nfds;
 
 	int exitnow;
@@ -213,6 +300,208 @@ eloop_ppoll(struct pollfd * fds, nfds_t nfds,
 }
 #endif
 
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+static int
+eloop_open(struct eloop *eloop)
+{
+#if defined(HAVE_KQUEUE)
+	int fd;
+
+	if ((fd = kqueue()) == -1)
+		return -1;
+	if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+		close(fd);
+		return -1;
+	}
+	eloop->poll_fd = fd;
+#else
+	if ((eloop->poll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+		return -1;
+#endif
+
+	/* Both kevent(2) and epoll_wait(2) need somewhere to report
+	 * at least one event even if only timeouts are queued. */
+	if (eloop->fds == NULL) {
+		eloop->fds = eloop_realloca(NULL, 1, sizeof(*eloop->fds));
+		if (eloop->fds == NULL) {
+			close(eloop->poll_fd);
+			eloop->poll_fd = -1;
+			return -1;
+		}
+		eloop->nfds = 1;
+	}
+	return eloop->poll_fd;
+}
+
+/* Sync the kernel queue with the wanted state of the event.
+ * kevent(2) and epoll_ctl(2) work on single fds, so unlike the poll
+ * backend there is no array to rebuild. */
+static int
+eloop_event_register(struct eloop *eloop, struct eloop_event *e)
+{
+#if defined(HAVE_KQUEUE)
+	struct kevent ke;
+
+	EV_SET(&ke, (uintptr_t)e->fd, EVFILT_READ,
+	    e->read_cb != NULL ? EV_ADD : EV_DELETE, 0, 0, UPTR(e));
+	if (kevent(eloop->poll_fd, &ke, 1, NULL, 0, NULL) == -1 &&
+	    !(e->read_cb == NULL && errno == ENOENT))
+		return -1;
+	EV_SET(&ke, (uintptr_t)e->fd, EVFILT_WRITE,
+	    e->write_cb != NULL ? EV_ADD : EV_DELETE, 0, 0, UPTR(e));
+	if (kevent(eloop->poll_fd, &ke, 1, NULL, 0, NULL) == -1 &&
+	    !(e->write_cb == NULL && errno == ENOENT))
+		return -1;
+	return 0;
+#else
+	struct epoll_event epe = { .events = 0 };
+
+	epe.data.ptr = e;
+	if (e->read_cb != NULL)
+		epe.events |= EPOLLIN;
+	if (e->write_cb != NULL)
+		epe.events |= EPOLLOUT;
+	if (epoll_ctl(eloop->poll_fd, EPOLL_CTL_MOD, e->fd, &epe) == 0)
+		return 0;
+	if (errno != ENOENT)
+		return -1;
+	return epoll_ctl(eloop->poll_fd, EPOLL_CTL_ADD, e->fd, &epe);
+#endif
+}
+
+static void
+eloop_event_unregister(struct eloop *eloop, struct eloop_event *e)
+{
+#if defined(HAVE_KQUEUE)
+	struct kevent ke;
+
+	/* Ignore any errors - the fd may already have been closed
+	 * which removes the knotes for us. */
+	EV_SET(&ke, (uintptr_t)e->fd, EVFILT_READ, EV_DELETE, 0, 0, UPTR(NULL));
+	(void)kevent(eloop->poll_fd, &ke, 1, NULL, 0, NULL);
+	EV_SET(&ke, (uintptr_t)e->fd, EVFILT_WRITE, EV_DELETE, 0, 0,UPTR(NULL));
+	(void)kevent(eloop->poll_fd, &ke, 1, NULL, 0, NULL);
+#else
+	/* Likewise, closing the fd removes it from the epoll set. */
+	(void)epoll_ctl(eloop->poll_fd, EPOLL_CTL_DEL, e->fd, NULL);
+#endif
+}
+#endif
+
+#if defined(HAVE_KQUEUE)
+static int
+eloop_signal_register(struct eloop *eloop)
+{
+	struct kevent ke;
+	size_t i;
+
+	/* kevent(2) has no signal mask argument, so signals are
+	 * delivered via EVFILT_SIGNAL.
+	 * The signals remain blocked - kqueue notes each attempted
+	 * delivery regardless. */
+	for (i = 0; i < eloop->signals_len; i++) {
+		EV_SET(&ke, (uintptr_t)eloop->signals[i], EVFILT_SIGNAL,
+		    EV_ADD, 0, 0, UPTR(NULL));
+		if (kevent(eloop->poll_fd, &ke, 1, NULL, 0, NULL) == -1)
+			return -1;
+	}
+	return 0;
+}
+#elif defined(HAVE_EPOLL)
+static int
+eloop_signal_register(struct eloop *eloop)
+{
+	sigset_t sset;
+	size_t i;
+	int fd;
+	struct epoll_event epe = { .events = EPOLLIN };
+
+	/* Signals remain blocked and are read from a signalfd like any
+	 * other event, so the wait needs no sigmask swap. */
+	sigemptyset(&sset);
+	for (i = 0; i < eloop->signals_len; i++)
+		sigaddset(&sset, eloop->signals[i]);
+
+	fd = signalfd(eloop->signal_fd, &sset, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	if (eloop->signal_fd != -1)
+		return 0;	/* mask updated in place */
+	eloop->signal_fd = fd;
+
+	/* A NULL data pointer marks the signalfd out from real events. */
+	epe.data.ptr = NULL;
+	if (epoll_ctl(eloop->poll_fd, EPOLL_CTL_ADD,
+	    eloop->signal_fd, &epe) == -1)
+	{
+		close(eloop->signal_fd);
+		eloop->signal_fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+static void
+eloop_signal_read(struct eloop *eloop)
+{
+	struct signalfd_siginfo ssi;
+	ssize_t len;
+
+	for (;;) {
+		len = read(eloop->signal_fd, &ssi, sizeof(ssi));
+		if (len != (ssize_t)sizeof(ssi))
+			break;
+		if (eloop->signal_cb != NULL)
+			eloop->signal_cb((int)ssi.ssi_signo,
+			    eloop->signal_cb_ctx);
+	}
+}
+#endif
+
+/* After fork(2) the kernel queue needs to be recreated -
+ * kqueue descriptors are not inherited by the child and an inherited
+ * epoll descriptor would still be shared with the parent.
+ * Re-registers all events (and signals for kqueue) on a fresh queue. */
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+int
+eloop_forked(struct eloop *eloop)
+{
+	struct eloop_event *e;
+
+	assert(eloop != NULL);
+
+	if (eloop->poll_fd != -1)
+		close(eloop->poll_fd);
+	if (eloop_open(eloop) == -1)
+		return -1;
+#if defined(HAVE_EPOLL)
+	/* The signalfd is shared with the parent - recreate it. */
+	if (eloop->signal_fd != -1) {
+		close(eloop->signal_fd);
+		eloop->signal_fd = -1;
+	}
+#endif
+
+	TAILQ_FOREACH(e, &eloop->events, next) {
+		if (e->fd == -1)
+			continue;
+		if (eloop_event_register(eloop, e) == -1)
+			return -1;
+	}
+
+	if (eloop->signals_len != 0 && eloop_signal_register(eloop) == -1)
+		return -1;
+	return 0;
+}
+#else
+int
+eloop_forked(__unused struct eloop *eloop)
+{
+
+	return 0;
+}
+#endif
+
 unsigned long long
 eloop_timespec_diff(const struct timespec *tsp, const struct timespec *usp,
     unsigned int *nsp)
@@ -248,6 +537,9 @@ eloop_timespec_diff(const struct timespec *tsp, const struct timespec *usp,
 	return secs;
 }
 
+/* Timers are stored relative to eloop->now.
+ * A uniform reduction is a monotone mapping, so the heap order is
+ * not disturbed and no re-sifting is needed. */
 static void
 eloop_reduce_timers(struct eloop *eloop)
 {
@@ -255,11 +547,13 @@ eloop_reduce_timers(struct eloop *eloop)
 	unsigned long long secs;
 	unsigned int nsecs;
 	struct eloop_timeout *t;
+	size_t i;
 
-	clock_gettime(CLOCK_MONOTONIC, &now);
+	clock_gettime(ELOOP_CLOCK, &now);
 	secs = eloop_timespec_diff(&now, &eloop->now, &nsecs);
 
-	TAILQ_FOREACH(t, &eloop->timeouts, next) {
+	for (i = 0; i < eloop->ntimeouts; i++) {
+		t = eloop->timeouts[i];
 		if (secs > t->seconds) {
 			t->seconds = 0;
 			t->nseconds = 0;
@@ -279,26 +573,246 @@ eloop_reduce_timers(struct eloop *eloop)
 	}
 
 	eloop->now = now;
+	eloop->now_fresh = true;
+}
+
+/* Sort by time, then by insertion order so that timeouts due
+ * together fire in the order they were added. */
+static bool
+eloop_timeout_before(const struct eloop_timeout *a,
+    const struct eloop_timeout *b)
+{
+
+	if (a->seconds != b->seconds)
+		return a->seconds < b->seconds;
+	if (a->nseconds != b->nseconds)
+		return a->nseconds < b->nseconds;
+	return a->seq < b->seq;
 }
 
 static void
-eloop_event_setup_fds(struct eloop *eloop)
+eloop_timeout_set(struct eloop *eloop, size_t i, struct eloop_timeout *t)
+{
+
+	eloop->timeouts[i] = t;
+	t->heap_idx = i;
+}
+
+static void
+eloop_timeout_siftup(struct eloop *eloop, size_t i)
+{
+	struct eloop_timeout *t = eloop->timeouts[i];
+	size_t p;
+
+	while (i > 0) {
+		p = (i - 1) / 2;
+		if (!eloop_timeout_before(t, eloop->timeouts[p]))
+			break;
+		eloop_timeout_set(eloop, i, eloop->timeouts[p]);
+		i = p;
+	}
+	eloop_timeout_set(eloop, i, t);
+}
+
+static void
+eloop_timeout_siftdown(struct eloop *eloop, size_t i)
+{
+	struct eloop_timeout *t = eloop->timeouts[i];
+	size_t c;
+
+	for (;;) {
+		c = i * 2 + 1;
+		if (c >= eloop->ntimeouts)
+			break;
+		if (c + 1 < eloop->ntimeouts &&
+		    eloop_timeout_before(eloop->timeouts[c + 1],
+		    eloop->timeouts[c]))
+			c++;
+		if (!eloop_timeout_before(eloop->timeouts[c], t))
+			break;
+		eloop_timeout_set(eloop, i, eloop->timeouts[c]);
+		i = c;
+	}
+	eloop_timeout_set(eloop, i, t);
+}
+
+static void
+eloop_timeout_remove(struct eloop *eloop, struct eloop_timeout *t)
+{
+	struct eloop_timeout *last;
+	size_t i = t->heap_idx;
+
+	eloop->ntimeouts--;
+	last = eloop->timeouts[eloop->ntimeouts];
+	if (last == t)
+		return;
+	eloop_timeout_set(eloop, i, last);
+	eloop_timeout_siftdown(eloop, i);
+	eloop_timeout_siftup(eloop, last->heap_idx);
+}
+
+static int
+eloop_timeout_insert(struct eloop *eloop, struct eloop_timeout *t)
+{
+	struct eloop_timeout **heap;
+	size_t new_len;
+
+	if (eloop->ntimeouts == eloop->timeouts_len) {
+		new_len = eloop->timeouts_len == 0 ?
+		    ELOOP_TIMEOUTS_MIN : eloop->timeouts_len * 2;
+		heap = eloop_realloca(eloop->timeouts, new_len, sizeof(*heap));
+		if (heap == NULL)
+			return -1;
+		eloop->timeouts = heap;
+		eloop->timeouts_len = new_len;
+	}
+	eloop_timeout_set(eloop, eloop->ntimeouts++, t);
+	eloop_timeout_siftup(eloop, eloop->ntimeouts - 1);
+	return 0;
+}
+
+static int
+eloop_event_pool_grow(struct eloop *eloop, size_t n)
+{
+	struct eloop_slab *slab;
+	struct eloop_event *e;
+	size_t i;
+
+	if ((slab = malloc(sizeof(*slab) + n * sizeof(*e))) == NULL)
+		return -1;
+	slab->next = eloop->event_slabs;
+	eloop->event_slabs = slab;
+	e = (struct eloop_event *)(void *)(slab + 1);
+	for (i = 0; i < n; i++, e++)
+		TAILQ_INSERT_TAIL(&eloop->free_events, e, next);
+	eloop->nevents_pooled += n;
+	return 0;
+}
+
+static int
+eloop_timeout_pool_grow(struct eloop *eloop, size_t n)
+{
+	struct eloop_slab *slab;
+	struct eloop_timeout *t;
+	size_t i;
+
+	if ((slab = malloc(sizeof(*slab) + n * sizeof(*t))) == NULL)
+		return -1;
+	slab->next = eloop->timeout_slabs;
+	eloop->timeout_slabs = slab;
+	t = (struct eloop_timeout *)(void *)(slab + 1);
+	for (i = 0; i < n; i++, t++)
+		TAILQ_INSERT_TAIL(&eloop->free_timeouts, t, next);
+	eloop->ntimeouts_pooled += n;
+	return 0;
+}
+
+/* Pre-warm the pools, eg from the expected interface count,
+ * so steady state operation never allocates. */
+int
+eloop_pool_reserve(struct eloop *eloop, size_t nevents, size_t ntimeouts)
+{
+
+	assert(eloop != NULL);
+
+	if (nevents > eloop->nevents_pooled &&
+	    eloop_event_pool_grow(eloop, nevents - eloop->nevents_pooled) == -1)
+		return -1;
+	if (ntimeouts > eloop->ntimeouts_pooled &&
+	    eloop_timeout_pool_grow(eloop,
+	    ntimeouts - eloop->ntimeouts_pooled) == -1)
+		return -1;
+	return 0;
+}
+
+void
+eloop_pool_stats(const struct eloop *eloop, struct eloop_pool_stats *stats)
+{
+	const struct eloop_event *e;
+	const struct eloop_timeout *t;
+
+	assert(eloop != NULL);
+	assert(stats != NULL);
+
+	stats->events_pooled = eloop->nevents_pooled;
+	stats->timeouts_pooled = eloop->ntimeouts_pooled;
+	stats->events_free = 0;
+	TAILQ_FOREACH(e, &eloop->free_events, next)
+		stats->events_free++;
+	stats->timeouts_free = 0;
+	TAILQ_FOREACH(t, &eloop->free_timeouts, next)
+		stats->timeouts_free++;
+}
+
+void
+eloop_run_stats(const struct eloop *eloop, struct eloop_run_stats *stats)
+{
+
+	assert(eloop != NULL);
+	assert(stats != NULL);
+
+	stats->timeouts_fired = eloop->timeouts_fired;
+	stats->events_fired = eloop->events_fired;
+}
+
+/* Approximate bytes held by the event loop, for the memory report.
+ * Events and timeouts allocated when the pools ran dry are not
+ * tracked, but they are freed back to the pools so stay rare. */
+size_t
+eloop_mem(const struct eloop *eloop)
+{
+	size_t bytes;
+
+	assert(eloop != NULL);
+
+	bytes = sizeof(*eloop);
+	bytes += eloop->nevents_pooled * sizeof(struct eloop_event);
+	bytes += eloop->ntimeouts_pooled * sizeof(struct eloop_timeout);
+	bytes += eloop->timeouts_len * sizeof(*eloop->timeouts);
+	bytes += eloop->nfds * sizeof(*eloop->fds);
+	return bytes;
+}
+
+/* Move deleted events to the free list.
+ * This is deferred so that callbacks may delete events under a
+ * dispatching eloop_start without invalidating what it is walking. */
+static void
+eloop_event_sweep(struct eloop *eloop)
 {
 	struct eloop_event *e, *ne;
-	struct pollfd *pfd;
 
-	pfd = eloop->fds;
 	TAILQ_FOREACH_SAFE(e, &eloop->events, next, ne) {
 		if (e->fd == -1) {
 			TAILQ_REMOVE(&eloop->events, e, next);
 			TAILQ_INSERT_TAIL(&eloop->free_events, e, next);
-			continue;
 		}
+	}
+	eloop->events_need_sweep = false;
+}
+
+#if !defined(HAVE_KQUEUE) && !defined(HAVE_EPOLL)
+/* Full rebuild of the pollfd array.
+ * Only needed as a fallback when growing the array has moved it -
+ * otherwise the array is maintained incrementally as events are
+ * added and deleted. */
+static void
+eloop_event_setup_fds(struct eloop *eloop)
+{
+	struct eloop_event *e;
+	struct pollfd *pfd;
+	size_t slot;
+
+	eloop_event_sweep(eloop);
+
+	pfd = eloop->fds;
+	slot = 0;
+	TAILQ_FOREACH(e, &eloop->events, next) {
 #ifdef ELOOP_DEBUG
 		fprintf(stderr, "%s(%d) fd=%d, rcb=%p, wcb=%p\n",
 		    __func__, getpid(), e->fd, e->read_cb, e->write_cb);
 #endif
 		e->pollfd = pfd;
+		eloop->fdevs[slot++] = e;
 		pfd->fd = e->fd;
 		pfd->events = 0;
 		if (e->read_cb != NULL)
@@ -310,6 +824,7 @@ eloop_event_setup_fds(struct eloop *eloop)
 	}
 	eloop->events_need_setup = false;
 }
+#endif
 
 size_t
 eloop_event_count(const struct eloop *eloop)
@@ -318,13 +833,39 @@ eloop_event_count(const struct eloop *eloop)
 	return eloop->nevents;
 }
 
+const char *
+eloop_backend(void)
+{
+
+#if defined(HAVE_KQUEUE)
+	return "kqueue";
+#elif defined(HAVE_EPOLL)
+	return "epoll";
+#elif defined(HAVE_PSELECT)
+	return "pselect";
+#elif defined(HAVE_POLLTS)
+	return "pollts";
+#else
+	return "ppoll";
+#endif
+}
+
 int
 eloop_event_add_rw(struct eloop *eloop, int fd,
     void (*read_cb)(void *), void *read_cb_arg,
     void (*write_cb)(void *), void *write_cb_arg)
 {
 	struct eloop_event *e;
+#if defined(HAVE_KQUEUE)
+	struct kevent *pfd;
+#elif defined(HAVE_EPOLL)
+	struct epoll_event *pfd;
+#else
 	struct pollfd *pfd;
+	struct eloop_event **fdevs;
+#endif
+	size_t nfds;
+	bool added;
 
 	assert(eloop != NULL);
 	assert(read_cb != NULL || write_cb != NULL);
@@ -339,23 +880,36 @@ eloop_event_add_rw(struct eloop *eloop, int fd,
 	}
 
 	if (e == NULL) {
-		if (eloop->nevents + 1 > eloop->nfds) {
-			pfd = eloop_realloca(eloop->fds, eloop->nevents + 1,
-			    sizeof(*pfd));
+		nfds = (eloop->nevents + 1) * NFD;
+#if defined(HAVE_KQUEUE)
+		nfds += eloop->signals_len;
+#endif
+		if (nfds > eloop->nfds) {
+			pfd = eloop_realloca(eloop->fds, nfds, sizeof(*pfd));
 			if (pfd == NULL)
 				return -1;
 			eloop->fds = pfd;
-			eloop->nfds++;
+#if !defined(HAVE_KQUEUE) && !defined(HAVE_EPOLL)
+			fdevs = eloop_realloca(eloop->fdevs, nfds,
+			    sizeof(*fdevs));
+			if (fdevs == NULL)
+				return -1;
+			eloop->fdevs = fdevs;
+			/* Growing may have moved the array, leaving the
+			 * events pointing at stale slots - rebuild. */
+			eloop->events_need_setup = true;
+#endif
+			eloop->nfds = nfds;
 		}
 
 		e = TAILQ_FIRST(&eloop->free_events);
-		if (e != NULL)
-			TAILQ_REMOVE(&eloop->free_events, e, next);
-		else {
-			e = malloc(sizeof(*e));
-			if (e == NULL)
+		if (e == NULL) {
+			if (eloop_event_pool_grow(eloop,
+			    ELOOP_POOL_CHUNK) == -1)
 				return -1;
+			e = TAILQ_FIRST(&eloop->free_events);
 		}
+		TAILQ_REMOVE(&eloop->free_events, e, next);
 		TAILQ_INSERT_HEAD(&eloop->events, e, next);
 		eloop->nevents++;
 		e->fd = fd;
@@ -363,8 +917,11 @@ eloop_event_add_rw(struct eloop *eloop, int fd,
 		e->read_cb_arg = read_cb_arg;
 		e->write_cb = write_cb;
 		e->write_cb_arg = write_cb_arg;
+		e->priority = ELOOP_PRIO_DEFAULT;
+		added = true;
 		goto setup;
 	}
+	added = false;
 
 	if (read_cb) {
 		e->read_cb = read_cb;
@@ -376,8 +933,34 @@ eloop_event_add_rw(struct eloop *eloop, int fd,
 	}
 
 setup:
-	e->pollfd = NULL;
-	eloop->events_need_setup = true;
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+	if (eloop_event_register(eloop, e) == -1) {
+		if (added) {
+			TAILQ_REMOVE(&eloop->events, e, next);
+			TAILQ_INSERT_TAIL(&eloop->free_events, e, next);
+			eloop->nevents--;
+		}
+		return -1;
+	}
+#else
+	if (eloop->events_need_setup) {
+		/* A rebuild is queued which will place everything. */
+		e->pollfd = NULL;
+	} else if (added) {
+		/* Append to the live array. */
+		e->pollfd = &eloop->fds[eloop->nevents - 1];
+		eloop->fdevs[eloop->nevents - 1] = e;
+		e->pollfd->fd = e->fd;
+		e->pollfd->revents = 0;
+	}
+	if (e->pollfd != NULL) {
+		e->pollfd->events = 0;
+		if (e->read_cb != NULL)
+			e->pollfd->events |= POLLIN;
+		if (e->write_cb != NULL)
+			e->pollfd->events |= POLLOUT;
+	}
+#endif
 	return 0;
 }
 
@@ -397,6 +980,31 @@ eloop_event_add_w(struct eloop *eloop, int fd,
 	return eloop_event_add_rw(eloop, fd, NULL,NULL, write_cb, write_cb_arg);
 }
 
+/* Raise or lower the dispatch priority of an event.
+ * Protocol sockets are prioritised so that a chatty control client
+ * or log consumer cannot delay packet processing within a loop
+ * iteration. */
+int
+eloop_event_priority(struct eloop *eloop, int fd, int priority)
+{
+	struct eloop_event *e;
+
+	assert(eloop != NULL);
+	if (fd == -1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	TAILQ_FOREACH(e, &eloop->events, next) {
+		if (e->fd == fd) {
+			e->priority = priority;
+			return 0;
+		}
+	}
+	errno = ENOENT;
+	return -1;
+}
+
 int
 eloop_event_delete_write(struct eloop *eloop, int fd, int write_only)
 {
@@ -422,17 +1030,39 @@ eloop_event_delete_write(struct eloop *eloop, int fd, int write_only)
 			goto remove;
 		e->write_cb = NULL;
 		e->write_cb_arg = NULL;
-		if (e->pollfd != NULL) {
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+		if (eloop_event_register(eloop, e) == -1)
+			return -1;
+#else
+		if (!eloop->events_need_setup && e->pollfd != NULL) {
 			e->pollfd->events &= ~POLLOUT;
 			e->pollfd->revents &= ~POLLOUT;
 		}
+#endif
 		return 1;
 	}
 
 remove:
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+	eloop_event_unregister(eloop, e);
+#else
+	if (!eloop->events_need_setup && e->pollfd != NULL) {
+		size_t slot, last;
+
+		/* Compact the array by moving the last slot into ours. */
+		slot = (size_t)(e->pollfd - eloop->fds);
+		last = eloop->nevents - 1;
+		if (slot != last) {
+			eloop->fds[slot] = eloop->fds[last];
+			eloop->fdevs[slot] = eloop->fdevs[last];
+			eloop->fdevs[slot]->pollfd = &eloop->fds[slot];
+		}
+	}
+	e->pollfd = NULL;
+#endif
 	e->fd = -1;
 	eloop->nevents--;
-	eloop->events_need_setup = true;
+	eloop->events_need_sweep = true;
 	return 1;
 }
 
@@ -447,52 +1077,112 @@ eloop_q_timeout_add(struct eloop *eloop, int queue,
     unsigned int seconds, unsigned int nseconds,
     void (*callback)(void *), void *arg)
 {
-	struct eloop_timeout *t, *tt = NULL;
+	struct eloop_timeout *t = NULL;
+	struct timespec now;
+	unsigned long long secs;
+	unsigned int nsecs;
+	size_t i;
 
 	assert(eloop != NULL);
 	assert(callback != NULL);
 	assert(nseconds <= NSEC_PER_SEC);
 
-	/* Remove existing timeout if present. */
-	TAILQ_FOREACH(t, &eloop->timeouts, next) {
-		if (t->callback == callback && t->arg == arg) {
-			TAILQ_REMOVE(&eloop->timeouts, t, next);
+	/* Update an existing timeout if present. */
+	for (i = 0; i < eloop->ntimeouts; i++) {
+		if (eloop->timeouts[i]->callback == callback &&
+		    eloop->timeouts[i]->arg == arg)
+		{
+			t = eloop->timeouts[i];
 			break;
 		}
 	}
 
 	if (t == NULL) {
-		/* No existing, so allocate or grab one from the free pool. */
-		if ((t = TAILQ_FIRST(&eloop->free_timeouts))) {
-			TAILQ_REMOVE(&eloop->free_timeouts, t, next);
-		} else {
-			if ((t = malloc(sizeof(*t))) == NULL)
+		/* No existing, so grab one from the pool. */
+		t = TAILQ_FIRST(&eloop->free_timeouts);
+		if (t == NULL) {
+			if (eloop_timeout_pool_grow(eloop,
+			    ELOOP_POOL_CHUNK) == -1)
 				return -1;
+			t = TAILQ_FIRST(&eloop->free_timeouts);
 		}
+		TAILQ_REMOVE(&eloop->free_timeouts, t, next);
 	}
 
-	eloop_reduce_timers(eloop);
+	/* Timers in the heap are relative to when they were last
+	 * reduced against eloop->now, so adjust the new timeout for
+	 * the time elapsed since rather than reducing every timer.
+	 * While eloop->now is fresh this iteration there is nothing
+	 * to adjust for and the clock read can be skipped. */
+	if (eloop->now_fresh) {
+		secs = 0;
+		nsecs = 0;
+	} else {
+		clock_gettime(ELOOP_CLOCK, &now);
+		secs = eloop_timespec_diff(&now, &eloop->now, &nsecs);
+	}
+	secs += seconds;
+	nsecs += nseconds;
+	while (nsecs >= NSEC_PER_SEC) {
+		secs++;
+		nsecs -= NSEC_PER_SEC;
+	}
+
+	/* Quantize into the queue's coalescing window, aligned to
+	 * absolute buckets, so timeouts due close together share an
+	 * expiry and a single wakeup. */
+	if (queue >= 0 && queue < ELOOP_NQUEUES &&
+	    eloop->coalesce_ns[queue] != 0)
+	{
+		unsigned long long grain, base, ns;
+
+		grain = eloop->coalesce_ns[queue];
+		base = (unsigned long long)eloop->now.tv_sec * NSEC_PER_SEC +
+		    (unsigned long long)eloop->now.tv_nsec;
+		ns = base + secs * NSEC_PER_SEC + nsecs;
+		ns += grain - 1;
+		ns -= ns % grain;
+		ns -= base;
+		secs = ns / NSEC_PER_SEC;
+		nsecs = (unsigned int)(ns % NSEC_PER_SEC);
+	}
+
+	if (secs > UINT_MAX) {
+		secs = UINT_MAX;
+		nsecs = 0;
+	}
 
-	t->seconds = seconds;
-	t->nseconds = nseconds;
+	t->seconds = (unsigned int)secs;
+	t->nseconds = nsecs;
 	t->callback = callback;
 	t->arg = arg;
 	t->queue = queue;
+	t->seq = eloop->timeout_seq++;
 
-	/* The timeout list should be in chronological order,
-	 * soonest first. */
-	TAILQ_FOREACH(tt, &eloop->timeouts, next) {
-		if (t->seconds < tt->seconds ||
-		    (t->seconds == tt->seconds && t->nseconds < tt->nseconds))
-		{
-			TAILQ_INSERT_BEFORE(tt, t, next);
-			return 0;
-		}
+	if (i < eloop->ntimeouts) {
+		/* Re-sift the updated timeout into place. */
+		eloop_timeout_siftdown(eloop, t->heap_idx);
+		eloop_timeout_siftup(eloop, t->heap_idx);
+		return 0;
+	}
+
+	if (eloop_timeout_insert(eloop, t) == -1) {
+		TAILQ_INSERT_TAIL(&eloop->free_timeouts, t, next);
+		return -1;
 	}
-	TAILQ_INSERT_TAIL(&eloop->timeouts, t, next);
 	return 0;
 }
 
+void
+eloop_q_timeout_coalesce(struct eloop *eloop, int queue, unsigned long msec)
+{
+
+	assert(eloop != NULL);
+	assert(queue > 0 && queue < ELOOP_NQUEUES);
+
+	eloop->coalesce_ns[queue] = (unsigned long long)msec * NSEC_PER_MSEC;
+}
+
 int
 eloop_q_timeout_add_tv(struct eloop *eloop, int queue,
     const struct timespec *when, void (*callback)(void *), void *arg)
@@ -541,21 +1231,29 @@ int
 eloop_q_timeout_delete(struct eloop *eloop, int queue,
     void (*callback)(void *), void *arg)
 {
-	struct eloop_timeout *t, *tt;
+	struct eloop_timeout *t;
+	size_t i;
 	int n;
 
 	assert(eloop != NULL);
 
 	n = 0;
-	TAILQ_FOREACH_SAFE(t, &eloop->timeouts, next, tt) {
+	i = 0;
+	while (i < eloop->ntimeouts) {
+		t = eloop->timeouts[i];
 		if ((queue == 0 || t->queue == queue) &&
 		    t->arg == arg &&
 		    (!callback || t->callback == callback))
 		{
-			TAILQ_REMOVE(&eloop->timeouts, t, next);
+			eloop_timeout_remove(eloop, t);
 			TAILQ_INSERT_TAIL(&eloop->free_timeouts, t, next);
 			n++;
+			/* Removal re-sifts the heap under us,
+			 * so restart the scan. */
+			i = 0;
+			continue;
 		}
+		i++;
 	}
 	return n;
 }
@@ -591,6 +1289,7 @@ eloop_signal_set_cb(struct eloop *eloop,
 	eloop->signal_cb_ctx = signal_cb_ctx;
 }
 
+#if !defined(HAVE_KQUEUE) && !defined(HAVE_EPOLL)
 static volatile int _eloop_sig[ELOOP_NSIGNALS];
 static volatile size_t _eloop_nsig;
 
@@ -608,16 +1307,19 @@ eloop_signal3(int sig, __unused siginfo_t *siginfo, __unused void *arg)
 
 	_eloop_sig[_eloop_nsig++] = sig;
 }
+#endif
 
 int
 eloop_signal_mask(struct eloop *eloop, sigset_t *oldset)
 {
 	sigset_t newset;
 	size_t i;
+#if !defined(HAVE_KQUEUE) && !defined(HAVE_EPOLL)
 	struct sigaction sa = {
 	    .sa_sigaction = eloop_signal3,
 	    .sa_flags = SA_SIGINFO,
 	};
+#endif
 
 	assert(eloop != NULL);
 
@@ -627,6 +1329,9 @@ eloop_signal_mask(struct eloop *eloop, sigset_t *oldset)
 	if (sigprocmask(SIG_SETMASK, &newset, oldset) == -1)
 		return -1;
 
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+	return eloop_signal_register(eloop);
+#else
 	sigemptyset(&sa.sa_mask);
 
 	for (i = 0; i < eloop->signals_len; i++) {
@@ -634,6 +1339,7 @@ eloop_signal_mask(struct eloop *eloop, sigset_t *oldset)
 			return -1;
 	}
 	return 0;
+#endif
 }
 
 struct eloop *
@@ -646,14 +1352,23 @@ eloop_new(void)
 		return NULL;
 
 	/* Check we have a working monotonic clock. */
-	if (clock_gettime(CLOCK_MONOTONIC, &eloop->now) == -1) {
+	if (clock_gettime(ELOOP_CLOCK, &eloop->now) == -1) {
 		free(eloop);
 		return NULL;
 	}
 
+#if defined(HAVE_EPOLL)
+	eloop->signal_fd = -1;
+#endif
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+	if (eloop_open(eloop) == -1) {
+		free(eloop);
+		return NULL;
+	}
+#endif
+
 	TAILQ_INIT(&eloop->events);
 	TAILQ_INIT(&eloop->free_events);
-	TAILQ_INIT(&eloop->timeouts);
 	TAILQ_INIT(&eloop->free_timeouts);
 	eloop->exitcode = EXIT_FAILURE;
 
@@ -663,8 +1378,7 @@ eloop_new(void)
 void
 eloop_clear(struct eloop *eloop)
 {
-	struct eloop_event *e;
-	struct eloop_timeout *t;
+	struct eloop_slab *slab;
 
 	if (eloop == NULL)
 		return;
@@ -673,25 +1387,30 @@ eloop_clear(struct eloop *eloop)
 	eloop->signals = NULL;
 	eloop->signals_len = 0;
 
-	while ((e = TAILQ_FIRST(&eloop->events))) {
-		TAILQ_REMOVE(&eloop->events, e, next);
-		free(e);
-	}
-	while ((e = TAILQ_FIRST(&eloop->free_events))) {
-		TAILQ_REMOVE(&eloop->free_events, e, next);
-		free(e);
-	}
-	while ((t = TAILQ_FIRST(&eloop->timeouts))) {
-		TAILQ_REMOVE(&eloop->timeouts, t, next);
-		free(t);
+	/* Events and timeouts live in the slabs,
+	 * so just empty the lists before freeing those. */
+	TAILQ_INIT(&eloop->events);
+	TAILQ_INIT(&eloop->free_events);
+	free(eloop->timeouts);
+	eloop->timeouts = NULL;
+	eloop->ntimeouts = eloop->timeouts_len = 0;
+	TAILQ_INIT(&eloop->free_timeouts);
+	while ((slab = eloop->event_slabs) != NULL) {
+		eloop->event_slabs = slab->next;
+		free(slab);
 	}
-	while ((t = TAILQ_FIRST(&eloop->free_timeouts))) {
-		TAILQ_REMOVE(&eloop->free_timeouts, t, next);
-		free(t);
+	while ((slab = eloop->timeout_slabs) != NULL) {
+		eloop->timeout_slabs = slab->next;
+		free(slab);
 	}
+	eloop->nevents_pooled = eloop->ntimeouts_pooled = 0;
 
 	free(eloop->fds);
 	eloop->fds = NULL;
+#if !defined(HAVE_KQUEUE) && !defined(HAVE_EPOLL)
+	free(eloop->fdevs);
+	eloop->fdevs = NULL;
+#endif
 	eloop->nfds = 0;
 }
 
@@ -700,31 +1419,53 @@ eloop_free(struct eloop *eloop)
 {
 
 	eloop_clear(eloop);
+#if defined(HAVE_EPOLL)
+	if (eloop != NULL && eloop->signal_fd != -1)
+		close(eloop->signal_fd);
+#endif
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+	if (eloop != NULL && eloop->poll_fd != -1)
+		close(eloop->poll_fd);
+#endif
 	free(eloop);
 }
 
 int
 eloop_start(struct eloop *eloop, sigset_t *signals)
 {
-	int n;
+	int n, pass;
 	struct eloop_event *e;
 	struct eloop_timeout *t;
 	struct timespec ts, *tsp;
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+	int i;
+#endif
+#if defined(HAVE_KQUEUE)
+	struct kevent *ke;
+#elif defined(HAVE_EPOLL)
+	struct epoll_event *epe;
+	int timeout;
+#endif
 
 	assert(eloop != NULL);
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+	UNUSED(signals);
+#endif
 
 	for (;;) {
 		if (eloop->exitnow)
 			break;
 
+#if !defined(HAVE_KQUEUE) && !defined(HAVE_EPOLL)
 		if (_eloop_nsig != 0) {
 			n = _eloop_sig[--_eloop_nsig];
 			if (eloop->signal_cb != NULL)
 				eloop->signal_cb(n, eloop->signal_cb_ctx);
 			continue;
 		}
+#endif
 
-		t = TAILQ_FIRST(&eloop->timeouts);
+		t = eloop->ntimeouts != 0 ? eloop->timeouts[0] : NULL;
 		if (t == NULL && eloop->nevents == 0)
 			break;
 
@@ -732,7 +1473,9 @@ eloop_start(struct eloop *eloop, sigset_t *signals)
 			eloop_reduce_timers(eloop);
 
 		if (t != NULL && t->seconds == 0 && t->nseconds == 0) {
-			TAILQ_REMOVE(&eloop->timeouts, t, next);
+			eloop_timeout_remove(eloop, t);
+			eloop->timeouts_fired++;
+			DHCPCD_PROBE1(eloop_timeout, t->callback);
 			t->callback(t->arg);
 			TAILQ_INSERT_TAIL(&eloop->free_timeouts, t, next);
 			continue;
@@ -750,10 +1493,33 @@ eloop_start(struct eloop *eloop, sigset_t *signals)
 		} else
 			tsp = NULL;
 
+#if !defined(HAVE_KQUEUE) && !defined(HAVE_EPOLL)
 		if (eloop->events_need_setup)
 			eloop_event_setup_fds(eloop);
-
+		else
+#endif
+		if (eloop->events_need_sweep)
+			eloop_event_sweep(eloop);
+
+		/* Time passes while we wait. */
+		eloop->now_fresh = false;
+
+#if defined(HAVE_KQUEUE)
+		n = kevent(eloop->poll_fd, NULL, 0, eloop->fds,
+		    (int)eloop->nfds, tsp);
+#elif defined(HAVE_EPOLL)
+		if (tsp == NULL)
+			timeout = -1;
+		else if (tsp->tv_sec >= INT_MAX / MSEC_PER_SEC)
+			timeout = INT_MAX;
+		else
+			timeout = (int)(tsp->tv_sec * MSEC_PER_SEC +
+			    (tsp->tv_nsec + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC);
+		n = epoll_wait(eloop->poll_fd, eloop->fds,
+		    (int)eloop->nfds, timeout);
+#else
 		n = ppoll(eloop->fds, (nfds_t)eloop->nevents, tsp, signals);
+#endif
 		if (n == -1) {
 			if (errno == EINTR)
 				continue;
@@ -761,26 +1527,95 @@ eloop_start(struct eloop *eloop, sigset_t *signals)
 		}
 		if (n == 0)
 			continue;
-
+		eloop->events_fired += (unsigned long long)n;
+
+		/* Two dispatch passes - prioritised events (and signals)
+		 * first, everything else after, so a busy control or log
+		 * fd cannot delay packet processing. */
+#if defined(HAVE_KQUEUE)
+		for (pass = 0; pass < 2; pass++)
+		for (i = 0; i < n; i++) {
+			ke = &eloop->fds[i];
+			if (ke->filter == EVFILT_SIGNAL) {
+				if (pass == 0 && eloop->signal_cb != NULL)
+					eloop->signal_cb((int)ke->ident,
+					    eloop->signal_cb_ctx);
+				continue;
+			}
+			e = (struct eloop_event *)ke->udata;
+			/* Skip events deleted by a prior callback -
+			 * they are not recycled until the next setup. */
+			if (e->fd == -1)
+				continue;
+			if (pass == 0 ?
+			    e->priority == ELOOP_PRIO_DEFAULT :
+			    e->priority != ELOOP_PRIO_DEFAULT)
+				continue;
+			DHCPCD_PROBE1(eloop_event, e->fd);
+			if (ke->filter == EVFILT_WRITE) {
+				if (e->write_cb != NULL)
+					e->write_cb(e->write_cb_arg);
+			} else if (ke->filter == EVFILT_READ) {
+				if (e->read_cb != NULL)
+					e->read_cb(e->read_cb_arg);
+			}
+		}
+#elif defined(HAVE_EPOLL)
+		for (pass = 0; pass < 2; pass++)
+		for (i = 0; i < n; i++) {
+			epe = &eloop->fds[i];
+			if (epe->data.ptr == NULL) {
+				/* The signalfd. */
+				if (pass == 0)
+					eloop_signal_read(eloop);
+				continue;
+			}
+			e = epe->data.ptr;
+			/* Skip events deleted by a prior callback -
+			 * they are not recycled until the next setup. */
+			if (e->fd == -1)
+				continue;
+			if (pass == 0 ?
+			    e->priority == ELOOP_PRIO_DEFAULT :
+			    e->priority != ELOOP_PRIO_DEFAULT)
+				continue;
+			DHCPCD_PROBE1(eloop_event, e->fd);
+			if (epe->events & EPOLLOUT && e->write_cb != NULL)
+				e->write_cb(e->write_cb_arg);
+			if (e->fd != -1 &&
+			    epe->events & (EPOLLIN | EPOLLERR | EPOLLHUP) &&
+			    e->read_cb != NULL)
+				e->read_cb(e->read_cb_arg);
+		}
+#else
+		for (pass = 0; pass < 2; pass++)
 		TAILQ_FOREACH(e, &eloop->events, next) {
+			short revents;
+
 			/* Skip freshly added events */
 			if (e->pollfd == NULL)
 				continue;
-			if (e->pollfd->revents)
-				n--;
-			if (e->fd != -1 && e->pollfd->revents & POLLOUT) {
+			if (pass == 0 ?
+			    e->priority == ELOOP_PRIO_DEFAULT :
+			    e->priority != ELOOP_PRIO_DEFAULT)
+				continue;
+			if (e->fd == -1 || e->pollfd->revents == 0)
+				continue;
+			DHCPCD_PROBE1(eloop_event, e->fd);
+			/* Claim the results so the other pass does not
+			 * dispatch this event again. */
+			revents = e->pollfd->revents;
+			e->pollfd->revents = 0;
+			if (revents & POLLOUT) {
 				if (e->write_cb != NULL)
 					e->write_cb(e->write_cb_arg);
 			}
-			if (e->fd != -1 &&
-			    e->pollfd != NULL && e->pollfd->revents)
-			{
+			if (e->fd != -1 && e->pollfd != NULL && revents) {
 				if (e->read_cb != NULL)
 					e->read_cb(e->read_cb_arg);
 			}
-			if (n == 0)
-				break;
 		}
+#endif
 	}
 
 	return eloop->exitcode;
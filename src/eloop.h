@@ -49,11 +49,18 @@
 /* Used for deleting a timeout for all queues. */
 #define	ELOOP_QUEUE_ALL	0
 
+/* Event dispatch priorities.
+ * Within one loop iteration, high priority events (protocol sockets)
+ * dispatch before default ones (control, logging). */
+#define	ELOOP_PRIO_DEFAULT	0
+#define	ELOOP_PRIO_HIGH		1
+
 /* Forward declare eloop - the content should be invisible to the outside */
 struct eloop;
 
 unsigned long long eloop_timespec_diff(const struct timespec *tsp,
     const struct timespec *usp, unsigned int *nsp);
+const char * eloop_backend(void);
 size_t eloop_event_count(const struct eloop  *);
 int eloop_event_add_rw(struct eloop *, int,
     void (*)(void *), void *,
@@ -67,6 +74,7 @@ int eloop_event_add_w(struct eloop *, int,
 #define eloop_event_remove_writecb(eloop, fd) \
     eloop_event_delete_write((eloop), (fd), 1)
 int eloop_event_delete_write(struct eloop *, int, int);
+int eloop_event_priority(struct eloop *, int, int);
 
 #define eloop_timeout_add_tv(eloop, tv, cb, ctx) \
     eloop_q_timeout_add_tv((eloop), ELOOP_QUEUE, (tv), (cb), (ctx))
@@ -83,12 +91,32 @@ int eloop_q_timeout_add_sec(struct eloop *, int,
 int eloop_q_timeout_add_msec(struct eloop *, int,
     unsigned long, void (*)(void *), void *);
 int eloop_q_timeout_delete(struct eloop *, int, void (*)(void *), void *);
+void eloop_q_timeout_coalesce(struct eloop *, int, unsigned long);
 
 void eloop_signal_set_cb(struct eloop *, const int *, size_t,
     void (*)(int, void *), void *);
 int eloop_signal_mask(struct eloop *, sigset_t *oldset);
 
+struct eloop_pool_stats {
+	size_t events_pooled;
+	size_t events_free;
+	size_t timeouts_pooled;
+	size_t timeouts_free;
+};
+
+int eloop_pool_reserve(struct eloop *, size_t, size_t);
+void eloop_pool_stats(const struct eloop *, struct eloop_pool_stats *);
+
+struct eloop_run_stats {
+	unsigned long long timeouts_fired;
+	unsigned long long events_fired;
+};
+
+void eloop_run_stats(const struct eloop *, struct eloop_run_stats *);
+size_t eloop_mem(const struct eloop *);
+
 struct eloop * eloop_new(void);
+int eloop_forked(struct eloop *);
 void eloop_clear(struct eloop *);
 void eloop_free(struct eloop *);
 void eloop_exit(struct eloop *, int);
@@ -578,7 +578,7 @@ if_findsdl(struct dhcpcd_ctx *ctx, const struct sockaddr_dl *sdl)
 {
 
 	if (sdl->sdl_index)
-		return if_findindex(ctx->ifaces, sdl->sdl_index);
+		return if_findindex(ctx, sdl->sdl_index);
 
 	if (sdl->sdl_nlen) {
 		char ifname[IF_NAMESIZE];
@@ -642,7 +642,7 @@ if_findsa(struct dhcpcd_ctx *ctx, const struct sockaddr *sa)
 		sin = (const void *)sa;
 		scope = ipv6_getscope(sin);
 		if (scope != 0)
-			return if_findindex(ctx->ifaces, scope);
+			return if_findindex(ctx, scope);
 		if ((ia = ipv6_findmaskaddr(ctx, &sin->sin6_addr)))
 			return ia->iface;
 		break;
@@ -896,7 +896,7 @@ if_copyrt(struct dhcpcd_ctx *ctx, struct rt *rt, const struct rt_msghdr *rtm)
 	rt->rt_mtu = (unsigned int)rtm->rtm_rmx.rmx_mtu;
 
 	if (rtm->rtm_index)
-		rt->rt_ifp = if_findindex(ctx->ifaces, rtm->rtm_index);
+		rt->rt_ifp = if_findindex(ctx, rtm->rtm_index);
 	else if (rtm->rtm_addrs & RTA_IFP)
 		rt->rt_ifp = if_findsa(ctx, rti_info[RTAX_IFP]);
 	else if (rtm->rtm_addrs & RTA_GATEWAY)
@@ -1222,7 +1222,7 @@ if_ifinfo(struct dhcpcd_ctx *ctx, const struct if_msghdr *ifm)
 		return -1;
 	}
 
-	if ((ifp = if_findindex(ctx->ifaces, ifm->ifm_index)) == NULL)
+	if ((ifp = if_findindex(ctx, ifm->ifm_index)) == NULL)
 		return 0;
 
 	link_state = if_carrier(ifp, &ifm->ifm_data);
@@ -1316,7 +1316,7 @@ if_ifa(struct dhcpcd_ctx *ctx, const struct ifa_msghdr *ifam)
 
 	if (~ifam->ifam_addrs & RTA_IFA)
 		return 0;
-	if ((ifp = if_findindex(ctx->ifaces, ifam->ifam_index)) == NULL)
+	if ((ifp = if_findindex(ctx, ifam->ifam_index)) == NULL)
 		return 0;
 
 	if (get_addrs(ifam->ifam_addrs, (const char *)ifam + sizeof(*ifam),
@@ -1590,33 +1590,133 @@ if_missfilter_apply(struct dhcpcd_ctx *ctx)
 }
 
 __CTASSERT(offsetof(struct rt_msghdr, rtm_msglen) == 0);
+
+struct if_rtmsg {
+	int ifindex;
+	size_t pos;
+};
+
+static int
+if_rtmsg_cmp(const void *va, const void *vb)
+{
+	const struct if_rtmsg *a = va, *b = vb;
+
+	if (a->ifindex != b->ifindex)
+		return a->ifindex < b->ifindex ? -1 : 1;
+	return a->pos < b->pos ? -1 : a->pos > b->pos;
+}
+
+/* Stored messages are padded so the next header is aligned. */
+#define	IF_RTM_ALIGN(l) (((l) + sizeof(long) - 1) & ~(sizeof(long) - 1))
+
+/* Route churn such as a CARP failover sends thousands of messages in
+ * one burst and the route socket returns just one per read.
+ * Drain the socket into one buffer, keep only the last link state
+ * message for each interface and dispatch the rest in received order,
+ * mirroring what the netlink side does for link message storms. */
 int
 if_handlelink(struct dhcpcd_ctx *ctx)
 {
 	struct rtm rtm;
+	uint8_t *dbuf = NULL, *nbuf;
+	size_t dlen = 0, pos, n, i;
 	ssize_t len;
+	struct rt_msghdr *hdr;
+	struct if_rtmsg *rms = NULL;
+	int r = 0, serrno = 0;
+
+	for (;;) {
+		len = read(ctx->link_fd, &rtm, sizeof(rtm));
+		if (len == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (errno == EINTR)
+				continue;
+			/* Report the error once the drained
+			 * messages have been dispatched. */
+			serrno = errno;
+			break;
+		}
+		if (len == 0)
+			break;
+		if ((size_t)len < sizeof(rtm.hdr.rtm_msglen) ||
+		    len != rtm.hdr.rtm_msglen)
+		{
+			serrno = EINVAL;
+			break;
+		}
+		nbuf = realloc(dbuf, dlen + IF_RTM_ALIGN((size_t)len));
+		if (nbuf == NULL) {
+			serrno = errno;
+			goto dispatch;
+		}
+		dbuf = nbuf;
+		memcpy(dbuf + dlen, &rtm, (size_t)len);
+		dlen += IF_RTM_ALIGN((size_t)len);
+	}
 
-	len = read(ctx->link_fd, &rtm, sizeof(rtm));
-	if (len == -1)
-		return -1;
-	if (len == 0)
-		return 0;
-	if ((size_t)len < sizeof(rtm.hdr.rtm_msglen) ||
-	    len != rtm.hdr.rtm_msglen)
-	{
-		errno = EINVAL;
+	/* Find the last link state message for each interface and mark
+	 * the earlier ones as superseded. */
+	n = 0;
+	for (pos = 0; pos < dlen; pos += IF_RTM_ALIGN(hdr->rtm_msglen)) {
+		hdr = (struct rt_msghdr *)(void *)(dbuf + pos);
+		if (hdr->rtm_version == RTM_VERSION &&
+		    hdr->rtm_type == RTM_IFINFO &&
+		    hdr->rtm_msglen >= sizeof(struct if_msghdr))
+			n++;
+	}
+	if (n > 1)
+		rms = reallocarray(NULL, n, sizeof(*rms));
+	if (rms != NULL) {
+		const struct if_msghdr *ifm;
+
+		n = 0;
+		for (pos = 0; pos < dlen;
+		    pos += IF_RTM_ALIGN(hdr->rtm_msglen))
+		{
+			hdr = (struct rt_msghdr *)(void *)(dbuf + pos);
+			if (hdr->rtm_version != RTM_VERSION ||
+			    hdr->rtm_type != RTM_IFINFO ||
+			    hdr->rtm_msglen < sizeof(*ifm))
+				continue;
+			ifm = (const void *)hdr;
+			rms[n].ifindex = ifm->ifm_index;
+			rms[n].pos = pos;
+			n++;
+		}
+		qsort(rms, n, sizeof(*rms), if_rtmsg_cmp);
+		for (i = 0; i + 1 < n; i++) {
+			if (rms[i].ifindex != rms[i + 1].ifindex)
+				continue;
+			hdr = (struct rt_msghdr *)(void *)
+			    (dbuf + rms[i].pos);
+			/* An unknown version is never dispatched. */
+			hdr->rtm_version = 0;
+		}
+		free(rms);
+	}
+
+dispatch:
+	for (pos = 0; pos < dlen; pos += IF_RTM_ALIGN(hdr->rtm_msglen)) {
+		hdr = (struct rt_msghdr *)(void *)(dbuf + pos);
+		/*
+		 * Coverity thinks that the data could be tainted from here.
+		 * I have no idea how because the length of the data we read
+		 * is guarded by len and checked to match rtm_msglen.
+		 * The issue seems to be related to extracting the addresses
+		 * at the end of the header, but seems to have no issues with
+		 * the equivalent call in if_initrt.
+		 */
+		/* coverity[tainted_data] */
+		r = if_dispatch(ctx, hdr);
+	}
+	free(dbuf);
+
+	if (serrno != 0) {
+		errno = serrno;
 		return -1;
 	}
-	/*
-	 * Coverity thinks that the data could be tainted from here.
-	 * I have no idea how because the length of the data we read
-	 * is guarded by len and checked to match rtm_msglen.
-	 * The issue seems to be related to extracting the addresses
-	 * at the end of the header, but seems to have no issues with the
-	 * equivalent call in if_initrt.
-	 */
-	/* coverity[tainted_data] */
-	return if_dispatch(ctx, &rtm.hdr);
+	return r;
 }
 
 #ifndef SYS_NMLN	/* OSX */
@@ -30,6 +30,7 @@
 
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/param.h>
 #include <sys/stat.h>
@@ -63,6 +64,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <ctype.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -141,10 +143,18 @@ int if_getssid_wext(const char *ifname, uint8_t *ssid);
 	(struct rtattr *)(void *)(((char *)(rta)) \
 	+ RTA_ALIGN((rta)->rta_len)))
 
+/* RTA_EXPIRES is an enumerator since Linux 4.5, so the guard only
+ * helps older headers.  The kernel ignores unknown attributes. */
+#ifndef RTA_EXPIRES
+#define RTA_EXPIRES		23
+#endif
+
 struct priv {
 	int route_fd;
 	int generic_fd;
 	uint32_t route_pid;
+	uint32_t *ign_filter;	/* ifindexes the kernel drops for us */
+	size_t ign_filter_len;
 };
 
 /* We need this to send a broadcast for InfiniBand.
@@ -498,6 +508,7 @@ if_closesockets_os(struct dhcpcd_ctx *ctx)
 		priv = (struct priv *)ctx->priv;
 		close(priv->route_fd);
 		close(priv->generic_fd);
+		free(priv->ign_filter);
 	}
 }
 
@@ -616,6 +627,390 @@ recv_again:
 	return r;
 }
 
+/* getifaddrs(3) performs the very netlink dumps below but builds a
+ * list of many small allocations which if_discover() and
+ * if_learnaddrs() then just walk.  Dump the links and addresses
+ * directly into one flat buffer instead and carry the address flags
+ * in ifa_data so that learning addresses needs no netlink round trip
+ * per address.  The whole list is freed with a single free(3) - see
+ * the freeifaddrs define in if.h. */
+union if_ifsa {
+	struct sockaddr sa;
+	struct sockaddr_in sin;
+	struct sockaddr_in6 sin6;
+	struct sockaddr_ll sll;
+	struct sockaddr_storage ss;
+};
+
+struct if_ifaddr {
+	struct ifaddrs ifa;
+	char name[IF_NAMESIZE];
+	union if_ifsa addr;
+	union if_ifsa netmask;
+	union if_ifsa broadaddr;
+	int addrflags;
+};
+
+static int
+if_nlsenddump(int s, uint16_t type, uint32_t seq)
+{
+	struct {
+		struct nlmsghdr hdr;
+		struct ifinfomsg ifi;
+	} nlm = {
+	    .hdr.nlmsg_len = NLMSG_LENGTH(type == RTM_GETLINK ?
+		sizeof(struct ifinfomsg) : sizeof(struct ifaddrmsg)),
+	    .hdr.nlmsg_type = type,
+	    .hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+	    .hdr.nlmsg_seq = seq,
+	};
+
+	if (send(s, &nlm, nlm.hdr.nlmsg_len, 0) == -1)
+		return -1;
+	return 0;
+}
+
+static ssize_t
+if_nlrecvdump(int s, uint32_t seq, void **dump)
+{
+	struct sockaddr_nl nladdr;
+	socklen_t nladdr_len;
+	uint8_t *rbuf = NULL, *dbuf = NULL, *nbuf;
+	size_t rbuf_len = 0, dlen = 0, mlen;
+	ssize_t bytes;
+	struct nlmsghdr *nlm;
+
+	for (;;) {
+		bytes = recv(s, NULL, 0, MSG_PEEK | MSG_TRUNC);
+		if (bytes == -1)
+			goto err;
+		if ((size_t)bytes > rbuf_len) {
+			nbuf = realloc(rbuf, (size_t)bytes);
+			if (nbuf == NULL)
+				goto err;
+			rbuf = nbuf;
+			rbuf_len = (size_t)bytes;
+		}
+		nladdr_len = sizeof(nladdr);
+		bytes = recvfrom(s, rbuf, rbuf_len, 0,
+		    (struct sockaddr *)&nladdr, &nladdr_len);
+		if (bytes == -1)
+			goto err;
+		/* Ignore messages not from the kernel. */
+		if (nladdr_len != sizeof(nladdr) || nladdr.nl_pid != 0)
+			continue;
+
+		for (nlm = (struct nlmsghdr *)(void *)rbuf,
+		    mlen = (size_t)bytes;
+		    NLMSG_OK(nlm, mlen);
+		    nlm = NLMSG_NEXT(nlm, mlen))
+		{
+			if (nlm->nlmsg_seq != seq)
+				continue;
+			if (nlm->nlmsg_type == NLMSG_ERROR) {
+				struct nlmsgerr *nlerr;
+
+				if (nlm->nlmsg_len - sizeof(*nlm) <
+				    sizeof(*nlerr))
+				{
+					errno = EBADMSG;
+					goto err;
+				}
+				nlerr = NLMSG_DATA(nlm);
+				if (nlerr->error != 0) {
+					errno = -nlerr->error;
+					goto err;
+				}
+				goto done;
+			}
+			if (nlm->nlmsg_type == NLMSG_DONE)
+				goto done;
+
+			nbuf = realloc(dbuf,
+			    dlen + NLMSG_ALIGN(nlm->nlmsg_len));
+			if (nbuf == NULL)
+				goto err;
+			dbuf = nbuf;
+			memcpy(dbuf + dlen, nlm, nlm->nlmsg_len);
+			dlen += NLMSG_ALIGN(nlm->nlmsg_len);
+		}
+	}
+
+done:
+	free(rbuf);
+	*dump = dbuf;
+	return (ssize_t)dlen;
+
+err:
+	free(rbuf);
+	free(dbuf);
+	return -1;
+}
+
+static struct if_ifaddr *
+if_ifa_findlink(struct if_ifaddr *ifas, size_t nlinks, int ifindex)
+{
+	size_t i;
+
+	for (i = 0; i < nlinks; i++) {
+		if (ifas[i].addr.sll.sll_ifindex == ifindex)
+			return &ifas[i];
+	}
+	return NULL;
+}
+
+static struct if_ifaddr *
+if_ifa_link(struct if_ifaddr *ia, struct nlmsghdr *nlm)
+{
+	struct ifinfomsg *ifi;
+	struct rtattr *rta;
+	size_t len, alen;
+
+	ifi = NLMSG_DATA(nlm);
+	ia->ifa.ifa_flags = ifi->ifi_flags;
+	ia->addr.sll.sll_family = AF_PACKET;
+	ia->addr.sll.sll_ifindex = ifi->ifi_index;
+	ia->addr.sll.sll_hatype = (unsigned short)ifi->ifi_type;
+
+	rta = IFLA_RTA(ifi);
+	len = (size_t)IFLA_PAYLOAD(nlm);
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		switch (rta->rta_type) {
+		case IFLA_IFNAME:
+			strlcpy(ia->name, RTA_DATA(rta), sizeof(ia->name));
+			break;
+		case IFLA_ADDRESS:
+			/* Like the libc, allow a hardware address
+			 * longer than sll_addr by running into the
+			 * storage behind it. */
+			alen = RTA_PAYLOAD(rta);
+			if (alen > sizeof(ia->addr.ss) -
+			    offsetof(struct sockaddr_ll, sll_addr))
+				alen = sizeof(ia->addr.ss) -
+				    offsetof(struct sockaddr_ll, sll_addr);
+			ia->addr.sll.sll_halen = (unsigned char)alen;
+			memcpy(ia->addr.sll.sll_addr, RTA_DATA(rta), alen);
+			break;
+		}
+	}
+	if (ia->name[0] == '\0') {
+		/* No IFLA_IFNAME - skip the malformed entry and
+		 * leave the slot clean for the next one. */
+		memset(ia, 0, sizeof(*ia));
+		return ia;
+	}
+
+	ia->ifa.ifa_name = ia->name;
+	ia->ifa.ifa_addr = &ia->addr.sa;
+	ia->ifa.ifa_data = &ia->addrflags;
+	return ia + 1;
+}
+
+static struct if_ifaddr *
+if_ifa_addr(struct if_ifaddr *ia, struct nlmsghdr *nlm,
+    const struct if_ifaddr *lifa)
+{
+	struct ifaddrmsg *ifa;
+	struct rtattr *rta;
+	size_t len;
+	void *laddr = NULL, *aaddr = NULL, *brd = NULL;
+	char *label = NULL;
+	uint32_t aflags;
+
+	ifa = NLMSG_DATA(nlm);
+	aflags = ifa->ifa_flags;
+
+	rta = IFA_RTA(ifa);
+	len = (size_t)IFA_PAYLOAD(nlm);
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		switch (rta->rta_type) {
+		case IFA_LOCAL:
+			laddr = RTA_DATA(rta);
+			break;
+		case IFA_ADDRESS:
+			aaddr = RTA_DATA(rta);
+			break;
+		case IFA_BROADCAST:
+			brd = RTA_DATA(rta);
+			break;
+		case IFA_LABEL:
+			label = RTA_DATA(rta);
+			break;
+#ifdef IFA_FLAGS
+		case IFA_FLAGS:
+			memcpy(&aflags, RTA_DATA(rta), sizeof(aflags));
+			break;
+#endif
+		}
+	}
+
+	if (label != NULL)
+		strlcpy(ia->name, label, sizeof(ia->name));
+	else if (lifa != NULL)
+		strlcpy(ia->name, lifa->name, sizeof(ia->name));
+	else
+		return ia;
+
+	switch (ifa->ifa_family) {
+	case AF_INET:
+		if (laddr == NULL)
+			laddr = aaddr;
+		if (laddr == NULL)
+			return ia;
+		ia->addr.sin.sin_family = AF_INET;
+		memcpy(&ia->addr.sin.sin_addr, laddr,
+		    sizeof(ia->addr.sin.sin_addr));
+		ia->netmask.sin.sin_family = AF_INET;
+		if (ifa->ifa_prefixlen != 0)
+			ia->netmask.sin.sin_addr.s_addr =
+			    htonl(~0U << (32 - ifa->ifa_prefixlen));
+		if (brd != NULL) {
+			ia->broadaddr.sin.sin_family = AF_INET;
+			memcpy(&ia->broadaddr.sin.sin_addr, brd,
+			    sizeof(ia->broadaddr.sin.sin_addr));
+			ia->ifa.ifa_broadaddr = &ia->broadaddr.sa;
+		} else if (aaddr != NULL && aaddr != laddr) {
+			/* Point to point destination. */
+			ia->broadaddr.sin.sin_family = AF_INET;
+			memcpy(&ia->broadaddr.sin.sin_addr, aaddr,
+			    sizeof(ia->broadaddr.sin.sin_addr));
+			ia->ifa.ifa_dstaddr = &ia->broadaddr.sa;
+		}
+		break;
+#ifdef INET6
+	case AF_INET6:
+		if (aaddr == NULL)
+			aaddr = laddr;
+		if (aaddr == NULL)
+			return ia;
+		ia->addr.sin6.sin6_family = AF_INET6;
+		memcpy(&ia->addr.sin6.sin6_addr, aaddr,
+		    sizeof(ia->addr.sin6.sin6_addr));
+		if (IN6_IS_ADDR_LINKLOCAL(&ia->addr.sin6.sin6_addr))
+			ia->addr.sin6.sin6_scope_id = ifa->ifa_index;
+		ia->netmask.sin6.sin6_family = AF_INET6;
+		ipv6_mask(&ia->netmask.sin6.sin6_addr, ifa->ifa_prefixlen);
+		break;
+#endif
+	default:
+		return ia;
+	}
+
+	ia->addrflags = (int)aflags;
+	if (lifa != NULL)
+		ia->ifa.ifa_flags = lifa->ifa.ifa_flags;
+	ia->ifa.ifa_name = ia->name;
+	ia->ifa.ifa_addr = &ia->addr.sa;
+	ia->ifa.ifa_netmask = &ia->netmask.sa;
+	ia->ifa.ifa_data = &ia->addrflags;
+	return ia + 1;
+}
+
+int
+if_getifaddrs(struct ifaddrs **ifap)
+{
+	struct sockaddr_nl snl = { .nl_family = AF_NETLINK };
+	int s, err = -1;
+	void *ldump = NULL, *adump = NULL;
+	ssize_t llen, alen;
+	struct nlmsghdr *nlm;
+	size_t n, nlinks, mlen;
+	struct if_ifaddr *ifas = NULL, *ia;
+	const struct if_ifaddr *lifa;
+
+	*ifap = NULL;
+	if ((s = if_linksocket(&snl, NETLINK_ROUTE, 0)) == -1)
+		return -1;
+
+	if (if_nlsenddump(s, RTM_GETLINK, 1) == -1 ||
+	    (llen = if_nlrecvdump(s, 1, &ldump)) == -1)
+		goto out;
+	if (if_nlsenddump(s, RTM_GETADDR, 2) == -1 ||
+	    (alen = if_nlrecvdump(s, 2, &adump)) == -1)
+		goto out;
+
+	n = 0;
+	for (nlm = ldump, mlen = (size_t)llen;
+	    nlm != NULL && NLMSG_OK(nlm, mlen);
+	    nlm = NLMSG_NEXT(nlm, mlen))
+	{
+		if (nlm->nlmsg_type == RTM_NEWLINK)
+			n++;
+	}
+	for (nlm = adump, mlen = (size_t)alen;
+	    nlm != NULL && NLMSG_OK(nlm, mlen);
+	    nlm = NLMSG_NEXT(nlm, mlen))
+	{
+		if (nlm->nlmsg_type == RTM_NEWADDR)
+			n++;
+	}
+	if (n == 0) {
+		err = 0;
+		goto out;
+	}
+
+	ifas = calloc(n, sizeof(*ifas));
+	if (ifas == NULL)
+		goto out;
+
+	ia = ifas;
+	for (nlm = ldump, mlen = (size_t)llen;
+	    nlm != NULL && NLMSG_OK(nlm, mlen);
+	    nlm = NLMSG_NEXT(nlm, mlen))
+	{
+		if (nlm->nlmsg_type == RTM_NEWLINK)
+			ia = if_ifa_link(ia, nlm);
+	}
+	nlinks = (size_t)(ia - ifas);
+
+	lifa = NULL;
+	for (nlm = adump, mlen = (size_t)alen;
+	    nlm != NULL && NLMSG_OK(nlm, mlen);
+	    nlm = NLMSG_NEXT(nlm, mlen))
+	{
+		struct ifaddrmsg *ifa;
+
+		if (nlm->nlmsg_type != RTM_NEWADDR)
+			continue;
+		ifa = NLMSG_DATA(nlm);
+		/* Addresses are grouped by interface,
+		 * so the last link is usually the right one. */
+		if (lifa == NULL ||
+		    lifa->addr.sll.sll_ifindex != (int)ifa->ifa_index)
+			lifa = if_ifa_findlink(ifas, nlinks,
+			    (int)ifa->ifa_index);
+		ia = if_ifa_addr(ia, nlm, lifa);
+	}
+
+	n = (size_t)(ia - ifas);
+	if (n == 0) {
+		free(ifas);
+		ifas = NULL;
+	}
+	for (ia = ifas; ia != NULL && ia < ifas + n; ia++)
+		ia->ifa.ifa_next = ia + 1 < ifas + n ? &(ia + 1)->ifa : NULL;
+
+	if (ifas != NULL)
+		*ifap = &ifas->ifa;
+	err = 0;
+
+out:
+	free(ldump);
+	free(adump);
+	close(s);
+	if (err == -1)
+		free(ifas);
+	return err;
+}
+
+void
+if_freeifaddrs_os(struct ifaddrs *ifa)
+{
+
+	/* The whole list is one allocation. */
+	free(ifa);
+}
+
 static int
 if_copyrt(struct dhcpcd_ctx *ctx, struct rt *rt, struct nlmsghdr *nlm)
 {
@@ -654,7 +1049,7 @@ if_copyrt(struct dhcpcd_ctx *ctx, struct rt *rt, struct nlmsghdr *nlm)
 			break;
 		case RTA_OIF:
 			ifindex = *(unsigned int *)RTA_DATA(rta);
-			rt->rt_ifp = if_findindex(ctx->ifaces, ifindex);
+			rt->rt_ifp = if_findindex(ctx, ifindex);
 			break;
 		case RTA_PRIORITY:
 			rt->rt_metric = *(unsigned int *)RTA_DATA(rta);
@@ -798,7 +1193,7 @@ link_addr(struct dhcpcd_ctx *ctx, struct interface *ifp, struct nlmsghdr *nlm)
 	}
 
 	ifa = NLMSG_DATA(nlm);
-	if ((ifp = if_findindex(ctx->ifaces, ifa->ifa_index)) == NULL) {
+	if ((ifp = if_findindex(ctx, ifa->ifa_index)) == NULL) {
 		/* We don't know about the interface the address is for
 		 * so it's not really an error */
 		return 1;
@@ -937,6 +1332,162 @@ link_neigh(struct dhcpcd_ctx *ctx, __unused struct interface *ifp,
 }
 #endif
 
+/* Interfaces matched by denyinterfaces, or excluded by allowinterfaces,
+ * can never become active while the configuration stands, yet on a
+ * container host their veth churn still wakes us for every link,
+ * address and neighbour message.
+ * Once such an interface announces itself, tell the kernel to drop
+ * further messages for its index with a classic BPF filter on the
+ * link socket.  RTM_DELLINK always passes so the interface and its
+ * filter slot are reclaimed, and route messages carry the index in an
+ * attribute rather than at a fixed offset so they pass as well.
+ * The filter is dropped when the configuration is reloaded as the
+ * interface may no longer be denied. */
+#define	IGN_FILTER_MAX	512
+
+static bool
+if_denied(struct dhcpcd_ctx *ctx, const char *ifname)
+{
+	struct if_spec spec;
+	int i;
+
+	if (if_nametospec(ifname, &spec) != 0)
+		return false;
+	for (i = 0; i < ctx->ifdc; i++)
+		if (fnmatch(ctx->ifdv[i], spec.devname, 0) == 0)
+			return true;
+	if (ctx->ifac == 0)
+		return false;
+	for (i = 0; i < ctx->ifac; i++)
+		if (fnmatch(ctx->ifav[i], spec.devname, 0) == 0)
+			return false;
+	return true;
+}
+
+static int
+if_ignorefilter_apply(struct dhcpcd_ctx *ctx)
+{
+	struct priv *priv = (struct priv *)ctx->priv;
+	/* BPF loads from the message are big endian, so byte swap the
+	 * host order constants we match against.
+	 * ifinfomsg, ifaddrmsg and ndmsg all carry the interface index
+	 * at offset 4 of the message payload. */
+	struct sock_filter ign_prologue[] = {
+		BPF_STMT(BPF_LD + BPF_H + BPF_ABS,
+		    offsetof(struct nlmsghdr, nlmsg_type)),
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htons(RTM_NEWLINK), 5, 0),
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htons(RTM_NEWADDR), 4, 0),
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htons(RTM_DELADDR), 3, 0),
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htons(RTM_NEWNEIGH), 2, 0),
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htons(RTM_DELNEIGH), 1, 0),
+		BPF_STMT(BPF_RET + BPF_K, UINT32_MAX),
+		BPF_STMT(BPF_LD + BPF_W + BPF_ABS,
+		    NLMSG_HDRLEN + sizeof(uint32_t)),
+	};
+	struct sock_filter *bf, *bp;
+	struct sock_fprog pf;
+	size_t i;
+	int r, dummy = 0;
+
+	if (priv->ign_filter_len == 0) {
+		/* The kernel insists on an integer option even though
+		 * detaching does not use it. */
+		r = setsockopt(ctx->link_fd, SOL_SOCKET, SO_DETACH_FILTER,
+		    &dummy, sizeof(dummy));
+		return r == -1 && errno != ENOENT ? -1 : 0;
+	}
+
+	bf = reallocarray(NULL,
+	    __arraycount(ign_prologue) + priv->ign_filter_len * 2 + 1,
+	    sizeof(*bf));
+	if (bf == NULL)
+		return -1;
+	memcpy(bf, ign_prologue, sizeof(ign_prologue));
+	bp = bf + __arraycount(ign_prologue);
+	for (i = 0; i < priv->ign_filter_len; i++) {
+		bp->code = BPF_JMP + BPF_JEQ + BPF_K;
+		bp->jt = 0;
+		bp->jf = 1;
+		bp->k = htonl(priv->ign_filter[i]);
+		bp++;
+		bp->code = BPF_RET + BPF_K;
+		bp->jt = bp->jf = 0;
+		bp->k = 0;
+		bp++;
+	}
+	bp->code = BPF_RET + BPF_K;
+	bp->jt = bp->jf = 0;
+	bp->k = UINT32_MAX;
+	bp++;
+
+	memset(&pf, 0, sizeof(pf));
+	pf.filter = bf;
+	pf.len = (unsigned short)(bp - bf);
+	r = setsockopt(ctx->link_fd, SOL_SOCKET, SO_ATTACH_FILTER,
+	    &pf, sizeof(pf));
+	free(bf);
+	return r;
+}
+
+static void
+if_ignorefilter_add(struct dhcpcd_ctx *ctx, unsigned int ifindex)
+{
+	struct priv *priv = (struct priv *)ctx->priv;
+	uint32_t *f;
+	size_t i;
+
+	for (i = 0; i < priv->ign_filter_len; i++)
+		if (priv->ign_filter[i] == ifindex)
+			return;
+	if (priv->ign_filter_len == IGN_FILTER_MAX)
+		return;
+	f = reallocarray(priv->ign_filter,
+	    priv->ign_filter_len + 1, sizeof(*f));
+	if (f == NULL) {
+		logerr(__func__);
+		return;
+	}
+	f[priv->ign_filter_len++] = ifindex;
+	priv->ign_filter = f;
+	if (if_ignorefilter_apply(ctx) == -1)
+		logerr("%s: if_ignorefilter_apply", __func__);
+}
+
+static void
+if_ignorefilter_del(struct dhcpcd_ctx *ctx, unsigned int ifindex)
+{
+	struct priv *priv = (struct priv *)ctx->priv;
+	size_t i;
+
+	for (i = 0; i < priv->ign_filter_len; i++)
+		if (priv->ign_filter[i] == ifindex)
+			break;
+	if (i == priv->ign_filter_len)
+		return;
+	memmove(&priv->ign_filter[i], &priv->ign_filter[i + 1],
+	    (priv->ign_filter_len - i - 1) * sizeof(*priv->ign_filter));
+	if (--priv->ign_filter_len == 0) {
+		free(priv->ign_filter);
+		priv->ign_filter = NULL;
+	}
+	if (if_ignorefilter_apply(ctx) == -1)
+		logerr("%s: if_ignorefilter_apply", __func__);
+}
+
+void
+if_ignorefilter_reset(struct dhcpcd_ctx *ctx)
+{
+	struct priv *priv = (struct priv *)ctx->priv;
+
+	if (priv == NULL || priv->ign_filter == NULL)
+		return;
+	free(priv->ign_filter);
+	priv->ign_filter = NULL;
+	priv->ign_filter_len = 0;
+	if (if_ignorefilter_apply(ctx) == -1)
+		logerr("%s: if_ignorefilter_apply", __func__);
+}
+
 static int
 link_netlink(struct dhcpcd_ctx *ctx, void *arg, struct nlmsghdr *nlm)
 {
@@ -977,10 +1528,20 @@ link_netlink(struct dhcpcd_ctx *ctx, void *arg, struct nlmsghdr *nlm)
 	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
 		switch (rta->rta_type) {
 		case IFLA_WIRELESS:
-			/* Ignore wireless messages */
+			/* Wireless events mean the association may
+			 * have changed, so invalidate the cached SSID,
+			 * but are otherwise ignored. */
 			if (nlm->nlmsg_type == RTM_NEWLINK &&
 			    ifi->ifi_change == 0)
+			{
+				struct interface *wifp;
+
+				wifp = if_findindex(ctx,
+				    (unsigned int)ifi->ifi_index);
+				if (wifp != NULL)
+					wifp->ssid_fresh = false;
 				return 0;
+			}
 			break;
 		case IFLA_IFNAME:
 			strlcpy(ifn, (char *)RTA_DATA(rta), sizeof(ifn));
@@ -992,6 +1553,7 @@ link_netlink(struct dhcpcd_ctx *ctx, void *arg, struct nlmsghdr *nlm)
 	}
 
 	if (nlm->nlmsg_type == RTM_DELLINK) {
+		if_ignorefilter_del(ctx, (unsigned int)ifi->ifi_index);
 #ifdef PLUGIN_DEV
 		/* If are listening to a dev manager, let that remove
 		 * the interface rather than the kernel. */
@@ -1001,6 +1563,11 @@ link_netlink(struct dhcpcd_ctx *ctx, void *arg, struct nlmsghdr *nlm)
 		return 0;
 	}
 
+	/* A denied interface can never start, so have the kernel
+	 * drop its messages from now on. */
+	if (*ifn != '\0' && if_denied(ctx, ifn))
+		if_ignorefilter_add(ctx, (unsigned int)ifi->ifi_index);
+
 	/* Virtual interfaces may not get a valid hardware address
 	 * at this point.
 	 * To trigger a valid hardware address pickup we need to pretend
@@ -1011,7 +1578,7 @@ link_netlink(struct dhcpcd_ctx *ctx, void *arg, struct nlmsghdr *nlm)
 	}
 
 	/* Check for a new interface */
-	ifp = if_findindex(ctx->ifaces, (unsigned int)ifi->ifi_index);
+	ifp = if_findindex(ctx, (unsigned int)ifi->ifi_index);
 	if (ifp == NULL) {
 #ifdef PLUGIN_DEV
 		/* If are listening to a dev manager, let that announce
@@ -1045,17 +1612,140 @@ link_netlink(struct dhcpcd_ctx *ctx, void *arg, struct nlmsghdr *nlm)
 	return 0;
 }
 
+/* Mark a superseded link message in our private copy of the burst.
+ * The broadcast socket always carries a sequence of zero. */
+#define	LINK_SUPERSEDED		UINT32_MAX
+
+struct if_linkmsg {
+	int ifindex;
+	size_t pos;
+};
+
+static int
+if_linkmsg_cmp(const void *va, const void *vb)
+{
+	const struct if_linkmsg *a = va, *b = vb;
+
+	if (a->ifindex != b->ifindex)
+		return a->ifindex < b->ifindex ? -1 : 1;
+	return a->pos < b->pos ? -1 : a->pos > b->pos;
+}
+
+/* During a bond or bridge reconfiguration the kernel sends thousands
+ * of link messages in one burst and dispatching every intermediate
+ * link state triggers as many carrier changes and route rebuilds.
+ * Drain the socket fully, keep only the last link message for each
+ * interface and dispatch the rest in received order. */
 int
 if_handlelink(struct dhcpcd_ctx *ctx)
 {
-	unsigned char buf[16 * 1024];
-	struct iovec iov = {
-		.iov_base = buf,
-		.iov_len = sizeof(buf),
-	};
+	unsigned char rbuf[16 * 1024];
+	struct sockaddr_nl nladdr;
+	socklen_t nladdr_len;
+	uint8_t *dbuf = NULL, *nbuf;
+	size_t dlen = 0, mlen, pos, n, i;
+	ssize_t bytes;
+	struct nlmsghdr *nlm;
+	struct if_linkmsg *lms = NULL;
+	int r = 0, serrno = 0;
+
+	for (;;) {
+		nladdr_len = sizeof(nladdr);
+		bytes = recvfrom(ctx->link_fd, rbuf, sizeof(rbuf),
+		    MSG_DONTWAIT, (struct sockaddr *)&nladdr, &nladdr_len);
+		if (bytes == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (errno == EINTR)
+				continue;
+			/* Report the error once the drained
+			 * messages have been dispatched. */
+			serrno = errno;
+			break;
+		}
+		if (bytes == 0)
+			break;
+		/* Ignore messages not from the kernel. */
+		if (nladdr_len != sizeof(nladdr) || nladdr.nl_pid != 0)
+			continue;
+
+		for (nlm = (struct nlmsghdr *)(void *)rbuf,
+		    mlen = (size_t)bytes;
+		    NLMSG_OK(nlm, mlen);
+		    nlm = NLMSG_NEXT(nlm, mlen))
+		{
+			if (nlm->nlmsg_type == NLMSG_NOOP ||
+			    nlm->nlmsg_type == NLMSG_DONE ||
+			    nlm->nlmsg_type == NLMSG_ERROR)
+				continue;
+			nbuf = realloc(dbuf,
+			    dlen + NLMSG_ALIGN(nlm->nlmsg_len));
+			if (nbuf == NULL) {
+				serrno = errno;
+				goto dispatch;
+			}
+			dbuf = nbuf;
+			memcpy(dbuf + dlen, nlm, nlm->nlmsg_len);
+			dlen += NLMSG_ALIGN(nlm->nlmsg_len);
+		}
+	}
+
+	/* Find the last link message for each interface and mark
+	 * the earlier ones as superseded. */
+	n = 0;
+	for (pos = 0; pos < dlen; pos += NLMSG_ALIGN(nlm->nlmsg_len)) {
+		nlm = (struct nlmsghdr *)(void *)(dbuf + pos);
+		if ((nlm->nlmsg_type == RTM_NEWLINK ||
+		    nlm->nlmsg_type == RTM_DELLINK) &&
+		    nlm->nlmsg_len - sizeof(*nlm) >=
+		    sizeof(struct ifinfomsg))
+			n++;
+	}
+	if (n > 1)
+		lms = reallocarray(NULL, n, sizeof(*lms));
+	if (lms != NULL) {
+		struct ifinfomsg *ifi;
+
+		n = 0;
+		for (pos = 0; pos < dlen;
+		    pos += NLMSG_ALIGN(nlm->nlmsg_len))
+		{
+			nlm = (struct nlmsghdr *)(void *)(dbuf + pos);
+			if ((nlm->nlmsg_type != RTM_NEWLINK &&
+			    nlm->nlmsg_type != RTM_DELLINK) ||
+			    nlm->nlmsg_len - sizeof(*nlm) < sizeof(*ifi))
+				continue;
+			ifi = NLMSG_DATA(nlm);
+			lms[n].ifindex = ifi->ifi_index;
+			lms[n].pos = pos;
+			n++;
+		}
+		qsort(lms, n, sizeof(*lms), if_linkmsg_cmp);
+		for (i = 0; i + 1 < n; i++) {
+			if (lms[i].ifindex != lms[i + 1].ifindex)
+				continue;
+			nlm = (struct nlmsghdr *)(void *)(dbuf + lms[i].pos);
+			nlm->nlmsg_seq = LINK_SUPERSEDED;
+		}
+		free(lms);
+	}
 
-	return if_getnetlink(ctx, &iov, ctx->link_fd, MSG_DONTWAIT,
-	    &link_netlink, NULL);
+dispatch:
+	for (pos = 0; pos < dlen; pos += NLMSG_ALIGN(nlm->nlmsg_len)) {
+		nlm = (struct nlmsghdr *)(void *)(dbuf + pos);
+		if (nlm->nlmsg_seq == LINK_SUPERSEDED) {
+			nlm->nlmsg_seq = 0;
+			continue;
+		}
+		r = link_netlink(ctx, NULL, nlm);
+	}
+	free(dbuf);
+
+	if (serrno != 0) {
+		errno = serrno;
+		return -1;
+	}
+	return r;
 }
 
 #ifdef PRIVSEP
@@ -1137,6 +1827,134 @@ if_sendnetlink(struct dhcpcd_ctx *ctx, int protocol, struct nlmsghdr *hdr,
 	return if_getnetlink(ctx, &riov, s, 0, cb, cbarg);
 }
 
+/* After a receive buffer overflow the kernel has dropped an unknown
+ * number of messages, so our view of link and address state is stale.
+ * Rather than discovering every system interface again, dump the links
+ * and addresses and apply just what concerns the interfaces we manage -
+ * on a host with thousands of denied interfaces a full discovery costs
+ * far more than the overflow did. */
+struct if_resync_ctx {
+	uint32_t *seen;
+	size_t seen_len;
+	bool oom;
+};
+
+static int
+if_resynclink(struct dhcpcd_ctx *ctx, void *arg, struct nlmsghdr *nlm)
+{
+	struct if_resync_ctx *rs = arg;
+	struct ifinfomsg *ifi;
+	struct rtattr *rta;
+	size_t len;
+	uint32_t *seen;
+	char ifn[IF_NAMESIZE + 1];
+
+	if (rs->oom)
+		return -1;
+	if (nlm->nlmsg_type != RTM_NEWLINK)
+		return 0;
+	if (nlm->nlmsg_len - sizeof(*nlm) < sizeof(*ifi)) {
+		errno = EBADMSG;
+		return -1;
+	}
+	ifi = NLMSG_DATA(nlm);
+
+	seen = reallocarray(rs->seen, rs->seen_len + 1, sizeof(*seen));
+	if (seen == NULL) {
+		rs->oom = true;
+		return -1;
+	}
+	seen[rs->seen_len++] = (uint32_t)ifi->ifi_index;
+	rs->seen = seen;
+
+	if (if_findindex(ctx, (unsigned int)ifi->ifi_index) == NULL) {
+		/* Don't pay discovery costs for interfaces the
+		 * configuration denies. */
+		rta = (void *)((char *)ifi + NLMSG_ALIGN(sizeof(*ifi)));
+		len = NLMSG_PAYLOAD(nlm, sizeof(*ifi));
+		*ifn = '\0';
+		for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+			if (rta->rta_type == IFLA_IFNAME) {
+				strlcpy(ifn, (char *)RTA_DATA(rta),
+				    sizeof(ifn));
+				break;
+			}
+		}
+		if (*ifn == '\0' || if_denied(ctx, ifn))
+			return 0;
+	}
+	return link_netlink(ctx, NULL, nlm);
+}
+
+static int
+if_resyncaddr(struct dhcpcd_ctx *ctx, __unused void *arg,
+    struct nlmsghdr *nlm)
+{
+	struct ifaddrmsg *ifa;
+
+	if (nlm->nlmsg_type != RTM_NEWADDR)
+		return 0;
+	if (nlm->nlmsg_len - sizeof(*nlm) < sizeof(*ifa)) {
+		errno = EBADMSG;
+		return -1;
+	}
+	ifa = NLMSG_DATA(nlm);
+	if (if_findindex(ctx, ifa->ifa_index) == NULL)
+		return 0;
+	return link_netlink(ctx, NULL, nlm);
+}
+
+int
+if_resync(struct dhcpcd_ctx *ctx)
+{
+	struct if_resync_ctx rs = { .seen = NULL, .seen_len = 0 };
+	struct {
+		struct nlmsghdr hdr;
+		struct ifinfomsg ifi;
+	} lnlm = {
+	    .hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg)),
+	    .hdr.nlmsg_type = RTM_GETLINK,
+	    .hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_MATCH,
+	};
+	struct {
+		struct nlmsghdr hdr;
+		struct ifaddrmsg ifa;
+	} anlm = {
+	    .hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg)),
+	    .hdr.nlmsg_type = RTM_GETADDR,
+	    .hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_MATCH,
+	};
+	struct interface *ifp, *ifn;
+	size_t i;
+
+	if (if_sendnetlink(ctx, NETLINK_ROUTE, &lnlm.hdr,
+	    if_resynclink, &rs) == -1)
+	{
+		free(rs.seen);
+		return -1;
+	}
+
+	/* Punt interfaces which departed during the overflow. */
+	TAILQ_FOREACH_SAFE(ifp, ctx->ifaces, next, ifn) {
+		for (i = 0; i < rs.seen_len; i++) {
+			if (rs.seen[i] == ifp->index)
+				break;
+		}
+		if (i == rs.seen_len)
+			dhcpcd_handleinterface(ctx, -1, ifp->name);
+	}
+	free(rs.seen);
+
+	/* Re-learn addresses for the interfaces we manage and delete
+	 * those which went away during the overflow. */
+	if_markaddrsstale(ctx->ifaces);
+	if (if_sendnetlink(ctx, NETLINK_ROUTE, &anlm.hdr,
+	    if_resyncaddr, NULL) == -1)
+		return -1;
+	if_deletestaleaddrs(ctx->ifaces);
+	return 0;
+}
+
 #define NLMSG_TAIL(nmsg)						\
 	((struct rtattr *)(((ptrdiff_t)(nmsg))+NLMSG_ALIGN((nmsg)->nlmsg_len)))
 
@@ -1409,20 +2227,32 @@ if_getssid_nl80211(struct interface *ifp)
 	struct nlmg nlm;
 
 	errno = 0;
-	family = gnl_getfamily(ifp->ctx, "nl80211");
-	if (family == -1)
-		return -1;
 
-	/* Is this a wireless interface? */
-	memset(&nlm, 0, sizeof(nlm));
-	nlm.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct genlmsghdr));
-	nlm.hdr.nlmsg_type = (unsigned short)family;
-	nlm.hdr.nlmsg_flags = NLM_F_REQUEST;
-	nlm.ghdr.cmd = NL80211_CMD_GET_WIPHY;
-	nla_put_32(&nlm.hdr, sizeof(nlm), NL80211_ATTR_IFINDEX, ifp->index);
-	if (if_sendnetlink(ifp->ctx, NETLINK_GENERIC, &nlm.hdr,
-	    NULL, NULL) == -1)
-		return -1;
+	/* The family id never changes while the kernel is up,
+	 * so resolve it once.  The SSID is queried on every wireless
+	 * carrier event and roaming devices bounce carrier a lot. */
+	if (ifp->ctx->nl80211_fam == 0) {
+		family = gnl_getfamily(ifp->ctx, "nl80211");
+		if (family == -1)
+			return -1;
+		ifp->ctx->nl80211_fam = family;
+	} else
+		family = ifp->ctx->nl80211_fam;
+
+	/* Is this a wireless interface?
+	 * Once we know it is, don't keep asking. */
+	if (!ifp->wireless) {
+		memset(&nlm, 0, sizeof(nlm));
+		nlm.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct genlmsghdr));
+		nlm.hdr.nlmsg_type = (unsigned short)family;
+		nlm.hdr.nlmsg_flags = NLM_F_REQUEST;
+		nlm.ghdr.cmd = NL80211_CMD_GET_WIPHY;
+		nla_put_32(&nlm.hdr, sizeof(nlm),
+		    NL80211_ATTR_IFINDEX, ifp->index);
+		if (if_sendnetlink(ifp->ctx, NETLINK_GENERIC, &nlm.hdr,
+		    NULL, NULL) == -1)
+			return -1;
+	}
 
 	/* We need to parse out the list of scan results and find the one
 	 * we are connected to. */
@@ -1453,6 +2283,8 @@ if_getssid(struct interface *ifp)
 		ifp->ssid_len = (unsigned int)r;
 #endif
 
+	if (r != -1)
+		ifp->ssid_fresh = true;
 	ifp->ssid[ifp->ssid_len] = '\0';
 	return r;
 }
@@ -1645,6 +2477,13 @@ if_route(unsigned char cmd, const struct rt *rt)
 			add_attr_8(&nlm.hdr, sizeof(nlm), RTA_PREF, pref);
 		}
 #endif
+
+		/* Have the kernel age RA learned routes out natively.
+		 * We still expire them ourselves, but should we die the
+		 * kernel won't route via a dead router forever. */
+		if (rt->rt_dflags & RTDF_RA && rt->rt_expires != 0)
+			add_attr_32(&nlm.hdr, sizeof(nlm), RTA_EXPIRES,
+			    rt->rt_expires);
 	}
 
 	if (!sa_is_loopback(&rt->rt_gateway))
@@ -1696,6 +2535,137 @@ if_initrt(struct dhcpcd_ctx *ctx, rb_tree_t *kroutes, int af)
 /* Linux is a special snowflake when it comes to BPF. */
 const char *bpf_name = "Packet Socket";
 
+#if defined(PACKET_RX_RING) && defined(TPACKET3_HDRLEN)
+/* Map a TPACKET_V3 receive ring over the packet socket so that reading
+ * a packet needs no syscall and no bounce buffer - the only copy left
+ * is from the ring into the caller's buffer. */
+#define	BPF_RX_RING
+/* A modest ring - we map one per filter and our traffic is sparse
+ * outside of broadcast storms. */
+#define	BPF_RING_NBLOCKS	4
+#define	BPF_RING_FRAMESIZ	2048
+/* Retire blocks to us as soon as they have data,
+ * much like BIOCIMMEDIATE on BSD. */
+#define	BPF_RING_BLOCKTOV	2	/* milliseconds */
+
+static int
+bpf_open_ring(struct bpf *bpf)
+{
+	struct tpacket_req3 req = { .tp_block_nr = 0 };
+	long pagesz;
+	unsigned int blocksiz;
+	int ver = TPACKET_V3;
+	void *ring;
+
+	pagesz = sysconf(_SC_PAGESIZE);
+	if (pagesz == -1)
+		return -1;
+	/* Blocks must be a multiple of the page size. */
+	blocksiz = MAX((unsigned int)pagesz, 1U << 14);
+
+	if (setsockopt(bpf->bpf_fd, SOL_PACKET, PACKET_VERSION,
+	    &ver, sizeof(ver)) == -1)
+		return -1;
+
+	req.tp_block_size = blocksiz;
+	req.tp_block_nr = BPF_RING_NBLOCKS;
+	req.tp_frame_size = BPF_RING_FRAMESIZ;
+	req.tp_frame_nr = blocksiz / BPF_RING_FRAMESIZ * BPF_RING_NBLOCKS;
+	req.tp_retire_blk_tov = BPF_RING_BLOCKTOV;
+	if (setsockopt(bpf->bpf_fd, SOL_PACKET, PACKET_RX_RING,
+	    &req, sizeof(req)) == -1)
+		return -1;
+
+	ring = mmap(NULL, (size_t)blocksiz * BPF_RING_NBLOCKS,
+	    PROT_READ | PROT_WRITE, MAP_SHARED, bpf->bpf_fd, 0);
+	if (ring == MAP_FAILED) {
+		/* Tear the ring down so packets flow to recvmsg(2) again. */
+		memset(&req, 0, sizeof(req));
+		(void)setsockopt(bpf->bpf_fd, SOL_PACKET, PACKET_RX_RING,
+		    &req, sizeof(req));
+		return -1;
+	}
+
+	bpf->bpf_ring = ring;
+	bpf->bpf_ring_size = (size_t)blocksiz * BPF_RING_NBLOCKS;
+	bpf->bpf_size = blocksiz;
+	return 0;
+}
+
+static struct tpacket_block_desc *
+bpf_ring_desc(const struct bpf *bpf, unsigned int block)
+{
+
+	return (struct tpacket_block_desc *)(void *)
+	    ((char *)bpf->bpf_ring + (size_t)block * bpf->bpf_size);
+}
+
+static void
+bpf_ring_release(struct bpf *bpf, struct tpacket_block_desc *bd)
+{
+
+	bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+	if (++bpf->bpf_ring_block == BPF_RING_NBLOCKS)
+		bpf->bpf_ring_block = 0;
+}
+
+static ssize_t
+bpf_read_ring(struct bpf *bpf, void *data, size_t len)
+{
+	struct tpacket_block_desc *bd;
+	struct tpacket3_hdr *tp;
+	const char *payload;
+	ssize_t bytes;
+
+	for (;;) {
+		bd = bpf_ring_desc(bpf, bpf->bpf_ring_block);
+		if (bpf->bpf_ring_npkts == 0) {
+			if (!(bd->hdr.bh1.block_status & TP_STATUS_USER)) {
+				/* Nothing pending. */
+				bpf->bpf_flags |= BPF_EOF;
+				errno = EAGAIN;
+				return -1;
+			}
+			bpf->bpf_ring_npkts = bd->hdr.bh1.num_pkts;
+			bpf->bpf_ring_pkt = (char *)bd +
+			    bd->hdr.bh1.offset_to_first_pkt;
+			if (bpf->bpf_ring_npkts == 0) {
+				bpf_ring_release(bpf, bd);
+				continue;
+			}
+		}
+
+		tp = bpf->bpf_ring_pkt;
+		payload = (const char *)tp + tp->tp_mac;
+		if (bpf_frame_bcast(bpf->bpf_ifp, payload) == 0)
+			bpf->bpf_flags |= BPF_BCAST;
+		else
+			bpf->bpf_flags &= ~BPF_BCAST;
+		if (tp->tp_status & TP_STATUS_CSUMNOTREADY)
+			bpf->bpf_flags |= BPF_PARTIALCSUM;
+		else
+			bpf->bpf_flags &= ~BPF_PARTIALCSUM;
+		if (tp->tp_snaplen > len)
+			bytes = (ssize_t)len;
+		else
+			bytes = (ssize_t)tp->tp_snaplen;
+		memcpy(data, payload, (size_t)bytes);
+
+		if (--bpf->bpf_ring_npkts != 0)
+			bpf->bpf_ring_pkt = (char *)tp + tp->tp_next_offset;
+		else {
+			bpf_ring_release(bpf, bd);
+			bd = bpf_ring_desc(bpf, bpf->bpf_ring_block);
+			if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+				bpf->bpf_flags |= BPF_EOF;
+		}
+		return bytes;
+	}
+
+	/* NOTREACHED */
+}
+#endif /* PACKET_RX_RING && TPACKET3_HDRLEN */
+
 /* Linux is a special snowflake for opening BPF. */
 struct bpf *
 bpf_open(const struct interface *ifp,
@@ -1723,12 +2693,6 @@ bpf_open(const struct interface *ifp,
 		return NULL;
 	bpf->bpf_ifp = ifp;
 
-	/* Allocate a suitably large buffer for a single packet. */
-	bpf->bpf_size = ETH_DATA_LEN;
-	bpf->bpf_buffer = malloc(bpf->bpf_size);
-	if (bpf->bpf_buffer == NULL)
-		goto eexit;
-
 	bpf->bpf_fd = xsocket(PF_PACKET, SOCK_RAW|SOCK_CXNB,htons(ETH_P_ALL));
 	if (bpf->bpf_fd == -1)
 		goto eexit;
@@ -1751,6 +2715,18 @@ bpf_open(const struct interface *ifp,
 	}
 #endif
 
+#ifdef BPF_RX_RING
+	/* Old kernels may refuse the ring, fall back to recvmsg(2). */
+	if (bpf_open_ring(bpf) == -1)
+#endif
+	{
+		/* Allocate a suitably large buffer for a single packet. */
+		bpf->bpf_size = ETH_DATA_LEN;
+		bpf->bpf_buffer = malloc(bpf->bpf_size);
+		if (bpf->bpf_buffer == NULL)
+			goto eexit;
+	}
+
 	/*
 	 * At this point we could have received packets for the wrong
 	 * interface or which don't pass the filter.
@@ -1790,6 +2766,11 @@ bpf_read(struct bpf *bpf, void *data, size_t len)
 	struct tpacket_auxdata *aux;
 #endif
 
+#ifdef BPF_RX_RING
+	if (bpf->bpf_ring != NULL)
+		return bpf_read_ring(bpf, data, len);
+#endif
+
 #ifdef PACKET_AUXDATA
 	msg.msg_control = cmsgbuf.buf;
 	msg.msg_controllen = sizeof(cmsgbuf.buf);
@@ -1825,6 +2806,21 @@ bpf_read(struct bpf *bpf, void *data, size_t len)
 	return bytes;
 }
 
+/* Linux is a special snowflake for closing BPF as well,
+ * as we may have a receive ring mapped. */
+void
+bpf_close(struct bpf *bpf)
+{
+
+#ifdef BPF_RX_RING
+	if (bpf->bpf_ring != NULL)
+		munmap(bpf->bpf_ring, bpf->bpf_ring_size);
+#endif
+	close(bpf->bpf_fd);
+	free(bpf->bpf_buffer);
+	free(bpf);
+}
+
 int
 bpf_attach(int s, void *filter, unsigned int filter_len)
 {
@@ -1834,17 +2830,20 @@ bpf_attach(int s, void *filter, unsigned int filter_len)
 	};
 
 	/* Install the filter. */
-	if (setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER, &pf, sizeof(pf)) == -1)
-		return -1;
+	return setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER, &pf, sizeof(pf));
+}
 
+int
+bpf_lock(int s)
+{
 #ifdef SO_LOCK_FILTER
 	int on = 1;
 
-	if (setsockopt(s, SOL_SOCKET, SO_LOCK_FILTER, &on, sizeof(on)) == -1)
-		return -1;
-#endif
-
+	return setsockopt(s, SOL_SOCKET, SO_LOCK_FILTER, &on, sizeof(on));
+#else
+	UNUSED(s);
 	return 0;
+#endif
 }
 
 int
@@ -1912,6 +2911,72 @@ __unused const struct in_addr *addr, __unused const char *alias)
 #endif
 
 #ifdef INET6
+#ifdef PRIVSEP
+/* Address messages are pipelined to the privileged process so that
+ * a lease carrying many addresses needs a single ack sweep rather
+ * than a round trip per address.  Kernel errors arrive in the
+ * completion, so remember enough context to log them usefully. */
+struct if_addr6_req {
+	unsigned char cmd;
+	char ifname[IF_NAMESIZE];
+	char saddr[INET6_ADDRSTRLEN];
+};
+
+static void
+if_address6_cb(void *arg, ssize_t result, int err)
+{
+	struct if_addr6_req *req = arg;
+
+	/* Deletions race interface departure and kernel address
+	 * expiry, so a missing address is not an error. */
+	if (result == -1 &&
+	    !(req->cmd == RTM_DELADDR &&
+	    (err == EADDRNOTAVAIL || err == ESRCH ||
+	    err == ENXIO || err == ENODEV)))
+	{
+		errno = err;
+		logerr("%s: %s %s", req->ifname,
+		    req->cmd == RTM_NEWADDR ? "RTM_NEWADDR" : "RTM_DELADDR",
+		    req->saddr);
+	}
+	free(req);
+}
+
+static int
+if_address6_queue(unsigned char cmd, const struct ipv6_addr *ia,
+    struct nlmsghdr *hdr)
+{
+	struct dhcpcd_ctx *ctx = ia->iface->ctx;
+	struct sockaddr_nl snl = { .nl_family = AF_NETLINK };
+	struct iovec iov = { .iov_base = hdr, .iov_len = hdr->nlmsg_len };
+	struct msghdr msg = {
+	    .msg_name = &snl, .msg_namelen = sizeof(snl),
+	    .msg_iov = &iov, .msg_iovlen = 1
+	};
+	struct if_addr6_req *req;
+
+	if ((req = malloc(sizeof(*req))) == NULL)
+		return -1;
+	req->cmd = cmd;
+	strlcpy(req->ifname, ia->iface->name, sizeof(req->ifname));
+	strlcpy(req->saddr, ia->saddr, sizeof(req->saddr));
+
+	/* Request a reply */
+	hdr->nlmsg_flags |= NLM_F_ACK;
+	hdr->nlmsg_seq = (uint32_t)++ctx->seq;
+	if ((unsigned int)ctx->seq > UINT32_MAX)
+		ctx->seq = 0;
+
+	if (ps_root_sendnetlink_async(ctx, NETLINK_ROUTE, &msg,
+	    if_address6_cb, req) == -1)
+	{
+		free(req);
+		return -1;
+	}
+	return 0;
+}
+#endif
+
 int
 if_address6(unsigned char cmd, const struct ipv6_addr *ia)
 {
@@ -1970,6 +3035,10 @@ if_address6(unsigned char cmd, const struct ipv6_addr *ia)
 		    &cinfo, sizeof(cinfo));
 	}
 
+#ifdef PRIVSEP
+	if (ia->iface->ctx->options & DHCPCD_PRIVSEP)
+		return if_address6_queue(cmd, ia, &nlm.hdr);
+#endif
 	return if_sendnetlink(ia->iface->ctx, NETLINK_ROUTE, &nlm.hdr,
 	    NULL, NULL);
 }
@@ -168,37 +168,90 @@ const struct option cf_options[] = {
 	{"link_rcvbuf",     required_argument, NULL, O_LINK_RCVBUF},
 	{"configure",       no_argument,       NULL, O_CONFIGURE},
 	{"noconfigure",     no_argument,       NULL, O_NOCONFIGURE},
+	{"leasedb",         required_argument, NULL, O_LEASEDB},
+	{"carrier_debounce", required_argument, NULL, O_CARRIER_DEBOUNCE},
+	{"nooldenv",        no_argument,       NULL, O_NOOLDENV},
+#ifndef SMALL
+	{"builtinhook",     required_argument, NULL, O_BUILTINHOOK},
+#endif
+	{"scriptjobs",      required_argument, NULL, O_SCRIPTJOBS},
+	{"script_debounce", required_argument, NULL, O_SCRIPT_DEBOUNCE},
+	{"renew_jitter",    required_argument, NULL, O_RENEW_JITTER},
+	{"exportstate",     no_argument,       NULL, O_EXPORTSTATE},
+	{"waitifaces",      required_argument, NULL, O_WAITIFACES},
 	{NULL,              0,                 NULL, '\0'}
 };
 
+/* An index of cf_options sorted by name, built on first use, so that
+ * a keyword lookup is a binary search instead of a scan over every
+ * option for every line parsed. */
+static const struct option
+    *cf_options_sorted[sizeof(cf_options) / sizeof(cf_options[0])];
+static size_t cf_options_nsorted;
+
+static int
+cf_option_scmp(const void *a, const void *b)
+{
+	const struct option *const *oa = a, *const *ob = b;
+
+	return strcmp((*oa)->name, (*ob)->name);
+}
+
+static int
+cf_option_kcmp(const void *k, const void *m)
+{
+	const struct option *const *om = m;
+
+	return strcmp(k, (*om)->name);
+}
+
+static const struct option *
+cf_option_find(const char *name)
+{
+	const struct option **o;
+	size_t i;
+
+	if (cf_options_nsorted == 0) {
+		for (i = 0;
+		    i < sizeof(cf_options) / sizeof(cf_options[0]);
+		    i++)
+		{
+			if (cf_options[i].name == NULL)
+				continue;
+			cf_options_sorted[cf_options_nsorted++] =
+			    &cf_options[i];
+		}
+		qsort(cf_options_sorted, cf_options_nsorted,
+		    sizeof(*cf_options_sorted), cf_option_scmp);
+	}
+	o = bsearch(name, cf_options_sorted, cf_options_nsorted,
+	    sizeof(*cf_options_sorted), cf_option_kcmp);
+	return o == NULL ? NULL : *o;
+}
+
 static char *
 add_environ(char ***array, const char *value, int uniq)
 {
 	char **newlist, **list = *array;
 	size_t i = 0, l, lv;
-	char *match = NULL, *p, *n;
+	const char *p;
+	char *n;
 
-	match = strdup(value);
-	if (match == NULL) {
-		logerr(__func__);
-		return NULL;
-	}
-	p = strchr(match, '=');
-	if (p == NULL) {
+	/* Match on the name in place rather than taking a copy
+	 * just to terminate it. */
+	l = strcspn(value, "=");
+	if (value[l] != '=') {
 		logerrx("%s: no assignment: %s", __func__, value);
-		free(match);
 		return NULL;
 	}
-	*p++ = '\0';
-	l = strlen(match);
+	p = value + l + 1;
 
 	while (list && list[i]) {
-		if (match && strncmp(list[i], match, l) == 0) {
+		if (strncmp(list[i], value, l) == 0) {
 			if (uniq) {
 				n = strdup(value);
 				if (n == NULL) {
 					logerr(__func__);
-					free(match);
 					return NULL;
 				}
 				free(list[i]);
@@ -210,7 +263,6 @@ add_environ(char ***array, const char *value, int uniq)
 				n = realloc(list[i], l + lv + 2);
 				if (n == NULL) {
 					logerr(__func__);
-					free(match);
 					return NULL;
 				}
 				list[i] = n;
@@ -218,13 +270,11 @@ add_environ(char ***array, const char *value, int uniq)
 				memcpy(list[i] + l + 1, p, lv);
 				list[i][l + lv + 1] = '\0';
 			}
-			free(match);
 			return list[i];
 		}
 		i++;
 	}
 
-	free(match);
 	n = strdup(value);
 	if (n == NULL) {
 		logerr(__func__);
@@ -415,31 +465,39 @@ static char **
 splitv(int *argc, char **argv, const char *arg)
 {
 	char **n, **v = argv;
-	char *o = strdup(arg), *p, *t, *nt;
-
-	if (o == NULL) {
+	const char *p;
+	char *t;
+	size_t len, nt;
+
+	/* Size the vector in one go by counting the tokens, then
+	 * copy each token straight out of the argument rather than
+	 * splitting a scratch copy of the whole string. */
+	nt = 1;
+	for (p = arg; *p != '\0'; p++) {
+		if (*p == ',' || *p == ' ')
+			nt++;
+	}
+	n = reallocarray(v, (size_t)(*argc) + nt, sizeof(char *));
+	if (n == NULL) {
 		logerr(__func__);
 		return v;
 	}
-	p = o;
-	while ((t = strsep(&p, ", "))) {
-		nt = strdup(t);
-		if (nt == NULL) {
-			logerr(__func__);
-			free(o);
-			return v;
-		}
-		n = reallocarray(v, (size_t)(*argc) + 1, sizeof(char *));
-		if (n == NULL) {
+	v = n;
+
+	for (p = arg;;) {
+		len = strcspn(p, ", ");
+		if ((t = malloc(len + 1)) == NULL) {
 			logerr(__func__);
-			free(o);
-			free(nt);
 			return v;
 		}
-		v = n;
-		v[(*argc)++] = nt;
+		memcpy(t, p, len);
+		t[len] = '\0';
+		v[(*argc)++] = t;
+		p += len;
+		if (*p == '\0')
+			break;
+		p++;
 	}
-	free(o);
 	return v;
 }
 
@@ -2124,11 +2182,15 @@ err_sla:
 			goto invalid_token;
 		}
 		parse_string((char *)token->key, token->key_len, arg);
-		TAILQ_INSERT_TAIL(&ifo->auth.tokens, token, next);
+		if (rb_tree_insert_node(&ifo->auth.tokens, token) != token) {
+			logerrx("duplicate authtoken");
+			goto invalid_token;
+		}
 		break;
 
 invalid_token:
 		free(token->realm);
+		free(token->key);
 		free(token);
 #else
 		logerrx("no authentication support");
@@ -2264,12 +2326,97 @@ invalid_token:
 		}
 #endif
 		break;
+	case O_CARRIER_DEBOUNCE:
+		ARG_REQUIRED;
+		ifo->carrier_debounce = (uint32_t)strtoi(arg, NULL, 0, 0,
+		    UINT32_MAX, &e);
+		if (e) {
+			logerrx("failed to convert carrier_debounce %s", arg);
+			return -1;
+		}
+		break;
+	case O_NOOLDENV:
+		ifo->options |= DHCPCD_NOOLDENV;
+		break;
+	case O_SCRIPT_DEBOUNCE:
+		ARG_REQUIRED;
+		ifo->script_debounce = (uint32_t)strtou(arg, NULL, 0, 0,
+		    UINT32_MAX, &e);
+		if (e) {
+			logerrx("failed to convert script_debounce %s", arg);
+			return -1;
+		}
+		break;
+	case O_RENEW_JITTER:
+		ARG_REQUIRED;
+		ifo->renew_jitter = (uint8_t)strtou(arg, NULL, 0, 0, 50, &e);
+		if (e) {
+			logerrx("failed to convert renew_jitter %s", arg);
+			return -1;
+		}
+		break;
+	case O_EXPORTSTATE:
+		ifo->options |= DHCPCD_EXPORTSTATE;
+		break;
+#ifndef SMALL
+	case O_BUILTINHOOK:
+		ARG_REQUIRED;
+		if (strcmp(arg, "resolv.conf") == 0)
+			ifo->builtin_resolvconf = true;
+		else if (strcmp(arg, "hostname") == 0)
+			ifo->builtin_hostname = true;
+		else {
+			logerrx("no built-in hook: %s", arg);
+			return -1;
+		}
+		/* Skip the shell hook we are replacing. */
+		dl = strlen("skip_hooks=") + strlen(arg) + 1;
+		p = malloc(sizeof(char) * dl);
+		if (p == NULL) {
+			logerr(__func__);
+			return -1;
+		}
+		snprintf(p, dl, "skip_hooks=%s", arg);
+		add_environ(&ifo->environ, p, 0);
+		free(p);
+		break;
+#endif
 	case O_CONFIGURE:
 		ifo->options |= DHCPCD_CONFIGURE;
 		break;
 	case O_NOCONFIGURE:
 		ifo->options &= ~DHCPCD_CONFIGURE;
 		break;
+	case O_SCRIPTJOBS:
+		ARG_REQUIRED;
+		if (ifname != NULL) /* script jobs are only global */
+			break;
+		ctx->script_jobs = (size_t)strtou(arg, NULL, 0, 1, 1024, &e);
+		if (e) {
+			logerrx("failed to convert scriptjobs %s", arg);
+			return -1;
+		}
+		break;
+	case O_WAITIFACES:
+		ARG_REQUIRED;
+		if (ifname != NULL) /* only makes sense globally */
+			break;
+		ctx->waitifaces = (size_t)strtou(arg, NULL, 0, 1, 65535, &e);
+		if (e) {
+			logerrx("failed to convert waitifaces %s", arg);
+			return -1;
+		}
+		break;
+	case O_LEASEDB:
+		ARG_REQUIRED;
+		p = strdup(arg);
+		if (p == NULL) {
+			logerr(__func__);
+			return -1;
+		}
+		free(ctx->leasedb_file);
+		ctx->leasedb_file = p;
+		break;
 	default:
 		return 0;
 	}
@@ -2289,19 +2436,15 @@ parse_config_line(struct dhcpcd_ctx *ctx, const char *ifname,
     struct if_options *ifo, const char *opt, char *line,
     struct dhcp_opt **ldop, struct dhcp_opt **edop)
 {
-	unsigned int i;
+	const struct option *o;
 
-	for (i = 0; i < sizeof(cf_options) / sizeof(cf_options[0]); i++) {
-		if (!cf_options[i].name ||
-		    strcmp(cf_options[i].name, opt) != 0)
-			continue;
-
-		if (cf_options[i].has_arg == required_argument && !line) {
+	if ((o = cf_option_find(opt)) != NULL) {
+		if (o->has_arg == required_argument && !line) {
 			logerrx("option requires an argument -- %s", opt);
 			return -1;
 		}
 
-		return parse_option(ctx, ifname, ifo, cf_options[i].val, line,
+		return parse_option(ctx, ifname, ifo, o->val, line,
 		    ldop, edop);
 	}
 
@@ -2310,6 +2453,451 @@ parse_config_line(struct dhcpcd_ctx *ctx, const char *ifname,
 	return -1;
 }
 
+/*
+ * The configuration file is compiled once into a list of tokenised
+ * lines with each option resolved to its cf_options entry, so that
+ * evaluating it for an interface, ssid or profile does not have to
+ * re-read and re-tokenise the file every time.
+ * The compiled form is validated against the file mtime and rebuilt
+ * when it changes.
+ */
+enum cf_linetype {
+	CF_OPTION,
+	CF_INTERFACE,
+	CF_SSID,
+	CF_PROFILE,
+};
+
+struct cf_line {
+	enum cf_linetype type;
+	long idx;		/* into cf_options, -1 if unknown */
+	char *option;
+	char *arg;
+	size_t arg_len;
+};
+
+struct cf_config {
+	time_t mtime;
+	struct cf_line *lines;
+	size_t nlines;
+};
+
+static void
+config_free(struct cf_config *cfc)
+{
+	size_t i;
+
+	if (cfc == NULL)
+		return;
+	for (i = 0; i < cfc->nlines; i++) {
+		free(cfc->lines[i].option);
+		free(cfc->lines[i].arg);
+	}
+	free(cfc->lines);
+	free(cfc);
+}
+
+void
+config_cache_free(struct dhcpcd_ctx *ctx)
+{
+
+	config_free(ctx->cf_config);
+	ctx->cf_config = NULL;
+	free_options(ctx, ctx->cf_ifo);
+	ctx->cf_ifo = NULL;
+}
+
+static struct cf_config *
+config_compile(struct dhcpcd_ctx *ctx)
+{
+	struct cf_config *cfc;
+	struct cf_line *cl, *lines;
+	char buf[UDPLEN_MAX], *bp; /* 64k max config file size */
+	char *line, *option, *p;
+	ssize_t buflen;
+	size_t nalloc;
+
+	buflen = dhcp_readfile(ctx, ctx->cffile, buf, sizeof(buf));
+	if (buflen == -1)
+		return NULL;
+	if (buf[buflen - 1] != '\0') {
+		if ((size_t)buflen < sizeof(buf) - 1)
+			buflen++;
+		buf[buflen - 1] = '\0';
+	}
+
+	if ((cfc = calloc(1, sizeof(*cfc))) == NULL)
+		return NULL;
+	dhcp_filemtime(ctx, ctx->cffile, &cfc->mtime);
+
+	nalloc = 0;
+	bp = buf;
+	while ((line = get_line(&bp, &buflen)) != NULL) {
+		option = strsep(&line, " \t");
+		if (line)
+			line = strskipwhite(line);
+		/* Trim trailing whitespace */
+		if (line) {
+			p = line + strlen(line) - 1;
+			while (p != line &&
+			    (*p == ' ' || *p == '\t') &&
+			    *(p - 1) != '\\')
+				*p-- = '\0';
+		}
+
+		if (cfc->nlines == nalloc) {
+			nalloc = nalloc == 0 ? 64 : nalloc * 2;
+			lines = reallocarray(cfc->lines, nalloc,
+			    sizeof(*lines));
+			if (lines == NULL)
+				goto err;
+			cfc->lines = lines;
+		}
+		cl = &cfc->lines[cfc->nlines];
+		memset(cl, 0, sizeof(*cl));
+
+		if (strcmp(option, "interface") == 0)
+			cl->type = CF_INTERFACE;
+		else if (strcmp(option, "ssid") == 0)
+			cl->type = CF_SSID;
+		else if (strcmp(option, "profile") == 0)
+			cl->type = CF_PROFILE;
+		else {
+			const struct option *o;
+
+			cl->type = CF_OPTION;
+			if ((o = cf_option_find(option)) != NULL)
+				cl->idx = o - cf_options;
+			else
+				cl->idx = -1;
+		}
+		if ((cl->option = strdup(option)) == NULL)
+			goto err;
+		if (line != NULL) {
+			cl->arg_len = strlen(line);
+			if ((cl->arg = strdup(line)) == NULL) {
+				free(cl->option);
+				goto err;
+			}
+		}
+		cfc->nlines++;
+	}
+	return cfc;
+
+err:
+	config_free(cfc);
+	return NULL;
+}
+
+static struct cf_config *
+config_cache(struct dhcpcd_ctx *ctx)
+{
+	struct cf_config *cfc = ctx->cf_config;
+	time_t mtime;
+
+	if (cfc != NULL) {
+		if (dhcp_filemtime(ctx, ctx->cffile, &mtime) != -1 &&
+		    mtime == cfc->mtime)
+			return cfc;
+		config_cache_free(ctx);
+	}
+	ctx->cf_config = cfc = config_compile(ctx);
+	return cfc;
+}
+
+/* Refresh the compiled configuration if the file has changed.
+ * Called from the config file watcher so that a later reload applies
+ * an already compiled configuration instead of parsing under time
+ * pressure. */
+void
+config_preparse(struct dhcpcd_ctx *ctx)
+{
+
+	if (config_cache(ctx) == NULL)
+		logerr(__func__);
+}
+
+/*
+ * Most interfaces match no interface, ssid or profile block and so
+ * evaluate to exactly the same options.
+ * Rather than walking the compiled configuration for each of them,
+ * the first such evaluation is cached and later ones deep copied
+ * from it.
+ * The copy has to be deep because options are mutated at runtime
+ * per interface, so the structures cannot simply be shared.
+ */
+static char **
+clone_strv(char *const *v)
+{
+	char **n;
+	size_t i, len;
+
+	for (len = 0; v[len] != NULL; len++)
+		;
+	if ((n = calloc(len + 1, sizeof(*n))) == NULL)
+		return NULL;
+	for (i = 0; i < len; i++) {
+		if ((n[i] = strdup(v[i])) == NULL) {
+			while (i-- > 0)
+				free(n[i]);
+			free(n);
+			return NULL;
+		}
+	}
+	return n;
+}
+
+static int
+clone_dhcp_opts(struct dhcp_opt **dstp, const struct dhcp_opt *src,
+    size_t len)
+{
+	struct dhcp_opt *dst, *d;
+	const struct dhcp_opt *s;
+	size_t i;
+
+	*dstp = NULL;
+	if (len == 0)
+		return 0;
+	if ((dst = calloc(len, sizeof(*dst))) == NULL)
+		return -1;
+	for (i = 0, s = src, d = dst; i < len; i++, s++, d++) {
+		*d = *s;
+		d->var = NULL;
+		d->embopts = NULL;
+		d->embopts_len = 0;
+		d->encopts = NULL;
+		d->encopts_len = 0;
+		if (s->var != NULL && (d->var = strdup(s->var)) == NULL)
+			goto err;
+		if (clone_dhcp_opts(&d->embopts, s->embopts,
+		    s->embopts_len) == -1)
+			goto err;
+		d->embopts_len = s->embopts_len;
+		if (clone_dhcp_opts(&d->encopts, s->encopts,
+		    s->encopts_len) == -1)
+			goto err;
+		d->encopts_len = s->encopts_len;
+	}
+	*dstp = dst;
+	return 0;
+
+err:
+	for (i = 0, d = dst; i < len; i++, d++)
+		free_dhcp_opt_embenc(d);
+	free(dst);
+	return -1;
+}
+
+static struct if_options *
+clone_options(struct dhcpcd_ctx *ctx, struct if_options *ifo)
+{
+	struct if_options *n;
+	struct rt *rt, *nrt;
+	size_t i;
+#ifdef AUTH
+	struct token *t, *nt;
+#endif
+
+	if ((n = malloc(sizeof(*n))) == NULL) {
+		logerr(__func__);
+		return NULL;
+	}
+	memcpy(n, ifo, sizeof(*n));
+
+	/* Reset the heap allocated members so a partial clone can
+	 * be handed to free_options(). */
+	n->environ = NULL;
+	n->config = NULL;
+	rb_tree_init(&n->routes, &rt_compare_list_ops);
+	n->blacklist = NULL;
+	n->blacklist_len = 0;
+	n->whitelist = NULL;
+	n->whitelist_len = 0;
+	n->arping = NULL;
+	n->arping_len = 0;
+	n->fallback = NULL;
+	n->ia = NULL;
+	n->ia_len = 0;
+	n->dhcp_override = NULL;
+	n->dhcp_override_len = 0;
+	n->nd_override = NULL;
+	n->nd_override_len = 0;
+	n->dhcp6_override = NULL;
+	n->dhcp6_override_len = 0;
+	n->vivco = NULL;
+	n->vivco_len = 0;
+	n->vivso_override = NULL;
+	n->vivso_override_len = 0;
+#ifdef AUTH
+	rb_tree_init(&n->auth.tokens, &token_compare_ops);
+#endif
+
+	if (ifo->environ != NULL &&
+	    (n->environ = clone_strv(ifo->environ)) == NULL)
+		goto err;
+	if (ifo->config != NULL &&
+	    (n->config = clone_strv(ifo->config)) == NULL)
+		goto err;
+
+	RB_TREE_FOREACH(rt, &ifo->routes) {
+		if ((nrt = rt_new0(ctx)) == NULL)
+			goto err;
+		memcpy(nrt, rt, sizeof(*nrt));
+		if (rb_tree_insert_node(&n->routes, nrt) != nrt) {
+			rt_free(nrt);
+			goto err;
+		}
+	}
+
+	if (ifo->blacklist_len != 0) {
+		n->blacklist = malloc(ifo->blacklist_len *
+		    sizeof(*n->blacklist));
+		if (n->blacklist == NULL)
+			goto err;
+		memcpy(n->blacklist, ifo->blacklist,
+		    ifo->blacklist_len * sizeof(*n->blacklist));
+		n->blacklist_len = ifo->blacklist_len;
+	}
+	if (ifo->whitelist_len != 0) {
+		n->whitelist = malloc(ifo->whitelist_len *
+		    sizeof(*n->whitelist));
+		if (n->whitelist == NULL)
+			goto err;
+		memcpy(n->whitelist, ifo->whitelist,
+		    ifo->whitelist_len * sizeof(*n->whitelist));
+		n->whitelist_len = ifo->whitelist_len;
+	}
+	if (ifo->arping_len != 0) {
+		n->arping = malloc((size_t)ifo->arping_len *
+		    sizeof(*n->arping));
+		if (n->arping == NULL)
+			goto err;
+		memcpy(n->arping, ifo->arping,
+		    (size_t)ifo->arping_len * sizeof(*n->arping));
+		n->arping_len = ifo->arping_len;
+	}
+	if (ifo->fallback != NULL &&
+	    (n->fallback = strdup(ifo->fallback)) == NULL)
+		goto err;
+
+	if (ifo->ia_len != 0) {
+		if ((n->ia = calloc(ifo->ia_len, sizeof(*n->ia))) == NULL)
+			goto err;
+		memcpy(n->ia, ifo->ia, ifo->ia_len * sizeof(*n->ia));
+		n->ia_len = ifo->ia_len;
+#if defined(INET6) && !defined(SMALL)
+		for (i = 0; i < n->ia_len; i++)
+			n->ia[i].sla = NULL;
+		for (i = 0; i < n->ia_len; i++) {
+			if (ifo->ia[i].sla_len == 0)
+				continue;
+			n->ia[i].sla = malloc(ifo->ia[i].sla_len *
+			    sizeof(*n->ia[i].sla));
+			if (n->ia[i].sla == NULL)
+				goto err;
+			memcpy(n->ia[i].sla, ifo->ia[i].sla,
+			    ifo->ia[i].sla_len * sizeof(*n->ia[i].sla));
+		}
+#endif
+	}
+
+	if (clone_dhcp_opts(&n->dhcp_override, ifo->dhcp_override,
+	    ifo->dhcp_override_len) == -1)
+		goto err;
+	n->dhcp_override_len = ifo->dhcp_override_len;
+	if (clone_dhcp_opts(&n->nd_override, ifo->nd_override,
+	    ifo->nd_override_len) == -1)
+		goto err;
+	n->nd_override_len = ifo->nd_override_len;
+	if (clone_dhcp_opts(&n->dhcp6_override, ifo->dhcp6_override,
+	    ifo->dhcp6_override_len) == -1)
+		goto err;
+	n->dhcp6_override_len = ifo->dhcp6_override_len;
+	if (clone_dhcp_opts(&n->vivso_override, ifo->vivso_override,
+	    ifo->vivso_override_len) == -1)
+		goto err;
+	n->vivso_override_len = ifo->vivso_override_len;
+
+	if (ifo->vivco_len != 0) {
+		n->vivco = calloc(ifo->vivco_len, sizeof(*n->vivco));
+		if (n->vivco == NULL)
+			goto err;
+		n->vivco_len = ifo->vivco_len;
+		for (i = 0; i < ifo->vivco_len; i++) {
+			n->vivco[i].len = ifo->vivco[i].len;
+			if (ifo->vivco[i].len == 0)
+				continue;
+			n->vivco[i].data = malloc(ifo->vivco[i].len);
+			if (n->vivco[i].data == NULL)
+				goto err;
+			memcpy(n->vivco[i].data, ifo->vivco[i].data,
+			    ifo->vivco[i].len);
+		}
+	}
+
+#ifdef AUTH
+	RB_TREE_FOREACH(t, &ifo->auth.tokens) {
+		if ((nt = malloc(sizeof(*nt))) == NULL)
+			goto err;
+		memcpy(nt, t, sizeof(*nt));
+		nt->realm = NULL;
+		nt->key = NULL;
+		nt->hmac_md5 = NULL;
+		if (t->realm_len != 0) {
+			if ((nt->realm = malloc(t->realm_len)) == NULL) {
+				free(nt);
+				goto err;
+			}
+			memcpy(nt->realm, t->realm, t->realm_len);
+		}
+		if (t->key_len != 0) {
+			if ((nt->key = malloc(t->key_len)) == NULL) {
+				free(nt->realm);
+				free(nt);
+				goto err;
+			}
+			memcpy(nt->key, t->key, t->key_len);
+		}
+		rb_tree_insert_node(&n->auth.tokens, nt);
+	}
+#endif
+
+	return n;
+
+err:
+	logerr(__func__);
+	free_options(ctx, n);
+	return NULL;
+}
+
+static struct if_options *
+config_clone(struct dhcpcd_ctx *ctx, const char *ifname, const char *ssid)
+{
+	const struct cf_config *cfc;
+	const struct cf_line *cl;
+	size_t i;
+
+	if ((cfc = config_cache(ctx)) == NULL || ctx->cf_ifo == NULL)
+		return NULL;
+
+	/* Only an interface matching no block gets the cached
+	 * evaluation. */
+	for (i = 0; i < cfc->nlines; i++) {
+		cl = &cfc->lines[i];
+		if (cl->arg == NULL)
+			continue;
+		if (cl->type == CF_INTERFACE &&
+		    strcmp(cl->arg, ifname) == 0)
+			return NULL;
+		if (cl->type == CF_SSID &&
+		    ssid != NULL && ssid[0] != '\0' &&
+		    strcmp(cl->arg, ssid) == 0)
+			return NULL;
+	}
+
+	return clone_options(ctx, ctx->cf_ifo);
+}
+
 static void
 finish_config(struct if_options *ifo)
 {
@@ -2357,7 +2945,7 @@ default_config(struct dhcpcd_ctx *ctx)
 	ifo->auth.options |= DHCPCD_AUTH_REQUIRE;
 	rb_tree_init(&ifo->routes, &rt_compare_list_ops);
 #ifdef AUTH
-	TAILQ_INIT(&ifo->auth.tokens);
+	rb_tree_init(&ifo->auth.tokens, &token_compare_ops);
 #endif
 
 	/* Inherit some global defaults */
@@ -2379,7 +2967,9 @@ read_config(struct dhcpcd_ctx *ctx,
 	char buf[UDPLEN_MAX], *bp; /* 64k max config file size */
 	char *line, *option, *p;
 	ssize_t buflen;
-	size_t vlen;
+	size_t vlen, cln;
+	struct cf_config *cfc;
+	const struct cf_line *cl;
 	int skip, have_profile, new_block, had_block;
 #if !defined(INET) || !defined(INET6)
 	size_t i;
@@ -2387,6 +2977,12 @@ read_config(struct dhcpcd_ctx *ctx,
 #endif
 	struct dhcp_opt *ldop, *edop;
 
+	/* An interface matching no block can copy the cached
+	 * block-less evaluation rather than walk the file again. */
+	if (ifname != NULL && profile == NULL &&
+	    (ifo = config_clone(ctx, ifname, ssid)) != NULL)
+		return ifo;
+
 	/* Seed our default options */
 	if ((ifo = default_config(ctx)) == NULL)
 		return NULL;
@@ -2495,6 +3091,7 @@ read_config(struct dhcpcd_ctx *ctx,
 #ifdef INET
 		ctx->dhcp_opts = ifo->dhcp_override;
 		ctx->dhcp_opts_len = ifo->dhcp_override_len;
+		dhcp_sortoptions(ctx->dhcp_opts, ctx->dhcp_opts_len);
 #else
 		for (i = 0, opt = ifo->dhcp_override;
 		    i < ifo->dhcp_override_len;
@@ -2508,9 +3105,11 @@ read_config(struct dhcpcd_ctx *ctx,
 #ifdef INET6
 		ctx->nd_opts = ifo->nd_override;
 		ctx->nd_opts_len = ifo->nd_override_len;
+		dhcp_sortoptions(ctx->nd_opts, ctx->nd_opts_len);
 #ifdef DHCP6
 		ctx->dhcp6_opts = ifo->dhcp6_override;
 		ctx->dhcp6_opts_len = ifo->dhcp6_override_len;
+		dhcp_sortoptions(ctx->dhcp6_opts, ctx->dhcp6_opts_len);
 #endif
 #else
 		for (i = 0, opt = ifo->nd_override;
@@ -2531,41 +3130,25 @@ read_config(struct dhcpcd_ctx *ctx,
 
 		ctx->vivso = ifo->vivso_override;
 		ctx->vivso_len = ifo->vivso_override_len;
+		dhcp_sortoptions(ctx->vivso, ctx->vivso_len);
 		ifo->vivso_override = NULL;
 		ifo->vivso_override_len = 0;
 	}
 
-	/* Parse our options file */
-	buflen = dhcp_readfile(ctx, ctx->cffile, buf, sizeof(buf));
-	if (buflen == -1) {
+	/* Evaluate our compiled options file */
+	if ((cfc = config_cache(ctx)) == NULL) {
 		/* dhcpcd can continue without it, but no DNS options
 		 * would be requested ... */
 		logerr("%s: %s", __func__, ctx->cffile);
 		return ifo;
 	}
-	if (buf[buflen - 1] != '\0') {
-		if ((size_t)buflen < sizeof(buf) - 1)
-			buflen++;
-		buf[buflen - 1] = '\0';
-	}
-	dhcp_filemtime(ctx, ctx->cffile, &ifo->mtime);
+	ifo->mtime = cfc->mtime;
 
 	ldop = edop = NULL;
 	skip = have_profile = new_block = 0;
 	had_block = ifname == NULL ? 1 : 0;
-	bp = buf;
-	while ((line = get_line(&bp, &buflen)) != NULL) {
-		option = strsep(&line, " \t");
-		if (line)
-			line = strskipwhite(line);
-		/* Trim trailing whitespace */
-		if (line) {
-			p = line + strlen(line) - 1;
-			while (p != line &&
-			    (*p == ' ' || *p == '\t') &&
-			    *(p - 1) != '\\')
-				*p-- = '\0';
-		}
+	for (cln = 0; cln < cfc->nlines; cln++) {
+		cl = &cfc->lines[cln];
 		if (skip == 0 && new_block) {
 			had_block = 1;
 			new_block = 0;
@@ -2574,16 +3157,16 @@ read_config(struct dhcpcd_ctx *ctx,
 		}
 
 		/* Start of an interface block, skip if not ours */
-		if (strcmp(option, "interface") == 0) {
+		if (cl->type == CF_INTERFACE) {
 			char **n;
 
 			new_block = 1;
-			if (line == NULL) {
+			if (cl->arg == NULL) {
 				/* No interface given */
 				skip = 1;
 				continue;
 			}
-			if (ifname && strcmp(line, ifname) == 0)
+			if (ifname && strcmp(cl->arg, ifname) == 0)
 				skip = 0;
 			else
 				skip = 1;
@@ -2597,7 +3180,7 @@ read_config(struct dhcpcd_ctx *ctx,
 				continue;
 			}
 			ctx->ifcv = n;
-			ctx->ifcv[ctx->ifcc] = strdup(line);
+			ctx->ifcv[ctx->ifcc] = strdup(cl->arg);
 			if (ctx->ifcv[ctx->ifcc] == NULL) {
 				logerr(__func__);
 				continue;
@@ -2606,18 +3189,20 @@ read_config(struct dhcpcd_ctx *ctx,
 			continue;
 		}
 		/* Start of an ssid block, skip if not ours */
-		if (strcmp(option, "ssid") == 0) {
+		if (cl->type == CF_SSID) {
 			new_block = 1;
-			if (ssid && line && strcmp(line, ssid) == 0)
+			if (ssid && cl->arg && strcmp(cl->arg, ssid) == 0)
 				skip = 0;
 			else
 				skip = 1;
 			continue;
 		}
 		/* Start of a profile block, skip if not ours */
-		if (strcmp(option, "profile") == 0) {
+		if (cl->type == CF_PROFILE) {
 			new_block = 1;
-			if (profile && line && strcmp(line, profile) == 0) {
+			if (profile && cl->arg &&
+			    strcmp(cl->arg, profile) == 0)
+			{
 				skip = 0;
 				have_profile = 1;
 			} else
@@ -2626,12 +3211,33 @@ read_config(struct dhcpcd_ctx *ctx,
 		}
 		/* Skip arping if we have selected a profile but not parsing
 		 * one. */
-		if (profile && !have_profile && strcmp(option, "arping") == 0)
+		if (profile && !have_profile &&
+		    strcmp(cl->option, "arping") == 0)
 			continue;
 		if (skip)
 			continue;
 
-		parse_config_line(ctx, ifname, ifo, option, line, &ldop, &edop);
+		if (cl->idx == -1) {
+			if (!(ctx->options & DHCPCD_PRINT_PIDFILE))
+				logerrx("unknown option: %s", cl->option);
+			continue;
+		}
+		if (cf_options[cl->idx].has_arg == required_argument &&
+		    cl->arg == NULL)
+		{
+			logerrx("option requires an argument -- %s",
+			    cl->option);
+			continue;
+		}
+		/* parse_option may write to its argument,
+		 * so give it a scratch copy. */
+		if (cl->arg != NULL) {
+			memcpy(buf, cl->arg, cl->arg_len + 1);
+			line = buf;
+		} else
+			line = NULL;
+		parse_option(ctx, ifname, ifo, cf_options[cl->idx].val, line,
+		    &ldop, &edop);
 	}
 
 	if (profile && !have_profile) {
@@ -2644,6 +3250,13 @@ read_config(struct dhcpcd_ctx *ctx,
 		ifo->options &= ~DHCPCD_WAITOPTS;
 	CLEAR_CONFIG_BLOCK(ifo);
 	finish_config(ifo);
+
+	/* This was the block-less evaluation, so cache a copy of it
+	 * for the next interface matching no block. */
+	if (ifname != NULL && profile == NULL && !had_block &&
+	    ctx->cf_ifo == NULL)
+		ctx->cf_ifo = clone_options(ctx, ifo);
+
 	return ifo;
 }
 
@@ -2680,6 +3293,246 @@ add_options(struct dhcpcd_ctx *ctx, const char *ifname,
 	return r;
 }
 
+static bool
+strv_equal(char *const *a, char *const *b)
+{
+	size_t i;
+
+	if (a == NULL || b == NULL)
+		return a == b;
+	for (i = 0; a[i] != NULL && b[i] != NULL; i++) {
+		if (strcmp(a[i], b[i]) != 0)
+			return false;
+	}
+	return a[i] == NULL && b[i] == NULL;
+}
+
+static bool
+dhcp_opts_equal(const struct dhcp_opt *a, size_t a_len,
+    const struct dhcp_opt *b, size_t b_len)
+{
+	size_t i;
+
+	if (a_len != b_len)
+		return false;
+	for (i = 0; i < a_len; i++, a++, b++) {
+		if (a->option != b->option ||
+		    a->type != b->type ||
+		    a->len != b->len ||
+		    memcmp(a->bitflags, b->bitflags,
+		    sizeof(a->bitflags)) != 0)
+			return false;
+		if ((a->var == NULL) != (b->var == NULL) ||
+		    (a->var != NULL && strcmp(a->var, b->var) != 0))
+			return false;
+		if (!dhcp_opts_equal(a->embopts, a->embopts_len,
+		    b->embopts, b->embopts_len) ||
+		    !dhcp_opts_equal(a->encopts, a->encopts_len,
+		    b->encopts, b->encopts_len))
+			return false;
+	}
+	return true;
+}
+
+/* Decide whether two parsed configurations would drive an interface
+ * identically.  Used after re-reading config so interfaces whose
+ * effective options have not changed can be left alone.
+ * Pointer members are compared by content, mirroring clone_options(),
+ * and mtime is ignored - a touched file with the same directives is
+ * still the same configuration.  Erring towards inequality is safe,
+ * it just reconfigures as we always have. */
+bool
+if_options_equal(struct if_options *a, struct if_options *b)
+{
+	struct rt *rta, *rtb;
+#ifdef AUTH
+	struct token *ta, *tb;
+#endif
+	size_t i;
+
+	if (((a->options ^ b->options) & ~DHCPCD_WARNINGS) != 0 ||
+	    a->metric != b->metric ||
+	    a->leasetime != b->leasetime ||
+	    a->timeout != b->timeout ||
+	    a->reboot != b->reboot ||
+	    a->carrier_debounce != b->carrier_debounce ||
+	    a->script_debounce != b->script_debounce ||
+	    a->renew_jitter != b->renew_jitter ||
+	    a->randomise_hwaddr != b->randomise_hwaddr ||
+	    a->builtin_resolvconf != b->builtin_resolvconf ||
+	    a->builtin_hostname != b->builtin_hostname ||
+	    a->fqdn != b->fqdn ||
+	    a->req_prefix_len != b->req_prefix_len ||
+	    a->mtu != b->mtu ||
+	    a->vivco_en != b->vivco_en)
+		return false;
+
+	if (memcmp(a->iaid, b->iaid, sizeof(a->iaid)) != 0 ||
+	    memcmp(a->requestmask, b->requestmask,
+	    sizeof(a->requestmask)) != 0 ||
+	    memcmp(a->requiremask, b->requiremask,
+	    sizeof(a->requiremask)) != 0 ||
+	    memcmp(a->nomask, b->nomask, sizeof(a->nomask)) != 0 ||
+	    memcmp(a->rejectmask, b->rejectmask,
+	    sizeof(a->rejectmask)) != 0 ||
+	    memcmp(a->dstmask, b->dstmask, sizeof(a->dstmask)) != 0 ||
+	    memcmp(a->requestmasknd, b->requestmasknd,
+	    sizeof(a->requestmasknd)) != 0 ||
+	    memcmp(a->requiremasknd, b->requiremasknd,
+	    sizeof(a->requiremasknd)) != 0 ||
+	    memcmp(a->nomasknd, b->nomasknd, sizeof(a->nomasknd)) != 0 ||
+	    memcmp(a->rejectmasknd, b->rejectmasknd,
+	    sizeof(a->rejectmasknd)) != 0 ||
+	    memcmp(a->requestmask6, b->requestmask6,
+	    sizeof(a->requestmask6)) != 0 ||
+	    memcmp(a->requiremask6, b->requiremask6,
+	    sizeof(a->requiremask6)) != 0 ||
+	    memcmp(a->nomask6, b->nomask6, sizeof(a->nomask6)) != 0 ||
+	    memcmp(a->rejectmask6, b->rejectmask6,
+	    sizeof(a->rejectmask6)) != 0)
+		return false;
+
+	if (memcmp(&a->req_addr, &b->req_addr, sizeof(a->req_addr)) != 0 ||
+	    memcmp(&a->req_mask, &b->req_mask, sizeof(a->req_mask)) != 0 ||
+	    memcmp(&a->req_brd, &b->req_brd, sizeof(a->req_brd)) != 0 ||
+	    memcmp(&a->req_addr6, &b->req_addr6, sizeof(a->req_addr6)) != 0)
+		return false;
+
+	/* The encoded options are length prefixed. */
+	if (strcmp(a->hostname, b->hostname) != 0 ||
+	    memcmp(a->vendorclassid, b->vendorclassid,
+	    (size_t)a->vendorclassid[0] + 1) != 0 ||
+	    memcmp(a->clientid, b->clientid,
+	    (size_t)a->clientid[0] + 1) != 0 ||
+	    memcmp(a->userclass, b->userclass,
+	    (size_t)a->userclass[0] + 1) != 0 ||
+	    memcmp(a->vendor, b->vendor, (size_t)a->vendor[0] + 1) != 0 ||
+	    memcmp(a->mudurl, b->mudurl, (size_t)a->mudurl[0] + 1) != 0)
+		return false;
+
+	if (!strv_equal(a->config, b->config) ||
+	    !strv_equal(a->environ, b->environ))
+		return false;
+
+	if ((a->fallback == NULL) != (b->fallback == NULL) ||
+	    (a->fallback != NULL && strcmp(a->fallback, b->fallback) != 0))
+		return false;
+
+	if (a->blacklist_len != b->blacklist_len ||
+	    (a->blacklist_len != 0 &&
+	    memcmp(a->blacklist, b->blacklist,
+	    a->blacklist_len * sizeof(*a->blacklist)) != 0))
+		return false;
+	if (a->whitelist_len != b->whitelist_len ||
+	    (a->whitelist_len != 0 &&
+	    memcmp(a->whitelist, b->whitelist,
+	    a->whitelist_len * sizeof(*a->whitelist)) != 0))
+		return false;
+	if (a->arping_len != b->arping_len ||
+	    (a->arping_len != 0 &&
+	    memcmp(a->arping, b->arping,
+	    (size_t)a->arping_len * sizeof(*a->arping)) != 0))
+		return false;
+
+	/* Both trees sort with rt_compare_list_ops, so walk them
+	 * in step. */
+	rta = RB_TREE_MIN(&a->routes);
+	rtb = RB_TREE_MIN(&b->routes);
+	while (rta != NULL && rtb != NULL) {
+		if (sa_cmp(&rta->rt_dest, &rtb->rt_dest) != 0 ||
+		    sa_cmp(&rta->rt_netmask, &rtb->rt_netmask) != 0 ||
+		    sa_cmp(&rta->rt_gateway, &rtb->rt_gateway) != 0)
+			return false;
+		rta = RB_TREE_NEXT(&a->routes, rta);
+		rtb = RB_TREE_NEXT(&b->routes, rtb);
+	}
+	if (rta != rtb)
+		return false;
+
+	if (a->ia_len != b->ia_len)
+		return false;
+	for (i = 0; i < a->ia_len; i++) {
+		const struct if_ia *iaa = &a->ia[i], *iab = &b->ia[i];
+
+		if (memcmp(iaa->iaid, iab->iaid, sizeof(iaa->iaid)) != 0)
+			return false;
+#ifdef INET6
+		if (iaa->ia_type != iab->ia_type ||
+		    iaa->iaid_set != iab->iaid_set ||
+		    iaa->prefix_len != iab->prefix_len ||
+		    memcmp(&iaa->addr, &iab->addr, sizeof(iaa->addr)) != 0)
+			return false;
+#ifndef SMALL
+		if (iaa->sla_max != iab->sla_max ||
+		    iaa->sla_len != iab->sla_len)
+			return false;
+		{
+			size_t j;
+
+			for (j = 0; j < iaa->sla_len; j++) {
+				const struct if_sla *sla = &iaa->sla[j];
+				const struct if_sla *slb = &iab->sla[j];
+
+				if (strcmp(sla->ifname, slb->ifname) != 0 ||
+				    sla->sla != slb->sla ||
+				    sla->prefix_len != slb->prefix_len ||
+				    sla->suffix != slb->suffix ||
+				    sla->sla_set != slb->sla_set)
+					return false;
+			}
+		}
+#endif
+#endif
+	}
+
+	if (!dhcp_opts_equal(a->dhcp_override, a->dhcp_override_len,
+	    b->dhcp_override, b->dhcp_override_len) ||
+	    !dhcp_opts_equal(a->nd_override, a->nd_override_len,
+	    b->nd_override, b->nd_override_len) ||
+	    !dhcp_opts_equal(a->dhcp6_override, a->dhcp6_override_len,
+	    b->dhcp6_override, b->dhcp6_override_len) ||
+	    !dhcp_opts_equal(a->vivso_override, a->vivso_override_len,
+	    b->vivso_override, b->vivso_override_len))
+		return false;
+
+	if (a->vivco_len != b->vivco_len)
+		return false;
+	for (i = 0; i < a->vivco_len; i++) {
+		if (a->vivco[i].len != b->vivco[i].len ||
+		    memcmp(a->vivco[i].data, b->vivco[i].data,
+		    a->vivco[i].len) != 0)
+			return false;
+	}
+
+	if (a->auth.options != b->auth.options)
+		return false;
+#ifdef AUTH
+	if (a->auth.protocol != b->auth.protocol ||
+	    a->auth.algorithm != b->auth.algorithm ||
+	    a->auth.rdm != b->auth.rdm)
+		return false;
+	ta = RB_TREE_MIN(&a->auth.tokens);
+	tb = RB_TREE_MIN(&b->auth.tokens);
+	while (ta != NULL && tb != NULL) {
+		if (ta->secretid != tb->secretid ||
+		    ta->realm_len != tb->realm_len ||
+		    (ta->realm_len != 0 &&
+		    memcmp(ta->realm, tb->realm, ta->realm_len) != 0) ||
+		    ta->key_len != tb->key_len ||
+		    (ta->key_len != 0 &&
+		    memcmp(ta->key, tb->key, ta->key_len) != 0) ||
+		    ta->expire != tb->expire)
+			return false;
+		ta = RB_TREE_NEXT(&a->auth.tokens, ta);
+		tb = RB_TREE_NEXT(&b->auth.tokens, tb);
+	}
+	if (ta != tb)
+		return false;
+#endif
+
+	return true;
+}
+
 void
 free_options(struct dhcpcd_ctx *ctx, struct if_options *ifo)
 {
@@ -2723,6 +3576,7 @@ free_options(struct dhcpcd_ctx *ctx, struct if_options *ifo)
 	}
 #endif
 	rt_headclear0(ctx, &ifo->routes, AF_UNSPEC);
+	rb_tree_fini(&ifo->routes);
 
 	free(ifo->arping);
 	free(ifo->blacklist);
@@ -2761,11 +3615,14 @@ free_options(struct dhcpcd_ctx *ctx, struct if_options *ifo)
 	free(ifo->ia);
 
 #ifdef AUTH
-	while ((token = TAILQ_FIRST(&ifo->auth.tokens))) {
-		TAILQ_REMOVE(&ifo->auth.tokens, token, next);
+	while ((token = RB_TREE_MIN(&ifo->auth.tokens)) != NULL) {
+		rb_tree_remove_node(&ifo->auth.tokens, token);
 		if (token->realm_len)
 			free(token->realm);
 		free(token->key);
+#ifdef HAVE_HMAC_CTX
+		hmac_free(token->hmac_md5);
+#endif
 		free(token);
 	}
 #endif
@@ -65,12 +65,14 @@
 #define DHCPCD_GATEWAY			(1ULL << 3)
 #define DHCPCD_STATIC			(1ULL << 4)
 #define DHCPCD_DEBUG			(1ULL << 5)
+#define DHCPCD_NOOLDENV			(1ULL << 6)
 #define DHCPCD_LASTLEASE		(1ULL << 7)
 #define DHCPCD_INFORM			(1ULL << 8)
 #define DHCPCD_REQUEST			(1ULL << 9)
 #define DHCPCD_IPV4LL			(1ULL << 10)
 #define DHCPCD_DUID			(1ULL << 11)
 #define DHCPCD_PERSISTENT		(1ULL << 12)
+#define DHCPCD_EXPORTSTATE		(1ULL << 13)
 #define DHCPCD_DAEMONISE		(1ULL << 14)
 #define DHCPCD_DAEMONISED		(1ULL << 15)
 #define DHCPCD_TEST			(1ULL << 16)
@@ -183,6 +185,15 @@
 #define O_CONFIGURE		O_BASE + 50
 #define O_NOCONFIGURE		O_BASE + 51
 #define O_RANDOMISE_HWADDR	O_BASE + 52
+#define O_LEASEDB		O_BASE + 53
+#define O_CARRIER_DEBOUNCE	O_BASE + 54
+#define O_NOOLDENV		O_BASE + 55
+#define O_BUILTINHOOK		O_BASE + 56
+#define O_SCRIPTJOBS		O_BASE + 57
+#define O_SCRIPT_DEBOUNCE	O_BASE + 58
+#define O_EXPORTSTATE		O_BASE + 59
+#define O_RENEW_JITTER		O_BASE + 60
+#define O_WAITIFACES		O_BASE + 61
 
 extern const struct option cf_options[];
 
@@ -234,8 +245,13 @@ struct if_options {
 	uint32_t leasetime;
 	uint32_t timeout;
 	uint32_t reboot;
+	uint32_t carrier_debounce;	/* milliseconds */
+	uint32_t script_debounce;	/* milliseconds */
+	uint8_t renew_jitter;		/* percent of renewal time */
 	unsigned long long options;
 	bool randomise_hwaddr;
+	bool builtin_resolvconf;
+	bool builtin_hostname;
 
 	struct in_addr req_addr;
 	struct in_addr req_mask;
@@ -287,7 +303,10 @@ struct if_options *read_config(struct dhcpcd_ctx *,
     const char *, const char *, const char *);
 int add_options(struct dhcpcd_ctx *, const char *,
     struct if_options *, int, char **);
+bool if_options_equal(struct if_options *, struct if_options *);
 void free_dhcp_opt_embenc(struct dhcp_opt *);
 void free_options(struct dhcpcd_ctx *, struct if_options *);
+void config_cache_free(struct dhcpcd_ctx *);
+void config_preparse(struct dhcpcd_ctx *);
 
 #endif
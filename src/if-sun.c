@@ -484,7 +484,7 @@ if_findsdl(struct dhcpcd_ctx *ctx, const struct sockaddr_dl *sdl)
 {
 
 	if (sdl->sdl_index)
-		return if_findindex(ctx->ifaces, sdl->sdl_index);
+		return if_findindex(ctx, sdl->sdl_index);
 
 	if (sdl->sdl_nlen) {
 		char ifname[IF_NAMESIZE];
@@ -702,7 +702,7 @@ if_copyrt(struct dhcpcd_ctx *ctx, struct rt *rt, const struct rt_msghdr *rtm)
 	rt->rt_mtu = (unsigned int)rtm->rtm_rmx.rmx_mtu;
 
 	if (rtm->rtm_index)
-		rt->rt_ifp = if_findindex(ctx->ifaces, rtm->rtm_index);
+		rt->rt_ifp = if_findindex(ctx, rtm->rtm_index);
 	else if (rtm->rtm_addrs & RTA_IFP)
 		rt->rt_ifp = if_findsa(ctx, rti_info[RTAX_IFP]);
 	else if (rtm->rtm_addrs & RTA_GATEWAY)
@@ -940,7 +940,7 @@ if_ifa(struct dhcpcd_ctx *ctx, const struct ifa_msghdr *ifam)
 	/* XXX We have no way of knowing who generated these
 	 * messages wich truely sucks because we want to
 	 * avoid listening to our own delete messages. */
-	if ((ifp = if_findindex(ctx->ifaces, ifam->ifam_index)) == NULL)
+	if ((ifp = if_findindex(ctx, ifam->ifam_index)) == NULL)
 		return 0;
 
 	/*
@@ -1058,7 +1058,7 @@ if_ifinfo(struct dhcpcd_ctx *ctx, const struct if_msghdr *ifm)
 		return -1;
 	}
 
-	if ((ifp = if_findindex(ctx->ifaces, ifm->ifm_index)) == NULL)
+	if ((ifp = if_findindex(ctx, ifm->ifm_index)) == NULL)
 		return 0;
 	flags = (unsigned int)ifm->ifm_flags;
 	if (ifm->ifm_flags & IFF_OFFLINE)
@@ -77,6 +77,8 @@
 #include "ipv6nd.h"
 #include "logerr.h"
 #include "privsep.h"
+#include "script.h"
+#include "script-builtin.h"
 
 void
 if_free(struct interface *ifp)
@@ -99,6 +101,8 @@ if_free(struct interface *ifp)
 	ipv6_free(ifp);
 #endif
 	rt_freeif(ifp);
+	script_free(ifp);
+	script_builtin_free(ifp);
 	free_options(ifp->ctx, ifp->options);
 	free(ifp);
 }
@@ -194,20 +198,27 @@ if_setflag(struct interface *ifp, short setflag, short unsetflag)
 }
 
 bool
-if_is_link_up(const struct interface *ifp)
+if_is_link_state_up(const struct interface *ifp, int carrier,
+    unsigned int flags)
 {
 
-	return ifp->flags & IFF_UP &&
-	    (ifp->carrier != LINK_DOWN ||
+	return flags & IFF_UP &&
+	    (carrier != LINK_DOWN ||
 	     (ifp->options != NULL && !(ifp->options->options & DHCPCD_LINK)));
 }
 
+bool
+if_is_link_up(const struct interface *ifp)
+{
+
+	return if_is_link_state_up(ifp, ifp->carrier, ifp->flags);
+}
+
 int
 if_randomisemac(struct interface *ifp)
 {
-	uint32_t randnum;
-	size_t hwlen = ifp->hwlen, rlen = 0;
-	uint8_t buf[HWADDR_LEN], *bp = buf, *rp = (uint8_t *)&randnum;
+	size_t hwlen = ifp->hwlen;
+	uint8_t buf[HWADDR_LEN];
 	char sbuf[HWADDR_LEN * 3];
 	int retval;
 
@@ -220,15 +231,7 @@ if_randomisemac(struct interface *ifp)
 		return -1;
 	}
 
-	for (; hwlen != 0; hwlen--) {
-		if (rlen == 0) {
-			randnum = arc4random();
-			rp = (uint8_t *)&randnum;
-			rlen = sizeof(randnum);
-		}
-		*bp++ = *rp++;
-		rlen--;
-	}
+	arc4random_buf(buf, hwlen);
 
 	/* Unicast address and locally administered. */
 	buf[0] &= 0xFC;
@@ -291,6 +294,11 @@ if_learnaddrs(struct dhcpcd_ctx *ctx, struct if_head *ifs,
 			continue;
 #ifdef HAVE_IFADDRS_ADDRFLAGS
 		addrflags = (int)ifa->ifa_addrflags;
+#elif defined(__linux__)
+		/* Our getifaddrs carries the address flags in ifa_data,
+		 * saving a netlink round trip per address. */
+		addrflags = ifa->ifa_data != NULL ?
+		    *(int *)ifa->ifa_data : 0;
 #endif
 		switch(ifa->ifa_addr->sa_family) {
 #ifdef INET
@@ -301,7 +309,7 @@ if_learnaddrs(struct dhcpcd_ctx *ctx, struct if_head *ifs,
 				brd = (void *)ifa->ifa_dstaddr;
 			else
 				brd = (void *)ifa->ifa_broadaddr;
-#ifndef HAVE_IFADDRS_ADDRFLAGS
+#if !defined(HAVE_IFADDRS_ADDRFLAGS) && !defined(__linux__)
 			addrflags = if_addrflags(ifp, &addr->sin_addr,
 			    ifa->ifa_name);
 			if (addrflags == -1) {
@@ -333,7 +341,7 @@ if_learnaddrs(struct dhcpcd_ctx *ctx, struct if_head *ifs,
 				sin6->sin6_addr.s6_addr[2] =
 				    sin6->sin6_addr.s6_addr[3] = '\0';
 #endif
-#ifndef HAVE_IFADDRS_ADDRFLAGS
+#if !defined(HAVE_IFADDRS_ADDRFLAGS) && !defined(__linux__)
 			addrflags = if_addrflags6(ifp, &sin6->sin6_addr,
 			    ifa->ifa_name);
 			if (addrflags == -1) {
@@ -358,9 +366,12 @@ if_learnaddrs(struct dhcpcd_ctx *ctx, struct if_head *ifs,
 	}
 }
 
-void if_freeifaddrs(struct ifaddrs **ifaddrs)
+void if_freeifaddrs(struct dhcpcd_ctx *ctx, struct ifaddrs **ifaddrs)
 {
 
+#ifndef PRIVSEP_GETIFADDRS
+	UNUSED(ctx);
+#endif
 	if (ifaddrs == NULL)
 		return;
 
@@ -821,18 +832,182 @@ if_findindexname(struct if_head *ifaces, unsigned int idx, const char *name)
 	return NULL;
 }
 
+/* Every packet received on a shared socket is demultiplexed to its
+ * interface by index and every control request and netlink event looks
+ * its interface up by name, which at thousands of interfaces makes a
+ * list walk the dominant cost.  Keep sorted index and name maps which
+ * are rebuilt lazily after the interface list changes. */
+struct if_idxentry {
+	unsigned int index;
+	size_t order;	/* position in the interface list */
+	struct interface *ifp;
+};
+
+struct if_nameentry {
+	size_t order;	/* position in the interface list */
+	struct interface *ifp;
+};
+
+void
+if_dirtyindexmap(struct dhcpcd_ctx *ctx)
+{
+
+	ctx->if_idxmap_dirty = true;
+}
+
+static int
+if_idxentry_cmp(const void *va, const void *vb)
+{
+	const struct if_idxentry *a = va, *b = vb;
+
+	if (a->index != b->index)
+		return a->index < b->index ? -1 : 1;
+	/* Preserve list order so a duplicate index resolves the same
+	 * as walking the list. */
+	return a->order < b->order ? -1 : a->order > b->order;
+}
+
+static int
+if_nameentry_cmp(const void *va, const void *vb)
+{
+	const struct if_nameentry *a = va, *b = vb;
+	int r;
+
+	r = strcmp(a->ifp->name, b->ifp->name);
+	if (r != 0)
+		return r;
+	return a->order < b->order ? -1 : a->order > b->order;
+}
+
+static int
+if_buildindexmap(struct dhcpcd_ctx *ctx)
+{
+	struct interface *ifp;
+	struct if_idxentry *map, *e;
+	struct if_nameentry *nmap, *ne;
+	size_t n;
+
+	n = 0;
+	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+		n++;
+	}
+	if (n == 0) {
+		free(ctx->if_idxmap);
+		ctx->if_idxmap = NULL;
+		ctx->if_idxmap_len = 0;
+		free(ctx->if_namemap);
+		ctx->if_namemap = NULL;
+		ctx->if_namemap_len = 0;
+		ctx->if_idxmap_dirty = false;
+		return 0;
+	}
+
+	map = reallocarray(ctx->if_idxmap, n, sizeof(*map));
+	if (map == NULL)
+		return -1;
+	ctx->if_idxmap = map;
+	nmap = reallocarray(ctx->if_namemap, n, sizeof(*nmap));
+	if (nmap == NULL)
+		return -1;
+	ctx->if_namemap = nmap;
+
+	e = map;
+	ne = nmap;
+	n = 0;
+	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+		e->index = ifp->index;
+		e->order = n;
+		e->ifp = ifp;
+		e++;
+		ne->order = n++;
+		ne->ifp = ifp;
+		ne++;
+	}
+	qsort(map, n, sizeof(*map), if_idxentry_cmp);
+	qsort(nmap, n, sizeof(*nmap), if_nameentry_cmp);
+	ctx->if_idxmap_len = n;
+	ctx->if_namemap_len = n;
+	ctx->if_idxmap_dirty = false;
+	return 0;
+}
+
 struct interface *
 if_find(struct if_head *ifaces, const char *name)
 {
+	struct dhcpcd_ctx *ctx;
+	struct interface *ifp;
+	struct if_spec spec;
+	size_t lo, hi, mid;
+	int r;
+
+	ifp = ifaces != NULL ? TAILQ_FIRST(ifaces) : NULL;
+	if (ifp == NULL) {
+		errno = ENXIO;
+		return NULL;
+	}
+
+	/* Only the main interface list carries the sorted maps.
+	 * Temporary discovery lists are walked as before. */
+	ctx = ifp->ctx;
+	if (ctx == NULL || ctx->ifaces != ifaces ||
+	    ((ctx->if_idxmap_dirty || ctx->if_namemap == NULL) &&
+	    if_buildindexmap(ctx) == -1))
+		return if_findindexname(ifaces, 0, name);
 
-	return if_findindexname(ifaces, 0, name);
+	if (if_nametospec(name, &spec) == -1)
+		return NULL;
+
+	lo = 0;
+	hi = ctx->if_namemap_len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		r = strcmp(ctx->if_namemap[mid].ifp->name, spec.devname);
+		if (r < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < ctx->if_namemap_len) {
+		ifp = ctx->if_namemap[lo].ifp;
+		if (strcmp(ifp->name, spec.devname) == 0)
+			return ifp;
+	}
+	errno = ENXIO;
+	return NULL;
 }
 
 struct interface *
-if_findindex(struct if_head *ifaces, unsigned int idx)
+if_findindex(struct dhcpcd_ctx *ctx, unsigned int idx)
 {
+	const struct if_idxentry *e;
+	size_t lo, hi, mid;
 
-	return if_findindexname(ifaces, idx, NULL);
+	if (ctx->ifaces == NULL) {
+		errno = ENXIO;
+		return NULL;
+	}
+
+	if ((ctx->if_idxmap_dirty || ctx->if_idxmap == NULL) &&
+	    if_buildindexmap(ctx) == -1)
+		/* No memory for the map, walk the list. */
+		return if_findindexname(ctx->ifaces, idx, NULL);
+
+	lo = 0;
+	hi = ctx->if_idxmap_len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (ctx->if_idxmap[mid].index < idx)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < ctx->if_idxmap_len) {
+		e = &ctx->if_idxmap[lo];
+		if (e->index == idx)
+			return e->ifp;
+	}
+	errno = ENXIO;
+	return NULL;
 }
 
 struct interface *
@@ -951,10 +1126,7 @@ if_findifpfromcmsg(struct dhcpcd_ctx *ctx, struct msghdr *msg, int *hoplimit)
 	}
 
 	/* Find the receiving interface */
-	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
-		if (ifp->index == ifindex)
-			break;
-	}
+	ifp = if_findindex(ctx, ifindex);
 	if (ifp == NULL)
 		errno = ESRCH;
 	return ifp;
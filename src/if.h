@@ -128,6 +128,19 @@ int if_getifaddrs(struct ifaddrs **);
 int if_getsubnet(struct dhcpcd_ctx *, const char *, int, void *, size_t);
 #endif
 
+#ifdef __linux__
+/* getifaddrs(3) builds a list of many small allocations from the same
+ * netlink dumps we can read directly.  Our implementation fills one
+ * flat buffer, freed with a single free(3), and carries the address
+ * flags in ifa_data so learning addresses needs no further netlink
+ * round trips.  See if-linux.c for details. */
+struct ifaddrs;
+int if_getifaddrs(struct ifaddrs **);
+#define	getifaddrs	if_getifaddrs
+void if_freeifaddrs_os(struct ifaddrs *);
+#define	freeifaddrs	if_freeifaddrs_os
+#endif
+
 int if_ioctl(struct dhcpcd_ctx *, ioctl_request_t, void *, size_t);
 #ifdef HAVE_PLEDGE
 #define	pioctl(ctx, req, data, len) if_ioctl((ctx), (req), (data), (len))
@@ -138,16 +151,18 @@ int if_getflags(struct interface *);
 int if_setflag(struct interface *, short, short);
 #define if_up(ifp) if_setflag((ifp), (IFF_UP | IFF_RUNNING), 0)
 #define if_down(ifp) if_setflag((ifp), 0, IFF_UP);
+bool if_is_link_state_up(const struct interface *, int, unsigned int);
 bool if_is_link_up(const struct interface *);
 bool if_valid_hwaddr(const uint8_t *, size_t);
 struct if_head *if_discover(struct dhcpcd_ctx *, struct ifaddrs **,
     int, char * const *);
-void if_freeifaddrs(struct ifaddrs **);
+void if_freeifaddrs(struct dhcpcd_ctx *, struct ifaddrs **);
 void if_markaddrsstale(struct if_head *);
 void if_learnaddrs(struct dhcpcd_ctx *, struct if_head *, struct ifaddrs **);
 void if_deletestaleaddrs(struct if_head *);
 struct interface *if_find(struct if_head *, const char *);
-struct interface *if_findindex(struct if_head *, unsigned int);
+struct interface *if_findindex(struct dhcpcd_ctx *, unsigned int);
+void if_dirtyindexmap(struct dhcpcd_ctx *);
 struct interface *if_loopback(struct dhcpcd_ctx *);
 void if_free(struct interface *);
 int if_domtu(const struct interface *, short int);
@@ -262,5 +277,7 @@ struct interface *if_findifpfromcmsg(struct dhcpcd_ctx *,
 int if_linksocket(struct sockaddr_nl *, int, int);
 int if_getnetlink(struct dhcpcd_ctx *, struct iovec *, int, int,
     int (*)(struct dhcpcd_ctx *, void *, struct nlmsghdr *), void *);
+void if_ignorefilter_reset(struct dhcpcd_ctx *);
+int if_resync(struct dhcpcd_ctx *);
 #endif
 #endif
@@ -368,6 +368,7 @@ inet_dhcproutes(rb_tree_t *routes, struct interface *ifp, bool *have_default)
 			*have_default = true;
 		n = 1;
 	}
+	rb_tree_fini(&nroutes);
 
 	return n;
 }
@@ -480,9 +481,32 @@ inet_routerhostroute(rb_tree_t *routes, struct interface *ifp)
 			rt_proto_add(routes, rtp);
 		}
 	}
+	rb_tree_fini(&troutes);
 	return 0;
 }
 
+/* Compute the routes contributed by a single interface.
+ * When called from rt_build_if() the router host route scan in
+ * inet_routerhostroute() only sees this interface's routes, but a
+ * router is expected to be on its own interface's subnet anyway. */
+bool
+inet_getroutes_if(struct interface *ifp, rb_tree_t *routes,
+    bool *have_default)
+{
+
+	if (!ifp->active)
+		return true;
+	if (inet_dhcproutes(routes, ifp, have_default) == -1)
+		return false;
+#ifdef IPV4LL
+	if (ipv4ll_subnetroute(routes, ifp) == -1)
+		return false;
+#endif
+	if (inet_routerhostroute(routes, ifp) == -1)
+		return false;
+	return true;
+}
+
 bool
 inet_getroutes(struct dhcpcd_ctx *ctx, rb_tree_t *routes)
 {
@@ -490,15 +514,7 @@ inet_getroutes(struct dhcpcd_ctx *ctx, rb_tree_t *routes)
 	bool have_default = false;
 
 	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
-		if (!ifp->active)
-			continue;
-		if (inet_dhcproutes(routes, ifp, &have_default) == -1)
-			return false;
-#ifdef IPV4LL
-		if (ipv4ll_subnetroute(routes, ifp) == -1)
-			return false;
-#endif
-		if (inet_routerhostroute(routes, ifp) == -1)
+		if (!inet_getroutes_if(ifp, routes, &have_default))
 			return false;
 	}
 
@@ -841,7 +857,7 @@ ipv4_applyaddr(void *arg)
 	state->addr = ia;
 	state->added = STATE_ADDED;
 
-	rt_build(ifp->ctx, AF_INET);
+	rt_build_if(ifp, AF_INET);
 
 #ifdef ARP
 	arp_announceaddr(ifp->ctx, &state->addr->addr);
@@ -126,6 +126,7 @@ uint32_t ipv4_getnetmask(uint32_t);
 int ipv4_hasaddr(const struct interface *);
 
 bool inet_getroutes(struct dhcpcd_ctx *, rb_tree_t *);
+bool inet_getroutes_if(struct interface *, rb_tree_t *, bool *);
 
 #define STATE_ADDED		0x01
 #define STATE_FAKE		0x02
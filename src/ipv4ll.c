@@ -57,19 +57,19 @@ static const struct in_addr inaddr_llbcast = {
 	.s_addr = HTONL(LINKLOCAL_BCAST)
 };
 
+/* Top up the candidate pool from the seeded PRNG. */
 static void
-ipv4ll_pickaddr(struct interface *ifp)
+ipv4ll_fillpool(struct interface *ifp)
 {
-	struct in_addr addr = { .s_addr = 0 };
-	struct ipv4ll_state *state;
+	struct ipv4ll_state *state = IPV4LL_STATE(ifp);
+	struct in_addr addr;
+	size_t i, n;
 
-	state = IPV4LL_STATE(ifp);
 	setstate(state->randomstate);
 
-	do {
+	for (n = state->ncandidates; n < IPV4LL_NCANDIDATES; ) {
 		long r;
 
-again:
 		/* RFC 3927 Section 2.1 states that the first 256 and
 		 * last 256 addresses are reserved for future use.
 		 * See ipv4ll_start for why we don't use arc4random. */
@@ -80,13 +80,44 @@ again:
 
 		/* No point using a failed address */
 		if (IN_ARE_ADDR_EQUAL(&addr, &state->pickedaddr))
-			goto again;
+			continue;
+		for (i = 0; i < n; i++) {
+			if (IN_ARE_ADDR_EQUAL(&addr, &state->candidates[i]))
+				break;
+		}
+		if (i != n)
+			continue;
 		/* Ensure we don't have the address on another interface */
-	} while (ipv4_findaddr(ifp->ctx, &addr) != NULL);
+		if (ipv4_findaddr(ifp->ctx, &addr) != NULL)
+			continue;
+		state->candidates[n++] = addr;
+	}
+	state->ncandidates = n;
 
 	/* Restore the original random state */
 	setstate(ifp->ctx->randomstate);
-	state->pickedaddr = addr;
+}
+
+/* Draw the next candidate from the pool. */
+static void
+ipv4ll_nextcandidate(struct interface *ifp, struct in_addr *addr)
+{
+	struct ipv4ll_state *state = IPV4LL_STATE(ifp);
+
+	if (state->ncandidates == 0)
+		ipv4ll_fillpool(ifp);
+	*addr = state->candidates[0];
+	state->ncandidates--;
+	memmove(&state->candidates[0], &state->candidates[1],
+	    state->ncandidates * sizeof(state->candidates[0]));
+}
+
+static void
+ipv4ll_pickaddr(struct interface *ifp)
+{
+	struct ipv4ll_state *state = IPV4LL_STATE(ifp);
+
+	ipv4ll_nextcandidate(ifp, &state->pickedaddr);
 }
 
 int
@@ -190,10 +221,17 @@ static void
 ipv4ll_free_arp(struct arp_state *astate)
 {
 	struct ipv4ll_state *state;
+	size_t i;
 
 	state = IPV4LL_STATE(astate->iface);
-	if (state != NULL && state->arp == astate)
+	if (state == NULL)
+		return;
+	if (state->arp == astate)
 		state->arp = NULL;
+	for (i = 0; i < __arraycount(state->window); i++) {
+		if (state->window[i] == astate)
+			state->window[i] = NULL;
+	}
 }
 
 /* This is us freeing any ARP state */
@@ -201,11 +239,20 @@ static void
 ipv4ll_freearp(struct interface *ifp)
 {
 	struct ipv4ll_state *state;
+	size_t i;
 
 	state = IPV4LL_STATE(ifp);
-	if (state == NULL || state->arp == NULL)
+	if (state == NULL)
 		return;
 
+	/* free_cb clears the matching slots. */
+	for (i = 0; i < __arraycount(state->window); i++) {
+		if (state->window[i] != NULL)
+			arp_free(state->window[i]);
+	}
+
+	if (state->arp == NULL)
+		return;
 	eloop_timeout_delete(ifp->ctx->eloop, NULL, state->arp);
 	arp_free(state->arp);
 	state->arp = NULL;
@@ -262,6 +309,7 @@ run:
 	dhcpcd_daemonise(ifp->ctx);
 }
 
+#ifdef IN_IFF_DUPLICATED
 static void
 ipv4ll_found(struct interface *ifp)
 {
@@ -277,6 +325,7 @@ ipv4ll_found(struct interface *ifp)
 	    RATE_LIMIT_INTERVAL : PROBE_WAIT,
 	    ipv4ll_start, ifp);
 }
+#endif
 
 static void
 ipv4ll_defend_failed(struct interface *ifp)
@@ -294,18 +343,69 @@ ipv4ll_defend_failed(struct interface *ifp)
 }
 
 #ifndef KERNEL_RFC5227
+static struct arp_state *ipv4ll_probeaddr(struct interface *,
+    const struct in_addr *);
+
 static void
 ipv4ll_not_found_arp(struct arp_state *astate)
 {
+	struct interface *ifp = astate->iface;
+	struct ipv4ll_state *state = IPV4LL_STATE(ifp);
+	size_t i;
+
+	/* The first candidate to probe clean wins - drop the others. */
+	state->pickedaddr = astate->addr;
+	state->arp = astate;
+	for (i = 0; i < __arraycount(state->window); i++) {
+		if (state->window[i] != NULL && state->window[i] != astate)
+			arp_free(state->window[i]);
+		state->window[i] = NULL;
+	}
 
-	ipv4ll_not_found(astate->iface);
+	ipv4ll_not_found(ifp);
 }
 
 static void
 ipv4ll_found_arp(struct arp_state *astate, __unused const struct arp_msg *amsg)
 {
+	struct interface *ifp = astate->iface;
+	struct ipv4ll_state *state = IPV4LL_STATE(ifp);
+	size_t i, slot = 0, nleft = 0;
+
+	if (++state->conflicts == MAX_CONFLICTS)
+		logerrx("%s: failed to acquire an IPv4LL address",
+		    ifp->name);
+
+	/* Burn just this candidate; others in the window race on. */
+	for (i = 0; i < __arraycount(state->window); i++) {
+		if (state->window[i] == astate) {
+			state->window[i] = NULL;
+			slot = i;
+		} else if (state->window[i] != NULL)
+			nleft++;
+	}
+	if (state->arp == astate)
+		state->arp = NULL;
+	arp_free(astate);
+
+	if (nleft != 0) {
+		/* Top up the window with a fresh candidate unless
+		 * we're rate limited. */
+		if (state->conflicts < MAX_CONFLICTS) {
+			struct in_addr cand;
+
+			ipv4ll_nextcandidate(ifp, &cand);
+			state->window[slot] = ipv4ll_probeaddr(ifp, &cand);
+		}
+		return;
+	}
 
-	ipv4ll_found(astate->iface);
+	/* The whole window conflicted - back off and go again. */
+	ipv4ll_pickaddr(ifp);
+	eloop_timeout_add_sec(ifp->ctx->eloop,
+	    state->conflicts >= MAX_CONFLICTS ?
+	    RATE_LIMIT_INTERVAL : PROBE_WAIT,
+	    ipv4ll_start, ifp);
 }
 
 static void
@@ -314,6 +414,24 @@ ipv4ll_defend_failed_arp(struct arp_state *astate)
 
 	ipv4ll_defend_failed(astate->iface);
 }
+
+static struct arp_state *
+ipv4ll_probeaddr(struct interface *ifp, const struct in_addr *addr)
+{
+	struct arp_state *astate;
+
+	astate = arp_new(ifp, addr);
+	if (astate == NULL)
+		return NULL;
+
+	astate->found_cb = ipv4ll_found_arp;
+	astate->not_found_cb = ipv4ll_not_found_arp;
+	astate->announced_cb = ipv4ll_announced_arp;
+	astate->defend_failed_cb = ipv4ll_defend_failed_arp;
+	astate->free_cb = ipv4ll_free_arp;
+	arp_probe(astate);
+	return astate;
+}
 #endif
 
 void
@@ -407,16 +525,22 @@ ipv4ll_start(void *arg)
 	ipv4ll_not_found(ifp);
 #else
 	ipv4ll_freearp(ifp);
-	state->arp = astate = arp_new(ifp, &state->pickedaddr);
+	state->arp = astate = ipv4ll_probeaddr(ifp, &state->pickedaddr);
 	if (state->arp == NULL)
 		return;
+	state->window[0] = astate;
 
-	astate->found_cb = ipv4ll_found_arp;
-	astate->not_found_cb = ipv4ll_not_found_arp;
-	astate->announced_cb = ipv4ll_announced_arp;
-	astate->defend_failed_cb = ipv4ll_defend_failed_arp;
-	astate->free_cb = ipv4ll_free_arp;
-	arp_probe(astate);
+	/* On a conflicted segment, race a window of candidates in
+	 * parallel and commit the first to probe clean. */
+	if (state->conflicts != 0 && state->conflicts < MAX_CONFLICTS) {
+		size_t i;
+		struct in_addr cand;
+
+		for (i = 1; i < __arraycount(state->window); i++) {
+			ipv4ll_nextcandidate(ifp, &cand);
+			state->window[i] = ipv4ll_probeaddr(ifp, &cand);
+		}
+	}
 #endif
 }
 
@@ -470,6 +594,7 @@ ipv4ll_reset(struct interface *ifp)
 		return;
 	ipv4ll_freearp(ifp);
 	state->pickedaddr.s_addr = INADDR_ANY;
+	state->ncandidates = 0;
 	state->seeded = false;
 }
 
@@ -40,8 +40,15 @@
 #ifdef IPV4LL
 #include "arp.h"
 
+/* Candidates derived up front from the seeded PRNG. */
+#define	IPV4LL_NCANDIDATES	16
+/* How many candidates are probed in parallel after a conflict. */
+#define	IPV4LL_PROBE_WINDOW	4
+
 struct ipv4ll_state {
 	struct in_addr pickedaddr;
+	struct in_addr candidates[IPV4LL_NCANDIDATES];
+	size_t ncandidates;
 	struct ipv4_addr *addr;
 	char randomstate[128];
 	bool seeded;
@@ -49,6 +56,8 @@ struct ipv4ll_state {
 	size_t conflicts;
 #ifndef KERNEL_RFC5227
 	struct arp_state *arp;
+	/* Parallel probes racing candidates after a conflict. */
+	struct arp_state *window[IPV4LL_PROBE_WINDOW];
 #endif
 };
 
@@ -72,6 +72,7 @@
 #include "privsep.h"
 #include "sa.h"
 #include "script.h"
+#include "stats.h"
 
 #ifdef HAVE_MD5_H
 #  ifndef DEPGEN
@@ -128,6 +129,7 @@ static void ipv6_regentempaddr(void *);
 int
 ipv6_init(struct dhcpcd_ctx *ctx)
 {
+	size_t i;
 
 	if (ctx->ra_routers != NULL)
 		return 0;
@@ -137,6 +139,15 @@ ipv6_init(struct dhcpcd_ctx *ctx)
 		return -1;
 	TAILQ_INIT(ctx->ra_routers);
 
+	ctx->ra_hash = malloc(sizeof(*ctx->ra_hash) * RA_HASHSZ);
+	if (ctx->ra_hash == NULL) {
+		free(ctx->ra_routers);
+		ctx->ra_routers = NULL;
+		return -1;
+	}
+	for (i = 0; i < RA_HASHSZ; i++)
+		TAILQ_INIT(&ctx->ra_hash[i]);
+
 #ifndef __sun
 	ctx->nd_fd = -1;
 #endif
@@ -151,9 +162,7 @@ static ssize_t
 ipv6_readsecret(struct dhcpcd_ctx *ctx)
 {
 	char line[1024];
-	unsigned char *p;
 	size_t len;
-	uint32_t r;
 
 	ctx->secret_len = dhcp_read_hwaddr_aton(ctx, &ctx->secret, SECRET);
 	if (ctx->secret_len != 0)
@@ -162,8 +171,7 @@ ipv6_readsecret(struct dhcpcd_ctx *ctx)
 	if (errno != ENOENT)
 		logerr("%s: cannot read secret", __func__);
 
-	/* Chaining arc4random should be good enough.
-	 * RFC7217 section 5.1 states the key SHOULD be at least 128 bits.
+	/* RFC7217 section 5.1 states the key SHOULD be at least 128 bits.
 	 * To attempt and future proof ourselves, we'll generate a key of
 	 * 512 bits (64 bytes). */
 	if (ctx->secret_len < 64) {
@@ -173,12 +181,7 @@ ipv6_readsecret(struct dhcpcd_ctx *ctx)
 		}
 		ctx->secret_len = 64;
 	}
-	p = ctx->secret;
-	for (len = 0; len < 512 / NBBY; len += sizeof(r)) {
-		r = arc4random();
-		memcpy(p, &r, sizeof(r));
-		p += sizeof(r);
-	}
+	arc4random_buf(ctx->secret, 512 / NBBY);
 
 	hwaddr_ntoa(ctx->secret, ctx->secret_len, line, sizeof(line));
 	len = strlen(line);
@@ -237,9 +240,9 @@ ipv6_makestableprivate1(struct dhcpcd_ctx *ctx,
     unsigned short vlanid,
     uint32_t *dad_counter)
 {
-	unsigned char buf[2048], *p, digest[SHA256_DIGEST_LENGTH];
+	unsigned char *p, digest[SHA256_DIGEST_LENGTH];
 	size_t len, l;
-	SHA256_CTX sha_ctx;
+	SHA256_CTX head_ctx, sha_ctx;
 
 	if (prefix_len < 0 || prefix_len > 120) {
 		errno = EINVAL;
@@ -252,40 +255,28 @@ ipv6_makestableprivate1(struct dhcpcd_ctx *ctx,
 	}
 
 	l = (size_t)(ROUNDUP8(prefix_len) / NBBY);
-	len = l + netiface_len + netid_len + sizeof(*dad_counter) +
-	    ctx->secret_len;
+
+	/* Make an address using the digest of all the parameters.
+	 * RFC7217 Section 5.1 states that we shouldn't use MD5.
+	 * Pity as we use that for HMAC-MD5 which is still deemed OK.
+	 * SHA-256 is recommended.
+	 * The parameter order is fixed by prior versions so that they
+	 * generate the same unique address.  Everything before the DAD
+	 * counter is invariant across the retry loop, so digest it once
+	 * and clone the midstate for each attempt. */
+	SHA256_Init(&head_ctx);
+	SHA256_Update(&head_ctx, prefix, l);
+	SHA256_Update(&head_ctx, netiface, netiface_len);
+	SHA256_Update(&head_ctx, netid, netid_len);
+	/* Don't use a vlanid if not set.
+	 * This ensures prior versions have the same unique address. */
 	if (vlanid != 0)
-		len += sizeof(vlanid);
-	if (len > sizeof(buf)) {
-		errno = ENOBUFS;
-		return -1;
-	}
+		SHA256_Update(&head_ctx, &vlanid, sizeof(vlanid));
 
 	for (;; (*dad_counter)++) {
-		/* Combine all parameters into one buffer */
-		p = buf;
-		memcpy(p, prefix, l);
-		p += l;
-		memcpy(p, netiface, netiface_len);
-		p += netiface_len;
-		memcpy(p, netid, netid_len);
-		p += netid_len;
-		/* Don't use a vlanid if not set.
-		 * This ensures prior versions have the same unique address. */
-		if (vlanid != 0) {
-			memcpy(p, &vlanid, sizeof(vlanid));
-			p += sizeof(vlanid);
-		}
-		memcpy(p, dad_counter, sizeof(*dad_counter));
-		p += sizeof(*dad_counter);
-		memcpy(p, ctx->secret, ctx->secret_len);
-
-		/* Make an address using the digest of the above.
-		 * RFC7217 Section 5.1 states that we shouldn't use MD5.
-		 * Pity as we use that for HMAC-MD5 which is still deemed OK.
-		 * SHA-256 is recommended */
-		SHA256_Init(&sha_ctx);
-		SHA256_Update(&sha_ctx, buf, len);
+		sha_ctx = head_ctx;
+		SHA256_Update(&sha_ctx, dad_counter, sizeof(*dad_counter));
+		SHA256_Update(&sha_ctx, ctx->secret, ctx->secret_len);
 		SHA256_Final(digest, &sha_ctx);
 
 		p = addr->s6_addr;
@@ -979,10 +970,16 @@ ipv6_addaddrs(struct ipv6_addrhead *iaddrs)
 	struct timespec now;
 	struct ipv6_addr *ia, *ian;
 	ssize_t i, r;
+#ifdef PRIVSEP
+	struct dhcpcd_ctx *ctx = NULL;
+#endif
 
 	i = 0;
 	timespecclear(&now);
 	TAILQ_FOREACH_SAFE(ia, iaddrs, next, ian) {
+#ifdef PRIVSEP
+		ctx = ia->iface->ctx;
+#endif
 		r = ipv6_doaddr(ia, &now);
 		if (r != 0)
 			i++;
@@ -991,6 +988,12 @@ ipv6_addaddrs(struct ipv6_addrhead *iaddrs)
 			ipv6_freeaddr(ia);
 		}
 	}
+#ifdef PRIVSEP
+	/* The address messages are pipelined -
+	 * sweep the acks for the whole batch in one go. */
+	if (ctx != NULL && ps_root_asyncflush(ctx) == -1)
+		logerr(__func__);
+#endif
 	return i;
 }
 
@@ -1027,6 +1030,9 @@ ipv6_freedrop_addrs(struct ipv6_addrhead *addrs, int drop,
 {
 	struct ipv6_addr *ap, *apn, *apf;
 	struct timespec now;
+#ifdef PRIVSEP
+	struct dhcpcd_ctx *ctx = NULL;
+#endif
 
 #ifdef SMALL
 	UNUSED(ifd);
@@ -1066,6 +1072,9 @@ ipv6_freedrop_addrs(struct ipv6_addrhead *addrs, int drop,
 						    &now);
 					ipv6_addaddr(apf, &now);
 				}
+#ifdef PRIVSEP
+				ctx = ap->iface->ctx;
+#endif
 				if (drop == 2)
 					ipv6_freeaddr(ap);
 			}
@@ -1073,6 +1082,10 @@ ipv6_freedrop_addrs(struct ipv6_addrhead *addrs, int drop,
 		if (drop != 2)
 			ipv6_freeaddr(ap);
 	}
+#ifdef PRIVSEP
+	if (ctx != NULL && ps_root_asyncflush(ctx) == -1)
+		logerr(__func__);
+#endif
 }
 
 static struct ipv6_state *
@@ -1245,8 +1258,12 @@ ipv6_handleifa(struct dhcpcd_ctx *ctx,
 			}
 #endif
 
-			if (ia->dadcallback)
+			if (ia->dadcallback) {
+				if (!(ia->flags & IPV6_AF_DADCOMPLETED))
+					stats_lat_record(ia->iface->name,
+					    STAT_LAT_DAD, &ia->acquired);
 				ia->dadcallback(ia);
+			}
 
 			if (IN6_IS_ADDR_LINKLOCAL(&ia->addr) &&
 			    !(ia->addr_flags & IN6_IFF_NOTUSEABLE))
@@ -1784,7 +1801,7 @@ ipv6_startstatic(struct interface *ifp)
 	ia->prefix_pltime = ND6_INFINITE_LIFETIME;
 	ia->dadcallback = ipv6_staticdadcallback;
 	ipv6_addaddr(ia, NULL);
-	rt_build(ifp->ctx, AF_INET6);
+	rt_build_if(ifp, AF_INET6);
 	if (run_script)
 		script_runreason(ifp, "STATIC6");
 	return 1;
@@ -1858,6 +1875,7 @@ ipv6_ctxfree(struct dhcpcd_ctx *ctx)
 {
 
 	free(ctx->ra_routers);
+	free(ctx->ra_hash);
 	free(ctx->secret);
 }
 
@@ -2273,7 +2291,8 @@ inet6_makerouter(struct ra *rap)
 	    IN6_ARE_ADDR_EQUAL(&((rtp)->mask), &in6addr_any))
 
 static int
-inet6_staticroutes(rb_tree_t *routes, struct dhcpcd_ctx *ctx)
+inet6_staticroutes(rb_tree_t *routes, struct dhcpcd_ctx *ctx,
+    const struct interface *ifpf)
 {
 	struct interface *ifp;
 	struct ipv6_state *state;
@@ -2281,6 +2300,8 @@ inet6_staticroutes(rb_tree_t *routes, struct dhcpcd_ctx *ctx)
 	struct rt *rt;
 
 	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+		if (ifpf != NULL && ifp != ifpf)
+			continue;
 		if ((state = IPV6_STATE(ifp)) == NULL)
 			continue;
 		TAILQ_FOREACH(ia, &state->addrs, next) {
@@ -2297,7 +2318,8 @@ inet6_staticroutes(rb_tree_t *routes, struct dhcpcd_ctx *ctx)
 }
 
 static int
-inet6_raroutes(rb_tree_t *routes, struct dhcpcd_ctx *ctx)
+inet6_raroutes(rb_tree_t *routes, struct dhcpcd_ctx *ctx,
+    const struct interface *ifpf)
 {
 	struct rt *rt;
 	struct ra *rap;
@@ -2309,12 +2331,17 @@ inet6_raroutes(rb_tree_t *routes, struct dhcpcd_ctx *ctx)
 	TAILQ_FOREACH(rap, ctx->ra_routers, next) {
 		if (rap->expired)
 			continue;
+		if (ifpf != NULL && rap->iface != ifpf)
+			continue;
 		TAILQ_FOREACH(addr, &rap->addrs, next) {
 			if (addr->prefix_vltime == 0)
 				continue;
 			rt = inet6_makeprefix(rap->iface, rap, addr);
 			if (rt) {
 				rt->rt_dflags |= RTDF_RA;
+				if (addr->prefix_vltime !=
+				    ND6_INFINITE_LIFETIME)
+					rt->rt_expires = addr->prefix_vltime;
 #ifdef HAVE_ROUTE_PREF
 				rt->rt_pref = ipv6nd_rtpref(rap);
 #endif
@@ -2329,6 +2356,8 @@ inet6_raroutes(rb_tree_t *routes, struct dhcpcd_ctx *ctx)
 		if (rt == NULL)
 			continue;
 		rt->rt_dflags |= RTDF_RA;
+		if (rap->lifetime != ND6_INFINITE_LIFETIME)
+			rt->rt_expires = rap->lifetime;
 #ifdef HAVE_ROUTE_PREF
 		rt->rt_pref = ipv6nd_rtpref(rap);
 #endif
@@ -2340,7 +2369,7 @@ inet6_raroutes(rb_tree_t *routes, struct dhcpcd_ctx *ctx)
 #ifdef DHCP6
 static int
 inet6_dhcproutes(rb_tree_t *routes, struct dhcpcd_ctx *ctx,
-    enum DH6S dstate)
+    enum DH6S dstate, const struct interface *ifpf)
 {
 	struct interface *ifp;
 	const struct dhcp6_state *d6_state;
@@ -2348,6 +2377,8 @@ inet6_dhcproutes(rb_tree_t *routes, struct dhcpcd_ctx *ctx,
 	struct rt *rt;
 
 	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+		if (ifpf != NULL && ifp != ifpf)
+			continue;
 		d6_state = D6_CSTATE(ifp);
 		if (d6_state && d6_state->state == dstate) {
 			TAILQ_FOREACH(addr, &d6_state->addrs, next) {
@@ -2363,27 +2394,43 @@ inet6_dhcproutes(rb_tree_t *routes, struct dhcpcd_ctx *ctx,
 }
 #endif
 
-bool
-inet6_getroutes(struct dhcpcd_ctx *ctx, rb_tree_t *routes)
+static bool
+inet6_getroutes1(struct dhcpcd_ctx *ctx, rb_tree_t *routes,
+    const struct interface *ifpf)
 {
 
 	/* Should static take priority? */
-	if (inet6_staticroutes(routes, ctx) == -1)
+	if (inet6_staticroutes(routes, ctx, ifpf) == -1)
 		return false;
 
 	/* First add reachable routers and their prefixes */
-	if (inet6_raroutes(routes, ctx) == -1)
+	if (inet6_raroutes(routes, ctx, ifpf) == -1)
 		return false;
 
 #ifdef DHCP6
 	/* We have no way of knowing if prefixes added by DHCP are reachable
 	 * or not, so we have to assume they are.
 	 * Add bound before delegated so we can prefer interfaces better. */
-	if (inet6_dhcproutes(routes, ctx, DH6S_BOUND) == -1)
+	if (inet6_dhcproutes(routes, ctx, DH6S_BOUND, ifpf) == -1)
 		return false;
-	if (inet6_dhcproutes(routes, ctx, DH6S_DELEGATED) == -1)
+	if (inet6_dhcproutes(routes, ctx, DH6S_DELEGATED, ifpf) == -1)
 		return false;
 #endif
 
 	return true;
 }
+
+bool
+inet6_getroutes(struct dhcpcd_ctx *ctx, rb_tree_t *routes)
+{
+
+	return inet6_getroutes1(ctx, routes, NULL);
+}
+
+/* Compute the routes contributed by a single interface. */
+bool
+inet6_getroutes_if(struct interface *ifp, rb_tree_t *routes)
+{
+
+	return inet6_getroutes1(ifp->ctx, routes, ifp);
+}
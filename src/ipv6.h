@@ -311,6 +311,7 @@ int ipv6_startstatic(struct interface *);
 ssize_t ipv6_env(FILE *, const char *, const struct interface *);
 void ipv6_ctxfree(struct dhcpcd_ctx *);
 bool inet6_getroutes(struct dhcpcd_ctx *, rb_tree_t *);
+bool inet6_getroutes_if(struct interface *, rb_tree_t *);
 #endif /* INET6 */
 
 #endif /* INET6_H */
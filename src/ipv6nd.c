@@ -57,6 +57,7 @@
 #include "privsep.h"
 #include "route.h"
 #include "script.h"
+#include "stats.h"
 
 /* Debugging Router Solicitations is a lot of spam, so disable it */
 //#define DEBUG_RS
@@ -283,6 +284,7 @@ ipv6nd_openif(struct interface *ifp)
 
 	state->nd_fd = fd;
 	eloop_event_add(ifp->ctx->eloop, fd, ipv6nd_handledata, ifp);
+	eloop_event_priority(ifp->ctx->eloop, fd, ELOOP_PRIO_HIGH);
 	return fd;
 }
 #endif
@@ -292,15 +294,21 @@ ipv6nd_makersprobe(struct interface *ifp)
 {
 	struct rs_state *state;
 	struct nd_router_solicit *rs;
+	size_t rslen;
 
 	state = RS_STATE(ifp);
-	free(state->rs);
-	state->rslen = sizeof(*rs);
+	rslen = sizeof(*rs);
 	if (ifp->hwlen != 0)
-		state->rslen += (size_t)ROUNDUP8(ifp->hwlen + 2);
-	state->rs = calloc(1, state->rslen);
-	if (state->rs == NULL)
-		return -1;
+		rslen += (size_t)ROUNDUP8(ifp->hwlen + 2);
+	/* The frame only changes with the hardware address, so patch
+	 * any prior buffer rather than allocating a new one. */
+	if (state->rs == NULL || state->rslen != rslen) {
+		free(state->rs);
+		state->rs = calloc(1, rslen);
+		if (state->rs == NULL)
+			return -1;
+		state->rslen = rslen;
+	}
 	rs = state->rs;
 	rs->nd_rs_type = ND_ROUTER_SOLICIT;
 	//rs->nd_rs_code = 0;
@@ -318,17 +326,19 @@ ipv6nd_makersprobe(struct interface *ifp)
 	return 0;
 }
 
+/* RS and NA share the same transmission scaffolding - the prebuilt
+ * frame in a single iovec sent to a link-local multicast group with
+ * the outbound interface in a cmsg. */
 static void
-ipv6nd_sendrsprobe(void *arg)
+ipv6nd_sendmsg(struct interface *ifp, const struct in6_addr *dst6,
+    void *data, size_t len)
 {
-	struct interface *ifp = arg;
-	struct rs_state *state = RS_STATE(ifp);
 	struct sockaddr_in6 dst = {
 		.sin6_family = AF_INET6,
-		.sin6_addr = IN6ADDR_LINKLOCAL_ALLROUTERS_INIT,
+		.sin6_addr = *dst6,
 		.sin6_scope_id = ifp->index,
 	};
-	struct iovec iov = { .iov_base = state->rs, .iov_len = state->rslen };
+	struct iovec iov = { .iov_base = data, .iov_len = len };
 	union {
 		struct cmsghdr hdr;
 		uint8_t buf[CMSG_SPACE(sizeof(struct in6_pktinfo))];
@@ -341,17 +351,12 @@ ipv6nd_sendrsprobe(void *arg)
 	struct cmsghdr *cm;
 	struct in6_pktinfo pi = { .ipi6_ifindex = ifp->index };
 	int s;
-#ifndef __sun
+#ifdef __sun
+	struct rs_state *state = RS_STATE(ifp);
+#else
 	struct dhcpcd_ctx *ctx = ifp->ctx;
 #endif
 
-	if (ipv6_linklocal(ifp) == NULL) {
-		logdebugx("%s: delaying Router Solicitation for LL address",
-		    ifp->name);
-		ipv6_addlinklocalcallback(ifp, ipv6nd_sendrsprobe, ifp);
-		return;
-	}
-
 #ifdef HAVE_SA_LEN
 	dst.sin6_len = sizeof(dst);
 #endif
@@ -365,12 +370,11 @@ ipv6nd_sendrsprobe(void *arg)
 	cm->cmsg_len = CMSG_LEN(sizeof(pi));
 	memcpy(CMSG_DATA(cm), &pi, sizeof(pi));
 
-	logdebugx("%s: sending Router Solicitation", ifp->name);
 #ifdef PRIVSEP
 	if (IN_PRIVSEP(ifp->ctx)) {
 		if (ps_inet_sendnd(ifp, &msg) == -1)
 			logerr(__func__);
-		goto sent;
+		return;
 	}
 #endif
 #ifdef __sun
@@ -389,8 +393,9 @@ ipv6nd_sendrsprobe(void *arg)
 			return;
 		}
 		eloop_event_add(ctx->eloop, ctx->nd_fd, ipv6nd_handledata, ctx);
+		eloop_event_priority(ctx->eloop, ctx->nd_fd, ELOOP_PRIO_HIGH);
 	}
-	s = ifp->ctx->nd_fd;
+	s = ctx->nd_fd;
 #endif
 	if (sendmsg(s, &msg, 0) == -1) {
 		logerr(__func__);
@@ -399,10 +404,25 @@ ipv6nd_sendrsprobe(void *arg)
 		 * Generally the error is ENOBUFS when struggling to
 		 * associate with an access point. */
 	}
+}
+
+static void
+ipv6nd_sendrsprobe(void *arg)
+{
+	const struct in6_addr allrouters = IN6ADDR_LINKLOCAL_ALLROUTERS_INIT;
+	struct interface *ifp = arg;
+	struct rs_state *state = RS_STATE(ifp);
+
+	if (ipv6_linklocal(ifp) == NULL) {
+		logdebugx("%s: delaying Router Solicitation for LL address",
+		    ifp->name);
+		ipv6_addlinklocalcallback(ifp, ipv6nd_sendrsprobe, ifp);
+		return;
+	}
+
+	logdebugx("%s: sending Router Solicitation", ifp->name);
+	ipv6nd_sendmsg(ifp, &allrouters, state->rs, state->rslen);
 
-#ifdef PRIVSEP
-sent:
-#endif
 	if (state->rsprobes++ < MAX_RTR_SOLICITATIONS)
 		eloop_timeout_add_sec(ifp->ctx->eloop,
 		    RTR_SOLICITATION_INTERVAL, ipv6nd_sendrsprobe, ifp);
@@ -414,63 +434,18 @@ sent:
 static void
 ipv6nd_sendadvertisement(void *arg)
 {
+	const struct in6_addr allnodes = IN6ADDR_LINKLOCAL_ALLNODES_INIT;
 	struct ipv6_addr *ia = arg;
 	struct interface *ifp = ia->iface;
 	struct dhcpcd_ctx *ctx = ifp->ctx;
-	struct sockaddr_in6 dst = {
-	    .sin6_family = AF_INET6,
-	    .sin6_addr = IN6ADDR_LINKLOCAL_ALLNODES_INIT,
-	    .sin6_scope_id = ifp->index,
-	};
-	struct iovec iov = { .iov_base = ia->na, .iov_len = ia->na_len };
-	union {
-		struct cmsghdr hdr;
-		uint8_t buf[CMSG_SPACE(sizeof(struct in6_pktinfo))];
-	} cmsgbuf = { .buf = { 0 } };
-	struct msghdr msg = {
-	    .msg_name = &dst, .msg_namelen = sizeof(dst),
-	    .msg_iov = &iov, .msg_iovlen = 1,
-	    .msg_control = cmsgbuf.buf, .msg_controllen = sizeof(cmsgbuf.buf),
-	};
-	struct cmsghdr *cm;
-	struct in6_pktinfo pi = { .ipi6_ifindex = ifp->index };
 	const struct rs_state *state = RS_CSTATE(ifp);
-	int s;
 
 	if (state == NULL || !if_is_link_up(ifp))
 		goto freeit;
 
-#ifdef SIN6_LEN
-	dst.sin6_len = sizeof(dst);
-#endif
-
-	/* Set the outbound interface. */
-	cm = CMSG_FIRSTHDR(&msg);
-	assert(cm != NULL);
-	cm->cmsg_level = IPPROTO_IPV6;
-	cm->cmsg_type = IPV6_PKTINFO;
-	cm->cmsg_len = CMSG_LEN(sizeof(pi));
-	memcpy(CMSG_DATA(cm), &pi, sizeof(pi));
 	logdebugx("%s: sending NA for %s", ifp->name, ia->saddr);
+	ipv6nd_sendmsg(ifp, &allnodes, ia->na, ia->na_len);
 
-#ifdef PRIVSEP
-	if (IN_PRIVSEP(ifp->ctx)) {
-		if (ps_inet_sendnd(ifp, &msg) == -1)
-			logerr(__func__);
-		goto sent;
-	}
-#endif
-#ifdef __sun
-	s = state->nd_fd;
-#else
-	s = ctx->nd_fd;
-#endif
-	if (sendmsg(s, &msg, 0) == -1)
-		logerr(__func__);
-
-#ifdef PRIVSEP
-sent:
-#endif
 	if (++ia->na_count < MAX_NEIGHBOR_ADVERTISEMENT) {
 		eloop_timeout_add_sec(ctx->eloop,
 		    state->retrans / 1000, ipv6nd_sendadvertisement, ia);
@@ -491,6 +466,7 @@ ipv6nd_advertise(struct ipv6_addr *ia)
 	struct ipv6_state *state;
 	struct ipv6_addr *iap, *iaf;
 	struct nd_neighbor_advert *na;
+	size_t na_len;
 
 	if (IN6_IS_ADDR_MULTICAST(&ia->addr))
 		return;
@@ -529,16 +505,23 @@ ipv6nd_advertise(struct ipv6_addr *ia)
 	if (iaf == NULL)
 		return;
 
-	/* Make the packet. */
+	/* Make the packet, reusing any prior frame - only the
+	 * flags and target may change between advertisements. */
 	ifp = iaf->iface;
-	iaf->na_len = sizeof(*na);
+	na_len = sizeof(*na);
 	if (ifp->hwlen != 0)
-		iaf->na_len += (size_t)ROUNDUP8(ifp->hwlen + 2);
-	na = calloc(1, iaf->na_len);
-	if (na == NULL) {
-		logerr(__func__);
-		return;
+		na_len += (size_t)ROUNDUP8(ifp->hwlen + 2);
+	if (iaf->na == NULL || iaf->na_len != na_len) {
+		free(iaf->na);
+		iaf->na = calloc(1, na_len);
+		if (iaf->na == NULL) {
+			logerr(__func__);
+			return;
+		}
+		iaf->na_len = na_len;
 	}
+	na = iaf->na;
+	memset(na, 0, na_len);
 
 	na->nd_na_type = ND_NEIGHBOR_ADVERT;
 	na->nd_na_flags_reserved = ND_NA_FLAG_OVERRIDE;
@@ -562,8 +545,6 @@ ipv6nd_advertise(struct ipv6_addr *ia)
 	}
 
 	iaf->na_count = 0;
-	free(iaf->na);
-	iaf->na = na;
 	eloop_timeout_delete(ctx->eloop, ipv6nd_sendadvertisement, iaf);
 	ipv6nd_sendadvertisement(iaf);
 }
@@ -683,6 +664,42 @@ ipv6nd_applyra(struct interface *ifp)
 		logerr(__func__);
 }
 
+/* 32 bit FNV-1a over the router source address,
+ * masked down to a hash bucket. */
+static size_t
+ipv6nd_hashra(const struct in6_addr *addr)
+{
+	const uint8_t *p = addr->s6_addr;
+	size_t len = sizeof(addr->s6_addr);
+	uint32_t sum = 2166136261U;
+
+	while (len-- != 0) {
+		sum ^= *p++;
+		sum *= 16777619U;
+	}
+	return sum & (RA_HASHSZ - 1);
+}
+
+/* Find the router advertising from the given address.
+ * A NULL interface matches any interface - neighbour messages
+ * do not tell us which interface they were heard on. */
+static struct ra *
+ipv6nd_findra(struct dhcpcd_ctx *ctx, const struct interface *ifp,
+    const struct in6_addr *from)
+{
+	struct ra *rap;
+
+	if (ctx->ra_hash == NULL)
+		return NULL;
+	TAILQ_FOREACH(rap, &ctx->ra_hash[ipv6nd_hashra(from)], hnext) {
+		if (ifp != NULL && rap->iface != ifp)
+			continue;
+		if (IN6_ARE_ADDR_EQUAL(&rap->from, from))
+			return rap;
+	}
+	return NULL;
+}
+
 /*
  * Neighbour reachability.
  *
@@ -695,6 +712,10 @@ ipv6nd_applyra(struct interface *ifp)
  * As such we CANNOT rely on the NA Router flag and MUST use
  * unreachability or receive a RA with a lifetime of zero to remove
  * the node as a default router.
+ *
+ * Reachability is driven entirely by kernel neighbour messages -
+ * dhcpcd does not probe routers or keep per router timers.
+ * Lifetime expiry runs off the per interface ipv6nd_expirera timer.
  */
 void
 ipv6nd_neighbour(struct dhcpcd_ctx *ctx, struct in6_addr *addr, bool reachable)
@@ -704,11 +725,7 @@ ipv6nd_neighbour(struct dhcpcd_ctx *ctx, struct in6_addr *addr, bool reachable)
 	if (ctx->ra_routers == NULL)
 		return;
 
-	TAILQ_FOREACH(rap, ctx->ra_routers, next) {
-		if (IN6_ARE_ADDR_EQUAL(&rap->from, addr))
-			break;
-	}
-
+	rap = ipv6nd_findra(ctx, NULL, addr);
 	if (rap == NULL || rap->expired || rap->isreachable == reachable)
 		return;
 
@@ -815,14 +832,86 @@ ipv6nd_removefreedrop_ra(struct ra *rap, int remove_ra, int drop_ra)
 {
 
 	eloop_timeout_delete(rap->iface->ctx->eloop, NULL, rap->iface);
-	eloop_timeout_delete(rap->iface->ctx->eloop, NULL, rap);
-	if (remove_ra)
-		TAILQ_REMOVE(rap->iface->ctx->ra_routers, rap, next);
+	if (remove_ra) {
+		struct dhcpcd_ctx *ctx = rap->iface->ctx;
+
+		TAILQ_REMOVE(ctx->ra_routers, rap, next);
+		TAILQ_REMOVE(&ctx->ra_hash[ipv6nd_hashra(&rap->from)],
+		    rap, hnext);
+	}
 	ipv6_freedrop_addrs(&rap->addrs, drop_ra, NULL);
+	free(rap->opts);
 	free(rap->data);
 	free(rap);
 }
 
+/* Decode the option TLVs once into an index that option parsing,
+ * expiry and script env generation all consume.
+ * Unlike DHCP, ND6 options *may* occur more than once and there is
+ * no provision for option concatenation, so every TLV is kept.
+ * External linkage so tests/packet-parse can drive it directly. */
+int
+ipv6nd_indexra(struct ra *rap)
+{
+	struct nd_opt_hdr ndo;
+	struct ra_optidx *opts, *ndi;
+	uint8_t *p;
+	size_t len, olen, n;
+
+	n = 0;
+	len = rap->data_len - sizeof(struct nd_router_advert);
+	for (p = rap->data + sizeof(struct nd_router_advert);
+	    len > 0;
+	    p += olen, len -= olen)
+	{
+		if (len < sizeof(ndo)) {
+			logerrx("%s: short option", rap->iface->name);
+			break;
+		}
+		memcpy(&ndo, p, sizeof(ndo));
+		olen = (size_t)ndo.nd_opt_len * 8;
+		if (olen == 0) {
+			logerrx("%s: zero length option", rap->iface->name);
+			break;
+		}
+		if (olen > len) {
+			logerrx("%s: option length exceeds message",
+			    rap->iface->name);
+			break;
+		}
+		n++;
+	}
+
+	if (n == 0) {
+		free(rap->opts);
+		rap->opts = NULL;
+		rap->opts_len = 0;
+		return 0;
+	}
+
+	opts = reallocarray(rap->opts, n, sizeof(*opts));
+	if (opts == NULL)
+		return -1;
+	rap->opts = opts;
+	rap->opts_len = n;
+
+	ndi = opts;
+	len = rap->data_len - sizeof(struct nd_router_advert);
+	for (p = rap->data + sizeof(struct nd_router_advert);
+	    n != 0;
+	    p += olen, len -= olen, ndi++, n--)
+	{
+		memcpy(&ndo, p, sizeof(ndo));
+		olen = (size_t)ndo.nd_opt_len * 8;
+		ndi->type = ndo.nd_opt_type;
+		ndi->opt = p;
+		ndi->olen = olen;
+		ndi->data = p + sizeof(ndo);
+		ndi->len = olen - sizeof(ndo);
+	}
+	return 0;
+}
+
 static void
 ipv6nd_freedrop_ra(struct ra *rap, int drop)
 {
@@ -1091,14 +1180,14 @@ ipv6nd_handlera(struct dhcpcd_ctx *ctx,
     const struct sockaddr_in6 *from, const char *sfrom,
     struct interface *ifp, struct icmp6_hdr *icp, size_t len, int hoplimit)
 {
-	size_t i, olen;
+	size_t i, oi;
 	struct nd_router_advert *nd_ra;
-	struct nd_opt_hdr ndo;
 	struct nd_opt_prefix_info pi;
 	struct nd_opt_mtu mtu;
 	struct nd_opt_rdnss rdnss;
-	uint8_t *p;
+	struct ra_optidx *ndi;
 	struct ra *rap;
+	struct rs_state *rstate;
 	struct in6_addr pi_prefix;
 	struct ipv6_addr *ia;
 	struct dhcp_opt *dho;
@@ -1111,6 +1200,7 @@ ipv6nd_handlera(struct dhcpcd_ctx *ctx,
 	bool new_ia;
 #endif
 
+	STAT_INC(ra_rx);
 	if (ifp == NULL || RS_STATE(ifp) == NULL) {
 #ifdef DEBUG_RS
 		logdebugx("RA for unexpected interface from %s", sfrom);
@@ -1168,14 +1258,18 @@ ipv6nd_handlera(struct dhcpcd_ctx *ctx,
 	if (rap != NULL && rap->willexpire)
 		ipv6nd_applyra(ifp);
 
-	TAILQ_FOREACH(rap, ctx->ra_routers, next) {
-		if (ifp == rap->iface &&
-		    IN6_ARE_ADDR_EQUAL(&rap->from, &from->sin6_addr))
-			break;
-	}
+	rap = ipv6nd_findra(ctx, ifp, &from->sin6_addr);
 
 	nd_ra = (struct nd_router_advert *)icp;
 
+	/* Time the first RA to answer our solicitation. */
+	rstate = RS_STATE(ifp);
+	if (rstate != NULL && timespecisset(&rstate->solicited)) {
+		stats_lat_record(ifp->name, STAT_LAT_RA,
+		    &rstate->solicited);
+		timespecclear(&rstate->solicited);
+	}
+
 	/* We don't want to spam the log with the fact we got an RA every
 	 * 30 seconds or so, so only spam the log if it's different. */
 	if (rap == NULL || (rap->data_len != len ||
@@ -1212,6 +1306,15 @@ ipv6nd_handlera(struct dhcpcd_ctx *ctx,
 		}
 		memcpy(rap->data, icp, len);
 		rap->data_len = len;
+		if (ipv6nd_indexra(rap) == -1) {
+			logerr(__func__);
+			free(rap->data);
+			rap->data = NULL;
+			rap->data_len = 0;
+			if (new_rap)
+				free(rap);
+			return;
+		}
 	}
 
 	/* We could change the debug level based on new_data, but some
@@ -1226,6 +1329,28 @@ ipv6nd_handlera(struct dhcpcd_ctx *ctx,
 	    ifp->name, rap->sfrom);
 
 	clock_gettime(CLOCK_MONOTONIC, &rap->acquired);
+
+	/* Periodic advertisements are normally byte identical to the
+	 * last one we fully processed, so there is nothing new to
+	 * parse and no reason to rebuild routes or run the script
+	 * hooks.  Refresh the acquired times, re-apply the address
+	 * lifetimes and re-arm the expiry timers. */
+	if (!new_rap && !new_data && rap->isreachable && !rap->expired &&
+	    !(ifp->ctx->options & DHCPCD_TEST))
+	{
+		TAILQ_FOREACH(ia, &rap->addrs, next) {
+			ia->acquired = rap->acquired;
+		}
+		if (ifp->options->options & DHCPCD_CONFIGURE) {
+			ipv6_addaddrs(&rap->addrs);
+#ifdef IPV6_MANAGETEMPADDR
+			ipv6_addtempaddrs(ifp, &rap->acquired);
+#endif
+		}
+		ipv6nd_expirera(ifp);
+		return;
+	}
+
 	rap->flags = nd_ra->nd_ra_flags_reserved;
 	old_lifetime = rap->lifetime;
 	rap->lifetime = ntohs(nd_ra->nd_ra_router_lifetime);
@@ -1259,33 +1384,15 @@ ipv6nd_handlera(struct dhcpcd_ctx *ctx,
 		ia->flags |= IPV6_AF_STALE;
 	}
 
-	len -= sizeof(struct nd_router_advert);
-	p = ((uint8_t *)icp) + sizeof(struct nd_router_advert);
-	for (; len > 0; p += olen, len -= olen) {
-		if (len < sizeof(ndo)) {
-			logerrx("%s: short option", ifp->name);
-			break;
-		}
-		memcpy(&ndo, p, sizeof(ndo));
-		olen = (size_t)ndo.nd_opt_len * 8;
-		if (olen == 0) {
-			logerrx("%s: zero length option", ifp->name);
-			break;
-		}
-		if (olen > len) {
-			logerrx("%s: option length exceeds message",
-			    ifp->name);
-			break;
-		}
-
+	for (oi = 0, ndi = rap->opts; oi < rap->opts_len; oi++, ndi++) {
 		if (has_option_mask(ifp->options->rejectmasknd,
-		    ndo.nd_opt_type))
+		    ndi->type))
 		{
 			for (i = 0, dho = ctx->nd_opts;
 			    i < ctx->nd_opts_len;
 			    i++, dho++)
 			{
-				if (dho->option == ndo.nd_opt_type)
+				if (dho->option == ndi->type)
 					break;
 			}
 			if (dho != NULL)
@@ -1293,7 +1400,7 @@ ipv6nd_handlera(struct dhcpcd_ctx *ctx,
 				    ifp->name, dho->var, rap->sfrom);
 			else
 				logwarnx("%s: reject RA (option %d) from %s",
-				    ifp->name, ndo.nd_opt_type, rap->sfrom);
+				    ifp->name, ndi->type, rap->sfrom);
 			if (new_rap)
 				ipv6nd_removefreedrop_ra(rap, 0, 0);
 			else
@@ -1301,19 +1408,19 @@ ipv6nd_handlera(struct dhcpcd_ctx *ctx,
 			return;
 		}
 
-		if (has_option_mask(ifp->options->nomasknd, ndo.nd_opt_type))
+		if (has_option_mask(ifp->options->nomasknd, ndi->type))
 			continue;
 
-		switch (ndo.nd_opt_type) {
+		switch (ndi->type) {
 		case ND_OPT_PREFIX_INFORMATION:
 			loglevel = new_data ? LOG_ERR : LOG_DEBUG;
-			if (ndo.nd_opt_len != 4) {
+			if (ndi->olen != sizeof(pi)) {
 				logmessage(loglevel,
 				    "%s: invalid option len for prefix",
 				    ifp->name);
 				continue;
 			}
-			memcpy(&pi, p, sizeof(pi));
+			memcpy(&pi, ndi->opt, sizeof(pi));
 			if (pi.nd_opt_pi_prefix_len > 128) {
 				logmessage(loglevel, "%s: invalid prefix len",
 				    ifp->name);
@@ -1412,11 +1519,11 @@ ipv6nd_handlera(struct dhcpcd_ctx *ctx,
 			break;
 
 		case ND_OPT_MTU:
-			if (len < sizeof(mtu)) {
+			if (ndi->olen < sizeof(mtu)) {
 				logmessage(loglevel, "%s: short MTU option", ifp->name);
 				break;
 			}
-			memcpy(&mtu, p, sizeof(mtu));
+			memcpy(&mtu, ndi->opt, sizeof(mtu));
 			mtu.nd_opt_mtu_mtu = ntohl(mtu.nd_opt_mtu_mtu);
 			if (mtu.nd_opt_mtu_mtu < IPV6_MMTU) {
 				logmessage(loglevel, "%s: invalid MTU %d",
@@ -1435,11 +1542,11 @@ ipv6nd_handlera(struct dhcpcd_ctx *ctx,
 				rap->mtu = mtu.nd_opt_mtu_mtu;
 			break;
 		case ND_OPT_RDNSS:
-			if (len < sizeof(rdnss)) {
+			if (ndi->olen < sizeof(rdnss)) {
 				logmessage(loglevel, "%s: short RDNSS option", ifp->name);
 				break;
 			}
-			memcpy(&rdnss, p, sizeof(rdnss));
+			memcpy(&rdnss, ndi->opt, sizeof(rdnss));
 			if (rdnss.nd_opt_rdnss_lifetime &&
 			    rdnss.nd_opt_rdnss_len > 1)
 				rap->hasdns = 1;
@@ -1483,8 +1590,11 @@ ipv6nd_handlera(struct dhcpcd_ctx *ctx,
 		logwarnx("%s: no global addresses for default route",
 		    ifp->name);
 
-	if (new_rap)
+	if (new_rap) {
 		TAILQ_INSERT_TAIL(ctx->ra_routers, rap, next);
+		TAILQ_INSERT_TAIL(&ctx->ra_hash[ipv6nd_hashra(&rap->from)],
+		    rap, hnext);
+	}
 	if (new_data)
 		ipv6nd_sortrouters(ifp->ctx);
 
@@ -1501,13 +1611,12 @@ ipv6nd_handlera(struct dhcpcd_ctx *ctx,
 #ifdef IPV6_MANAGETEMPADDR
 	ipv6_addtempaddrs(ifp, &rap->acquired);
 #endif
-	rt_build(ifp->ctx, AF_INET6);
+	rt_build_if(ifp, AF_INET6);
 
 run:
 	ipv6nd_scriptrun(rap);
 
 	eloop_timeout_delete(ifp->ctx->eloop, NULL, ifp);
-	eloop_timeout_delete(ifp->ctx->eloop, NULL, rap); /* reachable timer */
 
 handle_flag:
 	if (!(ifp->options->options & DHCPCD_DHCP6))
@@ -1597,14 +1706,9 @@ ipv6nd_getoption(struct dhcpcd_ctx *ctx,
 		*code = ndo.nd_opt_type;
 	}
 
-	for (i = 0, opt = ctx->nd_opts;
-	    i < ctx->nd_opts_len; i++, opt++)
-	{
-		if (opt->option == *code) {
-			*oopt = opt;
-			break;
-		}
-	}
+	opt = dhcp_findoption(ctx->nd_opts, ctx->nd_opts_len, *code);
+	if (opt != NULL)
+		*oopt = opt;
 
 	if (od)
 		return od + sizeof(ndo);
@@ -1614,12 +1718,11 @@ ipv6nd_getoption(struct dhcpcd_ctx *ctx,
 ssize_t
 ipv6nd_env(FILE *fp, const struct interface *ifp)
 {
-	size_t i, j, n, len, olen;
+	size_t i, j, n, oi;
 	struct ra *rap;
 	char ndprefix[32];
 	struct dhcp_opt *opt;
-	uint8_t *p;
-	struct nd_opt_hdr ndo;
+	struct ra_optidx *ndi;
 	struct ipv6_addr *ia;
 	struct timespec now;
 	int pref;
@@ -1662,33 +1765,22 @@ ipv6nd_env(FILE *fp, const struct interface *ifp)
 		    j++, opt++)
 			dhcp_zero_index(opt);
 
-		/* Unlike DHCP, ND6 options *may* occur more than once.
-		 * There is also no provision for option concatenation
-		 * unlike DHCP. */
-		len = rap->data_len - sizeof(struct nd_router_advert);
-		for (p = rap->data + sizeof(struct nd_router_advert);
-		    len >= sizeof(ndo);
-		    p += olen, len -= olen)
+		for (oi = 0, ndi = rap->opts; oi < rap->opts_len;
+		    oi++, ndi++)
 		{
-			memcpy(&ndo, p, sizeof(ndo));
-			olen = (size_t)(ndo.nd_opt_len * 8);
-			if (olen > len) {
-				errno =	EINVAL;
-				break;
-			}
 			if (has_option_mask(rap->iface->options->nomasknd,
-			    ndo.nd_opt_type))
+			    ndi->type))
 				continue;
 			for (j = 0, opt = rap->iface->options->nd_override;
 			    j < rap->iface->options->nd_override_len;
 			    j++, opt++)
-				if (opt->option == ndo.nd_opt_type)
+				if (opt->option == ndi->type)
 					break;
 			if (j == rap->iface->options->nd_override_len) {
 				for (j = 0, opt = rap->iface->ctx->nd_opts;
 				    j < rap->iface->ctx->nd_opts_len;
 				    j++, opt++)
-					if (opt->option == ndo.nd_opt_type)
+					if (opt->option == ndi->type)
 						break;
 				if (j == rap->iface->ctx->nd_opts_len)
 					opt = NULL;
@@ -1698,7 +1790,7 @@ ipv6nd_env(FILE *fp, const struct interface *ifp)
 			dhcp_envoption(rap->iface->ctx, fp,
 			    ndprefix, rap->iface->name,
 			    opt, ipv6nd_getoption,
-			    p + sizeof(ndo), olen - sizeof(ndo));
+			    ndi->data, ndi->len);
 		}
 
 		/* We need to output the addresses we actually made
@@ -1746,9 +1838,8 @@ ipv6nd_expirera(void *arg)
 	uint32_t elapsed;
 	bool expired, valid;
 	struct ipv6_addr *ia;
-	size_t len, olen;
-	uint8_t *p;
-	struct nd_opt_hdr ndo;
+	size_t oi;
+	struct ra_optidx *ndi;
 #if 0
 	struct nd_opt_prefix_info pi;
 #endif
@@ -1824,42 +1915,33 @@ ipv6nd_expirera(void *arg)
 		/* Work out expiry for ND options */
 		elapsed = (uint32_t)eloop_timespec_diff(&now,
 		    &rap->acquired, NULL);
-		len = rap->data_len - sizeof(struct nd_router_advert);
-		for (p = rap->data + sizeof(struct nd_router_advert);
-		    len >= sizeof(ndo);
-		    p += olen, len -= olen)
+		for (oi = 0, ndi = rap->opts; oi < rap->opts_len;
+		    oi++, ndi++)
 		{
-			memcpy(&ndo, p, sizeof(ndo));
-			olen = (size_t)(ndo.nd_opt_len * 8);
-			if (olen > len) {
-				errno =	EINVAL;
-				break;
-			}
-
 			if (has_option_mask(rap->iface->options->nomasknd,
-			    ndo.nd_opt_type))
+			    ndi->type))
 				continue;
 
-			switch (ndo.nd_opt_type) {
+			switch (ndi->type) {
 			/* Prefix info is already checked in the above loop. */
 #if 0
 			case ND_OPT_PREFIX_INFORMATION:
-				if (len < sizeof(pi))
+				if (ndi->olen < sizeof(pi))
 					break;
-				memcpy(&pi, p, sizeof(pi));
+				memcpy(&pi, ndi->opt, sizeof(pi));
 				ltime = pi.nd_opt_pi_valid_time;
 				break;
 #endif
 			case ND_OPT_DNSSL:
-				if (len < sizeof(dnssl))
+				if (ndi->olen < sizeof(dnssl))
 					continue;
-				memcpy(&dnssl, p, sizeof(dnssl));
+				memcpy(&dnssl, ndi->opt, sizeof(dnssl));
 				ltime = dnssl.nd_opt_dnssl_lifetime;
 				break;
 			case ND_OPT_RDNSS:
-				if (len < sizeof(rdnss))
+				if (ndi->olen < sizeof(rdnss))
 					continue;
-				memcpy(&rdnss, p, sizeof(rdnss));
+				memcpy(&rdnss, ndi->opt, sizeof(rdnss));
 				ltime = rdnss.nd_opt_rdnss_lifetime;
 				break;
 			default:
@@ -2053,6 +2135,7 @@ ipv6nd_startrs1(void *arg)
 
 	state->retrans = RETRANS_TIMER;
 	state->rsprobes = 0;
+	clock_gettime(CLOCK_MONOTONIC, &state->solicited);
 	ipv6nd_sendrsprobe(ifp);
 }
 
@@ -37,13 +37,27 @@
 #include "dhcpcd.h"
 #include "ipv6.h"
 
+/* Option TLVs are decoded once on receipt into this index so option
+ * parsing, expiry and script env generation need not rescan the raw
+ * advertisement. */
+struct ra_optidx {
+	uint8_t type;
+	uint8_t *opt;	/* whole option, header included */
+	size_t olen;
+	uint8_t *data;	/* option payload */
+	size_t len;
+};
+
 struct ra {
 	TAILQ_ENTRY(ra) next;
+	TAILQ_ENTRY(ra) hnext;	/* source address hash chain */
 	struct interface *iface;
 	struct in6_addr from;
 	char sfrom[INET6_ADDRSTRLEN];
 	uint8_t *data;
 	size_t data_len;
+	struct ra_optidx *opts;
+	size_t opts_len;
 	struct timespec acquired;
 	unsigned char flags;
 	uint32_t lifetime;
@@ -61,11 +75,18 @@ struct ra {
 
 TAILQ_HEAD(ra_head, ra);
 
+/* Routers are indexed by source address as well as kept in the
+ * preference sorted list, so matching a received RA or a neighbour
+ * message to its router does not walk every router we know of.
+ * Must be a power of two. */
+#define	RA_HASHSZ	64
+
 struct rs_state {
 	struct nd_router_solicit *rs;
 	size_t rslen;
 	int rsprobes;
 	uint32_t retrans;
+	struct timespec solicited;
 #ifdef __sun
 	int nd_fd;
 #endif
@@ -108,6 +129,7 @@ void ipv6nd_printoptions(const struct dhcpcd_ctx *,
     const struct dhcp_opt *, size_t);
 void ipv6nd_startrs(struct interface *);
 ssize_t ipv6nd_env(FILE *, const struct interface *);
+int ipv6nd_indexra(struct ra *);
 const struct ipv6_addr *ipv6nd_iffindaddr(const struct interface *ifp,
     const struct in6_addr *addr, unsigned int flags);
 struct ipv6_addr *ipv6nd_findaddr(struct dhcpcd_ctx *,
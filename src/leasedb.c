@@ -0,0 +1,367 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * dhcpcd - Consolidated lease database
+ * Copyright (c) 2006-2021 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "common.h"
+#include "dhcpcd.h"
+#include "leasedb.h"
+#include "logerr.h"
+
+/* The database is opened before the privsep sandbox is entered and the
+ * file descriptor is kept, so lease commits only need write(2) which
+ * the sandbox allows.  Compaction reopens the file and thus can only
+ * happen here at startup. */
+
+static struct leasedb_entry *
+dhcp_leasedb_find(struct leasedb *db, const char *name)
+{
+	struct leasedb_entry *e;
+
+	TAILQ_FOREACH(e, &db->entries, next) {
+		if (strcmp(e->name, name) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+static void
+dhcp_leasedb_delete(struct leasedb *db, struct leasedb_entry *e)
+{
+
+	TAILQ_REMOVE(&db->entries, e, next);
+	free(e->name);
+	free(e->data);
+	free(e);
+}
+
+static ssize_t
+dhcp_leasedb_putrec(int fd, const char *name, const void *data, size_t len)
+{
+	struct leasedb_rhdr rhdr = {
+	    .namelen = (uint32_t)strlen(name),
+	    .datalen = (uint32_t)len,
+	};
+	struct iovec iov[] = {
+	    { .iov_base = &rhdr, .iov_len = sizeof(rhdr), },
+	    { .iov_base = UNCONST(name), .iov_len = rhdr.namelen, },
+	    { .iov_base = UNCONST(data), .iov_len = len, },
+	};
+
+	return writev(fd, iov, len == 0 ? 2 : 3);
+}
+
+static int
+dhcp_leasedb_compact(struct dhcpcd_ctx *ctx, struct leasedb *db)
+{
+	struct leasedb_fhdr fhdr = {
+	    .magic = LEASEDB_MAGIC,
+	    .version = LEASEDB_VERSION,
+	};
+	struct leasedb_entry *e;
+	char tmp[PATH_MAX];
+	int fd;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", ctx->leasedb_file) >=
+	    (int)sizeof(tmp))
+	{
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+	if (fd == -1)
+		return -1;
+	if (write(fd, &fhdr, sizeof(fhdr)) == -1)
+		goto err;
+	TAILQ_FOREACH(e, &db->entries, next) {
+		if (dhcp_leasedb_putrec(fd, e->name, e->data, e->len) == -1)
+			goto err;
+	}
+	if (close(fd) == -1) {
+		fd = -1;
+		goto err;
+	}
+	if (rename(tmp, ctx->leasedb_file) == -1) {
+		fd = -1;
+		goto err;
+	}
+
+	/* The old descriptor now points to the unlinked file. */
+	fd = open(ctx->leasedb_file,
+	    O_RDWR | O_APPEND | O_CLOEXEC, 0640);
+	if (fd == -1)
+		return -1;
+	close(db->fd);
+	db->fd = fd;
+	return 0;
+
+err:
+	if (fd != -1)
+		close(fd);
+	unlink(tmp);
+	return -1;
+}
+
+int
+dhcp_leasedb_open(struct dhcpcd_ctx *ctx)
+{
+	struct leasedb *db;
+	struct leasedb_fhdr fhdr;
+	struct leasedb_rhdr rhdr;
+	struct leasedb_entry *e;
+	char *name;
+	void *data;
+	ssize_t bytes;
+	off_t off;
+	bool dirty;
+
+	db = calloc(1, sizeof(*db));
+	if (db == NULL)
+		return -1;
+	TAILQ_INIT(&db->entries);
+
+	db->fd = open(ctx->leasedb_file,
+	    O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+	if (db->fd == -1) {
+		free(db);
+		return -1;
+	}
+
+	bytes = read(db->fd, &fhdr, sizeof(fhdr));
+	if (bytes == 0) {
+		/* A new database. */
+		fhdr.magic = LEASEDB_MAGIC;
+		fhdr.version = LEASEDB_VERSION;
+		if (write(db->fd, &fhdr, sizeof(fhdr)) == -1)
+			goto err;
+	} else if (bytes != sizeof(fhdr) ||
+	    fhdr.magic != LEASEDB_MAGIC || fhdr.version != LEASEDB_VERSION)
+	{
+		logerrx("%s: invalid database", ctx->leasedb_file);
+		errno = EINVAL;
+		goto err;
+	}
+
+	dirty = false;
+	off = (off_t)sizeof(fhdr);
+	for (;;) {
+		bytes = read(db->fd, &rhdr, sizeof(rhdr));
+		if (bytes == 0)
+			break;
+		if (bytes != sizeof(rhdr) ||
+		    rhdr.namelen == 0 || rhdr.namelen > LEASEDB_MAXNAME ||
+		    rhdr.datalen > LEASEDB_MAXDATA)
+			goto corrupt;
+		name = malloc((size_t)rhdr.namelen + 1);
+		if (name == NULL)
+			goto err;
+		if (read(db->fd, name, rhdr.namelen) != (ssize_t)rhdr.namelen)
+		{
+			free(name);
+			goto corrupt;
+		}
+		name[rhdr.namelen] = '\0';
+		data = NULL;
+		if (rhdr.datalen != 0) {
+			data = malloc(rhdr.datalen);
+			if (data == NULL) {
+				free(name);
+				goto err;
+			}
+			if (read(db->fd, data, rhdr.datalen) !=
+			    (ssize_t)rhdr.datalen)
+			{
+				free(name);
+				free(data);
+				goto corrupt;
+			}
+		}
+
+		e = dhcp_leasedb_find(db, name);
+		if (e != NULL) {
+			/* A later record supersedes the earlier one. */
+			dirty = true;
+			if (rhdr.datalen == 0) {
+				dhcp_leasedb_delete(db, e);
+				free(name);
+			} else {
+				free(e->data);
+				e->data = data;
+				e->len = rhdr.datalen;
+				free(name);
+			}
+		} else if (rhdr.datalen == 0) {
+			/* A tombstone with nothing to delete. */
+			dirty = true;
+			free(name);
+		} else {
+			e = malloc(sizeof(*e));
+			if (e == NULL) {
+				free(name);
+				free(data);
+				goto err;
+			}
+			e->name = name;
+			e->data = data;
+			e->len = rhdr.datalen;
+			TAILQ_INSERT_TAIL(&db->entries, e, next);
+		}
+		off += (off_t)(sizeof(rhdr) + rhdr.namelen + rhdr.datalen);
+	}
+
+	ctx->leasedb = db;
+	if (dirty && dhcp_leasedb_compact(ctx, db) == -1)
+		logerr("%s: %s", __func__, ctx->leasedb_file);
+	return 0;
+
+corrupt:
+	/* Drop the damaged tail, likely from an interrupted write.
+	 * Everything before it is still good. */
+	logerrx("%s: truncated record, discarding tail", ctx->leasedb_file);
+	if (ftruncate(db->fd, off) == -1 ||
+	    lseek(db->fd, 0, SEEK_END) == -1)
+		goto err;
+	ctx->leasedb = db;
+	return 0;
+
+err:
+	ctx->leasedb = db;
+	dhcp_leasedb_close(ctx);
+	return -1;
+}
+
+void
+dhcp_leasedb_close(struct dhcpcd_ctx *ctx)
+{
+	struct leasedb *db = ctx->leasedb;
+	struct leasedb_entry *e;
+
+	if (db == NULL)
+		return;
+	while ((e = TAILQ_FIRST(&db->entries)) != NULL)
+		dhcp_leasedb_delete(db, e);
+	if (db->fd != -1)
+		close(db->fd);
+	free(db);
+	ctx->leasedb = NULL;
+}
+
+ssize_t
+dhcp_leasedb_read(struct dhcpcd_ctx *ctx, const char *name,
+    void *data, size_t len)
+{
+	struct leasedb_entry *e;
+
+	e = dhcp_leasedb_find(ctx->leasedb, name);
+	if (e == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+	if (e->len > len) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	memcpy(data, e->data, e->len);
+	return (ssize_t)e->len;
+}
+
+ssize_t
+dhcp_leasedb_write(struct dhcpcd_ctx *ctx, const char *name,
+    const void *data, size_t len)
+{
+	struct leasedb *db = ctx->leasedb;
+	struct leasedb_entry *e;
+	void *ndata;
+
+	if (len == 0 || len > LEASEDB_MAXDATA ||
+	    strlen(name) > LEASEDB_MAXNAME)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	ndata = malloc(len);
+	if (ndata == NULL)
+		return -1;
+	memcpy(ndata, data, len);
+
+	e = dhcp_leasedb_find(db, name);
+	if (e == NULL) {
+		e = malloc(sizeof(*e));
+		if (e == NULL)
+			goto err;
+		e->name = strdup(name);
+		if (e->name == NULL) {
+			free(e);
+			goto err;
+		}
+		e->data = ndata;
+		e->len = len;
+		TAILQ_INSERT_TAIL(&db->entries, e, next);
+	} else {
+		free(e->data);
+		e->data = ndata;
+		e->len = len;
+	}
+
+	if (dhcp_leasedb_putrec(db->fd, name, data, len) == -1)
+		return -1;
+	return (ssize_t)len;
+
+err:
+	free(ndata);
+	return -1;
+}
+
+int
+dhcp_leasedb_unlink(struct dhcpcd_ctx *ctx, const char *name)
+{
+	struct leasedb *db = ctx->leasedb;
+	struct leasedb_entry *e;
+
+	e = dhcp_leasedb_find(db, name);
+	if (e == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+	dhcp_leasedb_delete(db, e);
+	if (dhcp_leasedb_putrec(db->fd, name, NULL, 0) == -1)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * dhcpcd - Consolidated lease database
+ * Copyright (c) 2006-2021 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LEASEDB_H
+#define LEASEDB_H
+
+#include <sys/queue.h>
+
+#include <stdint.h>
+
+#include "dhcpcd.h"
+
+/* All leases live in one append only file so that startup needs a
+ * single open and one sequential read no matter how many interfaces
+ * there are, and a lease commit is just an append.
+ * The file starts with leasedb_fhdr and is followed by records, each
+ * a leasedb_rhdr, the lease file name and the lease as written by
+ * dhcp_writelease().  A record with a zero datalen deletes the name.
+ * Superseded records are dropped by rewriting the file at startup. */
+
+#define	LEASEDB_MAGIC		0x6c736462U
+#define	LEASEDB_VERSION		1U
+
+struct leasedb_fhdr {
+	uint32_t magic;
+	uint32_t version;
+};
+
+struct leasedb_rhdr {
+	uint32_t namelen;	/* name length, no NUL */
+	uint32_t datalen;	/* zero deletes the name */
+};
+
+#define	LEASEDB_MAXNAME		1024
+#define	LEASEDB_MAXDATA		(64 * 1024)
+
+struct leasedb_entry {
+	TAILQ_ENTRY(leasedb_entry) next;
+	char *name;
+	void *data;
+	size_t len;
+};
+TAILQ_HEAD(leasedb_entries, leasedb_entry);
+
+struct leasedb {
+	int fd;
+	struct leasedb_entries entries;
+};
+
+int dhcp_leasedb_open(struct dhcpcd_ctx *);
+void dhcp_leasedb_close(struct dhcpcd_ctx *);
+ssize_t dhcp_leasedb_read(struct dhcpcd_ctx *, const char *, void *, size_t);
+ssize_t dhcp_leasedb_write(struct dhcpcd_ctx *, const char *,
+    const void *, size_t);
+int dhcp_leasedb_unlink(struct dhcpcd_ctx *, const char *);
+
+#endif
@@ -50,6 +50,9 @@
 /* syslog protocol is 1k message max, RFC 3164 section 4.1 */
 #define LOGERR_SYSLOGBUF	1024 + sizeof(int) + sizeof(pid_t)
 
+/* Pending messages held when the log fd would block. */
+#define LOGERR_RING		16
+
 #define UNUSED(a)		(void)(a)
 
 struct logctx {
@@ -62,6 +65,17 @@ struct logctx {
 #ifdef LOGERR_TAG
 	const char	*log_tag;
 #endif
+	/* Suppression of duplicate message runs */
+	char		 log_last[1024];
+	int		 log_last_pri;
+	unsigned int	 log_repeats;
+	/* Ring of messages the log fd refused to take */
+	char		 log_ring[LOGERR_RING][LOGERR_SYSLOGBUF];
+	size_t		 log_ring_len[LOGERR_RING];
+	size_t		 log_ring_head;
+	size_t		 log_ring_n;
+	void		(*log_writecb)(void *, int);
+	void		*log_writecb_arg;
 #endif
 };
 
@@ -208,25 +222,109 @@ vlogprintf_r(struct logctx *ctx, FILE *stream, const char *fmt, va_list args)
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wmissing-format-attribute"
 #endif
-__printflike(2, 0) static int
-vlogmessage(int pri, const char *fmt, va_list args)
+__printflike(3, 4) static int
+logprintf_r(struct logctx *ctx, FILE *stream, const char *fmt, ...)
+{
+	va_list args;
+	int r;
+
+	va_start(args, fmt);
+	r = vlogprintf_r(ctx, stream, fmt, args);
+	va_end(args);
+	return r;
+}
+
+#ifndef SMALL
+static int
+logqueue(struct logctx *ctx, const char *buf, size_t len)
+{
+	size_t i;
+
+	if (ctx->log_ring_n == LOGERR_RING) {
+		/* Drop the oldest message to make room. */
+		ctx->log_ring_head = (ctx->log_ring_head + 1) % LOGERR_RING;
+		ctx->log_ring_n--;
+	}
+	i = (ctx->log_ring_head + ctx->log_ring_n) % LOGERR_RING;
+	memcpy(ctx->log_ring[i], buf, len);
+	ctx->log_ring_len[i] = len;
+	if (ctx->log_ring_n++ == 0 && ctx->log_writecb != NULL)
+		ctx->log_writecb(ctx->log_writecb_arg, 1);
+	return (int)len;
+}
+#endif
+
+int
+logdrain(void)
+{
+#ifndef SMALL
+	struct logctx *ctx = &_logctx;
+	ssize_t wr;
+
+	while (ctx->log_ring_n != 0) {
+		if (ctx->log_fd != -1) {
+			wr = write(ctx->log_fd,
+			    ctx->log_ring[ctx->log_ring_head],
+			    ctx->log_ring_len[ctx->log_ring_head]);
+			if (wr == -1 &&
+			    (errno == EAGAIN || errno == ENOBUFS))
+				return -1;
+			/* Other errors: drop the message,
+			 * there is nowhere to report it. */
+		}
+		ctx->log_ring_head = (ctx->log_ring_head + 1) % LOGERR_RING;
+		if (--ctx->log_ring_n == 0 && ctx->log_writecb != NULL)
+			ctx->log_writecb(ctx->log_writecb_arg, 0);
+	}
+#endif
+	return 0;
+}
+
+void
+logsetwritecb(void (*cb)(void *, int), void *arg)
 {
+#ifndef SMALL
 	struct logctx *ctx = &_logctx;
+
+	ctx->log_writecb = cb;
+	ctx->log_writecb_arg = arg;
+#else
+	UNUSED(cb);
+	UNUSED(arg);
+#endif
+}
+
+/* Emit one formatted message to the configured sinks. */
+static int
+logmessage_r(struct logctx *ctx, int pri, const char *msg)
+{
 	int len = 0;
 
 	if (ctx->log_fd != -1) {
 		char buf[LOGERR_SYSLOGBUF];
 		pid_t pid;
+		size_t mlen;
 
 		memcpy(buf, &pri, sizeof(pri));
 		pid = getpid();
 		memcpy(buf + sizeof(pri), &pid, sizeof(pid));
-		len = vsnprintf(buf + sizeof(pri) + sizeof(pid),
-		    sizeof(buf) - sizeof(pri) - sizeof(pid),
-		    fmt, args);
-		if (len != -1)
-			len = (int)write(ctx->log_fd, buf,
-			    ((size_t)++len) + sizeof(pri) + sizeof(pid));
+		mlen = strlen(msg);
+		if (mlen > sizeof(buf) - sizeof(pri) - sizeof(pid) - 1)
+			mlen = sizeof(buf) - sizeof(pri) - sizeof(pid) - 1;
+		memcpy(buf + sizeof(pri) + sizeof(pid), msg, mlen);
+		buf[sizeof(pri) + sizeof(pid) + mlen] = '\0';
+		mlen += sizeof(pri) + sizeof(pid) + 1;
+#ifndef SMALL
+		/* Preserve ordering - drain anything queued first and
+		 * queue behind it if the fd still will not take us. */
+		if (logdrain() == -1)
+			return logqueue(ctx, buf, mlen);
+#endif
+		len = (int)write(ctx->log_fd, buf, mlen);
+#ifndef SMALL
+		if (len == -1 && (errno == EAGAIN || errno == ENOBUFS))
+			return logqueue(ctx, buf, mlen);
+#endif
 		return len;
 	}
 
@@ -234,19 +332,59 @@ vlogmessage(int pri, const char *fmt, va_list args)
 	    (pri <= LOG_ERR ||
 	    (!(ctx->log_opts & LOGERR_QUIET) && pri <= LOG_INFO) ||
 	    (ctx->log_opts & LOGERR_DEBUG && pri <= LOG_DEBUG)))
-		len = vlogprintf_r(ctx, stderr, fmt, args);
+		len = logprintf_r(ctx, stderr, "%s", msg);
 
 #ifndef SMALL
 	if (ctx->log_file != NULL &&
 	    (pri != LOG_DEBUG || (ctx->log_opts & LOGERR_DEBUG)))
-		len = vlogprintf_r(ctx, ctx->log_file, fmt, args);
+		len = logprintf_r(ctx, ctx->log_file, "%s", msg);
 #endif
 
 	if (ctx->log_opts & LOGERR_LOG)
-		vsyslog(pri, fmt, args);
+		syslog(pri, "%s", msg);
 
 	return len;
 }
+
+#ifndef SMALL
+static void
+logflushrepeats(struct logctx *ctx)
+{
+	unsigned int repeats = ctx->log_repeats;
+	char buf[64];
+
+	if (repeats == 0)
+		return;
+	ctx->log_repeats = 0;
+	snprintf(buf, sizeof(buf), "last message repeated %u times", repeats);
+	logmessage_r(ctx, ctx->log_last_pri, buf);
+}
+#endif
+
+__printflike(2, 0) static int
+vlogmessage(int pri, const char *fmt, va_list args)
+{
+	struct logctx *ctx = &_logctx;
+	char buf[1024];
+
+	vsnprintf(buf, sizeof(buf), fmt, args);
+
+#ifndef SMALL
+	/* Suppress runs of duplicate messages so log storms
+	 * cost one line per burst rather than one per event. */
+	if (pri == ctx->log_last_pri &&
+	    strcmp(buf, ctx->log_last) == 0)
+	{
+		ctx->log_repeats++;
+		return (int)strlen(buf);
+	}
+	logflushrepeats(ctx);
+	memcpy(ctx->log_last, buf, sizeof(ctx->log_last));
+	ctx->log_last_pri = pri;
+#endif
+
+	return logmessage_r(ctx, pri, buf);
+}
 #if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ > 5))
 #pragma GCC diagnostic pop
 #endif
@@ -377,6 +515,12 @@ logsetfd(int fd)
 
 	ctx->log_fd = fd;
 #ifndef SMALL
+	/* Queued messages belong to the old fd. */
+	if (ctx->log_ring_n != 0) {
+		ctx->log_ring_n = ctx->log_ring_head = 0;
+		if (ctx->log_writecb != NULL)
+			ctx->log_writecb(ctx->log_writecb_arg, 0);
+	}
 	if (fd != -1 && ctx->log_file != NULL) {
 		fclose(ctx->log_file);
 		ctx->log_file = NULL;
@@ -481,6 +625,9 @@ logclose(void)
 {
 #ifndef SMALL
 	struct logctx *ctx = &_logctx;
+
+	logflushrepeats(ctx);
+	(void)logdrain();
 #endif
 
 	closelog();
@@ -67,8 +67,18 @@ __printflike(2, 3) void logerrmessage(int pri, const char *fmt, ...);
  * The solution is to put fmt into __VA_ARGS__.
  * It's not pretty but it's 100% portable.
  */
-#define logdebug(...)	log_debug(__VA_ARGS__)
-#define logdebugx(...)	log_debugx(__VA_ARGS__)
+/* Debug messages are gated here so that their arguments, which often
+ * format addresses just to be discarded, are not evaluated at all
+ * unless debug logging is enabled. */
+#define logisdebug()	(loggetopts() & LOGERR_DEBUG)
+#define logdebug(...)	do {						\
+	if (logisdebug())						\
+		log_debug(__VA_ARGS__);					\
+} while (0 /* CONSTCOND */)
+#define logdebugx(...)	do {						\
+	if (logisdebug())						\
+		log_debugx(__VA_ARGS__);				\
+} while (0 /* CONSTCOND */)
 #define loginfo(...)	log_info(__VA_ARGS__)
 #define loginfox(...)	log_infox(__VA_ARGS__)
 #define logwarn(...)	log_warn(__VA_ARGS__)
@@ -81,6 +91,12 @@ int loggetfd(void);
 void logsetfd(int);
 int logreadfd(int);
 
+/* Drain messages queued when the log fd would block.
+ * The write callback fires with 1 when messages queue up and with 0
+ * once drained, so an event loop writer can be toggled. */
+int logdrain(void);
+void logsetwritecb(void (*)(void *, int), void *);
+
 unsigned int loggetopts(void);
 void logsetopts(unsigned int);
 #define	LOGERR_DEBUG	(1U << 6)
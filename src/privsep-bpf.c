@@ -46,6 +46,7 @@
 
 #include "arp.h"
 #include "bpf.h"
+#include "common.h"
 #include "dhcp.h"
 #include "dhcp6.h"
 #include "eloop.h"
@@ -60,15 +61,30 @@ ps_bpf_recvbpf(void *arg)
 	struct bpf *bpf = psp->psp_bpf;
 	uint8_t buf[FRAMELEN_MAX];
 	ssize_t len;
+	unsigned int budget = BPF_READ_BUDGET;
 	struct ps_msghdr psm = {
 		.ps_id = psp->psp_id,
 		.ps_cmd = psp->psp_id.psi_cmd,
 	};
 
+	/* We might be re-scheduled after an earlier ENXIO error. */
+	if (bpf == NULL)
+		return;
+
+	/* We may be resuming a drain that ran out of budget. */
+	eloop_timeout_delete(psp->psp_ctx->eloop, ps_bpf_recvbpf, psp);
+
 	bpf->bpf_flags &= ~BPF_EOF;
 	/* A BPF read can read more than one filtered packet at time.
 	 * This mechanism allows us to read each packet from the buffer. */
 	while (!(bpf->bpf_flags & BPF_EOF)) {
+		if (budget-- == 0) {
+			/* Out of budget - give way to other events and
+			 * pick up the residue afterwards. */
+			eloop_timeout_add_sec(psp->psp_ctx->eloop, 0,
+			    ps_bpf_recvbpf, psp);
+			break;
+		}
 		len = bpf_read(bpf, buf, sizeof(buf));
 		if (len == -1) {
 			int error = errno;
@@ -110,6 +126,7 @@ ps_bpf_recvmsgcb(void *arg, struct ps_msghdr *psm, struct msghdr *msg)
 	switch(psm->ps_cmd) {
 #ifdef ARP
 	case PS_BPF_ARP:	/* FALLTHROUGH */
+	case PS_BPF_ARP_ADDRS:
 #endif
 	case PS_BPF_BOOTP:
 		break;
@@ -126,6 +143,20 @@ ps_bpf_recvmsgcb(void *arg, struct ps_msghdr *psm, struct msghdr *msg)
 		return -1;
 	}
 
+#ifdef ARP
+	if (psm->ps_cmd == PS_BPF_ARP_ADDRS) {
+		struct in_addr addrs[BPF_ARP_MAXADDRS + 1];
+		size_t naddrs = iov->iov_len / sizeof(*addrs);
+
+		/* More addresses than fit also triggers the
+		 * accept-all filter, so clamping is safe. */
+		if (naddrs > __arraycount(addrs))
+			naddrs = __arraycount(addrs);
+		memcpy(addrs, iov->iov_base, naddrs * sizeof(*addrs));
+		return bpf_arp_addrs(psp->psp_bpf, addrs, naddrs);
+	}
+#endif
+
 	return bpf_send(psp->psp_bpf, psp->psp_proto,
 	    iov->iov_base, iov->iov_len);
 }
@@ -281,7 +312,7 @@ ps_bpf_dispatch(struct dhcpcd_ctx *ctx,
 		return -1;
 	}
 
-	ifp = if_findindex(ctx->ifaces, psm->ps_id.psi_ifindex);
+	ifp = if_findindex(ctx, psm->ps_id.psi_ifindex);
 	/* interface may have departed .... */
 	if (ifp == NULL)
 		return -1;
@@ -324,28 +355,43 @@ ps_bpf_send(const struct interface *ifp, const struct in_addr *ia,
 
 #ifdef ARP
 ssize_t
-ps_bpf_openarp(const struct interface *ifp, const struct in_addr *ia)
+ps_bpf_openarp(const struct interface *ifp)
 {
 
-	assert(ia != NULL);
-	return ps_bpf_send(ifp, ia, PS_BPF_ARP | PS_START,
+	return ps_bpf_send(ifp, NULL, PS_BPF_ARP | PS_START,
 	    ifp, sizeof(*ifp));
 }
 
 ssize_t
-ps_bpf_closearp(const struct interface *ifp, const struct in_addr *ia)
+ps_bpf_closearp(const struct interface *ifp)
 {
 
-	return ps_bpf_send(ifp, ia, PS_BPF_ARP | PS_STOP, NULL, 0);
+	return ps_bpf_send(ifp, NULL, PS_BPF_ARP | PS_STOP, NULL, 0);
+}
+
+ssize_t
+ps_bpf_addrsarp(const struct interface *ifp,
+    const struct in_addr *addrs, size_t naddrs)
+{
+	struct dhcpcd_ctx *ctx = ifp->ctx;
+	struct ps_msghdr psm = {
+		.ps_cmd = PS_BPF_ARP_ADDRS,
+		.ps_id = {
+			.psi_ifindex = ifp->index,
+			/* Address the existing ARP process. */
+			.psi_cmd = PS_BPF_ARP,
+		},
+	};
+
+	return ps_sendpsmdata(ctx, ctx->ps_root_fd, &psm,
+	    addrs, naddrs * sizeof(*addrs));
 }
 
 ssize_t
-ps_bpf_sendarp(const struct interface *ifp, const struct in_addr *ia,
-    const void *data, size_t len)
+ps_bpf_sendarp(const struct interface *ifp, const void *data, size_t len)
 {
 
-	assert(ia != NULL);
-	return ps_bpf_send(ifp, ia, PS_BPF_ARP, data, len);
+	return ps_bpf_send(ifp, NULL, PS_BPF_ARP, data, len);
 }
 #endif
 
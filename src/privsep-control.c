@@ -90,6 +90,34 @@ ps_ctl_recvmsg(void *arg)
 		logerr(__func__);
 }
 
+/* Patterns arrive as NUL separated arguments after the command.
+ * Strip any trailing newline as the text protocol terminates
+ * the last argument with one. */
+static void
+ps_ctl_subscribe(struct fd_list *fd, char *data, size_t len)
+{
+	char *e = data + len, *p, *n;
+	size_t l;
+
+	fd->listen_if[0] = fd->listen_reason[0] = '\0';
+	p = memchr(data, '\0', len);
+	if (p == NULL || ++p == e)
+		return;
+	n = memchr(p, '\0', (size_t)(e - p));
+	if (n == NULL)
+		return;
+	strlcpy(fd->listen_if, p, sizeof(fd->listen_if));
+	p = n + 1;
+	if (p < e && memchr(p, '\0', (size_t)(e - p)) != NULL)
+		strlcpy(fd->listen_reason, p, sizeof(fd->listen_reason));
+	l = strlen(fd->listen_if);
+	if (l != 0 && fd->listen_if[l - 1] == '\n')
+		fd->listen_if[l - 1] = '\0';
+	l = strlen(fd->listen_reason);
+	if (l != 0 && fd->listen_reason[l - 1] == '\n')
+		fd->listen_reason[l - 1] = '\0';
+}
+
 ssize_t
 ps_ctl_handleargs(struct fd_list *fd, char *data, size_t len)
 {
@@ -107,6 +135,11 @@ ps_ctl_handleargs(struct fd_list *fd, char *data, size_t len)
 	    MIN(strlen("--listen"), len)) == 0) {
 		fd->flags |= FD_LISTEN;
 		return 0;
+	} else if (strncmp(data, "--subscribe",
+	    MIN(strlen("--subscribe"), len)) == 0) {
+		fd->flags |= FD_LISTEN;
+		ps_ctl_subscribe(fd, data, len);
+		return 0;
 	}
 
 	if (fd->ctx->ps_control_client != NULL &&
@@ -196,7 +229,7 @@ ps_ctl_listen(void *arg)
 	struct dhcpcd_ctx *ctx = arg;
 	char buf[BUFSIZ];
 	ssize_t len;
-	struct fd_list *fd;
+	struct fd_list *fd, *fdn;
 
 	errno = 0;
 	len = read(ctx->ps_control->fd, buf, sizeof(buf));
@@ -207,11 +240,18 @@ ps_ctl_listen(void *arg)
 	}
 
 	/* Send to our listeners */
-	TAILQ_FOREACH(fd, &ctx->control_fds, next) {
+	TAILQ_FOREACH_SAFE(fd, &ctx->control_fds, next, fdn) {
 		if (!(fd->flags & FD_LISTEN))
 			continue;
-		if (control_queue(fd, buf, (size_t)len)== -1)
+		if (!control_listen_match(fd, buf, (size_t)len))
+			continue;
+		if (control_queue(fd, buf, (size_t)len)== -1) {
 			logerr("%s: control_queue", __func__);
+			/* Disconnect a client too slow to drain
+			 * its queue rather than growing it. */
+			if (errno == ENOBUFS)
+				control_delete(fd);
+		}
 	}
 }
 
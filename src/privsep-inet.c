@@ -151,8 +151,11 @@ ps_inet_startcb(void *arg)
 			logerr("%s: eloop_event_add DHCP", __func__);
 			close(ctx->udp_rfd);
 			ctx->udp_rfd = -1;
-		} else
+		} else {
+			eloop_event_priority(ctx->eloop, ctx->udp_rfd,
+			    ELOOP_PRIO_HIGH);
 			ret++;
+		}
 	}
 #endif
 #if defined(INET6) && !defined(__sun)
@@ -173,8 +176,11 @@ ps_inet_startcb(void *arg)
 			logerr("%s: eloop_event_add RA", __func__);
 			close(ctx->nd_fd);
 			ctx->nd_fd = -1;
-		} else
+		} else {
+			eloop_event_priority(ctx->eloop, ctx->nd_fd,
+			    ELOOP_PRIO_HIGH);
 			ret++;
+		}
 	}
 #endif
 #ifdef DHCP6
@@ -197,8 +203,11 @@ ps_inet_startcb(void *arg)
 			logerr("%s: eloop_event_add DHCP6", __func__);
 			close(ctx->dhcp6_rfd);
 			ctx->dhcp6_rfd = -1;
-		} else
+		} else {
+			eloop_event_priority(ctx->eloop, ctx->dhcp6_rfd,
+			    ELOOP_PRIO_HIGH);
 			ret++;
+		}
 	}
 #endif
 
@@ -408,6 +417,8 @@ ps_inet_listenin(void *arg)
 		logerr("%s: eloop_event_add DHCP", __func__);
 		return -1;
 	}
+	eloop_event_priority(psp->psp_ctx->eloop, psp->psp_work_fd,
+	    ELOOP_PRIO_HIGH);
 
 	logdebugx("spawned listener %s on PID %d", buf, getpid());
 	return 0;
@@ -451,6 +462,8 @@ ps_inet_listennd(void *arg)
 		logerr(__func__);
 		return -1;
 	}
+	eloop_event_priority(psp->psp_ctx->eloop, psp->psp_work_fd,
+	    ELOOP_PRIO_HIGH);
 
 	logdebugx("spawned ND listener on PID %d", getpid());
 	return 0;
@@ -497,6 +510,8 @@ ps_inet_listenin6(void *arg)
 		logerr("%s: eloop_event_add DHCP", __func__);
 		return -1;
 	}
+	eloop_event_priority(psp->psp_ctx->eloop, psp->psp_work_fd,
+	    ELOOP_PRIO_HIGH);
 
 	logdebugx("spawned listener %s on PID %d", buf, getpid());
 	return 0;
@@ -109,6 +109,20 @@ ps_root_sendnetlink(struct dhcpcd_ctx *ctx, int protocol, struct msghdr *msg)
 	return ps_root_readerror(ctx, NULL, 0);
 }
 
+/* As above, but don't wait for the result.
+ * The callback is invoked from the main eloop when it arrives,
+ * so a batch of messages can be pipelined. */
+ssize_t
+ps_root_sendnetlink_async(struct dhcpcd_ctx *ctx, int protocol,
+    struct msghdr *msg, void (*cb)(void *, ssize_t, int), void *arg)
+{
+
+	if (ps_sendmsg(ctx, ctx->ps_root_fd, PS_ROUTE,
+	    (unsigned long)protocol, msg) == -1)
+		return -1;
+	return ps_root_async(ctx, cb, arg);
+}
+
 #if (BYTE_ORDER == LITTLE_ENDIAN)
 # define SECCOMP_ARG_LO	0
 # define SECCOMP_ARG_HI	sizeof(uint32_t)
@@ -279,6 +293,18 @@ static struct sock_filter ps_seccomp_filter[] = {
 #ifdef __NR_close
 	SECCOMP_ALLOW(__NR_close),
 #endif
+#ifdef __NR_epoll_create1
+	SECCOMP_ALLOW(__NR_epoll_create1),
+#endif
+#ifdef __NR_epoll_ctl
+	SECCOMP_ALLOW(__NR_epoll_ctl),
+#endif
+#ifdef __NR_epoll_pwait
+	SECCOMP_ALLOW(__NR_epoll_pwait),
+#endif
+#ifdef __NR_epoll_wait
+	SECCOMP_ALLOW(__NR_epoll_wait),
+#endif
 #ifdef __NR_exit_group
 	SECCOMP_ALLOW(__NR_exit_group),
 #endif
@@ -294,12 +320,21 @@ static struct sock_filter ps_seccomp_filter[] = {
 #ifdef __NR_fstat64
 	SECCOMP_ALLOW(__NR_fstat64),
 #endif
+#ifdef __NR_ftruncate
+	SECCOMP_ALLOW(__NR_ftruncate),
+#endif
+#ifdef __NR_ftruncate64
+	SECCOMP_ALLOW(__NR_ftruncate64),
+#endif
 #ifdef __NR_gettimeofday
 	SECCOMP_ALLOW(__NR_gettimeofday),
 #endif
 #ifdef __NR_getpid
 	SECCOMP_ALLOW(__NR_getpid),
 #endif
+#ifdef __NR_getrandom
+	SECCOMP_ALLOW(__NR_getrandom),
+#endif
 #ifdef __NR_getsockopt
 	/* For route socket overflow */
 	SECCOMP_ALLOW_ARG(__NR_getsockopt, 1, SOL_SOCKET),
@@ -316,6 +351,12 @@ static struct sock_filter ps_seccomp_filter[] = {
 	/* SECCOMP BPF is newer than nl80211 so we don't need SIOCGIWESSID
 	 * which lives in the impossible to include linux/wireless.h header */
 #endif
+#ifdef __NR_lseek
+	SECCOMP_ALLOW(__NR_lseek),
+#endif
+#ifdef __NR__llseek
+	SECCOMP_ALLOW(__NR__llseek),
+#endif
 #ifdef __NR_mmap
 	SECCOMP_ALLOW(__NR_mmap),
 #endif
@@ -358,6 +399,11 @@ static struct sock_filter ps_seccomp_filter[] = {
 #ifdef __NR_sendto
 	SECCOMP_ALLOW(__NR_sendto),
 #endif
+#ifdef __NR_setsockopt
+	/* For filtering denied interfaces on the link socket */
+	SECCOMP_ALLOW_ARG(__NR_setsockopt, 2, SO_ATTACH_FILTER),
+	SECCOMP_ALLOW_ARG(__NR_setsockopt, 2, SO_DETACH_FILTER),
+#endif
 #ifdef __NR_socketcall
 	/* i386 needs this and demonstrates why SECCOMP
 	 * is poor compared to OpenBSD pledge(2) and FreeBSD capsicum(4)
@@ -373,6 +419,7 @@ static struct sock_filter ps_seccomp_filter[] = {
 	SECCOMP_ALLOW_ARG(__NR_socketcall, 0, SYS_SEND),
 	SECCOMP_ALLOW_ARG(__NR_socketcall, 0, SYS_SENDMSG),
 	SECCOMP_ALLOW_ARG(__NR_socketcall, 0, SYS_SENDTO),
+	SECCOMP_ALLOW_ARG(__NR_socketcall, 0, SYS_SETSOCKOPT),	/* link filter */
 	SECCOMP_ALLOW_ARG(__NR_socketcall, 0, SYS_SHUTDOWN),
 #endif
 #ifdef __NR_shutdown
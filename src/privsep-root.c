@@ -71,8 +71,139 @@ struct psr_ctx {
 	struct psr_error psr_error;
 	size_t psr_datalen;
 	void *psr_data;
+	int psr_fd;	/* file descriptor passed with the reply */
 };
 
+/* A pipelined request awaiting completion.
+ * The root process answers requests strictly in the order received,
+ * so completions are correlated by queue position rather than an id
+ * on the wire. */
+struct ps_async_op {
+	TAILQ_ENTRY(ps_async_op) next;
+	void (*psa_cb)(void *, ssize_t, int);
+	void *psa_arg;
+};
+
+/* Read one completion and hand it to the oldest pipelined request. */
+static ssize_t
+ps_root_recvasync(struct dhcpcd_ctx *ctx)
+{
+	struct psr_error psr;
+	struct iovec iov[] = {
+		{ .iov_base = &psr, .iov_len = sizeof(psr) },
+		{ .iov_base = NULL, .iov_len = 0 },
+	};
+	struct ps_async_op *psa;
+	void *data = NULL;
+	ssize_t len;
+
+	len = recv(ctx->ps_root_fd, &psr, sizeof(psr), MSG_PEEK);
+	if (len == -1)
+		return -1;
+	if ((size_t)len < sizeof(psr)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (psr.psr_datalen != 0) {
+		if (psr.psr_datalen > SSIZE_MAX) {
+			errno = ENOBUFS;
+			return -1;
+		}
+		data = malloc(psr.psr_datalen);
+		if (data == NULL)
+			return -1;
+		iov[1].iov_base = data;
+		iov[1].iov_len = psr.psr_datalen;
+	}
+	len = readv(ctx->ps_root_fd, iov, __arraycount(iov));
+	free(data);
+	if (len == -1)
+		return -1;
+
+	psa = TAILQ_FIRST(&ctx->ps_async_ops);
+	if (psa == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	TAILQ_REMOVE(&ctx->ps_async_ops, psa, next);
+	if (--ctx->ps_async_len == 0)
+		eloop_event_delete(ctx->eloop, ctx->ps_root_fd);
+	if (psa->psa_cb != NULL)
+		psa->psa_cb(psa->psa_arg, psr.psr_result, psr.psr_errno);
+	free(psa);
+	return 1;
+}
+
+static void
+ps_root_asynccb(void *arg)
+{
+	struct dhcpcd_ctx *ctx = arg;
+
+	if (ps_root_recvasync(ctx) == -1 &&
+	    errno != EAGAIN && errno != EINTR)
+		logerr(__func__);
+}
+
+/* Queue a completion callback for a request just sent to the
+ * privileged process.  Completions are reaped from the main eloop
+ * as they arrive, so callers can pipeline a batch of requests
+ * without a round trip for each one. */
+int
+ps_root_async(struct dhcpcd_ctx *ctx,
+    void (*cb)(void *, ssize_t, int), void *arg)
+{
+	struct ps_async_op *psa;
+
+	psa = malloc(sizeof(*psa));
+	if (psa == NULL)
+		return -1;
+	psa->psa_cb = cb;
+	psa->psa_arg = arg;
+	if (ctx->ps_async_len == 0 &&
+	    eloop_event_add(ctx->eloop, ctx->ps_root_fd,
+	    ps_root_asynccb, ctx) == -1)
+	{
+		free(psa);
+		return -1;
+	}
+	TAILQ_INSERT_TAIL(&ctx->ps_async_ops, psa, next);
+	ctx->ps_async_len++;
+	return 0;
+}
+
+static void
+ps_root_asyncflushcb(void *arg)
+{
+	struct dhcpcd_ctx *ctx = arg;
+
+	if (ps_root_recvasync(ctx) == -1 &&
+	    errno != EAGAIN && errno != EINTR)
+	{
+		eloop_exit(ctx->ps_eloop, EXIT_FAILURE);
+		return;
+	}
+	if (ctx->ps_async_len == 0)
+		eloop_exit(ctx->ps_eloop, EXIT_SUCCESS);
+}
+
+/* Wait for every pipelined request to complete. */
+int
+ps_root_asyncflush(struct dhcpcd_ctx *ctx)
+{
+
+	if (ctx->ps_async_len == 0)
+		return 0;
+
+	if (eloop_event_add(ctx->ps_eloop, ctx->ps_root_fd,
+	    ps_root_asyncflushcb, ctx) == -1)
+		return -1;
+
+	eloop_enter(ctx->ps_eloop);
+	if (eloop_start(ctx->ps_eloop, &ctx->sigset) != EXIT_SUCCESS)
+		return -1;
+	return 0;
+}
+
 static void
 ps_root_readerrorcb(void *arg)
 {
@@ -84,6 +215,16 @@ ps_root_readerrorcb(void *arg)
 		{ .iov_base = psr_ctx->psr_data,
 		  .iov_len = psr_ctx->psr_datalen },
 	};
+	union {
+		struct cmsghdr hdr;
+		uint8_t buf[CMSG_SPACE(sizeof(int))];
+	} cmsgbuf = { .buf = { 0 } };
+	struct msghdr msg = {
+		.msg_iov = iov, .msg_iovlen = __arraycount(iov),
+		.msg_control = cmsgbuf.buf,
+		.msg_controllen = sizeof(cmsgbuf.buf),
+	};
+	struct cmsghdr *cm;
 	ssize_t len;
 	int exit_code = EXIT_FAILURE;
 
@@ -94,23 +235,41 @@ ps_root_readerrorcb(void *arg)
 		goto out;			\
 	} while (0 /* CONSTCOND */)
 
-	len = readv(ctx->ps_root_fd, iov, __arraycount(iov));
+	/* Pipelined requests were sent first so their completions
+	 * arrive before the reply to this synchronous request. */
+	if (ctx->ps_async_len != 0) {
+		if (ps_root_recvasync(ctx) == -1 &&
+		    errno != EAGAIN && errno != EINTR)
+			PSR_ERROR(errno);
+		return;
+	}
+
+	len = recvmsg(ctx->ps_root_fd, &msg, 0);
 	if (len == -1)
 		PSR_ERROR(errno);
 	else if ((size_t)len < sizeof(*psr_error))
 		PSR_ERROR(EINVAL);
+
+	/* Pick up any file descriptor passed back with the reply. */
+	for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+		if (cm->cmsg_level == SOL_SOCKET &&
+		    cm->cmsg_type == SCM_RIGHTS &&
+		    cm->cmsg_len == CMSG_LEN(sizeof(int)))
+			memcpy(&psr_ctx->psr_fd, CMSG_DATA(cm), sizeof(int));
+	}
 	exit_code = EXIT_SUCCESS;
 
 out:
 	eloop_exit(ctx->ps_eloop, exit_code);
 }
 
-ssize_t
-ps_root_readerror(struct dhcpcd_ctx *ctx, void *data, size_t len)
+static ssize_t
+ps_root_readerrorfd(struct dhcpcd_ctx *ctx, void *data, size_t len, int *rfd)
 {
 	struct psr_ctx psr_ctx = {
 	    .psr_ctx = ctx,
 	    .psr_data = data, .psr_datalen = len,
+	    .psr_fd = -1,
 	};
 
 	if (eloop_event_add(ctx->ps_eloop, ctx->ps_root_fd,
@@ -120,10 +279,23 @@ ps_root_readerror(struct dhcpcd_ctx *ctx, void *data, size_t len)
 	eloop_enter(ctx->ps_eloop);
 	eloop_start(ctx->ps_eloop, &ctx->sigset);
 
+	if (rfd != NULL)
+		*rfd = psr_ctx.psr_fd;
+	else if (psr_ctx.psr_fd != -1)
+		/* Not expecting a descriptor, don't leak it. */
+		close(psr_ctx.psr_fd);
+
 	errno = psr_ctx.psr_error.psr_errno;
 	return psr_ctx.psr_error.psr_result;
 }
 
+ssize_t
+ps_root_readerror(struct dhcpcd_ctx *ctx, void *data, size_t len)
+{
+
+	return ps_root_readerrorfd(ctx, data, len, NULL);
+}
+
 #ifdef PRIVSEP_GETIFADDRS
 static void
 ps_root_mreaderrorcb(void *arg)
@@ -138,6 +310,15 @@ ps_root_mreaderrorcb(void *arg)
 	ssize_t len;
 	int exit_code = EXIT_FAILURE;
 
+	/* Pipelined requests were sent first so their completions
+	 * arrive before the reply to this synchronous request. */
+	if (ctx->ps_async_len != 0) {
+		if (ps_root_recvasync(ctx) == -1 &&
+		    errno != EAGAIN && errno != EINTR)
+			PSR_ERROR(errno);
+		return;
+	}
+
 	len = recv(ctx->ps_root_fd, psr_error, sizeof(*psr_error), MSG_PEEK);
 	if (len == -1)
 		PSR_ERROR(errno);
@@ -189,7 +370,7 @@ ps_root_mreaderror(struct dhcpcd_ctx *ctx, void **data, size_t *len)
 
 static ssize_t
 ps_root_writeerror(struct dhcpcd_ctx *ctx, ssize_t result,
-    void *data, size_t len)
+    void *data, size_t len, int fd)
 {
 	struct psr_error psr = {
 		.psr_result = result,
@@ -200,12 +381,30 @@ ps_root_writeerror(struct dhcpcd_ctx *ctx, ssize_t result,
 		{ .iov_base = &psr, .iov_len = sizeof(psr) },
 		{ .iov_base = data, .iov_len = len },
 	};
+	union {
+		struct cmsghdr hdr;
+		uint8_t buf[CMSG_SPACE(sizeof(int))];
+	} cmsgbuf = { .buf = { 0 } };
+	struct msghdr msg = {
+		.msg_iov = iov, .msg_iovlen = __arraycount(iov),
+	};
+	struct cmsghdr *cm;
+
+	if (fd != -1) {
+		msg.msg_control = cmsgbuf.buf;
+		msg.msg_controllen = sizeof(cmsgbuf.buf);
+		cm = CMSG_FIRSTHDR(&msg);
+		cm->cmsg_level = SOL_SOCKET;
+		cm->cmsg_type = SCM_RIGHTS;
+		cm->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cm), &fd, sizeof(fd));
+	}
 
 #ifdef PRIVSEP_DEBUG
 	logdebugx("%s: result %zd errno %d", __func__, result, errno);
 #endif
 
-	return writev(ctx->ps_root_fd, iov, __arraycount(iov));
+	return sendmsg(ctx->ps_root_fd, &msg, 0);
 }
 
 static ssize_t
@@ -253,6 +452,159 @@ ps_root_doioctl(unsigned long req, void *data, size_t len)
 	return err;
 }
 
+struct ps_script_status {
+	ssize_t psc_result;
+	int psc_errno;
+};
+
+/* Loop in a small pre-forked process executing hooks on demand.
+ * The environment arrives as one datagram and the wait status is
+ * sent back, so the expensive part of running a hook - duplicating
+ * the address space of the privileged proxy - is paid once at
+ * startup by a process which stays tiny. */
+static void
+ps_script_run(struct dhcpcd_ctx *ctx, int fd)
+{
+	char * const argv[] = { ctx->script, NULL };
+	struct ps_script_status psc;
+	char *buf;
+	ssize_t len;
+	pid_t pid;
+	int status;
+
+	setproctitle("[script runner]");
+
+	/* The manager detects the privileged proxy going away by
+	 * descriptor EOF, so don't hold its sockets open. */
+	if (ctx->ps_root_fd != -1) {
+		close(ctx->ps_root_fd);
+		ctx->ps_root_fd = -1;
+	}
+	if (ctx->ps_data_fd != -1) {
+		close(ctx->ps_data_fd);
+		ctx->ps_data_fd = -1;
+	}
+
+	if (ctx->ps_script_map != NULL)
+		/* The environment is read from the shared map,
+		 * only its length arrives on the socket. */
+		buf = ctx->ps_script_map;
+	else if ((buf = malloc(PS_BUFLEN)) == NULL) {
+		logerr(__func__);
+		exit(EXIT_FAILURE);
+	}
+
+	for (;;) {
+		if (ctx->ps_script_map != NULL) {
+			size_t maplen;
+
+			len = recv(fd, &maplen, sizeof(maplen), 0);
+			if (len == 0)
+				break;
+			if (len == -1) {
+				if (errno == EINTR)
+					continue;
+				logerr(__func__);
+				break;
+			}
+			if ((size_t)len != sizeof(maplen) ||
+			    maplen == 0 || maplen > ctx->ps_script_maplen)
+			{
+				psc.psc_result = -1;
+				psc.psc_errno = EINVAL;
+				goto sendstatus;
+			}
+			len = (ssize_t)maplen;
+		} else {
+			len = recv(fd, buf, PS_BUFLEN, 0);
+			if (len == 0)
+				break;
+			if (len == -1) {
+				if (errno == EINTR)
+					continue;
+				logerr(__func__);
+				break;
+			}
+		}
+
+		psc.psc_result = 0;
+		psc.psc_errno = 0;
+		if (script_buftoenv(ctx, buf, (size_t)len) == NULL ||
+		    (pid = script_exec(argv, ctx->script_env)) == -1)
+		{
+			psc.psc_result = -1;
+			psc.psc_errno = errno;
+		} else {
+			/* Wait for the script to finish */
+			while (waitpid(pid, &status, 0) == -1) {
+				if (errno != EINTR) {
+					logerr(__func__);
+					status = 0;
+					break;
+				}
+			}
+			psc.psc_result = status;
+		}
+
+sendstatus:
+		if (send(fd, &psc, sizeof(psc), 0) == -1) {
+			logerr(__func__);
+			break;
+		}
+	}
+
+	if (buf != ctx->ps_script_map)
+		free(buf);
+	exit(EXIT_SUCCESS);
+}
+
+static int
+ps_script_start(struct dhcpcd_ctx *ctx)
+{
+	int fd[2];
+	pid_t pid;
+
+	if (ctx->script == NULL)
+		return 0;
+
+	/* Both ends block - the runner has nothing else to do and
+	 * we always want the hook exit status.
+	 * SOCK_SEQPACKET keeps the message boundaries of SOCK_DGRAM
+	 * but reports EOF, so the runner exits with us. */
+	if (xsocketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fd) == -1) {
+		logerr("%s: socketpair", __func__);
+		return -1;
+	}
+	if (ps_setbuf_fdpair(fd) == -1) {
+		logerr("%s: ps_setbuf_fdpair", __func__);
+		return -1;
+	}
+#ifdef PRIVSEP_RIGHTS
+	if (ps_rights_limit_fdpair(fd) == -1) {
+		logerr("%s: ps_rights_limit_fdpair", __func__);
+		return -1;
+	}
+#endif
+
+	switch (pid = fork()) {
+	case -1:
+		logerr("%s: fork", __func__);
+		close(fd[0]);
+		close(fd[1]);
+		return -1;
+	case 0:
+		close(fd[0]);
+		ps_script_run(ctx, fd[1]);
+		/* NOTREACHED */
+		return 0;
+	default:
+		close(fd[1]);
+		ctx->ps_script_pid = pid;
+		ctx->ps_script_fd = fd[0];
+		return 0;
+	}
+}
+
 static ssize_t
 ps_root_run_script(struct dhcpcd_ctx *ctx, const void *data, size_t len)
 {
@@ -264,6 +616,53 @@ ps_root_run_script(struct dhcpcd_ctx *ctx, const void *data, size_t len)
 	if (len == 0)
 		return 0;
 
+	if (ctx->script_jobs > 1) {
+		const char *ifname = "", *ep = envbuf + len, *e;
+
+		/* Queue on the interface the environment was built for. */
+		for (e = envbuf; e < ep; e += strlen(e) + 1) {
+			if (strncmp(e, "interface=",
+			    strlen("interface=")) == 0) {
+				ifname = e + strlen("interface=");
+				break;
+			}
+		}
+		return script_queue(ctx, ifname, envbuf, len);
+	}
+
+	if (ctx->ps_script_fd != -1) {
+		struct ps_script_status psc;
+		ssize_t r;
+
+		/* The runner shares the map, so only the length needs
+		 * to travel.  The environment is normally in the map
+		 * already; a socket fallback cannot exceed its size. */
+		if (ctx->ps_script_map != NULL) {
+			if (envbuf != ctx->ps_script_map)
+				memcpy(ctx->ps_script_map, envbuf, len);
+			r = send(ctx->ps_script_fd, &len, sizeof(len), 0);
+		} else
+			r = send(ctx->ps_script_fd, envbuf, len, 0);
+		if (r == -1)
+			logerr(__func__);
+		else {
+			while ((r = recv(ctx->ps_script_fd, &psc,
+			    sizeof(psc), 0)) == -1 && errno == EINTR)
+				;
+			if (r == sizeof(psc)) {
+				errno = psc.psc_errno;
+				return psc.psc_result;
+			}
+			if (r == -1)
+				logerr(__func__);
+			else
+				logerrx("%s: script runner died", __func__);
+		}
+		/* Fall back to forking each hook ourselves. */
+		close(ctx->ps_script_fd);
+		ctx->ps_script_fd = -1;
+	}
+
 	if (script_buftoenv(ctx, UNCONST(envbuf), len) == NULL)
 		return -1;
 
@@ -303,6 +702,18 @@ ps_root_validpath(const struct dhcpcd_ctx *ctx, uint16_t cmd, const char *path)
 	if (strncmp(RUNDIR, path, strlen(RUNDIR)) == 0)
 		return true;
 
+#ifndef SMALL
+	/* The built-in resolv.conf hook writes where
+	 * the shell hook would have. */
+	if (cmd == PS_WRITEFILE && strcmp(path, "/etc/resolv.conf") == 0)
+		return true;
+	if (cmd == PS_READFILE &&
+	    (strcmp(path, "/etc/resolv.conf") == 0 ||
+	    strcmp(path, "/etc/resolv.conf.head") == 0 ||
+	    strcmp(path, "/etc/resolv.conf.tail") == 0))
+		return true;
+#endif
+
 #ifdef __linux__
 	if (strncmp("/proc/net/", path, strlen("/proc/net/")) == 0 ||
 	    strncmp("/proc/sys/net/", path, strlen("/proc/sys/net/")) == 0 ||
@@ -332,6 +743,26 @@ ps_root_dowritefile(const struct dhcpcd_ctx *ctx,
 	return writefile(file, mode, nc, len - (size_t)(nc - file));
 }
 
+/* Open a file for writing and pass the descriptor back so the
+ * unprivileged process can write to it directly rather than copying
+ * the payload over the socket for every commit. */
+static ssize_t
+ps_root_doopenfile(const struct dhcpcd_ctx *ctx, mode_t mode,
+    void *data, size_t len, int *rfd)
+{
+	char *file = data;
+
+	if (len == 0 || memchr(file, '\0', len) == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!ps_root_validpath(ctx, PS_OPENFILE, file))
+		return -1;
+	*rfd = open(file, O_WRONLY | O_CREAT | O_CLOEXEC, mode);
+	return *rfd == -1 ? -1 : 0;
+}
+
 #ifdef AUTH
 static ssize_t
 ps_root_monordm(uint64_t *rdm, size_t len)
@@ -387,6 +818,13 @@ ps_root_dogetifaddrs(void **rdata, size_t *rlen)
 		if (ifa->ifa_addr != NULL &&
 		    ifa->ifa_addr->sa_family == AF_LINK)
 			len += ALIGN(sizeof(struct if_data));
+#elif defined(__linux__)
+		/*
+		 * On Linux ifa_data carries the address flags,
+		 * see if_getifaddrs() in if-linux.c.
+		 */
+		if (ifa->ifa_data != NULL)
+			len += ALIGN(sizeof(int));
 #endif
 	}
 
@@ -436,6 +874,12 @@ ps_root_dogetifaddrs(void **rdata, size_t *rlen)
 			memcpy(buf, ifa->ifa_data, salen);
 			buf += ALIGN(salen);
 		} else
+#elif defined(__linux__)
+		if (ifa->ifa_data != NULL) {
+			salen = (socklen_t)sizeof(int);
+			memcpy(buf, ifa->ifa_data, salen);
+			buf += ALIGN(salen);
+		} else
 #endif
 			salen = 0;
 		memcpy(sap, &salen, sizeof(salen));
@@ -458,6 +902,7 @@ ps_root_recvmsgcb(void *arg, struct ps_msghdr *psm, struct msghdr *msg)
 	uint8_t buf[PS_BUFLEN];
 	time_t mtime;
 	ssize_t err;
+	int rfd = -1;
 	bool free_rdata = false;
 
 	cmd = (uint16_t)(psm->ps_cmd & ~(PS_START | PS_STOP));
@@ -530,6 +975,15 @@ ps_root_recvmsgcb(void *arg, struct ps_msghdr *psm, struct msghdr *msg)
 		}
 		break;
 	case PS_SCRIPT:
+		/* A length in ps_flags means the environment is in the
+		 * shared map rather than the message. */
+		if (len == 0 && psm->ps_flags != 0 &&
+		    ctx->ps_script_map != NULL &&
+		    psm->ps_flags <= ctx->ps_script_maplen)
+		{
+			data = ctx->ps_script_map;
+			len = (size_t)psm->ps_flags;
+		}
 		err = ps_root_run_script(ctx, data, len);
 		break;
 	case PS_UNLINK:
@@ -554,6 +1008,15 @@ ps_root_recvmsgcb(void *arg, struct ps_msghdr *psm, struct msghdr *msg)
 		err = ps_root_dowritefile(ctx, (mode_t)psm->ps_flags,
 		    data, len);
 		break;
+	case PS_OPENFILE:
+		err = ps_root_doopenfile(ctx, (mode_t)psm->ps_flags,
+		    data, len, &rfd);
+		break;
+#ifndef SMALL
+	case PS_SETHOSTNAME:
+		err = sethostname(data, strlen(data));
+		break;
+#endif
 	case PS_FILEMTIME:
 		err = filemtime(data, &mtime);
 		if (err != -1) {
@@ -597,7 +1060,9 @@ ps_root_recvmsgcb(void *arg, struct ps_msghdr *psm, struct msghdr *msg)
 		break;
 	}
 
-	err = ps_root_writeerror(ctx, err, rlen != 0 ? rdata : 0, rlen);
+	err = ps_root_writeerror(ctx, err, rlen != 0 ? rdata : 0, rlen, rfd);
+	if (rfd != -1)
+		close(rfd);
 	if (free_rdata)
 		free(rdata);
 	return err;
@@ -651,6 +1116,9 @@ ps_root_startcb(void *arg)
 	ctx->ps_root_pid = getpid();
 	ctx->options |= DHCPCD_PRIVSEPROOT;
 
+	/* Pre-fork the hook script runner while this process is small. */
+	ps_script_start(ctx);
+
 	/* Open network sockets for sending.
 	 * This is a small bit wasteful for non sandboxed OS's
 	 * but makes life very easy for unicasting DHCPv6 in non manager
@@ -709,12 +1177,16 @@ ps_root_startcb(void *arg)
 }
 
 static void
-ps_root_signalcb(int sig, __unused void *arg)
+ps_root_signalcb(int sig, void *arg)
 {
+	struct dhcpcd_ctx *ctx = arg;
 
 	if (sig == SIGCHLD) {
-		while (waitpid(-1, NULL, WNOHANG) > 0)
-			;
+		int status;
+		pid_t pid;
+
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+			script_reap(ctx, pid, status);
 		return;
 	}
 }
@@ -778,9 +1250,24 @@ static void
 ps_root_dispatch(void *arg)
 {
 	struct dhcpcd_ctx *ctx = arg;
+	unsigned int budget = PS_DISPATCH_BUDGET;
 
-	if (ps_recvpsmsg(ctx, ctx->ps_data_fd, ps_root_dispatchcb, ctx) == -1)
-		logerr(__func__);
+	/* Burst receives cause one wakeup per queued message.
+	 * Drain what has queued, within budget so other
+	 * events still get a look in. */
+	while (budget-- != 0) {
+		ssize_t err;
+
+		err = ps_recvpsmsg(ctx, ctx->ps_data_fd,
+		    ps_root_dispatchcb, ctx);
+		if (err == -1) {
+			if (errno != EAGAIN && errno != EINTR)
+				logerr(__func__);
+			break;
+		}
+		if (err < 1)
+			break;
+	}
 }
 
 static void
@@ -792,6 +1279,26 @@ ps_root_log(void *arg)
 		logerr(__func__);
 }
 
+static void
+ps_root_logdrain(__unused void *arg)
+{
+
+	(void)logdrain();
+}
+
+/* Toggle an eloop writer to drain messages the log fd refused. */
+static void
+ps_root_logqueued(void *arg, int queued)
+{
+	struct dhcpcd_ctx *ctx = arg;
+
+	if (queued)
+		(void)eloop_event_add_w(ctx->eloop, loggetfd(),
+		    ps_root_logdrain, ctx);
+	else
+		eloop_event_remove_writecb(ctx->eloop, loggetfd());
+}
+
 pid_t
 ps_root_start(struct dhcpcd_ctx *ctx)
 {
@@ -831,6 +1338,7 @@ ps_root_start(struct dhcpcd_ctx *ctx)
 		return -1;
 
 	logsetfd(logfd[0]);
+	logsetwritecb(ps_root_logqueued, ctx);
 	close(logfd[1]);
 
 	ctx->ps_data_fd = datafd[0];
@@ -852,6 +1360,14 @@ ps_root_start(struct dhcpcd_ctx *ctx)
 int
 ps_root_stop(struct dhcpcd_ctx *ctx)
 {
+	struct ps_async_op *psa;
+
+	/* Discard pipelined requests we will no longer reap. */
+	while ((psa = TAILQ_FIRST(&ctx->ps_async_ops)) != NULL) {
+		TAILQ_REMOVE(&ctx->ps_async_ops, psa, next);
+		free(psa);
+	}
+	ctx->ps_async_len = 0;
 
 	return ps_dostop(ctx, &ctx->ps_root_pid, &ctx->ps_root_fd);
 }
@@ -860,6 +1376,20 @@ ssize_t
 ps_root_script(struct dhcpcd_ctx *ctx, const void *data, size_t len)
 {
 
+	/* Hand over just the length when the environment fits the
+	 * shared map - the privileged proxy and its script runner read
+	 * it straight out of the map.  We block for the hook status so
+	 * the map cannot be overwritten while they do. */
+	if (ctx->ps_script_map != NULL && len != 0 &&
+	    len <= ctx->ps_script_maplen)
+	{
+		memcpy(ctx->ps_script_map, data, len);
+		if (ps_sendcmd(ctx, ctx->ps_root_fd, PS_SCRIPT,
+		    (unsigned long)len, NULL, 0) == -1)
+			return -1;
+		return ps_root_readerror(ctx, NULL, 0);
+	}
+
 	if (ps_sendcmd(ctx, ctx->ps_root_fd, PS_SCRIPT, 0, data, len) == -1)
 		return -1;
 	return ps_root_readerror(ctx, NULL, 0);
@@ -923,6 +1453,36 @@ ps_root_writefile(struct dhcpcd_ctx *ctx, const char *file, mode_t mode,
 	return ps_root_readerror(ctx, NULL, 0);
 }
 
+int
+ps_root_openfile(struct dhcpcd_ctx *ctx, const char *file, mode_t mode)
+{
+	int fd = -1;
+
+	if (ps_sendcmd(ctx, ctx->ps_root_fd, PS_OPENFILE, mode,
+	    file, strlen(file) + 1) == -1)
+		return -1;
+	if (ps_root_readerrorfd(ctx, NULL, 0, &fd) == -1) {
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+	if (fd == -1)
+		errno = EINVAL;
+	return fd;
+}
+
+#ifndef SMALL
+ssize_t
+ps_root_sethostname(struct dhcpcd_ctx *ctx, const char *name)
+{
+
+	if (ps_sendcmd(ctx, ctx->ps_root_fd, PS_SETHOSTNAME, 0,
+	    name, strlen(name) + 1) == -1)
+		return -1;
+	return ps_root_readerror(ctx, NULL, 0);
+}
+#endif
+
 ssize_t
 ps_root_filemtime(struct dhcpcd_ctx *ctx, const char *file, time_t *time)
 {
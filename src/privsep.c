@@ -40,6 +40,7 @@
  * this in a script or something.
  */
 
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -72,6 +73,7 @@
 #include "ipv6nd.h"
 #include "logerr.h"
 #include "privsep.h"
+#include "stats.h"
 
 #ifdef HAVE_CAPSICUM
 #include <sys/capsicum.h>
@@ -373,6 +375,8 @@ ps_dostart(struct dhcpcd_ctx *ctx,
 	}
 
 	ctx->options |= DHCPCD_FORKED;
+	/* The inherited log write callback points at the parent eloop. */
+	logsetwritecb(NULL, NULL);
 	if (ctx->fork_fd != -1) {
 		close(ctx->fork_fd);
 		ctx->fork_fd = -1;
@@ -380,6 +384,10 @@ ps_dostart(struct dhcpcd_ctx *ctx,
 	pidfile_clean();
 
 	eloop_clear(ctx->eloop);
+	if (eloop_forked(ctx->eloop) == -1) {
+		logerr("%s: eloop_forked", __func__);
+		goto errexit;
+	}
 	eloop_signal_set_cb(ctx->eloop,
 	    dhcpcd_signals, dhcpcd_signals_len, signal_cb, ctx);
 	/* ctx->sigset aready has the initial sigmask set in main() */
@@ -460,6 +468,10 @@ ps_dostop(struct dhcpcd_ctx *ctx, pid_t *pid, int *fd)
 	return err;
 }
 
+#ifndef MAP_ANON
+#define	MAP_ANON	MAP_ANONYMOUS
+#endif
+
 int
 ps_start(struct dhcpcd_ctx *ctx)
 {
@@ -467,6 +479,20 @@ ps_start(struct dhcpcd_ctx *ctx)
 
 	TAILQ_INIT(&ctx->ps_processes);
 
+	/* Hook environments are handed to the privileged proxy and its
+	 * script runner through pages shared with them at fork, so the
+	 * environment size does not multiply the copy cost of each hook
+	 * invocation.  On failure we fall back to copying over the
+	 * sockets as before. */
+	if (ctx->script != NULL) {
+		ctx->ps_script_map = mmap(NULL, PS_BUFLEN,
+		    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+		if (ctx->ps_script_map == MAP_FAILED)
+			ctx->ps_script_map = NULL;
+		else
+			ctx->ps_script_maplen = PS_BUFLEN;
+	}
+
 	switch (pid = ps_root_start(ctx)) {
 	case -1:
 		logerr("ps_root_start");
@@ -622,6 +648,12 @@ ps_stop(struct dhcpcd_ctx *ctx)
 	if (r != 0)
 		ret = r;
 
+	if (ctx->ps_script_map != NULL) {
+		munmap(ctx->ps_script_map, ctx->ps_script_maplen);
+		ctx->ps_script_map = NULL;
+		ctx->ps_script_maplen = 0;
+	}
+
 	ctx->options &= ~DHCPCD_PRIVSEP;
 	return ret;
 }
@@ -722,6 +754,7 @@ ps_sendpsmmsg(struct dhcpcd_ctx *ctx, int fd,
 	int iovlen;
 	ssize_t len;
 
+	STAT_INC(privsep_sends);
 	if (msg != NULL) {
 		struct iovec *iovp = &iov[1];
 		int i;
@@ -848,51 +881,43 @@ static ssize_t
 ps_sendcmdmsg(int fd, uint16_t cmd, const struct msghdr *msg)
 {
 	struct ps_msghdr psm = { .ps_cmd = cmd };
-	uint8_t data[PS_BUFLEN], *p = data;
+	long padding[1] = { 0 };
 	struct iovec iov[] = {
 		{ .iov_base = &psm, .iov_len = sizeof(psm) },
-		{ .iov_base = data, .iov_len = 0 },
+		{ .iov_base = NULL, },	/* name */
+		{ .iov_base = NULL, },	/* control padding */
+		{ .iov_base = NULL, },	/* control */
+		{ .iov_base = NULL, },	/* payload */
 	};
-	size_t dl = sizeof(data);
 	socklen_t cmsg_padlen =
 	    CALC_CMSG_PADLEN(msg->msg_controllen, msg->msg_namelen);
 
-	if (msg->msg_namelen != 0) {
-		if (msg->msg_namelen > dl)
-			goto nobufs;
-		psm.ps_namelen = msg->msg_namelen;
-		memcpy(p, msg->msg_name, msg->msg_namelen);
-		p += msg->msg_namelen;
-		dl -= msg->msg_namelen;
-	}
+	assert(cmsg_padlen <= sizeof(padding));
 
-	if (msg->msg_controllen != 0) {
-		if (msg->msg_controllen + cmsg_padlen > dl)
-			goto nobufs;
-		if (cmsg_padlen != 0) {
-			memset(p, 0, cmsg_padlen);
-			p += cmsg_padlen;
-			dl -= cmsg_padlen;
-		}
-		psm.ps_controllen = (socklen_t)msg->msg_controllen;
-		memcpy(p, msg->msg_control, msg->msg_controllen);
-		p += msg->msg_controllen;
-		dl -= msg->msg_controllen;
+	/* The receiver reads into a struct ps_msg. */
+	if (msg->msg_namelen + cmsg_padlen + msg->msg_controllen +
+	    msg->msg_iov[0].iov_len > PS_BUFLEN)
+	{
+		errno = ENOBUFS;
+		return -1;
 	}
 
+	/* Gather directly from the source buffers rather than
+	 * copying them into one - the datagram is still atomic. */
+	psm.ps_namelen = msg->msg_namelen;
+	psm.ps_controllen = (socklen_t)msg->msg_controllen;
 	psm.ps_datalen = msg->msg_iov[0].iov_len;
-	if (psm.ps_datalen > dl)
-		goto nobufs;
 
-	iov[1].iov_len =
-	    psm.ps_namelen + psm.ps_controllen + psm.ps_datalen + cmsg_padlen;
-	if (psm.ps_datalen != 0)
-		memcpy(p, msg->msg_iov[0].iov_base, psm.ps_datalen);
-	return writev(fd, iov, __arraycount(iov));
+	iov[1].iov_base = msg->msg_name;
+	iov[1].iov_len = msg->msg_namelen;
+	iov[2].iov_base = cmsg_padlen != 0 ? padding : NULL;
+	iov[2].iov_len = cmsg_padlen;
+	iov[3].iov_base = msg->msg_control;
+	iov[3].iov_len = msg->msg_controllen;
+	iov[4].iov_base = msg->msg_iov[0].iov_base;
+	iov[4].iov_len = msg->msg_iov[0].iov_len;
 
-nobufs:
-	errno = ENOBUFS;
-	return -1;
+	return writev(fd, iov, __arraycount(iov));
 }
 
 ssize_t
@@ -950,6 +975,10 @@ ps_recvpsmsg(struct dhcpcd_ctx *ctx, int fd,
 	logdebugx("%s: %zd", __func__, len);
 #endif
 
+	/* Callers may drain the socket, so running dry is not an error. */
+	if (len == -1 && (errno == EAGAIN || errno == EINTR))
+		return -1;
+
 	if (len == -1 || len == 0)
 		stop = true;
 	else {
@@ -40,6 +40,7 @@
 #define	PS_DHCP6		0x0003
 #define	PS_BPF_BOOTP		0x0004
 #define	PS_BPF_ARP		0x0005
+#define	PS_BPF_ARP_ADDRS	0x0006
 
 /* Generic commands */
 #define	PS_IOCTL		0x0010
@@ -52,6 +53,8 @@
 #define	PS_AUTH_MONORDM		0x0017
 #define	PS_CTL			0x0018
 #define	PS_CTL_EOF		0x0019
+#define	PS_OPENFILE		0x001a
+#define	PS_SETHOSTNAME		0x001b
 #define	PS_LOGREOPEN		0x0020
 
 /* BSD Commands */
@@ -87,6 +90,9 @@
 				 CMSG_SPACE(sizeof(struct in6_pktinfo) + \
 					    sizeof(int)))
 
+/* Max queued messages drained in one eloop wakeup. */
+#define	PS_DISPATCH_BUDGET	64
+
 /* Handy macro to work out if in the privsep engine or not. */
 #define	IN_PRIVSEP(ctx)	\
 	((ctx)->options & DHCPCD_PRIVSEP)
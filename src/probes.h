@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2021 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * Static tracepoints on the state machine hot paths, for tracing
+ * live systems with bpftrace/systemtap/dtrace without rebuilding.
+ *
+ * Compiled out by default - configure with --enable-sdt (needs
+ * <sys/sdt.h> from systemtap-sdt-dev or the platform DTrace) and
+ * the probes cost a single nop until a tracer arms them, e.g.
+ *	bpftrace -e 'usdt:/sbin/dhcpcd:dhcpcd:dhcp_bind { ... }'
+ */
+
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+#define DHCPCD_PROBE(name)		DTRACE_PROBE(dhcpcd, name)
+#define DHCPCD_PROBE1(name, a)		DTRACE_PROBE1(dhcpcd, name, (a))
+#define DHCPCD_PROBE2(name, a, b)	DTRACE_PROBE2(dhcpcd, name, (a), (b))
+#else
+#define DHCPCD_PROBE(name)
+#define DHCPCD_PROBE1(name, a)
+#define DHCPCD_PROBE2(name, a, b)
+#endif
+
+#endif
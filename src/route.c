@@ -44,6 +44,7 @@
 #include "ipv4ll.h"
 #include "ipv6.h"
 #include "logerr.h"
+#include "probes.h"
 #include "route.h"
 #include "sa.h"
 
@@ -234,6 +235,43 @@ static const rb_tree_ops_t rt_compare_free_ops = {
 	.rbto_node_offset = offsetof(struct rt, rt_tree),
 	.rbto_context = NULL
 };
+
+/* Routes are carved from slabs so the free list stays warm and mass
+ * route recomputation does not hit the allocator per route.
+ * Nodes are only returned to the free list, never freed - the slabs
+ * are freed as one in rt_dispose(). */
+struct rt_slab {
+	struct rt_slab *next;
+	size_t size;
+	struct rt rts[];
+};
+#define RT_SLAB_MIN	64
+
+static int
+rt_slab_grow(struct dhcpcd_ctx *ctx, size_t size)
+{
+	struct rt_slab *slab;
+	size_t i;
+
+	if (size < RT_SLAB_MIN)
+		size = RT_SLAB_MIN;
+	slab = malloc(sizeof(*slab) + size * sizeof(*slab->rts));
+	if (slab == NULL)
+		return -1;
+	slab->next = ctx->rt_slabs;
+	slab->size = size;
+	ctx->rt_slabs = slab;
+	for (i = 0; i < size; i++) {
+		memset(&slab->rts[i], 0, sizeof(slab->rts[i]));
+		rb_tree_insert_node(&ctx->froutes, &slab->rts[i]);
+	}
+#ifdef RT_FREE_ROUTE_TABLE_STATS
+	croutes += size;
+	if (croutes > mroutes)
+		mroutes = croutes;
+#endif
+	return 0;
+}
 #endif
 
 void
@@ -241,8 +279,11 @@ rt_init(struct dhcpcd_ctx *ctx)
 {
 
 	rb_tree_init(&ctx->routes, &rt_compare_os_ops);
+	rb_tree_init(&ctx->kroutes, &rt_compare_os_ops);
 #ifdef RT_FREE_ROUTE_TABLE
 	rb_tree_init(&ctx->froutes, &rt_compare_free_ops);
+	if (rt_slab_grow(ctx, RT_SLAB_MIN) == -1)
+		logerr(__func__);
 #endif
 }
 
@@ -329,6 +370,7 @@ rt_headclear(rb_tree_t *rts, int af)
 	rt_headclear0(rt->rt_ifp->ctx, rts, af);
 }
 
+#ifndef RT_FREE_ROUTE_TABLE
 static void
 rt_headfree(rb_tree_t *rts)
 {
@@ -339,21 +381,42 @@ rt_headfree(rb_tree_t *rts)
 		free(rt);
 	}
 }
+#endif
 
 void
 rt_dispose(struct dhcpcd_ctx *ctx)
 {
+#ifdef RT_FREE_ROUTE_TABLE
+	struct rt_slab *slab;
+#ifdef RT_FREE_ROUTE_TABLE_STATS
+	size_t sroutes = 0, nslabs = 0;
+#endif
 
 	assert(ctx != NULL);
-	rt_headfree(&ctx->routes);
-#ifdef RT_FREE_ROUTE_TABLE
-	rt_headfree(&ctx->froutes);
+	/* Every route lives in a slab, so just free the slabs. */
+	while ((slab = ctx->rt_slabs) != NULL) {
+		ctx->rt_slabs = slab->next;
+#ifdef RT_FREE_ROUTE_TABLE_STATS
+		sroutes += slab->size;
+		nslabs++;
+#endif
+		free(slab);
+	}
 #ifdef RT_FREE_ROUTE_TABLE_STATS
 	logdebugx("free route list used %zu times", froutes);
 	logdebugx("new routes from route free list %zu", nroutes);
 	logdebugx("maximum route free list size %zu", mroutes);
+	logdebugx("route pool of %zu entries in %zu slabs, "
+	    "high water %zu", sroutes, nslabs, ctx->rt_maxuse);
 #endif
+	rb_tree_fini(&ctx->froutes);
+#else
+	assert(ctx != NULL);
+	rt_headfree(&ctx->routes);
+	rt_headfree(&ctx->kroutes);
 #endif
+	rb_tree_fini(&ctx->routes);
+	rb_tree_fini(&ctx->kroutes);
 }
 
 struct rt *
@@ -363,18 +426,28 @@ rt_new0(struct dhcpcd_ctx *ctx)
 
 	assert(ctx != NULL);
 #ifdef RT_FREE_ROUTE_TABLE
-	if ((rt = RB_TREE_MIN(&ctx->froutes)) != NULL) {
-		rb_tree_remove_node(&ctx->froutes, rt);
+	if ((rt = RB_TREE_MIN(&ctx->froutes)) == NULL) {
+		/* Size the new slab to the high water mark so a mass
+		 * route recomputation settles into one allocation. */
+		if (rt_slab_grow(ctx, ctx->rt_maxuse) == -1) {
+			logerr(__func__);
+			return NULL;
+		}
+		rt = RB_TREE_MIN(&ctx->froutes);
+	}
+	rb_tree_remove_node(&ctx->froutes, rt);
+	if (++ctx->rt_nuse > ctx->rt_maxuse)
+		ctx->rt_maxuse = ctx->rt_nuse;
 #ifdef RT_FREE_ROUTE_TABLE_STATS
-		croutes--;
-		nroutes++;
-#endif
-	} else
+	croutes--;
+	nroutes++;
 #endif
+#else
 	if ((rt = malloc(sizeof(*rt))) == NULL) {
 		logerr(__func__);
 		return NULL;
 	}
+#endif
 	memset(rt, 0, sizeof(*rt));
 	return rt;
 }
@@ -434,12 +507,15 @@ rt_free(struct rt *rt)
 
 	assert(rt != NULL);
 	if (rt->rt_ifp == NULL) {
-		free(rt);
+		/* No context to find the free list with, so the node
+		 * is lost for re-use until rt_dispose() frees its slab. */
 		return;
 	}
 
 	ctx = rt->rt_ifp->ctx;
 	rb_tree_insert_node(&ctx->froutes, rt);
+	if (ctx->rt_nuse != 0)
+		ctx->rt_nuse--;
 #ifdef RT_FREE_ROUTE_TABLE_STATS
 	croutes++;
 	froutes++;
@@ -466,6 +542,71 @@ rt_freeif(struct interface *ifp)
 			rt_free(rt);
 		}
 	}
+	RB_TREE_FOREACH_SAFE(rt, &ctx->kroutes, rtn) {
+		if (rt->rt_ifp == ifp) {
+			rb_tree_remove_node(&ctx->kroutes, rt);
+			rt_free(rt);
+		}
+	}
+}
+
+/*
+ * The kernel route table is shadowed so that rebuilding our routes
+ * does not have to dump it each time.  The shadow is seeded once and
+ * then maintained from the route messages we already receive and the
+ * routes we install and delete ourselves.  Anything which could have
+ * lost messages - a route socket overflow, a new interface whose
+ * routes predate our knowledge of it - invalidates the shadow and the
+ * next rebuild dumps afresh.
+ */
+static void
+rt_kroute_delete(struct dhcpcd_ctx *ctx, const struct rt *rt)
+{
+	struct rt *kr;
+
+	if ((kr = rb_tree_find_node(&ctx->kroutes, rt)) != NULL) {
+		rb_tree_remove_node(&ctx->kroutes, kr);
+		rt_free(kr);
+	}
+}
+
+static void
+rt_kroute_update(struct dhcpcd_ctx *ctx, const struct rt *rt)
+{
+	struct rt *kr;
+
+	rt_kroute_delete(ctx, rt);
+	if ((kr = rt_new(rt->rt_ifp)) == NULL) {
+		/* The shadow is now incomplete,
+		 * make the next rebuild dump. */
+		logerr(__func__);
+		ctx->kroutes_valid = false;
+		return;
+	}
+	memcpy(kr, rt, sizeof(*kr));
+	if (rb_tree_insert_node(&ctx->kroutes, kr) != kr) {
+		rt_free(kr);
+		ctx->kroutes_valid = false;
+	}
+}
+
+void
+rt_kroutes_invalidate(struct dhcpcd_ctx *ctx)
+{
+
+	rt_headclear(&ctx->kroutes, AF_UNSPEC);
+	ctx->kroutes_valid = false;
+}
+
+static void
+rt_kroutes(struct dhcpcd_ctx *ctx)
+{
+
+	if (ctx->kroutes_valid)
+		return;
+	rt_headclear(&ctx->kroutes, AF_UNSPEC);
+	if (if_initrt(ctx, &ctx->kroutes, AF_UNSPEC) == 0)
+		ctx->kroutes_valid = true;
 }
 
 /* If something other than dhcpcd removes a route,
@@ -483,7 +624,12 @@ rt_recvrt(int cmd, const struct rt *rt, pid_t pid)
 	ctx = rt->rt_ifp->ctx;
 
 	switch(cmd) {
+	case RTM_ADD:
+	case RTM_CHANGE:
+		rt_kroute_update(ctx, rt);
+		break;
 	case RTM_DELETE:
+		rt_kroute_delete(ctx, rt);
 		f = rb_tree_find_node(&ctx->routes, rt);
 		if (f != NULL) {
 			char buf[32];
@@ -503,10 +649,10 @@ rt_recvrt(int cmd, const struct rt *rt, pid_t pid)
 }
 
 static bool
-rt_add(rb_tree_t *kroutes, struct rt *nrt, struct rt *ort)
+rt_add(struct rt *nrt, struct rt *ort)
 {
 	struct dhcpcd_ctx *ctx;
-	bool change, kroute, result;
+	bool change, result;
 
 	assert(nrt != NULL);
 	ctx = nrt->rt_ifp->ctx;
@@ -528,9 +674,9 @@ rt_add(rb_tree_t *kroutes, struct rt *nrt, struct rt *ort)
 
 	rt_desc(ort == NULL ? "adding" : "changing", nrt);
 
-	change = kroute = result = false;
+	change = result = false;
 	if (ort == NULL) {
-		ort = rb_tree_find_node(kroutes, nrt);
+		ort = rb_tree_find_node(&ctx->kroutes, nrt);
 		if (ort != NULL &&
 		    ((ort->rt_flags & RTF_REJECT &&
 		      nrt->rt_flags & RTF_REJECT) ||
@@ -540,10 +686,12 @@ rt_add(rb_tree_t *kroutes, struct rt *nrt, struct rt *ort)
 #endif
 		    sa_cmp(&ort->rt_gateway, &nrt->rt_gateway) == 0)))
 		{
-			if (ort->rt_mtu == nrt->rt_mtu)
+			/* Routes with a kernel expiry always need the
+			 * change to re-arm the expiry timer. */
+			if (ort->rt_mtu == nrt->rt_mtu &&
+			    nrt->rt_expires == 0)
 				return true;
 			change = true;
-			kroute = true;
 		}
 	} else if (ort->rt_dflags & RTDF_FAKE &&
 	    !(nrt->rt_dflags & RTDF_FAKE) &&
@@ -555,7 +703,7 @@ rt_add(rb_tree_t *kroutes, struct rt *nrt, struct rt *ort)
 	    rt_cmp_netmask(ort, nrt) == 0 &&
 	    sa_cmp(&ort->rt_gateway, &nrt->rt_gateway) == 0)
 	{
-		if (ort->rt_mtu == nrt->rt_mtu)
+		if (ort->rt_mtu == nrt->rt_mtu && nrt->rt_expires == 0)
 			return true;
 		change = true;
 	}
@@ -571,6 +719,7 @@ rt_add(rb_tree_t *kroutes, struct rt *nrt, struct rt *ort)
 
 	if (change) {
 		if (if_route(RTM_CHANGE, nrt) != -1) {
+			rt_kroute_update(ctx, nrt);
 			result = true;
 			goto out;
 		}
@@ -585,7 +734,9 @@ rt_add(rb_tree_t *kroutes, struct rt *nrt, struct rt *ort)
 		if (ort != NULL) {
 			if (if_route(RTM_DELETE, ort) == -1 && errno != ESRCH)
 				logerr("if_route (DEL)");
+			rt_kroute_delete(ctx, ort);
 		}
+		rt_kroute_update(ctx, nrt);
 		result = true;
 		goto out;
 	}
@@ -604,8 +755,6 @@ rt_add(rb_tree_t *kroutes, struct rt *nrt, struct rt *ort)
 	if (ort != NULL) {
 		if (if_route(RTM_DELETE, ort) == -1 && errno != ESRCH)
 			logerr("if_route (DEL)");
-		else
-			kroute = false;
 	}
 #ifdef ROUTE_PER_GATEWAY
 	/* The OS allows many routes to the same dest with different gateways.
@@ -618,10 +767,13 @@ rt_add(rb_tree_t *kroutes, struct rt *nrt, struct rt *ort)
 		}
 	}
 #endif
+	if (ort != NULL)
+		rt_kroute_delete(ctx, ort);
 
 	/* Shouldn't need to check for EEXIST, but some kernels don't
 	 * dump the subnet route just after we added the address. */
 	if (if_route(RTM_ADD, nrt) != -1 || errno == EEXIST) {
+		rt_kroute_update(ctx, nrt);
 		result = true;
 		goto out;
 	}
@@ -632,10 +784,6 @@ logerr:
 	logerr("if_route (ADD)");
 
 out:
-	if (kroute) {
-		rb_tree_remove_node(kroutes, ort);
-		rt_free(ort);
-	}
 	return result;
 }
 
@@ -648,6 +796,7 @@ rt_delete(struct rt *rt)
 	retval = if_route(RTM_DELETE, rt) == -1 ? false : true;
 	if (!retval && errno != ENOENT && errno != ESRCH)
 		logerr(__func__);
+	rt_kroute_delete(rt->rt_ifp->ctx, rt);
 	return retval;
 }
 
@@ -663,7 +812,7 @@ rt_cmp(const struct rt *r1, const struct rt *r2)
 }
 
 static bool
-rt_doroute(rb_tree_t *kroutes, struct rt *rt)
+rt_doroute(struct rt *rt)
 {
 	struct dhcpcd_ctx *ctx;
 	struct rt *or;
@@ -680,20 +829,20 @@ rt_doroute(rb_tree_t *kroutes, struct rt *rt)
 		    sa_cmp(&or->rt_ifa, &rt->rt_ifa) != 0) ||
 		    or->rt_mtu != rt->rt_mtu)
 		{
-			if (!rt_add(kroutes, rt, or))
+			if (!rt_add(rt, or))
 				return false;
 		}
 		rb_tree_remove_node(&ctx->routes, or);
 		rt_free(or);
 	} else {
 		if (rt->rt_dflags & RTDF_FAKE) {
-			or = rb_tree_find_node(kroutes, rt);
+			or = rb_tree_find_node(&ctx->kroutes, rt);
 			if (or == NULL)
 				return false;
 			if (!rt_cmp(rt, or))
 				return false;
 		} else {
-			if (!rt_add(kroutes, rt, NULL))
+			if (!rt_add(rt, NULL))
 				return false;
 		}
 	}
@@ -704,14 +853,14 @@ rt_doroute(rb_tree_t *kroutes, struct rt *rt)
 void
 rt_build(struct dhcpcd_ctx *ctx, int af)
 {
-	rb_tree_t routes, added, kroutes;
+	rb_tree_t routes, added;
 	struct rt *rt, *rtn;
 	unsigned long long o;
 
+	DHCPCD_PROBE1(rt_build_begin, af);
 	rb_tree_init(&routes, &rt_compare_proto_ops);
 	rb_tree_init(&added, &rt_compare_os_ops);
-	rb_tree_init(&kroutes, &rt_compare_os_ops);
-	if_initrt(ctx, &kroutes, af);
+	rt_kroutes(ctx);
 	ctx->rt_order = 0;
 	ctx->options |= DHCPCD_RTBUILD;
 
@@ -748,7 +897,7 @@ rt_build(struct dhcpcd_ctx *ctx, int af)
 		/* Is this route already in our table? */
 		if (rb_tree_find_node(&added, rt) != NULL)
 			continue;
-		if (rt_doroute(&kroutes, rt)) {
+		if (rt_doroute(rt)) {
 			rb_tree_remove_node(&routes, rt);
 			if (rb_tree_insert_node(&added, rt) != rt) {
 				errno = EEXIST;
@@ -783,9 +932,125 @@ rt_build(struct dhcpcd_ctx *ctx, int af)
 		rt_free(rt);
 	}
 
-	/* XXX This needs to be optimised. */
+	/* The removal loop above cleared every slot the added routes
+	 * could occupy, so the trees merge without equal keys. */
+	rb_tree_merge(&ctx->routes, &added);
+
+getfail:
+	rt_headclear(&routes, AF_UNSPEC);
+	rb_tree_fini(&routes);
+	rb_tree_fini(&added);
+	DHCPCD_PROBE1(rt_build_end, af);
+}
+
+#ifndef BSD
+/* Find a route in a proto ordered tree matching the OS key
+ * (masked destination and metric) of key. */
+static struct rt *
+rt_find_oskey(rb_tree_t *routes, const struct rt *key)
+{
+	struct rt *rt;
+
+	RB_TREE_FOREACH(rt, routes) {
+		if (rt_compare_os(NULL, rt, key) == 0)
+			return rt;
+	}
+	return NULL;
+}
+#endif
+
+/*
+ * Patch the managed route table for a change on one interface without
+ * recomputing the desired routes of every other interface.
+ * Any condition where another interface could influence the outcome
+ * falls back to a full rt_build():
+ * - a route this interface managed is no longer desired, as another
+ *   interface may want the same destination;
+ * - a desired route's slot is managed for another interface;
+ * - an IPv4LL fallback default route is managed, as its presence
+ *   depends on the defaults of every other interface.
+ * On BSD the route miss filter is built from every default route, so
+ * the full build is always taken.
+ */
+void
+rt_build_if(struct interface *ifp, int af)
+{
+	struct dhcpcd_ctx *ctx = ifp->ctx;
+#ifndef BSD
+	rb_tree_t routes, added;
+	struct rt *rt, *rtn, *ort;
+#ifdef INET
+	bool have_default = false;
+#endif
+
+	rb_tree_init(&routes, &rt_compare_proto_ops);
+	ctx->rt_order = 0;
+
+#ifdef INET
+	if ((af == AF_INET || af == AF_UNSPEC) &&
+	    !inet_getroutes_if(ifp, &routes, &have_default))
+		goto full;
+#endif
+#ifdef INET6
+	if ((af == AF_INET6 || af == AF_UNSPEC) &&
+	    !inet6_getroutes_if(ifp, &routes))
+		goto full;
+#endif
+
+	RB_TREE_FOREACH(rt, &ctx->routes) {
+		if ((rt->rt_dest.sa_family != af &&
+		    rt->rt_dest.sa_family != AF_UNSPEC) ||
+		    (rt->rt_gateway.sa_family != af &&
+		    rt->rt_gateway.sa_family != AF_UNSPEC))
+			continue;
+		if (rt->rt_ifp == ifp && rt_find_oskey(&routes, rt) == NULL)
+			goto full;
+#if defined(INET) && defined(IPV4LL)
+		if (rt->rt_dflags & RTDF_IPV4LL && rt_is_default(rt))
+			goto full;
+#endif
+	}
+
+	RB_TREE_FOREACH(rt, &routes) {
+		ort = rb_tree_find_node(&ctx->routes, rt);
+		if (ort != NULL && ort->rt_ifp != ifp)
+			goto full;
+	}
+
+	rb_tree_init(&added, &rt_compare_os_ops);
+	rt_kroutes(ctx);
+	ctx->options |= DHCPCD_RTBUILD;
+
+	RB_TREE_FOREACH_SAFE(rt, &routes, rtn) {
+		if (rt->rt_ifp->active) {
+			if (!(rt->rt_ifp->options->options & DHCPCD_CONFIGURE))
+				continue;
+		} else if (!(ctx->options & DHCPCD_CONFIGURE))
+			continue;
+		if ((rt->rt_dest.sa_family != af &&
+		    rt->rt_dest.sa_family != AF_UNSPEC) ||
+		    (rt->rt_gateway.sa_family != af &&
+		    rt->rt_gateway.sa_family != AF_UNSPEC))
+			continue;
+		if (rb_tree_find_node(&added, rt) != NULL)
+			continue;
+		if (rt_doroute(rt)) {
+			rb_tree_remove_node(&routes, rt);
+			if (rb_tree_insert_node(&added, rt) != rt) {
+				errno = EEXIST;
+				logerr(__func__);
+				rt_free(rt);
+			}
+		}
+	}
+
 	while ((rt = RB_TREE_MIN(&added)) != NULL) {
 		rb_tree_remove_node(&added, rt);
+		ort = rb_tree_find_node(&ctx->routes, rt);
+		if (ort != NULL) {
+			rb_tree_remove_node(&ctx->routes, ort);
+			rt_free(ort);
+		}
 		if (rb_tree_insert_node(&ctx->routes, rt) != rt) {
 			errno = EEXIST;
 			logerr(__func__);
@@ -793,7 +1058,14 @@ rt_build(struct dhcpcd_ctx *ctx, int af)
 		}
 	}
 
-getfail:
 	rt_headclear(&routes, AF_UNSPEC);
-	rt_headclear(&kroutes, AF_UNSPEC);
+	rb_tree_fini(&routes);
+	rb_tree_fini(&added);
+	return;
+
+full:
+	rt_headclear(&routes, AF_UNSPEC);
+	rb_tree_fini(&routes);
+#endif /* !BSD */
+	rt_build(ctx, af);
 }
@@ -90,6 +90,11 @@ struct rt {
 #define rt_ifa			rt_ss_ifa.sa
 	unsigned int		rt_flags;
 	unsigned int		rt_mtu;
+	/* Lifetime in seconds for kernels which can expire routes
+	 * themselves (Linux RTA_EXPIRES), zero for no expiry.
+	 * dhcpcd still expires the route from its own state; this is
+	 * a backstop so the kernel drops the route even if we die. */
+	unsigned int		rt_expires;
 #ifdef HAVE_ROUTE_METRIC
 	unsigned int		rt_metric;
 #endif
@@ -140,6 +145,8 @@ struct rt * rt_proto_add_ctx(rb_tree_t *, struct rt *, struct dhcpcd_ctx *);
 struct rt * rt_proto_add(rb_tree_t *, struct rt *);
 int rt_cmp_dest(const struct rt *, const struct rt *);
 void rt_recvrt(int, const struct rt *, pid_t);
+void rt_kroutes_invalidate(struct dhcpcd_ctx *);
 void rt_build(struct dhcpcd_ctx *, int);
+void rt_build_if(struct interface *, int);
 
 #endif
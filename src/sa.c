@@ -357,6 +357,68 @@ sa_fromprefix(struct sockaddr *sa, int prefix)
 }
 
 /* inet_ntop, but for sockaddr. */
+/* Small LRU of recent conversions - route logging, control responses
+ * and env generation ask for the same few addresses (routers, DNS
+ * servers) over and over, so don't re-derive identical strings. */
+#define SA_NTOP_CACHE_SIZE	8
+struct sa_ntop_cache {
+	sa_family_t family;
+	uint8_t addr[16];
+	char str[INET6_ADDRSTRLEN];
+};
+static struct sa_ntop_cache sa_ntop_cache[SA_NTOP_CACHE_SIZE];
+
+static const char *
+sa_ntop_cached(const struct sockaddr *sa, const void *addr,
+    char *buf, socklen_t len)
+{
+	struct sa_ntop_cache *c, tmp;
+	size_t i, alen;
+
+	switch (sa->sa_family) {
+	case AF_INET:
+		alen = sizeof(struct in_addr);
+		break;
+#ifdef INET6
+	case AF_INET6:
+		alen = sizeof(struct in6_addr);
+		break;
+#endif
+	default:
+		return inet_ntop(sa->sa_family, addr, buf, len);
+	}
+
+	for (i = 0; i < SA_NTOP_CACHE_SIZE; i++) {
+		c = &sa_ntop_cache[i];
+		if (c->family == sa->sa_family &&
+		    memcmp(c->addr, addr, alen) == 0)
+			goto found;
+	}
+
+	/* Not cached, evict the least recently used entry. */
+	c = &sa_ntop_cache[SA_NTOP_CACHE_SIZE - 1];
+	if (inet_ntop(sa->sa_family, addr, c->str, sizeof(c->str)) == NULL) {
+		c->family = AF_UNSPEC;
+		return NULL;
+	}
+	c->family = sa->sa_family;
+	memcpy(c->addr, addr, alen);
+
+found:
+	if (c != &sa_ntop_cache[0]) {
+		tmp = *c;
+		memmove(&sa_ntop_cache[1], &sa_ntop_cache[0],
+		    (size_t)(c - sa_ntop_cache) * sizeof(tmp));
+		sa_ntop_cache[0] = tmp;
+		c = &sa_ntop_cache[0];
+	}
+	if (strlcpy(buf, c->str, (size_t)len) >= (size_t)len) {
+		errno = ENOSPC;
+		return NULL;
+	}
+	return buf;
+}
+
 const char *
 sa_addrtop(const struct sockaddr *sa, char *buf, socklen_t len)
 {
@@ -394,7 +456,7 @@ sa_addrtop(const struct sockaddr *sa, char *buf, socklen_t len)
 	}
 #endif
 	addr = (const char *)sa + sa_addroffset(sa);
-	return inet_ntop(sa->sa_family, addr, buf, len);
+	return sa_ntop_cached(sa, addr, buf, len);
 }
 
 int
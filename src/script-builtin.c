@@ -0,0 +1,657 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * dhcpcd - Built-in hook fast paths
+ * Copyright (c) 2006-2021 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Native implementations of the 20-resolv.conf and 30-hostname hooks.
+ * Spawning a shell interpreter for every lease event does not scale to
+ * thousands of interfaces, yet nearly every installation only needs
+ * these two hooks.  When enabled with the builtinhook option we apply
+ * the change directly from the environment built for the hooks, which
+ * keeps the behaviour identical to the shell implementation, and the
+ * matching shell hook is skipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "common.h"
+#include "dhcpcd.h"
+#include "dhcp-common.h"
+#include "if.h"
+#include "if-options.h"
+#include "logerr.h"
+#include "privsep.h"
+#include "script-builtin.h"
+
+#ifndef SMALL
+
+#define RESOLV_CONF		"/etc/resolv.conf"
+#define RESOLV_CONF_HEAD	RESOLV_CONF ".head"
+#define RESOLV_CONF_TAIL	RESOLV_CONF ".tail"
+#define RESOLV_CONF_SIG		"# Generated by dhcpcd"
+
+/* Per interface DNS state, mirroring the hooks resolv.conf fragments. */
+struct script_builtin {
+	char *domain;
+	char *search;
+	char *servers;
+};
+#define SCRIPT_BUILTIN(ifp)						\
+    ((struct script_builtin *)(ifp)->if_data[IF_DATA_BUILTIN])
+
+/* A simple growable string to assemble lists and file contents. */
+struct sbuf {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+static int
+sbuf_cat(struct sbuf *sb, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (sb->len + len + 1 > sb->size) {
+		size_t size = sb->size + MAX(len + 1, BUFSIZ);
+		char *nbuf = realloc(sb->buf, size);
+
+		if (nbuf == NULL)
+			return -1;
+		sb->buf = nbuf;
+		sb->size = size;
+	}
+	memcpy(sb->buf + sb->len, str, len + 1);
+	sb->len += len;
+	return 0;
+}
+
+static void
+sbuf_free(struct sbuf *sb)
+{
+
+	free(sb->buf);
+	sb->buf = NULL;
+	sb->len = sb->size = 0;
+}
+
+/* Look up a variable in the NUL separated environment buffer. */
+static const char *
+builtin_getenv(const char *env, size_t envlen, const char *var)
+{
+	const char *ep = env + envlen;
+	size_t vlen = strlen(var);
+
+	while (env < ep) {
+		if (strncmp(env, var, vlen) == 0 && env[vlen] == '=')
+			return env + vlen + 1;
+		env += strlen(env) + 1;
+	}
+	return NULL;
+}
+
+static bool
+token_present(const char *list, const char *tok, size_t toklen)
+{
+	const char *p;
+
+	if (list == NULL)
+		return false;
+	for (p = list; *p != '\0'; ) {
+		size_t len = strcspn(p, " ");
+
+		if (len == toklen && strncmp(p, tok, toklen) == 0)
+			return true;
+		p += len;
+		if (*p == ' ')
+			p++;
+	}
+	return false;
+}
+
+/* Append the space separated tokens of src not already present,
+ * preserving order, like the hooks uniqify function. */
+static int
+cat_uniq(struct sbuf *sb, const char *src)
+{
+	const char *p;
+
+	if (src == NULL)
+		return 0;
+	for (p = src; *p != '\0'; ) {
+		size_t len = strcspn(p, " ");
+
+		if (len != 0 && !token_present(sb->buf, p, len)) {
+			char tok[256];
+
+			if (len < sizeof(tok)) {
+				memcpy(tok, p, len);
+				tok[len] = '\0';
+				if ((sb->len != 0 &&
+				    sbuf_cat(sb, " ") == -1) ||
+				    sbuf_cat(sb, tok) == -1)
+					return -1;
+			}
+		}
+		p += len;
+		if (*p == ' ')
+			p++;
+	}
+	return 0;
+}
+
+static bool
+valid_domainname(const char *tok, size_t len)
+{
+	size_t i;
+
+	if (len == 0 || len > 255)
+		return false;
+	for (i = 0; i < len; i++) {
+		char c = tok[i];
+
+		if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		    (c >= '0' && c <= '9') || c == '.' || c == '-' ||
+		    c == '_'))
+			return false;
+	}
+	return true;
+}
+
+static struct script_builtin *
+script_builtin_state(const struct interface *ifp)
+{
+	struct script_builtin *state = SCRIPT_BUILTIN(ifp);
+
+	if (state == NULL) {
+		state = calloc(1, sizeof(*state));
+		if (state == NULL)
+			return NULL;
+		((struct interface *)UNCONST(ifp))->if_data[IF_DATA_BUILTIN]
+		    = state;
+	}
+	return state;
+}
+
+/* Extract the RDNSS and DNSSL options from the Router Advertisement
+ * variables, obeying their lifetimes, like the hook does. */
+static void
+nd_dns(const char *env, size_t envlen,
+    struct sbuf *servers, struct sbuf *search)
+{
+	char var[64];
+	const char *p;
+	long long acquired, now, offset, ltime;
+	size_t i, j;
+
+	for (i = 1; ; i++) {
+		snprintf(var, sizeof(var), "nd%zu_acquired", i);
+		if ((p = builtin_getenv(env, envlen, var)) == NULL)
+			break;
+		acquired = strtoll(p, NULL, 10);
+		snprintf(var, sizeof(var), "nd%zu_now", i);
+		if ((p = builtin_getenv(env, envlen, var)) == NULL)
+			break;
+		now = strtoll(p, NULL, 10);
+		offset = now - acquired;
+		for (j = 1; ; j++) {
+			snprintf(var, sizeof(var),
+			    "nd%zu_rdnss%zu_lifetime", i, j);
+			if ((p = builtin_getenv(env, envlen, var)) == NULL)
+				break;
+			ltime = strtoll(p, NULL, 10) - offset;
+			if (ltime > 0) {
+				snprintf(var, sizeof(var),
+				    "nd%zu_rdnss%zu_servers", i, j);
+				cat_uniq(servers,
+				    builtin_getenv(env, envlen, var));
+			}
+			snprintf(var, sizeof(var),
+			    "nd%zu_dnssl%zu_lifetime", i, j);
+			if ((p = builtin_getenv(env, envlen, var)) == NULL)
+				break;
+			ltime = strtoll(p, NULL, 10) - offset;
+			if (ltime > 0) {
+				snprintf(var, sizeof(var),
+				    "nd%zu_dnssl%zu_search", i, j);
+				cat_uniq(search,
+				    builtin_getenv(env, envlen, var));
+			}
+		}
+	}
+}
+
+/* Rebuild the DNS state for the interface from the hook environment.
+ * Returns 1 if the state changed, 0 if not and -1 on error. */
+static int
+builtin_resolvconf_update(const struct interface *ifp, const char *reason,
+    const char *env, size_t envlen)
+{
+	struct script_builtin *state;
+	struct sbuf servers = { 0 }, search = { 0 };
+	char *domain = NULL;
+	const char *p, *if_up, *if_down;
+	bool is6, changed;
+
+	if ((state = script_builtin_state(ifp)) == NULL)
+		return -1;
+
+	if_up = builtin_getenv(env, envlen, "if_up");
+	if ((if_up == NULL || strcmp(if_up, "true") != 0) &&
+	    strcmp(reason, "ROUTERADVERT") != 0)
+	{
+		if_down = builtin_getenv(env, envlen, "if_down");
+		if (if_down == NULL || strcmp(if_down, "true") != 0)
+			return 0;
+
+		/* Torn down - just clear our state. */
+		changed = state->domain != NULL || state->search != NULL ||
+		    state->servers != NULL;
+		free(state->domain);
+		free(state->search);
+		free(state->servers);
+		state->domain = state->search = state->servers = NULL;
+		return changed ? 1 : 0;
+	}
+
+	is6 = reason[0] != '\0' && reason[strlen(reason) - 1] == '6';
+	if (cat_uniq(&servers, builtin_getenv(env, envlen, is6 ?
+	    "new_dhcp6_name_servers" : "new_domain_name_servers")) == -1)
+		goto err;
+	if (cat_uniq(&search, builtin_getenv(env, envlen, is6 ?
+	    "new_dhcp6_domain_search" : "new_domain_search")) == -1)
+		goto err;
+	nd_dns(env, envlen, &servers, &search);
+
+	/* Derive a domain from the various hostname options. */
+	p = builtin_getenv(env, envlen, "new_domain_name");
+	if (p == NULL || *p == '\0') {
+		if (((p = builtin_getenv(env, envlen,
+		    "new_dhcp6_fqdn")) == NULL ||
+		    strchr(p, '.') == NULL) &&
+		    ((p = builtin_getenv(env, envlen,
+		    "new_fqdn")) == NULL ||
+		    strchr(p, '.') == NULL) &&
+		    ((p = builtin_getenv(env, envlen,
+		    "new_host_name")) == NULL ||
+		    strchr(p, '.') == NULL))
+			p = NULL;
+		else
+			p = strchr(p, '.') + 1;
+	}
+	if (p != NULL && *p != '\0') {
+		size_t len = strcspn(p, " ");
+
+		if (valid_domainname(p, len)) {
+			if ((domain = malloc(len + 1)) == NULL)
+				goto err;
+			memcpy(domain, p, len);
+			domain[len] = '\0';
+			/* If there is no search list, make this one. */
+			if (search.buf == NULL &&
+			    cat_uniq(&search, domain) == -1)
+				goto err;
+		} else
+			logerrx("%s: invalid domain name: %s", ifp->name, p);
+	}
+
+	changed =
+	    (domain == NULL) != (state->domain == NULL) ||
+	    (domain != NULL && strcmp(domain, state->domain) != 0) ||
+	    (search.buf == NULL) != (state->search == NULL) ||
+	    (search.buf != NULL && strcmp(search.buf, state->search) != 0) ||
+	    (servers.buf == NULL) != (state->servers == NULL) ||
+	    (servers.buf != NULL && strcmp(servers.buf, state->servers) != 0);
+
+	free(state->domain);
+	free(state->search);
+	free(state->servers);
+	state->domain = domain;
+	state->search = search.buf;
+	state->servers = servers.buf;
+	return changed ? 1 : 0;
+
+err:
+	logerr(__func__);
+	free(domain);
+	sbuf_free(&servers);
+	sbuf_free(&search);
+	return -1;
+}
+
+/* Merge the DNS state of all interfaces into /etc/resolv.conf,
+ * like the hooks build_resolv_conf function. */
+static int
+builtin_resolvconf_write(struct dhcpcd_ctx *ctx)
+{
+	struct sbuf cf = { 0 }, search = { 0 }, servers = { 0 };
+	struct interface *ifp;
+	struct script_builtin *state;
+	const char *domain = NULL, *p;
+	char buf[BUFSIZ], *cur;
+	ssize_t len;
+	int r = -1;
+
+	if (sbuf_cat(&cf, RESOLV_CONF_SIG) == -1)
+		goto out;
+	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+		state = SCRIPT_BUILTIN(ifp);
+		if (state == NULL || (state->domain == NULL &&
+		    state->search == NULL && state->servers == NULL))
+			continue;
+		if (sbuf_cat(&cf, domain == NULL && search.buf == NULL &&
+		    servers.buf == NULL ? " from " : ", ") == -1 ||
+		    sbuf_cat(&cf, ifp->name) == -1)
+			goto out;
+		if (state->domain != NULL) {
+			if (domain == NULL)
+				domain = state->domain;
+			else if (cat_uniq(&search, state->domain) == -1)
+				goto out;
+		}
+		if (cat_uniq(&search, state->search) == -1 ||
+		    cat_uniq(&servers, state->servers) == -1)
+			goto out;
+	}
+	if (sbuf_cat(&cf, "\n") == -1)
+		goto out;
+
+	len = dhcp_readfile(ctx, RESOLV_CONF_HEAD, buf, sizeof(buf) - 1);
+	if (len != -1) {
+		buf[len] = '\0';
+		if (sbuf_cat(&cf, buf) == -1)
+			goto out;
+	} else if (sbuf_cat(&cf,
+	    "# " RESOLV_CONF_HEAD " can replace this line\n") == -1)
+		goto out;
+
+	if (domain != NULL && search.buf != NULL &&
+	    strcmp(domain, search.buf) == 0)
+		sbuf_free(&search);
+	if (domain != NULL) {
+		if (sbuf_cat(&cf, "domain ") == -1 ||
+		    sbuf_cat(&cf, domain) == -1 ||
+		    sbuf_cat(&cf, "\n") == -1)
+			goto out;
+	}
+	if (search.buf != NULL) {
+		if (sbuf_cat(&cf, "search ") == -1 ||
+		    sbuf_cat(&cf, search.buf) == -1 ||
+		    sbuf_cat(&cf, "\n") == -1)
+			goto out;
+	}
+	if (servers.buf != NULL) {
+		for (p = servers.buf; *p != '\0'; ) {
+			size_t tlen = strcspn(p, " ");
+			char tok[256];
+
+			if (tlen < sizeof(tok)) {
+				memcpy(tok, p, tlen);
+				tok[tlen] = '\0';
+				if (sbuf_cat(&cf, "nameserver ") == -1 ||
+				    sbuf_cat(&cf, tok) == -1 ||
+				    sbuf_cat(&cf, "\n") == -1)
+					goto out;
+			}
+			p += tlen;
+			if (*p == ' ')
+				p++;
+		}
+	}
+
+	len = dhcp_readfile(ctx, RESOLV_CONF_TAIL, buf, sizeof(buf) - 1);
+	if (len != -1) {
+		buf[len] = '\0';
+		if (sbuf_cat(&cf, buf) == -1)
+			goto out;
+	} else if (sbuf_cat(&cf,
+	    "# " RESOLV_CONF_TAIL " can replace this line\n") == -1)
+		goto out;
+
+	/* Don't write the file if it hasn't changed. */
+	if ((cur = malloc(cf.len + 1)) != NULL) {
+		len = dhcp_readfile(ctx, RESOLV_CONF, cur, cf.len + 1);
+		if (len != -1 && (size_t)len == cf.len &&
+		    memcmp(cur, cf.buf, cf.len) == 0)
+		{
+			free(cur);
+			r = 0;
+			goto out;
+		}
+		free(cur);
+	}
+
+	if (dhcp_writefile(ctx, RESOLV_CONF, 0644, cf.buf, cf.len) == -1)
+		logerr("%s: dhcp_writefile: %s", __func__, RESOLV_CONF);
+	else
+		r = 0;
+
+out:
+	sbuf_free(&cf);
+	sbuf_free(&search);
+	sbuf_free(&servers);
+	return r;
+}
+
+static bool
+is_default_hostname(const char *name)
+{
+
+	return name[0] == '\0' ||
+	    strcmp(name, "localhost") == 0 ||
+	    strcmp(name, "localhost.localdomain") == 0;
+}
+
+static bool
+env_istrue(const char *val)
+{
+
+	return val != NULL &&
+	    (strcasecmp(val, "yes") == 0 || strcasecmp(val, "true") == 0 ||
+	    strcmp(val, "1") == 0);
+}
+
+static int
+builtin_sethostname(struct dhcpcd_ctx *ctx, const char *name)
+{
+
+#ifdef PRIVSEP
+	if (ctx->options & DHCPCD_PRIVSEP)
+		return (int)ps_root_sethostname(ctx, name);
+#else
+	UNUSED(ctx);
+#endif
+	return sethostname(name, strlen(name));
+}
+
+/* Set the hostname from the lease if required,
+ * mirroring the 30-hostname hook. */
+static void
+builtin_hostname_update(const struct interface *ifp, const char *reason,
+    const char *env, size_t envlen)
+{
+	char cur[HOSTNAME_MAX_LEN + 1], name[HOSTNAME_MAX_LEN + 1];
+	const char *p, *fqdn, *hostname, *domain, *hostname_fqdn;
+	bool is6, hfqdn = false, hshort = false;
+
+	p = builtin_getenv(env, envlen, "if_up");
+	if (p == NULL || strcmp(p, "true") != 0 ||
+	    strcmp(reason, "ROUTERADVERT") == 0)
+		return;
+
+	/* The hooks hostname_fqdn and force_hostname tunables are
+	 * set with the env option and so appear in our environment. */
+	hostname_fqdn = builtin_getenv(env, envlen, "hostname_fqdn");
+	if (hostname_fqdn == NULL || env_istrue(hostname_fqdn))
+		hfqdn = true;
+	else if (strcasecmp(hostname_fqdn, "server") != 0)
+		hshort = true;
+
+	if (gethostname(cur, sizeof(cur)) != 0)
+		cur[0] = '\0';
+	cur[sizeof(cur) - 1] = '\0';
+
+	is6 = reason[0] != '\0' && reason[strlen(reason) - 1] == '6';
+	fqdn = builtin_getenv(env, envlen,
+	    is6 ? "new_dhcp6_fqdn" : "new_fqdn");
+	hostname = builtin_getenv(env, envlen, "new_host_name");
+	domain = builtin_getenv(env, envlen, "new_domain_name");
+
+	/* Only set the hostname if it's not been set,
+	 * it was set by a previous lease or we are forced to. */
+	if (!is_default_hostname(cur) &&
+	    !env_istrue(builtin_getenv(env, envlen, "force_hostname")))
+	{
+		const char *ofqdn, *ohostname, *odomain;
+		bool owned = false;
+
+		ofqdn = builtin_getenv(env, envlen,
+		    is6 ? "old_dhcp6_fqdn" : "old_fqdn");
+		ohostname = builtin_getenv(env, envlen, "old_host_name");
+		odomain = builtin_getenv(env, envlen, "old_domain_name");
+		if (ofqdn != NULL && *ofqdn != '\0') {
+			if (hfqdn || !hshort)
+				owned = strcmp(cur, ofqdn) == 0;
+			else {
+				size_t len = strcspn(ofqdn, ".");
+
+				owned = strlen(cur) == len &&
+				    strncmp(cur, ofqdn, len) == 0;
+			}
+		} else if (ohostname != NULL && *ohostname != '\0') {
+			if (hfqdn && odomain != NULL && *odomain != '\0' &&
+			    strchr(ohostname, '.') == NULL)
+			{
+				snprintf(name, sizeof(name), "%s.%s",
+				    ohostname, odomain);
+				owned = strcmp(cur, name) == 0;
+			} else if (hshort) {
+				size_t len = strcspn(ohostname, ".");
+
+				owned = strlen(cur) == len &&
+				    strncmp(cur, ohostname, len) == 0;
+			} else
+				owned = strcmp(cur, ohostname) == 0;
+		}
+		if (!owned)
+			return;
+	}
+
+	name[0] = '\0';
+	if (fqdn != NULL && *fqdn != '\0') {
+		if (hfqdn || !hshort)
+			strlcpy(name, fqdn, sizeof(name));
+		else
+			snprintf(name, sizeof(name), "%.*s",
+			    (int)strcspn(fqdn, "."), fqdn);
+	} else if (hostname != NULL && *hostname != '\0') {
+		if (hfqdn && domain != NULL && *domain != '\0' &&
+		    strchr(hostname, '.') == NULL)
+			snprintf(name, sizeof(name), "%s.%s",
+			    hostname, domain);
+		else if (hshort)
+			snprintf(name, sizeof(name), "%.*s",
+			    (int)strcspn(hostname, "."), hostname);
+		else
+			strlcpy(name, hostname, sizeof(name));
+	} else if (!is_default_hostname(cur)) {
+		/* We relinquish control of the hostname. */
+	} else
+		return;
+
+	if (strcmp(cur, name) == 0)
+		return;
+	if (name[0] != '\0' &&
+	    !valid_domainname(name, strlen(name))) {
+		logerrx("%s: invalid hostname: %s", ifp->name, name);
+		return;
+	}
+	loginfox("%s: setting hostname: %s", ifp->name, name);
+	if (builtin_sethostname(ifp->ctx, name) == -1)
+		logerr("%s: sethostname", __func__);
+}
+
+void
+script_builtin_run(const struct interface *ifp, const char *reason,
+    const char *env, size_t envlen)
+{
+	const struct if_options *ifo = ifp->options;
+	const char *p;
+
+	if (!ifo->builtin_resolvconf && !ifo->builtin_hostname)
+		return;
+
+	p = builtin_getenv(env, envlen, "if_configured");
+	if (p == NULL || strcmp(p, "true") != 0)
+		return;
+
+	if (ifo->builtin_resolvconf) {
+		if (builtin_resolvconf_update(ifp, reason, env, envlen) == 1)
+			builtin_resolvconf_write(ifp->ctx);
+	}
+	if (ifo->builtin_hostname)
+		builtin_hostname_update(ifp, reason, env, envlen);
+}
+
+void
+script_builtin_free(struct interface *ifp)
+{
+	struct script_builtin *state = SCRIPT_BUILTIN(ifp);
+
+	if (state == NULL)
+		return;
+	free(state->domain);
+	free(state->search);
+	free(state->servers);
+	free(state);
+	ifp->if_data[IF_DATA_BUILTIN] = NULL;
+}
+
+#else /* SMALL */
+
+void
+script_builtin_run(const struct interface *ifp, const char *reason,
+    const char *env, size_t envlen)
+{
+
+	UNUSED(ifp);
+	UNUSED(reason);
+	UNUSED(env);
+	UNUSED(envlen);
+}
+
+void
+script_builtin_free(struct interface *ifp)
+{
+
+	UNUSED(ifp);
+}
+
+#endif /* SMALL */
@@ -56,6 +56,9 @@
 #include "logerr.h"
 #include "privsep.h"
 #include "script.h"
+#include "script-builtin.h"
+#include "stats.h"
+#include "probes.h"
 
 #define DEFAULT_PATH	"/usr/bin:/usr/sbin:/bin:/sbin"
 
@@ -90,34 +93,36 @@ pid_t
 script_exec(char *const *argv, char *const *env)
 {
 	pid_t pid = 0;
-	posix_spawnattr_t attr;
+	static posix_spawnattr_t attr;
+	static bool attr_init;
 	int r;
 #ifdef USE_SIGNALS
 	size_t i;
 	short flags;
 	sigset_t defsigs;
-#else
-	UNUSED(ctx);
 #endif
 
 	/* posix_spawn is a safe way of executing another image
-	 * and changing signals back to how they should be. */
-	if (posix_spawnattr_init(&attr) == -1)
-		return -1;
+	 * and changing signals back to how they should be.
+	 * The attributes never change, so only build them once. */
+	if (!attr_init) {
+		if (posix_spawnattr_init(&attr) == -1)
+			return -1;
 #ifdef USE_SIGNALS
-	flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
-	posix_spawnattr_setflags(&attr, flags);
-	sigemptyset(&defsigs);
-	posix_spawnattr_setsigmask(&attr, &defsigs);
-	for (i = 0; i < dhcpcd_signals_len; i++)
-		sigaddset(&defsigs, dhcpcd_signals[i]);
-	for (i = 0; i < dhcpcd_signals_ignore_len; i++)
-		sigaddset(&defsigs, dhcpcd_signals_ignore[i]);
-	posix_spawnattr_setsigdefault(&attr, &defsigs);
+		flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+		posix_spawnattr_setflags(&attr, flags);
+		sigemptyset(&defsigs);
+		posix_spawnattr_setsigmask(&attr, &defsigs);
+		for (i = 0; i < dhcpcd_signals_len; i++)
+			sigaddset(&defsigs, dhcpcd_signals[i]);
+		for (i = 0; i < dhcpcd_signals_ignore_len; i++)
+			sigaddset(&defsigs, dhcpcd_signals_ignore[i]);
+		posix_spawnattr_setsigdefault(&attr, &defsigs);
 #endif
+		attr_init = true;
+	}
 	errno = 0;
 	r = posix_spawn(&pid, argv[0], NULL, &attr, argv, env);
-	posix_spawnattr_destroy(&attr);
 	if (r) {
 		errno = r;
 		return -1;
@@ -220,6 +225,201 @@ script_buftoenv(struct dhcpcd_ctx *ctx, char *buf, size_t len)
 	return ctx->script_env;
 }
 
+/*
+ * Serializing a lease into environment variables walks every option
+ * definition and is by far the most expensive part of building the
+ * hook environment, yet the lease rarely changes between invocations.
+ * Cache the serialized export per interface and replay it while the
+ * lease is unchanged.
+ * The cache is identified by the lease data and checksummed so a
+ * reallocation to the same address cannot replay a stale export.
+ */
+#ifdef HAVE_OPEN_MEMSTREAM
+struct script_env_cache {
+	char *buf;
+	size_t len;
+	const void *data;	/* identity of the serialized lease */
+	size_t data_len;
+	uint32_t sum;
+};
+#endif
+
+struct script_state {
+#ifdef HAVE_OPEN_MEMSTREAM
+	struct script_env_cache dhcp[2];	/* old, new */
+	struct script_env_cache dhcp6[2];
+#endif
+	char pending_reason[32];	/* deferred by script_debounce */
+};
+
+#define	SCRIPT_STATE(ifp)						\
+	((struct script_state *)(ifp)->if_data[IF_DATA_SCRIPT])
+
+static struct script_state *
+script_state(const struct interface *ifp)
+{
+	struct script_state *state = SCRIPT_STATE(ifp);
+
+	if (state == NULL) {
+		state = calloc(1, sizeof(*state));
+		((struct interface *)UNCONST(ifp))->
+		    if_data[IF_DATA_SCRIPT] = state;
+	}
+	return state;
+}
+
+#ifdef HAVE_OPEN_MEMSTREAM
+static uint32_t
+script_env_sum(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint32_t sum = 2166136261U;
+
+	/* 32 bit FNV-1a */
+	while (len-- != 0) {
+		sum ^= *p++;
+		sum *= 16777619U;
+	}
+	return sum;
+}
+
+/* Writes the cached export and returns 1 on a hit,
+ * 0 if the caller needs to serialize, -1 on error. */
+static int
+script_env_cached(FILE *fp, const struct script_env_cache *c,
+    const void *data, size_t data_len)
+{
+
+	if (c == NULL || c->buf == NULL ||
+	    c->data != data || c->data_len != data_len ||
+	    c->sum != script_env_sum(data, data_len))
+		return 0;
+	if (fwrite(c->buf, 1, c->len, fp) != c->len)
+		return -1;
+	return 1;
+}
+
+static void
+script_env_store(struct dhcpcd_ctx *ctx, FILE *fp,
+    struct script_env_cache *c, const void *data, size_t data_len,
+    long start)
+{
+	long end;
+	char *buf;
+	size_t len;
+
+	if (c == NULL || start == -1)
+		return;
+	if (fflush(fp) == EOF || (end = ftell(fp)) == -1 || end <= start)
+		return;
+	len = (size_t)(end - start);
+	free(c->buf);
+	c->buf = NULL;
+	if ((buf = malloc(len)) == NULL)
+		return;
+	memcpy(buf, ctx->script_buf + start, len);
+	c->buf = buf;
+	c->len = len;
+	c->data = data;
+	c->data_len = data_len;
+	c->sum = script_env_sum(data, data_len);
+}
+#endif
+
+static int
+script_lease_env1(FILE *fp, const struct interface *ifp, int protocol,
+    const char *prefix, const void *data, size_t data_len)
+{
+
+	switch (protocol) {
+#ifdef INET
+	case PROTO_DHCP:
+		return dhcp_env(fp, prefix, ifp, data, data_len) == -1 ?
+		    -1 : 0;
+#endif
+#ifdef DHCP6
+	case PROTO_DHCP6:
+		return dhcp6_env(fp, prefix, ifp, data, data_len) == -1 ?
+		    -1 : 0;
+#endif
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+}
+
+static int
+script_lease_env(struct dhcpcd_ctx *ctx, FILE *fp,
+    const struct interface *ifp, int protocol, int newlease,
+    const char *prefix, const void *data, size_t data_len)
+{
+#ifdef HAVE_OPEN_MEMSTREAM
+	struct script_state *state = script_state(ifp);
+	struct script_env_cache *c;
+	long start;
+
+	c = NULL;
+	if (state != NULL) {
+		switch (protocol) {
+#ifdef INET
+		case PROTO_DHCP:
+			c = &state->dhcp[newlease];
+			break;
+#endif
+#ifdef DHCP6
+		case PROTO_DHCP6:
+			c = &state->dhcp6[newlease];
+			break;
+#endif
+		}
+	}
+
+	switch (script_env_cached(fp, c, data, data_len)) {
+	case -1:
+		return -1;
+	case 1:
+		return 0;
+	}
+
+	start = ftell(fp);
+	if (script_lease_env1(fp, ifp, protocol, prefix,
+	    data, data_len) == -1)
+		return -1;
+	script_env_store(ctx, fp, c, data, data_len, start);
+	return 0;
+#else
+	UNUSED(ctx);
+	UNUSED(newlease);
+	return script_lease_env1(fp, ifp, protocol, prefix, data, data_len);
+#endif
+}
+
+static void script_debounce_cb(void *);
+
+void
+script_free(struct interface *ifp)
+{
+	struct script_state *state;
+#ifdef HAVE_OPEN_MEMSTREAM
+	size_t i;
+#endif
+
+	if (ifp == NULL)
+		return;
+	eloop_timeout_delete(ifp->ctx->eloop, script_debounce_cb, ifp);
+	state = SCRIPT_STATE(ifp);
+	if (state == NULL)
+		return;
+#ifdef HAVE_OPEN_MEMSTREAM
+	for (i = 0; i < 2; i++) {
+		free(state->dhcp[i].buf);
+		free(state->dhcp6[i].buf);
+	}
+#endif
+	free(state);
+	ifp->if_data[IF_DATA_SCRIPT] = NULL;
+}
+
 static long
 make_env(struct dhcpcd_ctx *ctx, const struct interface *ifp,
     const char *reason)
@@ -411,6 +611,7 @@ make_env(struct dhcpcd_ctx *ctx, const struct interface *ifp,
 			goto eexit;
 	}
 	rt_headclear(&ifaces, AF_UNSPEC);
+	rb_tree_fini(&ifaces);
 	if (fputc('\0', fp) == EOF)
 		goto eexit;
 
@@ -475,9 +676,13 @@ make_env(struct dhcpcd_ctx *ctx, const struct interface *ifp,
 		if (efprintf(fp, "syslog_debug=true") == -1)
 			goto eexit;
 	}
+	/* Exporting the old lease serializes every option it holds,
+	 * so allow hooks known not to read old_ variables to skip it. */
+	if (ifo->options & DHCPCD_NOOLDENV)
+		goto dumplease;
 #ifdef INET
 	if (protocol == PROTO_DHCP && state && state->old) {
-		if (dhcp_env(fp, "old", ifp,
+		if (script_lease_env(ctx, fp, ifp, protocol, 0, "old",
 		    state->old, state->old_len) == -1)
 			goto eexit;
 		if (append_config(fp, "old",
@@ -487,7 +692,7 @@ make_env(struct dhcpcd_ctx *ctx, const struct interface *ifp,
 #endif
 #ifdef DHCP6
 	if (protocol == PROTO_DHCP6 && d6_state && d6_state->old) {
-		if (dhcp6_env(fp, "old", ifp,
+		if (script_lease_env(ctx, fp, ifp, protocol, 0, "old",
 		    d6_state->old, d6_state->old_len) == -1)
 			goto eexit;
 	}
@@ -502,7 +707,7 @@ dumplease:
 	}
 #endif
 	if (protocol == PROTO_DHCP && state && state->new) {
-		if (dhcp_env(fp, "new", ifp,
+		if (script_lease_env(ctx, fp, ifp, protocol, 1, "new",
 		    state->new, state->new_len) == -1)
 			goto eexit;
 		if (append_config(fp, "new",
@@ -517,7 +722,7 @@ dumplease:
 	}
 #ifdef DHCP6
 	if (protocol == PROTO_DHCP6 && D6_STATE_RUNNING(ifp)) {
-		if (dhcp6_env(fp, "new", ifp,
+		if (script_lease_env(ctx, fp, ifp, protocol, 1, "new",
 		    d6_state->new, d6_state->new_len) == -1)
 			goto eexit;
 	}
@@ -699,6 +904,7 @@ script_run(struct dhcpcd_ctx *ctx, char **argv)
 				break;
 			}
 		}
+		DHCPCD_PROBE2(script_reap, pid, status);
 		if (WIFEXITED(status)) {
 			if (WEXITSTATUS(status))
 				logerrx("%s: %s: WEXITSTATUS %d",
@@ -711,6 +917,160 @@ script_run(struct dhcpcd_ctx *ctx, char **argv)
 	return WEXITSTATUS(status);
 }
 
+/*
+ * When more than one hook script job is allowed, scripts are queued and
+ * run concurrently rather than waited for, so a slow hook on one
+ * interface cannot delay configuring the others.
+ * Scripts for the same interface are still run one at a time in the
+ * order they were queued.
+ */
+struct script_job {
+	TAILQ_ENTRY(script_job) next;
+	char ifname[IF_NAMESIZE];
+	pid_t pid;	/* -1 while queued */
+	char *env;
+	size_t len;
+};
+
+static void
+script_job_free(struct dhcpcd_ctx *ctx, struct script_job *job)
+{
+
+	TAILQ_REMOVE(&ctx->script_jobs_queue, job, next);
+	free(job->env);
+	free(job);
+}
+
+static void
+script_job_status(const struct dhcpcd_ctx *ctx, int status)
+{
+
+	if (WIFEXITED(status)) {
+		if (WEXITSTATUS(status))
+			logerrx("%s: %s: WEXITSTATUS %d",
+			    __func__, ctx->script, WEXITSTATUS(status));
+	} else if (WIFSIGNALED(status))
+		logerrx("%s: %s: %s",
+		    __func__, ctx->script, strsignal(WTERMSIG(status)));
+}
+
+static pid_t
+script_job_exec(struct dhcpcd_ctx *ctx, struct script_job *job)
+{
+	char *argv[2] = { ctx->script, NULL };
+
+	if (script_buftoenv(ctx, job->env, job->len) == NULL)
+		return -1;
+	return script_exec(argv, ctx->script_env);
+}
+
+static void
+script_jobs_run(struct dhcpcd_ctx *ctx)
+{
+	struct script_job *job, *jobn, *job2;
+	bool blocked;
+
+	TAILQ_FOREACH_SAFE(job, &ctx->script_jobs_queue, next, jobn) {
+		if (job->pid != -1)
+			continue;
+		if (ctx->script_jobs_running >= ctx->script_jobs)
+			break;
+
+		/* An earlier job for the same interface, running or
+		 * still queued, keeps this one in order. */
+		blocked = false;
+		TAILQ_FOREACH(job2, &ctx->script_jobs_queue, next) {
+			if (job2 == job)
+				break;
+			if (strcmp(job2->ifname, job->ifname) == 0) {
+				blocked = true;
+				break;
+			}
+		}
+		if (blocked)
+			continue;
+
+		job->pid = script_job_exec(ctx, job);
+		if (job->pid == -1) {
+			logerr("%s: %s", __func__, ctx->script);
+			script_job_free(ctx, job);
+			continue;
+		}
+		ctx->script_jobs_running++;
+	}
+}
+
+int
+script_queue(struct dhcpcd_ctx *ctx, const char *ifname,
+    const void *env, size_t len)
+{
+	struct script_job *job;
+
+	if ((job = malloc(sizeof(*job))) == NULL)
+		return -1;
+	if ((job->env = malloc(len)) == NULL) {
+		free(job);
+		return -1;
+	}
+	memcpy(job->env, env, len);
+	job->len = len;
+	job->pid = -1;
+	strlcpy(job->ifname, ifname, sizeof(job->ifname));
+	TAILQ_INSERT_TAIL(&ctx->script_jobs_queue, job, next);
+	script_jobs_run(ctx);
+	return 0;
+}
+
+void
+script_reap(struct dhcpcd_ctx *ctx, pid_t pid, int status)
+{
+	struct script_job *job;
+
+	TAILQ_FOREACH(job, &ctx->script_jobs_queue, next) {
+		if (job->pid == pid)
+			break;
+	}
+	if (job == NULL)
+		return;
+
+	DHCPCD_PROBE2(script_reap, pid, status);
+	script_job_status(ctx, status);
+	script_job_free(ctx, job);
+	ctx->script_jobs_running--;
+	script_jobs_run(ctx);
+}
+
+/* Wait for the running scripts and run any still queued, in order.
+ * Called on shutdown with signals blocked, so nothing else reaps. */
+void
+script_queue_drain(struct dhcpcd_ctx *ctx)
+{
+	struct script_job *job;
+	int status;
+
+	while ((job = TAILQ_FIRST(&ctx->script_jobs_queue)) != NULL) {
+		if (job->pid == -1) {
+			job->pid = script_job_exec(ctx, job);
+			if (job->pid == -1) {
+				logerr("%s: %s", __func__, ctx->script);
+				script_job_free(ctx, job);
+				continue;
+			}
+		} else
+			ctx->script_jobs_running--;
+		while (waitpid(job->pid, &status, 0) == -1) {
+			if (errno != EINTR) {
+				logerr("%s: waitpid", __func__);
+				status = 0;
+				break;
+			}
+		}
+		script_job_status(ctx, status);
+		script_job_free(ctx, job);
+	}
+	ctx->script_jobs_running = 0;
+}
+
 int
 script_dump(const char *env, size_t len)
 {
@@ -732,17 +1092,57 @@ script_dump(const char *env, size_t len)
 	return 0;
 }
 
-int
-script_runreason(const struct interface *ifp, const char *reason)
+/* Maintain RUNDIR/<interface>.state so monitoring can read the
+ * current binding state without querying the daemon. */
+static void
+script_exportstate(const struct interface *ifp, const char *reason,
+    const char *env, size_t len)
+{
+	struct dhcpcd_ctx *ctx = ifp->ctx;
+	char file[sizeof(RUNDIR "/.state") + IF_NAMESIZE];
+	struct state_export se;
+	char *buf;
+
+	if (!(ifp->options->options & DHCPCD_EXPORTSTATE) ||
+	    ctx->options & (DHCPCD_TEST | DHCPCD_DUMPLEASE))
+		return;
+
+	snprintf(file, sizeof(file), RUNDIR "/%s.state", ifp->name);
+
+	if (strcmp(reason, "DEPARTED") == 0 ||
+	    strcmp(reason, "STOPPED") == 0)
+	{
+		if (dhcp_unlink(ctx, file) == -1 && errno != ENOENT)
+			logerr(__func__);
+		return;
+	}
+
+	buf = malloc(sizeof(se) + len);
+	if (buf == NULL) {
+		logerr(__func__);
+		return;
+	}
+	se.se_magic = STATE_EXPORT_MAGIC;
+	se.se_len = (uint32_t)len;
+	memcpy(buf, &se, sizeof(se));
+	memcpy(buf + sizeof(se), env, len);
+	if (dhcp_writefile(ctx, file, 0644, buf, sizeof(se) + len) == -1)
+		logerr(__func__);
+	free(buf);
+}
+
+static int
+script_runreason1(const struct interface *ifp, const char *reason)
 {
 	struct dhcpcd_ctx *ctx = ifp->ctx;
 	char *argv[2];
 	int status = 0;
-	struct fd_list *fd;
+	struct fd_list *fd, *fdn;
 	long buflen;
 
 	if (ctx->script == NULL &&
-	    TAILQ_FIRST(&ifp->ctx->control_fds) == NULL)
+	    TAILQ_FIRST(&ifp->ctx->control_fds) == NULL &&
+	    !(ifp->options->options & DHCPCD_EXPORTSTATE))
 		return 0;
 
 	/* Make our env */
@@ -754,12 +1154,19 @@ script_runreason(const struct interface *ifp, const char *reason)
 	if (strncmp(reason, "DUMP", 4) == 0)
 		return script_dump(ctx->script_buf, (size_t)buflen);
 
+	/* Apply any built-in hooks before running the script. */
+	script_builtin_run(ifp, reason, ctx->script_buf, (size_t)buflen);
+
+	script_exportstate(ifp, reason, ctx->script_buf, (size_t)buflen);
+
 	if (ctx->script == NULL)
 		goto send_listeners;
 
 	argv[0] = ctx->script;
 	argv[1] = NULL;
 	logdebugx("%s: executing: %s %s", ifp->name, argv[0], reason);
+	STAT_INC(hooks_run);
+	DHCPCD_PROBE2(script_spawn, ifp->name, reason);
 
 #ifdef PRIVSEP
 	if (ctx->options & DHCPCD_PRIVSEP) {
@@ -770,19 +1177,104 @@ script_runreason(const struct interface *ifp, const char *reason)
 	}
 #endif
 
-	script_run(ctx, argv);
+	if (ctx->script_jobs > 1) {
+		if (script_queue(ctx, ifp->name,
+		    ctx->script_buf, (size_t)buflen) == -1)
+			logerr(__func__);
+	} else
+		script_run(ctx, argv);
 
 send_listeners:
 	/* Send to our listeners */
 	status = 0;
-	TAILQ_FOREACH(fd, &ctx->control_fds, next) {
+	TAILQ_FOREACH_SAFE(fd, &ctx->control_fds, next, fdn) {
 		if (!(fd->flags & FD_LISTEN))
 			continue;
+		if (!control_listen_match(fd,
+		    ctx->script_buf, ctx->script_buflen))
+			continue;
 		if (control_queue(fd, ctx->script_buf, ctx->script_buflen)== -1)
+		{
 			logerr("%s: control_queue", __func__);
-		else
+			/* Disconnect a client too slow to drain
+			 * its queue rather than growing it. */
+			if (errno == ENOBUFS)
+				control_delete(fd);
+		} else
 			status = 1;
 	}
 
 	return status;
 }
+
+static void
+script_debounce_cb(void *arg)
+{
+	struct interface *ifp = arg;
+	struct script_state *state = SCRIPT_STATE(ifp);
+	char reason[sizeof(state->pending_reason)];
+
+	if (state == NULL || state->pending_reason[0] == '\0')
+		return;
+	strlcpy(reason, state->pending_reason, sizeof(reason));
+	state->pending_reason[0] = '\0';
+	script_runreason1(ifp, reason);
+}
+
+/* These events either have no superseding event
+ * or mark the interface or daemon going away. */
+static bool
+script_debounceable(const char *reason)
+{
+
+	return strcmp(reason, "PREINIT") != 0 &&
+	    strcmp(reason, "DEPARTED") != 0 &&
+	    strcmp(reason, "STOPPED") != 0 &&
+	    strcmp(reason, "TEST") != 0 &&
+	    strncmp(reason, "DUMP", 4) != 0;
+}
+
+/*
+ * Interface flaps emit bursts like CARRIER/NOCARRIER/CARRIER/BOUND
+ * where only the last state matters, yet each event runs the whole
+ * hook chain. With script_debounce set, events are held back for the
+ * window and a newer event replaces a held one, so only the hook for
+ * the final state runs. The deadline is not extended by new events,
+ * so a long flap cannot defer the hook forever.
+ */
+int
+script_runreason(const struct interface *ifp, const char *reason)
+{
+	struct dhcpcd_ctx *ctx = ifp->ctx;
+	struct script_state *state;
+
+	if (ifp->options == NULL || ifp->options->script_debounce == 0 ||
+	    ctx->options & (DHCPCD_TEST | DHCPCD_DUMPLEASE))
+		return script_runreason1(ifp, reason);
+
+	if (!script_debounceable(reason)) {
+		/* Drop any held event - this one supersedes it. */
+		state = SCRIPT_STATE(ifp);
+		if (state != NULL && state->pending_reason[0] != '\0') {
+			state->pending_reason[0] = '\0';
+			eloop_timeout_delete(ctx->eloop,
+			    script_debounce_cb, UNCONST(ifp));
+		}
+		return script_runreason1(ifp, reason);
+	}
+
+	if ((state = script_state(ifp)) == NULL)
+		return script_runreason1(ifp, reason);
+
+	if (state->pending_reason[0] == '\0' &&
+	    eloop_timeout_add_msec(ctx->eloop,
+	    ifp->options->script_debounce,
+	    script_debounce_cb, UNCONST(ifp)) == -1)
+	{
+		logerr(__func__);
+		return script_runreason1(ifp, reason);
+	}
+	strlcpy(state->pending_reason, reason,
+	    sizeof(state->pending_reason));
+	return 0;
+}
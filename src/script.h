@@ -31,6 +31,17 @@
 
 #include "control.h"
 
+/* Per-interface binding state export, RUNDIR/<interface>.state.
+ * The file is rewritten in a single write on each state commit and
+ * holds the same environment the hooks and listeners receive.
+ * Readers should check the magic and that se_len bytes follow the
+ * header to detect a torn update. */
+#define	STATE_EXPORT_MAGIC	0x64737465U	/* "dste" */
+struct state_export {
+	uint32_t se_magic;
+	uint32_t se_len;	/* length of the following environment */
+};
+
 __printflike(2, 3) int efprintf(FILE *, const char *, ...);
 void if_printoptions(void);
 char ** script_buftoenv(struct dhcpcd_ctx *, char *, size_t);
@@ -38,4 +49,8 @@ pid_t script_exec(char *const *, char *const *);
 int send_interface(struct fd_list *, const struct interface *, int);
 int script_dump(const char *, size_t);
 int script_runreason(const struct interface *, const char *);
+void script_free(struct interface *);
+int script_queue(struct dhcpcd_ctx *, const char *, const void *, size_t);
+void script_reap(struct dhcpcd_ctx *, pid_t, int);
+void script_queue_drain(struct dhcpcd_ctx *);
 #endif
@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2021 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/queue.h>
+
+#include <net/if.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "common.h"
+#include "dhcpcd.h"
+#include "dhcp.h"
+#include "dhcp6.h"
+#include "eloop.h"
+#include "ipv6.h"
+#include "ipv6nd.h"
+#include "route.h"
+#include "stats.h"
+
+#ifdef STATS
+struct dhcpcd_stats dhcpcd_stats;
+
+struct stat_iflat {
+	TAILQ_ENTRY(stat_iflat) next;
+	char ifname[IF_NAMESIZE];
+	unsigned long long hist[STAT_LAT_MAX][STAT_LAT_BUCKETS];
+};
+static TAILQ_HEAD(, stat_iflat) stat_iflats =
+    TAILQ_HEAD_INITIALIZER(stat_iflats);
+
+static const char * const stat_lat_names[STAT_LAT_MAX] = {
+	"dhcp_bind", "arp_probe", "ra", "dhcp6_bind", "dad",
+};
+
+/* Approximate bytes held per subsystem, walking the live structures.
+ * Sub-allocations we cannot see from here (option strings, control
+ * buffers) are not counted, but the consumers that grow with the
+ * interface and route counts all are. */
+ssize_t
+stats_mem_dump(struct dhcpcd_ctx *ctx, char *buf, size_t len)
+{
+	struct interface *ifp;
+	struct rt *rt;
+	size_t ifaces = 0, iface_b = 0, ifo_b = 0;
+	size_t dhcp_b = 0, dhcp6_b = 0, ipv6_b = 0, nd_b = 0;
+	size_t routes = 0, kroutes = 0, route_b = 0;
+	int r;
+
+	if (ctx->ifaces != NULL) {
+		TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+			ifaces++;
+			iface_b += sizeof(*ifp);
+			if (ifp->options != NULL)
+				ifo_b += sizeof(*ifp->options);
+#ifdef INET
+			{
+				const struct dhcp_state *state;
+
+				if ((state = D_CSTATE(ifp)) != NULL) {
+					dhcp_b += sizeof(*state) +
+					    state->offer_len +
+					    state->new_len +
+					    state->old_len;
+					if (state->clientid != NULL)
+						dhcp_b += (size_t)
+						    state->clientid[0] + 1;
+				}
+			}
+#endif
+#ifdef DHCP6
+			{
+				const struct dhcp6_state *state;
+
+				if ((state = D6_CSTATE(ifp)) != NULL)
+					dhcp6_b += sizeof(*state) +
+					    state->send_alloc +
+					    state->recv_len +
+					    state->new_len +
+					    state->old_len;
+			}
+#endif
+#ifdef INET6
+			{
+				const struct ipv6_state *state;
+				const struct ipv6_addr *ia;
+
+				if ((state = IPV6_CSTATE(ifp)) != NULL) {
+					ipv6_b += sizeof(*state);
+					TAILQ_FOREACH(ia, &state->addrs,
+					    next)
+						ipv6_b += sizeof(*ia);
+				}
+			}
+#endif
+		}
+	}
+
+#ifdef INET6
+	if (ctx->ra_routers != NULL) {
+		const struct ra *rap;
+		const struct ipv6_addr *ia;
+
+		TAILQ_FOREACH(rap, ctx->ra_routers, next) {
+			nd_b += sizeof(*rap) + rap->data_len +
+			    rap->opts_len * sizeof(*rap->opts);
+			TAILQ_FOREACH(ia, &rap->addrs, next)
+				nd_b += sizeof(*ia);
+		}
+	}
+#endif
+
+	RB_TREE_FOREACH(rt, &ctx->routes)
+		routes++;
+	RB_TREE_FOREACH(rt, &ctx->kroutes)
+		kroutes++;
+	route_b = (routes + kroutes) * sizeof(*rt);
+#ifdef RT_FREE_ROUTE_TABLE
+	route_b += ctx->rt_nuse * sizeof(*rt);
+#endif
+
+	r = snprintf(buf, len,
+	    "interfaces=%zu\n"
+	    "iface_bytes=%zu\n"
+	    "ifo_bytes=%zu\n"
+	    "dhcp_bytes=%zu\n"
+	    "dhcp6_bytes=%zu\n"
+	    "ipv6_bytes=%zu\n"
+	    "ipv6nd_bytes=%zu\n"
+	    "routes=%zu\n"
+	    "kroutes=%zu\n"
+	    "route_bytes=%zu\n"
+	    "eloop_bytes=%zu\n",
+	    ifaces, iface_b, ifo_b, dhcp_b, dhcp6_b, ipv6_b, nd_b,
+	    routes, kroutes, route_b, eloop_mem(ctx->eloop));
+	if (r < 0 || (size_t)r >= len)
+		return -1;
+	return (ssize_t)r + 1;
+}
+
+/* Record the time elapsed since start against a stage histogram.
+ * A handful of interfaces at most, so a linear scan is fine. */
+void
+stats_lat_record(const char *ifname, enum stat_lat stage,
+    const struct timespec *start)
+{
+	struct stat_iflat *il;
+	struct timespec now;
+	long long ms;
+	size_t b;
+
+	if (!timespecisset(start))
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (long long)(now.tv_sec - start->tv_sec) * MSEC_PER_SEC +
+	    (now.tv_nsec - start->tv_nsec) / NSEC_PER_MSEC;
+	if (ms < 0)
+		ms = 0;
+
+	TAILQ_FOREACH(il, &stat_iflats, next) {
+		if (strcmp(il->ifname, ifname) == 0)
+			break;
+	}
+	if (il == NULL) {
+		if ((il = calloc(1, sizeof(*il))) == NULL)
+			return;
+		strlcpy(il->ifname, ifname, sizeof(il->ifname));
+		TAILQ_INSERT_TAIL(&stat_iflats, il, next);
+	}
+
+	for (b = 0; b < STAT_LAT_BUCKETS - 1 && ms >= (1LL << b); b++)
+		;
+	il->hist[stage][b]++;
+}
+
+/* Dump the histograms, one "ifname.stage.lt<N>ms=count" line per
+ * bucket, skipping buckets with no samples. */
+ssize_t
+stats_lat_dump(char *buf, size_t len)
+{
+	struct stat_iflat *il;
+	size_t stage, b, off = 0;
+	int r;
+
+	TAILQ_FOREACH(il, &stat_iflats, next) {
+		for (stage = 0; stage < STAT_LAT_MAX; stage++) {
+			for (b = 0; b < STAT_LAT_BUCKETS; b++) {
+				if (il->hist[stage][b] == 0)
+					continue;
+				if (b == STAT_LAT_BUCKETS - 1)
+					r = snprintf(buf + off, len - off,
+					    "%s.%s.ge%llums=%llu\n",
+					    il->ifname,
+					    stat_lat_names[stage],
+					    1ULL << (STAT_LAT_BUCKETS - 2),
+					    il->hist[stage][b]);
+				else
+					r = snprintf(buf + off, len - off,
+					    "%s.%s.lt%llums=%llu\n",
+					    il->ifname,
+					    stat_lat_names[stage],
+					    1ULL << b,
+					    il->hist[stage][b]);
+				if (r < 0 || (size_t)r >= len - off)
+					return -1;
+				off += (size_t)r;
+			}
+		}
+	}
+	if (off == 0) {
+		r = snprintf(buf, len, "no samples\n");
+		if (r < 0 || (size_t)r >= len)
+			return -1;
+		off = (size_t)r;
+	}
+	return (ssize_t)off + 1;
+}
+
+/* Dump the counters, one "name=value" per line.
+ * These are the manager's counters - sandboxed processes keep
+ * their own and do not contribute. */
+ssize_t
+stats_dump(struct dhcpcd_ctx *ctx, char *buf, size_t len)
+{
+	struct eloop_run_stats ers;
+	int r;
+
+	eloop_run_stats(ctx->eloop, &ers);
+	r = snprintf(buf, len,
+	    "bootp_rx=%llu\n"
+	    "bootp_discarded=%llu\n"
+	    "bootp_ratelimited=%llu\n"
+	    "dhcp6_rx=%llu\n"
+	    "ra_rx=%llu\n"
+	    "arp_rx=%llu\n"
+	    "hooks_run=%llu\n"
+	    "privsep_sends=%llu\n"
+	    "control_commands=%llu\n"
+	    "eloop_timeouts_fired=%llu\n"
+	    "eloop_events_fired=%llu\n"
+	    "eloop_events=%zu\n",
+	    dhcpcd_stats.bootp_rx,
+	    dhcpcd_stats.bootp_discarded,
+	    dhcpcd_stats.bootp_ratelimited,
+	    dhcpcd_stats.dhcp6_rx,
+	    dhcpcd_stats.ra_rx,
+	    dhcpcd_stats.arp_rx,
+	    dhcpcd_stats.hooks_run,
+	    dhcpcd_stats.privsep_sends,
+	    dhcpcd_stats.control_commands,
+	    ers.timeouts_fired,
+	    ers.events_fired,
+	    eloop_event_count(ctx->eloop));
+	if (r < 0 || (size_t)r >= len)
+		return -1;
+	return (ssize_t)r + 1;
+}
+#endif
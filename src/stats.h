@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2021 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <sys/types.h>
+
+#include "config.h"
+
+#ifndef SMALL
+#define STATS
+#endif
+
+#ifdef STATS
+/* Per process counters for locating hot paths in production.
+ * dhcpcd is single threaded, so a plain increment is as cheap
+ * as an increment can be. */
+struct dhcpcd_stats {
+	unsigned long long bootp_rx;
+	unsigned long long bootp_discarded;
+	unsigned long long bootp_ratelimited;
+	unsigned long long dhcp6_rx;
+	unsigned long long ra_rx;
+	unsigned long long arp_rx;
+	unsigned long long hooks_run;
+	unsigned long long privsep_sends;
+	unsigned long long control_commands;
+};
+
+extern struct dhcpcd_stats dhcpcd_stats;
+
+#define STAT_INC(field)		(dhcpcd_stats.field++)
+
+struct dhcpcd_ctx;
+ssize_t stats_dump(struct dhcpcd_ctx *, char *, size_t);
+ssize_t stats_mem_dump(struct dhcpcd_ctx *, char *, size_t);
+
+/* Stage latencies for the time-to-lease SLO, kept per interface as
+ * log2 millisecond histograms so each stage costs a few counters. */
+enum stat_lat {
+	STAT_LAT_DHCP_BIND,	/* DISCOVER sent to lease bound */
+	STAT_LAT_ARP_PROBE,	/* ARP probe start to address usable */
+	STAT_LAT_RA,		/* RS sent to first RA processed */
+	STAT_LAT_DHCP6_BIND,	/* SOLICIT sent to lease bound */
+	STAT_LAT_DAD,		/* address acquired to DAD completed */
+	STAT_LAT_MAX
+};
+#define STAT_LAT_BUCKETS	17	/* <1ms doubling up to >=32s */
+
+struct timespec;
+void stats_lat_record(const char *, enum stat_lat,
+    const struct timespec *);
+ssize_t stats_lat_dump(char *, size_t);
+#else
+#define STAT_INC(field)
+#define stats_lat_record(ifname, stage, start)
+#endif
+
+#endif
@@ -193,6 +193,37 @@ hmac_md5_test7(void)
 	test_hmac(digest, expect);
 }
 
+#ifdef HAVE_HMAC_CTX
+static void
+hmac_md5_testctx(void)
+{
+	const uint8_t text[] = "Hi There";
+	uint8_t key[16];
+	const uint8_t expect[16] = {
+	    0x92, 0x94, 0x72, 0x7a, 0x36, 0x38, 0xbb, 0x1c,
+	    0x13, 0xf4, 0x8e, 0xf8, 0x15, 0x8b, 0xfc, 0x9d,
+	};
+	uint8_t digest[16];
+	struct hmacctx *hc;
+	int i;
+
+	/* As test 1, but through a reused key schedule. */
+	for (i = 0; i < 16; i++)
+		key[i] = 0x0b;
+	hc = hmac_new("md5", key, 16);
+	if (hc == NULL) {
+		fprintf(stderr, "hmac_new FAILED!\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < 2; i++) {
+		printf ("HMAC MD5 Test ctx %d:\t\t", i + 1);
+		hmac_digest(hc, text, 8, digest, sizeof(digest));
+		test_hmac(digest, expect);
+	}
+	hmac_free(hc);
+}
+#endif
+
 int test_hmac_md5(void)
 {
 
@@ -204,6 +235,9 @@ int test_hmac_md5(void)
 	hmac_md5_test5();
 	hmac_md5_test6();
 	hmac_md5_test7();
+#ifdef HAVE_HMAC_CTX
+	hmac_md5_testctx();
+#endif
 	printf("\nAll tests pass.\n");
 	return 0;
 }
@@ -0,0 +1,157 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2021 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* FIPS 180-2 known answer tests.
+ * These also cover the hardware accelerated transforms as the
+ * implementation dispatches at run time. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "test.h"
+
+static void
+print_sha256(FILE *stream, const uint8_t *digest)
+{
+	int i;
+
+	fprintf(stream, "digest = 0x");
+	for (i = 0; i < SHA256_DIGEST_LENGTH; i++)
+		fprintf(stream, "%02x", *digest++);
+	fprintf(stream, "\n");
+}
+
+static void
+test_digest(const uint8_t *digest, const uint8_t *tst)
+{
+	print_sha256(stdout, digest);
+	if (memcmp(digest, tst, SHA256_DIGEST_LENGTH) == 0)
+		return;
+	fprintf(stderr, "FAILED!\nExpected\t\t\t");
+	print_sha256(stderr, tst);
+	exit(EXIT_FAILURE);
+}
+
+static void
+sha256_test1(void)
+{
+	const uint8_t text[] = "abc";
+	const uint8_t expect[SHA256_DIGEST_LENGTH] = {
+	    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+	    0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+	    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+	    0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+	};
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+	SHA256_CTX ctx;
+
+	printf("SHA256 Test 1:\t\t\t");
+	SHA256_Init(&ctx);
+	SHA256_Update(&ctx, text, 3);
+	SHA256_Final(digest, &ctx);
+	test_digest(digest, expect);
+}
+
+static void
+sha256_test2(void)
+{
+	const uint8_t text[] =
+	    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	const uint8_t expect[SHA256_DIGEST_LENGTH] = {
+	    0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+	    0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+	    0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+	    0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1,
+	};
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+	SHA256_CTX ctx;
+
+	printf("SHA256 Test 2:\t\t\t");
+	SHA256_Init(&ctx);
+	SHA256_Update(&ctx, text, 56);
+	SHA256_Final(digest, &ctx);
+	test_digest(digest, expect);
+}
+
+static void
+sha256_test3(void)
+{
+	const uint8_t expect[SHA256_DIGEST_LENGTH] = {
+	    0xcd, 0xc7, 0x6e, 0x5c, 0x99, 0x14, 0xfb, 0x92,
+	    0x81, 0xa1, 0xc7, 0xe2, 0x84, 0xd7, 0x3e, 0x67,
+	    0xf1, 0x80, 0x9a, 0x48, 0xa4, 0x97, 0x20, 0x0e,
+	    0x04, 0x6d, 0x39, 0xcc, 0xc7, 0x11, 0x2c, 0xd0,
+	};
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+	uint8_t text[1000];
+	SHA256_CTX ctx;
+	int i;
+
+	/* One million 'a', fed in odd sized chunks to exercise
+	 * the block buffering. */
+	printf("SHA256 Test 3:\t\t\t");
+	memset(text, 'a', sizeof(text));
+	SHA256_Init(&ctx);
+	for (i = 0; i < 1000; i++)
+		SHA256_Update(&ctx, text, sizeof(text));
+	SHA256_Final(digest, &ctx);
+	test_digest(digest, expect);
+}
+
+static void
+sha256_test4(void)
+{
+	const uint8_t expect[SHA256_DIGEST_LENGTH] = {
+	    0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14,
+	    0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+	    0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c,
+	    0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55,
+	};
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+	SHA256_CTX ctx;
+
+	printf("SHA256 Test 4:\t\t\t");
+	SHA256_Init(&ctx);
+	SHA256_Final(digest, &ctx);
+	test_digest(digest, expect);
+}
+
+int test_sha256(void)
+{
+
+	printf("Starting SHA256 tests...\n");
+	sha256_test1();
+	sha256_test2();
+	sha256_test3();
+	sha256_test4();
+	printf("\nAll SHA256 tests pass\n\n");
+
+	return 0;
+}
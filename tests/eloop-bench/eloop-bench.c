@@ -29,8 +29,10 @@
 
 #include <err.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -54,8 +56,23 @@ struct pipe {
 
 static size_t good, bad, writes, fired;
 static size_t npipes = 100, nwrites = 100, nactive = 1;
+static size_t ntimers = 1000, tfired, texpect;
+static size_t sigexpect, sigfired;
 static struct pipe *pipes;
+static unsigned char *timers;
 static struct eloop *e;
+static sigset_t sigset_unblocked;
+
+/* A run ends once every write has been read back, every timer has
+ * expired and every raised signal has been delivered. */
+static void
+maybe_exit(void)
+{
+
+	if (writes == 0 && fired == good &&
+	    tfired == texpect && sigfired == sigexpect)
+		eloop_exit(e, bad == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
 
 static void
 read_cb(void *arg)
@@ -78,23 +95,61 @@ read_cb(void *arg)
 			fired++;
 	}
 
-	if (writes == 0 && fired == good) {
-		//printf("fired %zu, good %zu, bad %zu\n", fired, good, bad);
-		eloop_exit(e, good == fired && bad == 0 ?
-		    EXIT_SUCCESS : EXIT_FAILURE);
-	}
+	maybe_exit();
+}
+
+static void
+timer_cb(void *arg)
+{
+
+	(void)arg;
+	tfired++;
+	maybe_exit();
 }
 
+static void
+signal_cb(int sig, void *arg)
+{
+
+	(void)arg;
+	if (sig == SIGUSR1)
+		sigfired++;
+	maybe_exit();
+}
+
+static void
+runstart(void)
+{
+
+	writes = fired = good = bad = 0;
+	tfired = texpect = 0;
+	sigfired = sigexpect = 0;
+	/* Re-arm the loop - eloop_exit(3) from the previous run sticks. */
+	eloop_enter(e);
+}
+
+static void
+runtime(const struct timespec *ts, struct timespec *t)
+{
+	struct timespec te;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &te) == -1)
+		err(EXIT_FAILURE, "clock_gettime");
+	timespecsub(&te, ts, t);
+}
+
+/* The original benchmark - writes ripple through nactive pipes until
+ * nwrites have been read back. */
 static int
-runone(struct timespec *t)
+run_fd(struct timespec *t)
 {
 	size_t i;
 	struct pipe *p;
-	struct timespec ts, te;
+	struct timespec ts;
 	int result;
 
+	runstart();
 	writes = nwrites;
-	fired = good = 0;
 
 	for (i = 0, p = pipes; i < nactive; i++, p++) {
 		if (write(p->fd[1], "e", 1) != 1)
@@ -106,10 +161,81 @@ runone(struct timespec *t)
 	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
 		err(EXIT_FAILURE, "clock_gettime");
 	result = eloop_start(e, NULL);
-	if (clock_gettime(CLOCK_MONOTONIC, &te) == -1)
+	runtime(&ts, t);
+	return result;
+}
+
+/* Time adding ntimers far off timeouts, deleting them all again and
+ * then dispatching ntimers due timeouts. */
+static int
+run_timer(struct timespec *tadd, struct timespec *tdel, struct timespec *trun)
+{
+	size_t i;
+	struct timespec ts;
+	int result;
+
+	runstart();
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		err(EXIT_FAILURE, "clock_gettime");
+	for (i = 0; i < ntimers; i++) {
+		if (eloop_timeout_add_sec(e, (unsigned int)(i % 60) + 10,
+		    timer_cb, &timers[i]) == -1)
+			err(EXIT_FAILURE, "eloop_timeout_add_sec");
+	}
+	runtime(&ts, tadd);
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
 		err(EXIT_FAILURE, "clock_gettime");
+	for (i = 0; i < ntimers; i++)
+		eloop_timeout_delete(e, timer_cb, &timers[i]);
+	runtime(&ts, tdel);
 
-	timespecsub(&te, &ts, t);
+	texpect = ntimers;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		err(EXIT_FAILURE, "clock_gettime");
+	for (i = 0; i < ntimers; i++) {
+		if (eloop_timeout_add_msec(e, 0, timer_cb, &timers[i]) == -1)
+			err(EXIT_FAILURE, "eloop_timeout_add_msec");
+	}
+	result = eloop_start(e, NULL);
+	runtime(&ts, trun);
+	return result;
+}
+
+/* Everything at once - pipe writes, due timers and a signal. */
+static int
+run_mixed(struct timespec *t)
+{
+	size_t i;
+	struct pipe *p;
+	struct timespec ts;
+	int result;
+
+	runstart();
+	writes = nwrites;
+	texpect = ntimers;
+	sigexpect = 1;
+
+	for (i = 0; i < ntimers; i++) {
+		if (eloop_timeout_add_msec(e, 0, timer_cb, &timers[i]) == -1)
+			err(EXIT_FAILURE, "eloop_timeout_add_msec");
+	}
+
+	for (i = 0, p = pipes; i < nactive; i++, p++) {
+		if (write(p->fd[1], "e", 1) != 1)
+			err(EXIT_FAILURE, "send");
+		writes--;
+		fired++;
+	}
+
+	if (raise(SIGUSR1) == -1)
+		err(EXIT_FAILURE, "raise");
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		err(EXIT_FAILURE, "clock_gettime");
+	result = eloop_start(e, &sigset_unblocked);
+	runtime(&ts, t);
 	return result;
 }
 
@@ -118,20 +244,38 @@ main(int argc, char **argv)
 {
 	int c, result, exit_code;
 	size_t i, nruns = 25;
+	int do_fd = 0, do_timer = 0, do_mixed = 0;
 	struct pipe *p;
-	struct timespec ts, te, t;
+	struct timespec ts, t, ta, td, tr;
+	static const int bench_sigs[] = { SIGUSR1 };
 
-	while ((c = getopt(argc, argv, "a:n:r:w:")) != -1) {
+	while ((c = getopt(argc, argv, "a:m:n:r:t:w:")) != -1) {
 		switch (c) {
 		case 'a':
 			nactive = (size_t)atoi(optarg);
 			break;
+		case 'm':
+			if (strcmp(optarg, "fd") == 0)
+				do_fd = 1;
+			else if (strcmp(optarg, "timer") == 0)
+				do_timer = 1;
+			else if (strcmp(optarg, "mixed") == 0)
+				do_mixed = 1;
+			else if (strcmp(optarg, "all") == 0)
+				do_fd = do_timer = do_mixed = 1;
+			else
+				errx(EXIT_FAILURE, "unknown mode `%s'",
+				    optarg);
+			break;
 		case 'n':
 			npipes = (size_t)atoi(optarg);
 			break;
 		case 'r':
 			nruns = (size_t)atoi(optarg);
 			break;
+		case 't':
+			ntimers = (size_t)atoi(optarg);
+			break;
 		case 'w':
 			nwrites = (size_t)atoi(optarg);
 			break;
@@ -140,6 +284,10 @@ main(int argc, char **argv)
 		}
 	}
 
+	/* Default to the original fd benchmark. */
+	if (!do_fd && !do_timer && !do_mixed)
+		do_fd = 1;
+
 	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
 		err(EXIT_FAILURE, "clock_gettime");
 
@@ -152,6 +300,16 @@ main(int argc, char **argv)
 	pipes = calloc(npipes, sizeof(*p));
 	if (pipes == NULL)
 		err(EXIT_FAILURE, "malloc");
+	timers = calloc(ntimers, sizeof(*timers));
+	if (timers == NULL)
+		err(EXIT_FAILURE, "malloc");
+
+	if (do_mixed) {
+		/* Block SIGUSR1 so it is only delivered while waiting. */
+		eloop_signal_set_cb(e, bench_sigs, 1, signal_cb, NULL);
+		if (eloop_signal_mask(e, &sigset_unblocked) == -1)
+			err(EXIT_FAILURE, "eloop_signal_mask");
+	}
 
 	for (i = 0, p = pipes; i < npipes; i++, p++) {
 		if (pipe2(p->fd, O_CLOEXEC | O_NONBLOCK) == -1)
@@ -160,24 +318,55 @@ main(int argc, char **argv)
 			err(EXIT_FAILURE, "eloop_event_add");
 	}
 
-	printf("active = %zu, pipes = %zu, runs = %zu, writes = %zu\n",
-	    nactive, npipes, nruns, nwrites);
+	printf("backend = %s\n", eloop_backend());
+	printf("active = %zu, pipes = %zu, runs = %zu, writes = %zu, "
+	    "timers = %zu\n",
+	    nactive, npipes, nruns, nwrites, ntimers);
 
 	exit_code = EXIT_SUCCESS;
-	for (i = 0; i < nruns; i++) {
-		result = runone(&t);
-		if (result != EXIT_SUCCESS)
-			exit_code = result;
-		printf("run %zu took %lld.%.9ld seconds, result %d\n",
-		    i + 1, (long long)t.tv_sec, t.tv_nsec, result);
+
+	if (do_fd) {
+		for (i = 0; i < nruns; i++) {
+			result = run_fd(&t);
+			if (result != EXIT_SUCCESS)
+				exit_code = result;
+			printf("fd run %zu took %lld.%.9ld seconds, "
+			    "result %d\n",
+			    i + 1, (long long)t.tv_sec, t.tv_nsec, result);
+		}
+	}
+
+	if (do_timer) {
+		for (i = 0; i < nruns; i++) {
+			result = run_timer(&ta, &td, &tr);
+			if (result != EXIT_SUCCESS)
+				exit_code = result;
+			printf("timer run %zu "
+			    "add %lld.%.9ld del %lld.%.9ld "
+			    "dispatch %lld.%.9ld seconds, result %d\n",
+			    i + 1,
+			    (long long)ta.tv_sec, ta.tv_nsec,
+			    (long long)td.tv_sec, td.tv_nsec,
+			    (long long)tr.tv_sec, tr.tv_nsec, result);
+		}
+	}
+
+	if (do_mixed) {
+		for (i = 0; i < nruns; i++) {
+			result = run_mixed(&t);
+			if (result != EXIT_SUCCESS)
+				exit_code = result;
+			printf("mixed run %zu took %lld.%.9ld seconds, "
+			    "result %d\n",
+			    i + 1, (long long)t.tv_sec, t.tv_nsec, result);
+		}
 	}
 
 	eloop_free(e);
 	free(pipes);
+	free(timers);
 
-	if (clock_gettime(CLOCK_MONOTONIC, &te) == -1)
-		err(EXIT_FAILURE, "clock_gettime");
-	timespecsub(&te, &ts, &t);
+	runtime(&ts, &t);
 	printf("total %lld.%.9ld seconds, result %d\n",
 	    (long long)t.tv_sec, t.tv_nsec, exit_code);
 	exit(exit_code);
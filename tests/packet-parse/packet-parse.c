@@ -0,0 +1,379 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * packet-parse - benchmark and fuzz harness for the packet parsers
+ *
+ * Feeds DHCPv4, DHCPv6 and Router Advertisement buffers into the
+ * real option walkers linked from src - dhcp_env() drives
+ * get_option() over the whole known option table, dhcp6_env()
+ * drives dhcp6_findoption() and ipv6nd_indexra() walks raw ND
+ * options - either over a corpus of files or in a timed loop for
+ * packets-per-second numbers.
+ *
+ *	packet-parse [-n iterations]	benchmark built-in packets
+ *	packet-parse -4|-6|-r file ...	parse each file once
+ *
+ * Build with -DUSE_LIBFUZZER and clang -fsanitize=fuzzer for
+ * libFuzzer; the first input byte then selects the parser.
+ */
+
+#include <sys/types.h>
+
+#include <netinet/in.h>
+#include <netinet/icmp6.h>
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "common.h"
+#include "dhcpcd.h"
+#include "dhcp.h"
+#include "dhcp6.h"
+#include "eloop.h"
+#include "if-options.h"
+#include "ipv6nd.h"
+#include "logerr.h"
+
+/* struct dhcp6_message is private to dhcp6.c; on the wire it is
+ * just a type byte and a 3 byte transaction id. */
+struct d6_header {
+	uint8_t type;
+	uint8_t xid[3];
+};
+
+static struct dhcpcd_ctx ctx;
+static struct interface *ifp;
+static FILE *fnull;
+
+static int
+setup(void)
+{
+	struct if_options *ifo;
+	struct dhcp6_state *d6state;
+
+	logsetopts(LOGERR_QUIET);
+	ctx.cffile = "/dev/null";
+	/* Load the embedded option definitions the env dumpers walk. */
+	if ((ifo = read_config(&ctx, NULL, NULL, NULL)) == NULL)
+		return -1;
+	if ((ifp = calloc(1, sizeof(*ifp))) == NULL)
+		return -1;
+	ifp->ctx = &ctx;
+	strlcpy(ifp->name, "pkt0", sizeof(ifp->name));
+	ifp->options = ifo;
+	/* dhcp6_env() reports delegated prefixes from the state. */
+	if ((d6state = calloc(1, sizeof(*d6state))) == NULL)
+		return -1;
+	TAILQ_INIT(&d6state->addrs);
+	ifp->if_data[IF_DATA_DHCP6] = d6state;
+	if ((fnull = fopen("/dev/null", "w")) == NULL)
+		return -1;
+	return 0;
+}
+
+static void
+parse4(uint8_t *buf, size_t len)
+{
+
+	if (len < offsetof(struct bootp, vend) + 4)
+		return;
+	(void)dhcp_env(fnull, "new", ifp, (struct bootp *)(void *)buf, len);
+}
+
+static void
+parse6(uint8_t *buf, size_t len)
+{
+
+	if (len < sizeof(struct d6_header))
+		return;
+	(void)dhcp6_env(fnull, "new", ifp,
+	    (const struct dhcp6_message *)(void *)buf, len);
+}
+
+static void
+parsera(uint8_t *buf, size_t len)
+{
+	struct ra rap = { .iface = ifp, .data = buf, .data_len = len };
+
+	if (len < sizeof(struct nd_router_advert))
+		return;
+	(void)ipv6nd_indexra(&rap);
+	free(rap.opts);
+}
+
+static size_t
+put_opt(uint8_t *p, uint8_t code, uint8_t len, const void *data)
+{
+
+	p[0] = code;
+	p[1] = len;
+	memcpy(p + 2, data, len);
+	return (size_t)len + 2;
+}
+
+static size_t
+put_opt6(uint8_t *p, uint16_t code, uint16_t len, const void *data)
+{
+	uint16_t u16;
+
+	u16 = htons(code);
+	memcpy(p, &u16, sizeof(u16));
+	u16 = htons(len);
+	memcpy(p + 2, &u16, sizeof(u16));
+	if (data != NULL)
+		memcpy(p + 4, data, len);
+	return (size_t)len + 4;
+}
+
+static size_t
+mkbootp(uint8_t *buf)
+{
+	struct bootp *b = (struct bootp *)(void *)buf;
+	uint8_t *p = b->vend;
+	uint8_t u8;
+	uint32_t u32;
+	uint32_t dns[2];
+
+	memset(buf, 0, sizeof(*b));
+	b->op = 2;	/* BOOTREPLY */
+	b->htype = 1;
+	b->hlen = 6;
+	b->xid = htonl(0xdeadc0de);
+	b->yiaddr = htonl(0xc0000264);		/* 192.0.2.100 */
+
+	/* DHCP magic cookie */
+	*p++ = 99; *p++ = 130; *p++ = 83; *p++ = 99;
+
+	u8 = 5;		/* ACK */
+	p += put_opt(p, DHO_MESSAGETYPE, sizeof(u8), &u8);
+	u32 = htonl(0xffffff00);
+	p += put_opt(p, DHO_SUBNETMASK, sizeof(u32), &u32);
+	u32 = htonl(0xc0000201);		/* 192.0.2.1 */
+	p += put_opt(p, DHO_ROUTER, sizeof(u32), &u32);
+	dns[0] = htonl(0xc0000202);
+	dns[1] = htonl(0xc0000203);
+	p += put_opt(p, DHO_DNSSERVER, sizeof(dns), dns);
+	u32 = htonl(3600);
+	p += put_opt(p, DHO_LEASETIME, sizeof(u32), &u32);
+	u32 = htonl(1800);
+	p += put_opt(p, DHO_RENEWALTIME, sizeof(u32), &u32);
+	p += put_opt(p, DHO_DNSDOMAIN, 11, "example.org");
+	u32 = htonl(0xc0000201);
+	p += put_opt(p, DHO_SERVERID, sizeof(u32), &u32);
+	*p++ = DHO_END;
+	return (size_t)(p - buf);
+}
+
+static size_t
+mkdhcp6(uint8_t *buf)
+{
+	struct d6_header *m = (struct d6_header *)(void *)buf;
+	uint8_t *p = buf + sizeof(*m), *ia;
+	uint8_t duid[14] = { 0, 1, 0, 1, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+	uint8_t addr[16] = { 0x20, 0x01, 0x0d, 0xb8, [15] = 1 };
+	uint8_t dns[32] = { 0x20, 0x01, 0x0d, 0xb8, [15] = 0x53,
+	    [16] = 0x20, [17] = 0x01, [18] = 0x0d, [19] = 0xb8, [31] = 0x54 };
+	uint32_t u32;
+
+	memset(m, 0, sizeof(*m));
+	m->type = DHCP6_REPLY;
+
+	p += put_opt6(p, D6_OPTION_CLIENTID, sizeof(duid), duid);
+	duid[8] ^= 0xff;
+	p += put_opt6(p, D6_OPTION_SERVERID, sizeof(duid), duid);
+
+	/* IA_NA holding one IA_ADDR */
+	ia = p;
+	p += put_opt6(p, D6_OPTION_IA_NA, 12 + 28, NULL);
+	p = ia + 4;
+	u32 = htonl(1);			/* IAID */
+	memcpy(p, &u32, sizeof(u32)); p += 4;
+	u32 = htonl(1800);		/* T1 */
+	memcpy(p, &u32, sizeof(u32)); p += 4;
+	u32 = htonl(2880);		/* T2 */
+	memcpy(p, &u32, sizeof(u32)); p += 4;
+	p += put_opt6(p, D6_OPTION_IA_ADDR, 28, NULL);
+	p -= 28;
+	memcpy(p, addr, sizeof(addr)); p += 16;
+	u32 = htonl(3600);		/* preferred lifetime */
+	memcpy(p, &u32, sizeof(u32)); p += 4;
+	u32 = htonl(7200);		/* valid lifetime */
+	memcpy(p, &u32, sizeof(u32)); p += 4;
+
+	p += put_opt6(p, D6_OPTION_DNS_SERVERS, sizeof(dns), dns);
+	return (size_t)(p - buf);
+}
+
+static size_t
+mkra(uint8_t *buf)
+{
+	struct nd_router_advert *ra = (struct nd_router_advert *)(void *)buf;
+	struct nd_opt_prefix_info *pi;
+	uint8_t *p = buf + sizeof(*ra);
+
+	memset(ra, 0, sizeof(*ra));
+	ra->nd_ra_type = ND_ROUTER_ADVERT;
+	ra->nd_ra_curhoplimit = 64;
+	ra->nd_ra_router_lifetime = htons(1800);
+
+	/* source link-layer address */
+	p[0] = ND_OPT_SOURCE_LINKADDR; p[1] = 1;
+	memcpy(p + 2, "\x02\x00\x00\x00\x00\x01", 6);
+	p += 8;
+
+	/* MTU */
+	memset(p, 0, 8);
+	p[0] = ND_OPT_MTU; p[1] = 1;
+	p[4] = 0x00; p[5] = 0x00; p[6] = 0x05; p[7] = 0xdc;	/* 1500 */
+	p += 8;
+
+	/* prefix information */
+	pi = (struct nd_opt_prefix_info *)(void *)p;
+	memset(pi, 0, sizeof(*pi));
+	pi->nd_opt_pi_type = ND_OPT_PREFIX_INFORMATION;
+	pi->nd_opt_pi_len = 4;
+	pi->nd_opt_pi_prefix_len = 64;
+	pi->nd_opt_pi_flags_reserved =
+	    ND_OPT_PI_FLAG_ONLINK | ND_OPT_PI_FLAG_AUTO;
+	pi->nd_opt_pi_valid_time = htonl(7200);
+	pi->nd_opt_pi_preferred_time = htonl(3600);
+	pi->nd_opt_pi_prefix.s6_addr[0] = 0x20;
+	pi->nd_opt_pi_prefix.s6_addr[1] = 0x01;
+	pi->nd_opt_pi_prefix.s6_addr[2] = 0x0d;
+	pi->nd_opt_pi_prefix.s6_addr[3] = 0xb8;
+	p += sizeof(*pi);
+
+	/* RDNSS with one server */
+	memset(p, 0, 24);
+	p[0] = 25; p[1] = 3;	/* ND_OPT_RDNSS */
+	p[8] = 0x20; p[9] = 0x01; p[10] = 0x0d; p[11] = 0xb8; p[23] = 0x53;
+	p += 24;
+	return (size_t)(p - buf);
+}
+
+#ifdef USE_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *, size_t);
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static bool done;
+	uint8_t *buf;
+
+	if (!done) {
+		if (setup() == -1)
+			abort();
+		done = true;
+	}
+	if (size < 1)
+		return 0;
+	if ((buf = malloc(size - 1)) == NULL)
+		return 0;
+	memcpy(buf, data + 1, size - 1);
+	switch (data[0] % 3) {
+	case 0:
+		parse4(buf, size - 1);
+		break;
+	case 1:
+		parse6(buf, size - 1);
+		break;
+	case 2:
+		parsera(buf, size - 1);
+		break;
+	}
+	free(buf);
+	return 0;
+}
+#else /* !USE_LIBFUZZER */
+
+static void
+bench(const char *name, void (*parse)(uint8_t *, size_t),
+    uint8_t *buf, size_t len, unsigned long iters)
+{
+	struct timespec ts, te;
+	unsigned long i;
+	double secs;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	for (i = 0; i < iters; i++)
+		parse(buf, len);
+	clock_gettime(CLOCK_MONOTONIC, &te);
+	secs = (double)(te.tv_sec - ts.tv_sec) +
+	    (double)(te.tv_nsec - ts.tv_nsec) / 1e9;
+	printf("%-6s %4zu bytes %10lu packets %8.3f secs %12.0f pkts/sec\n",
+	    name, len, iters, secs, (double)iters / secs);
+}
+
+int
+main(int argc, char **argv)
+{
+	uint8_t buf[1500];
+	void (*parse)(uint8_t *, size_t) = parse4;
+	unsigned long iters = 100000;
+	size_t len;
+	int c;
+
+	while ((c = getopt(argc, argv, "46rbn:")) != -1) {
+		switch (c) {
+		case '4':
+			parse = parse4;
+			break;
+		case '6':
+			parse = parse6;
+			break;
+		case 'r':
+			parse = parsera;
+			break;
+		case 'b':
+			break;
+		case 'n':
+			iters = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+			    "usage: packet-parse [-n iters]\n"
+			    "       packet-parse -4|-6|-r file ...\n");
+			return EXIT_FAILURE;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (setup() == -1) {
+		fprintf(stderr, "setup failed: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (argc > 0) {
+		/* Corpus mode - parse each file once. */
+		for (c = 0; c < argc; c++) {
+			FILE *fp;
+			uint8_t fbuf[65536];
+
+			if ((fp = fopen(argv[c], "r")) == NULL) {
+				fprintf(stderr, "%s: %s\n",
+				    argv[c], strerror(errno));
+				return EXIT_FAILURE;
+			}
+			len = fread(fbuf, 1, sizeof(fbuf), fp);
+			fclose(fp);
+			parse(fbuf, len);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	len = mkbootp(buf);
+	bench("dhcp", parse4, buf, len, iters);
+	len = mkdhcp6(buf);
+	bench("dhcp6", parse6, buf, len, iters);
+	len = mkra(buf);
+	bench("ra", parsera, buf, len, iters);
+	return EXIT_SUCCESS;
+}
+#endif /* USE_LIBFUZZER */
@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * packet-parse - stubs for the dhcpcd.c entry points
+ *
+ * The harness links every object from src except dhcpcd.o so it can
+ * drive the real parsers.  The parse paths never reach the state
+ * machine, so any stub being called is a harness bug - abort loudly
+ * rather than mask it.
+ */
+
+#include <sys/types.h>
+
+#include <signal.h>
+#include <stdlib.h>
+
+#ifdef __GNUC__
+#define STUB_DEAD	__attribute__((__noreturn__))
+#else
+#define STUB_DEAD
+#endif
+
+#include "config.h"
+#include "common.h"
+#include "dhcpcd.h"
+
+const int dhcpcd_signals[] = { SIGTERM, SIGINT, SIGALRM, SIGHUP };
+const size_t dhcpcd_signals_len = __arraycount(dhcpcd_signals);
+const int dhcpcd_signals_ignore[] = { SIGPIPE };
+const size_t dhcpcd_signals_ignore_len = __arraycount(dhcpcd_signals_ignore);
+const char *dhcpcd_default_script = "/dev/null";
+
+STUB_DEAD uint32_t
+dhcpcd_renewjitter(__unused const struct interface *ifp,
+    __unused uint32_t renewaltime)
+{
+
+	abort();
+}
+
+STUB_DEAD int
+dhcpcd_ifafwaiting(__unused const struct interface *ifp)
+{
+
+	abort();
+}
+
+STUB_DEAD int
+dhcpcd_afwaiting(__unused const struct dhcpcd_ctx *ctx)
+{
+
+	abort();
+}
+
+STUB_DEAD void
+dhcpcd_daemonise(__unused struct dhcpcd_ctx *ctx)
+{
+
+	abort();
+}
+
+STUB_DEAD int
+dhcpcd_handleargs(__unused struct dhcpcd_ctx *ctx,
+    __unused struct fd_list *fd, __unused int argc, __unused char **argv)
+{
+
+	abort();
+}
+
+STUB_DEAD void
+dhcpcd_handlecarrier(__unused struct interface *ifp,
+    __unused int carrier, __unused unsigned int flags)
+{
+
+	abort();
+}
+
+STUB_DEAD int
+dhcpcd_handleinterface(__unused void *arg, __unused int action,
+    __unused const char *ifname)
+{
+
+	abort();
+}
+
+STUB_DEAD void
+dhcpcd_handlehwaddr(__unused struct interface *ifp,
+    __unused uint16_t hwtype, __unused const void *hwaddr,
+    __unused uint8_t hwlen)
+{
+
+	abort();
+}
+
+STUB_DEAD int
+dhcpcd_selectprofile(__unused struct interface *ifp,
+    __unused const char *profile)
+{
+
+	abort();
+}
+
+STUB_DEAD void
+dhcpcd_startinterface(__unused void *arg)
+{
+
+	abort();
+}
+
+STUB_DEAD void
+dhcpcd_activateinterface(__unused struct interface *ifp,
+    __unused unsigned long long options)
+{
+
+	abort();
+}
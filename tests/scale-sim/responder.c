@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * responder - minimal in-harness DHCP server for scale-sim
+ *
+ * Listens on UDP port 67 bound to the harness bridge and answers
+ * DISCOVER with OFFER and REQUEST with ACK, deriving the offered
+ * address from the low three octets of the client hardware address
+ * so every virtual interface gets a stable, unique 10/8 lease with
+ * no allocation state.  Replies are broadcast so clients probing
+ * from 0.0.0.0 hear them.
+ */
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BOOTP_MIN	236
+#define OPT_AREA	312
+
+#define DHCP_DISCOVER	1
+#define DHCP_OFFER	2
+#define DHCP_REQUEST	3
+#define DHCP_ACK	5
+
+#define OPT_MSGTYPE	53
+#define OPT_REQIP	50
+#define OPT_SERVERID	54
+#define OPT_SUBNETMASK	1
+#define OPT_LEASETIME	51
+#define OPT_END		255
+#define OPT_PAD		0
+
+static const uint8_t cookie[4] = { 99, 130, 83, 99 };
+
+static uint8_t
+find_msgtype(const uint8_t *buf, size_t len)
+{
+	const uint8_t *p = buf + BOOTP_MIN + sizeof(cookie);
+	const uint8_t *e = buf + len;
+
+	while (p < e) {
+		uint8_t o = *p++;
+
+		if (o == OPT_PAD)
+			continue;
+		if (o == OPT_END || p == e)
+			break;
+		if (o == OPT_MSGTYPE && *p >= 1 && p + 1 < e)
+			return p[1];
+		p += (size_t)*p + 1;
+	}
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	int s, n;
+	struct sockaddr_in sin;
+	uint8_t buf[1500];
+	ssize_t len;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: responder <bridge-interface>\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((s = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+	n = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &n, sizeof(n));
+	setsockopt(s, SOL_SOCKET, SO_BROADCAST, &n, sizeof(n));
+	if (setsockopt(s, SOL_SOCKET, SO_BINDTODEVICE,
+	    argv[1], (socklen_t)strlen(argv[1])) == -1) {
+		perror("SO_BINDTODEVICE");
+		return EXIT_FAILURE;
+	}
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(67);
+	if (bind(s, (struct sockaddr *)&sin, sizeof(sin)) == -1) {
+		perror("bind");
+		return EXIT_FAILURE;
+	}
+
+	for (;;) {
+		uint8_t type, reply;
+		uint8_t *p;
+		struct sockaddr_in to;
+
+		len = recv(s, buf, sizeof(buf), 0);
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("recv");
+			return EXIT_FAILURE;
+		}
+		if (len < BOOTP_MIN + (ssize_t)sizeof(cookie) ||
+		    buf[0] != 1 ||	/* BOOTREQUEST */
+		    memcmp(buf + BOOTP_MIN, cookie, sizeof(cookie)) != 0)
+			continue;
+
+		type = find_msgtype(buf, (size_t)len);
+		if (type == DHCP_DISCOVER)
+			reply = DHCP_OFFER;
+		else if (type == DHCP_REQUEST)
+			reply = DHCP_ACK;
+		else
+			continue;
+
+		/* Reuse the request as the reply template - op, yiaddr
+		 * and the option area change, xid and chaddr stay. */
+		buf[0] = 2;	/* BOOTREPLY */
+		/* yiaddr = 10.x.y.z from the low chaddr octets */
+		buf[16] = 10;
+		buf[17] = buf[28 + 3];
+		buf[18] = buf[28 + 4];
+		buf[19] = buf[28 + 5] != 0 ? buf[28 + 5] : 1;
+		buf[20] = buf[21] = buf[22] = buf[23] = 0;	/* siaddr */
+
+		p = buf + BOOTP_MIN + sizeof(cookie);
+		*p++ = OPT_MSGTYPE; *p++ = 1; *p++ = reply;
+		*p++ = OPT_SERVERID; *p++ = 4;
+		*p++ = 10; *p++ = 255; *p++ = 255; *p++ = 254;
+		*p++ = OPT_SUBNETMASK; *p++ = 4;
+		*p++ = 255; *p++ = 0; *p++ = 0; *p++ = 0;
+		*p++ = OPT_LEASETIME; *p++ = 4;
+		*p++ = 0; *p++ = 0; *p++ = 0x0e; *p++ = 0x10;	/* 3600 */
+		*p++ = OPT_END;
+
+		memset(&to, 0, sizeof(to));
+		to.sin_family = AF_INET;
+		to.sin_port = htons(68);
+		to.sin_addr.s_addr = INADDR_BROADCAST;
+		if (sendto(s, buf, (size_t)(p - buf), 0,
+		    (struct sockaddr *)&to, sizeof(to)) == -1)
+			perror("sendto");
+	}
+}
@@ -0,0 +1,120 @@
+#!/bin/sh
+# scale-sim - drive dhcpcd against N virtual interfaces
+#
+# Creates N veth pairs with one end enslaved to a bridge, answers
+# DHCP on the bridge with the in-harness responder and starts one
+# dhcpcd managing every veth end, then reports time to fully bound,
+# steady-state CPU over a 5 second window and RSS.
+#
+# Needs root.  Usage: scale-sim.sh [N ...]   (default: 1000 5000 10000)
+
+set -e
+
+TOP=$(dirname "$0")/../..
+DHCPCD=${DHCPCD:-$TOP/src/dhcpcd}
+RESPONDER=${RESPONDER:-$(dirname "$0")/responder}
+BRIDGE=ssbr0
+PREFIX=ssv
+CPU_WINDOW=5
+
+[ "$(id -u)" = 0 ] || { echo "scale-sim: need root" >&2; exit 1; }
+[ -x "$DHCPCD" ] || { echo "scale-sim: build src first" >&2; exit 1; }
+[ -x "$RESPONDER" ] || { echo "scale-sim: build responder first" >&2; exit 1; }
+
+cleanup()
+{
+	"$DHCPCD" -x >/dev/null 2>&1 || true
+	kill "$RESPONDER_PID" 2>/dev/null || true
+	# Deleting the bridge and the veth ends takes the peers with it.
+	batch=$(mktemp)
+	for i in $(seq 1 "$LAST_N"); do
+		echo "link del ${PREFIX}$i" >>"$batch"
+	done
+	ip -b "$batch" >/dev/null 2>&1 || true
+	rm -f "$batch"
+	ip link del $BRIDGE >/dev/null 2>&1 || true
+	rm -f "$CONF"
+}
+trap cleanup EXIT INT TERM
+
+CONF=$(mktemp)
+cat >"$CONF" <<EOF
+# scale-sim: v4 only, no ARP probe, no hooks
+allowinterfaces ${PREFIX}*
+ipv4only
+noarp
+script /bin/true
+EOF
+
+cpu_jiffies()
+{
+	awk '{print $14 + $15}' "/proc/$1/stat"
+}
+
+run_one()
+{
+	n=$1
+	LAST_N=$n
+
+	ip link add $BRIDGE type bridge
+	ip link set $BRIDGE up
+
+	setup_start=$(date +%s)
+	batch=$(mktemp)
+	for i in $(seq 1 "$n"); do
+		cat >>"$batch" <<EOF
+link add ${PREFIX}$i type veth peer name ${PREFIX}b$i
+link set ${PREFIX}b$i master $BRIDGE up
+link set ${PREFIX}$i up
+EOF
+	done
+	ip -b "$batch"
+	rm -f "$batch"
+	echo "N=$n setup $(($(date +%s) - setup_start))s"
+
+	"$RESPONDER" $BRIDGE &
+	RESPONDER_PID=$!
+
+	start=$(date +%s)
+	"$DHCPCD" -q -f "$CONF"
+	pid=$(cat /var/run/dhcpcd/pid 2>/dev/null ||
+	    cat /var/run/dhcpcd.pid 2>/dev/null)
+
+	# Wait for every interface to hold a 10/8 lease.
+	while :; do
+		bound=$(ip -4 -o addr show | grep -c " inet 10\." || true)
+		[ "$bound" -ge "$n" ] && break
+		if [ $(($(date +%s) - start)) -gt 300 ]; then
+			echo "N=$n TIMED OUT with $bound/$n bound" >&2
+			break
+		fi
+		sleep 1
+	done
+	echo "N=$n bound $bound/$n in $(($(date +%s) - start))s"
+
+	# Steady state: CPU jiffies over a quiet window, then RSS.
+	j0=$(cpu_jiffies "$pid")
+	sleep $CPU_WINDOW
+	j1=$(cpu_jiffies "$pid")
+	hz=$(getconf CLK_TCK)
+	rss=$(awk '/VmRSS/ {print $2}' "/proc/$pid/status")
+	echo "N=$n cpu $(awk "BEGIN {printf \"%.1f\", \
+	    ($j1 - $j0) * 100 / ($hz * $CPU_WINDOW)}")% rss ${rss}kB"
+
+	"$DHCPCD" -x >/dev/null 2>&1 || true
+	kill "$RESPONDER_PID" 2>/dev/null || true
+	wait "$RESPONDER_PID" 2>/dev/null || true
+
+	batch=$(mktemp)
+	for i in $(seq 1 "$n"); do
+		echo "link del ${PREFIX}$i" >>"$batch"
+	done
+	ip -b "$batch" >/dev/null 2>&1 || true
+	rm -f "$batch"
+	ip link del $BRIDGE
+	LAST_N=0
+}
+
+for n in ${@:-1000 5000 10000}; do
+	run_one "$n"
+done